@@ -0,0 +1,46 @@
+/*
+ * Offline cooker: turns OBJ files into an asset package for --package.
+ *
+ *   AssetCooker [--lz4] <output package> <input.obj>...
+ *
+ * Every mesh of every input goes into the one package, in input order.
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "MeshCooker.h"
+
+int main(int argc, char** argv) {
+    bool compress = false;
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--lz4") == 0) {
+            compress = true;
+        } else {
+            paths.push_back(argv[i]);
+        }
+    }
+    if (paths.size() < 2) {
+        fprintf(stderr, "Usage: %s [--lz4] <output package> <input.obj>... \n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    try {
+        std::vector<MeshData> meshes;
+        for (size_t i = 1; i < paths.size(); i++) {
+            loadObj(paths[i], meshes);
+        }
+        AssetCookStats stats = writeAssetPackage(paths[0], meshes, compress);
+        printf("%s: %zu meshes, %.2f MiB payload in %.2f MiB, %u chunks (%u LZ4) \n", paths[0].c_str(),
+               meshes.size(), stats.payloadBytes / (1024.0 * 1024.0), stats.fileBytes / (1024.0 * 1024.0),
+               stats.chunks, stats.compressedChunks);
+    } catch (const std::runtime_error& e) {
+        fprintf(stderr, "%s \n", e.what());
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
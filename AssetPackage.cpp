@@ -0,0 +1,130 @@
+#include "AssetPackage.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include <lz4.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+void AssetPackage::open(const std::string& path) {
+    if (mheader != nullptr) {
+        throw std::runtime_error("Asset package already open");
+    }
+    if (!mfile.open(path)) {
+        throw std::runtime_error("Failed to map asset package: " + path);
+    }
+
+    const char* base = static_cast<const char*>(mfile.data());
+    const AssetPackageHeader* header = reinterpret_cast<const AssetPackageHeader*>(base);
+    if (mfile.size() < sizeof(AssetPackageHeader) || header->magic != ASSET_PACKAGE_MAGIC) {
+        throw std::runtime_error("Not an asset package: " + path);
+    }
+    if (header->version != ASSET_PACKAGE_VERSION) {
+        throw std::runtime_error("Asset package " + path + " has version " + std::to_string(header->version) +
+                                 ", expected " + std::to_string(ASSET_PACKAGE_VERSION));
+    }
+    /* Every size is checked against what is left of the file, so no sum can wrap */
+    uint64_t fileSize = mfile.size();
+    if (header->fileSize != fileSize ||
+        header->meshOffset < sizeof(AssetPackageHeader) || header->meshOffset > fileSize ||
+        header->meshCount > (fileSize - header->meshOffset) / sizeof(AssetMesh) ||
+        header->chunkOffset < sizeof(AssetPackageHeader) || header->chunkOffset > fileSize ||
+        header->chunkCount > (fileSize - header->chunkOffset) / sizeof(AssetChunk)) {
+        throw std::runtime_error("Truncated asset package: " + path);
+    }
+    if (header->meshOffset % alignof(AssetMesh) != 0 || header->chunkOffset % alignof(AssetChunk) != 0) {
+        throw std::runtime_error("Misaligned tables in asset package: " + path);
+    }
+
+    const AssetMesh* meshes = reinterpret_cast<const AssetMesh*>(base + header->meshOffset);
+    const AssetChunk* chunks = reinterpret_cast<const AssetChunk*>(base + header->chunkOffset);
+    for (uint32_t c = 0; c < header->chunkCount; c++) {
+        const AssetChunk& chunk = chunks[c];
+        bool raw = (chunk.flags & ASSET_CHUNK_LZ4) == 0;
+        if (chunk.fileOffset > fileSize || chunk.storedBytes > fileSize - chunk.fileOffset ||
+            chunk.fileOffset % ASSET_BLOB_ALIGNMENT != 0 || chunk.bytes > ASSET_CHUNK_BYTES ||
+            (raw && chunk.storedBytes != chunk.bytes)) {
+            throw std::runtime_error("Corrupt chunk table in asset package: " + path);
+        }
+    }
+
+    /*
+     * A mesh's chunks must tile exactly its payload, which is the size of the
+     * buffer the streamer copies them into: full chunks, then the remainder.
+     */
+    for (uint32_t m = 0; m < header->meshCount; m++) {
+        const AssetMesh& mesh = meshes[m];
+        uint64_t expectedChunks = mesh.payloadBytes / ASSET_CHUNK_BYTES + (mesh.payloadBytes % ASSET_CHUNK_BYTES != 0);
+        bool valid = mesh.payloadBytes > 0 && mesh.chunkCount == expectedChunks &&
+                     mesh.firstChunk <= header->chunkCount &&
+                     mesh.chunkCount <= header->chunkCount - mesh.firstChunk &&
+                     mesh.indexOffset <= mesh.payloadBytes &&
+                     static_cast<uint64_t>(mesh.indexCount) * sizeof(uint32_t) <= mesh.payloadBytes - mesh.indexOffset &&
+                     static_cast<uint64_t>(mesh.vertexCount) * sizeof(PackedVertex) <= mesh.indexOffset;
+        for (uint32_t c = 0; valid && c < mesh.chunkCount; c++) {
+            uint64_t start = static_cast<uint64_t>(c) * ASSET_CHUNK_BYTES;
+            uint64_t expectedBytes = std::min<uint64_t>(ASSET_CHUNK_BYTES, mesh.payloadBytes - start);
+            valid = chunks[mesh.firstChunk + c].bytes == expectedBytes;
+        }
+        if (!valid) {
+            throw std::runtime_error("Corrupt mesh table in asset package: " + path);
+        }
+    }
+
+    mheader = header;
+    mmeshes = meshes;
+    mchunks = chunks;
+}
+
+int32_t AssetPackage::findMesh(const char* name) const {
+    for (uint32_t m = 0; m < mheader->meshCount; m++) {
+        if (strncmp(mmeshes[m].name, name, sizeof(mmeshes[m].name)) == 0) {
+            return static_cast<int32_t>(m);
+        }
+    }
+    return -1;
+}
+
+void AssetPackage::adviseRange(uint64_t offset, uint64_t size, int advice) const {
+    /* The mapping is page aligned, so rounding the offset down stays inside it */
+    uint64_t page = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+    uint64_t begin = offset / page * page;
+    uint64_t end = offset + size;
+    if (advice == MADV_DONTNEED) {
+        /* Only whole pages the chunk owns; its neighbours may still be needed */
+        begin = (offset + page - 1) / page * page;
+        end = end / page * page;
+    }
+    if (end > begin) {
+        char* base = static_cast<char*>(const_cast<void*>(mfile.data()));
+        madvise(base + begin, end - begin, advice);
+    }
+}
+
+void AssetPackage::prefetch(const AssetMesh& mesh) const {
+    if (mesh.chunkCount == 0) {
+        return;
+    }
+    const AssetChunk& first = mchunks[mesh.firstChunk];
+    const AssetChunk& last = mchunks[mesh.firstChunk + mesh.chunkCount - 1];
+    adviseRange(first.fileOffset, last.fileOffset + last.storedBytes - first.fileOffset, MADV_WILLNEED);
+}
+
+void AssetPackage::read(const AssetChunk& chunk, void* dst) const {
+    const char* src = static_cast<const char*>(mfile.data()) + chunk.fileOffset;
+    if ((chunk.flags & ASSET_CHUNK_LZ4) == 0) {
+        memcpy(dst, src, chunk.bytes);
+        return;
+    }
+    int decoded = LZ4_decompress_safe(src, static_cast<char*>(dst), static_cast<int>(chunk.storedBytes),
+                                      static_cast<int>(chunk.bytes));
+    if (decoded != static_cast<int>(chunk.bytes)) {
+        throw std::runtime_error("Corrupt LZ4 chunk in asset package");
+    }
+}
+
+void AssetPackage::release(const AssetChunk& chunk) const {
+    adviseRange(chunk.fileOffset, chunk.storedBytes, MADV_DONTNEED);
+}
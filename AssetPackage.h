@@ -0,0 +1,110 @@
+#ifndef VULKAN_BASIC_SAMPLES_ASSETPACKAGE_H
+#define VULKAN_BASIC_SAMPLES_ASSETPACKAGE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "ShaderCache.h"
+
+/*
+ * On-disk layout of a cooked asset package, written by AssetCooker:
+ *
+ *   AssetPackageHeader
+ *   AssetMesh[meshCount]
+ *   AssetChunk[chunkCount]
+ *   chunk blobs, each starting on a 16-byte boundary
+ *
+ * A mesh's payload is its PackedVertex array followed by its uint32_t
+ * indices, which start at the next 16-byte boundary. This is exactly what
+ * the GPU buffer holds. The payload is split into chunks of at most
+ * ASSET_CHUNK_BYTES, and each chunk is stored raw or LZ4 compressed,
+ * whichever is smaller. All fields are little endian.
+ */
+const uint32_t ASSET_PACKAGE_MAGIC = 0x4B504B56;  // "VKPK"
+const uint32_t ASSET_PACKAGE_VERSION = 1;
+const uint32_t ASSET_BLOB_ALIGNMENT = 16;
+/* Small enough that a chunk always fits the staging ring several times over */
+const uint32_t ASSET_CHUNK_BYTES = 256 * 1024;
+
+const uint32_t ASSET_CHUNK_LZ4 = 1u << 0;
+
+struct PackedVertex {
+    float position[3];
+    float normal[3];
+    float uv[2];
+};
+static_assert(sizeof(PackedVertex) == 32, "PackedVertex is part of the package format");
+
+struct AssetPackageHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t meshCount;
+    uint32_t chunkCount;
+    uint64_t meshOffset;
+    uint64_t chunkOffset;
+    uint64_t fileSize;
+};
+static_assert(sizeof(AssetPackageHeader) == 40, "AssetPackageHeader is part of the package format");
+
+struct AssetMesh {
+    char name[40];
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    /* Byte offset of the indices within the payload */
+    uint64_t indexOffset;
+    uint64_t payloadBytes;
+    uint32_t firstChunk;
+    uint32_t chunkCount;
+    float boundsMin[3];
+    float boundsMax[3];
+};
+static_assert(sizeof(AssetMesh) == 96, "AssetMesh is part of the package format");
+
+struct AssetChunk {
+    uint64_t fileOffset;
+    uint32_t storedBytes;
+    /* Payload bytes once decompressed; the chunk covers the mesh payload at chunk index * ASSET_CHUNK_BYTES */
+    uint32_t bytes;
+    uint32_t flags;
+    uint32_t reserved;
+};
+static_assert(sizeof(AssetChunk) == 24, "AssetChunk is part of the package format");
+
+/*
+ * Read-only view of a package through a single mapping. Nothing is read
+ * until a chunk is asked for: open() only checks the header and the tables,
+ * including that each mesh's chunks tile exactly its payload.
+ * read() writes a chunk's payload straight into the caller's memory,
+ * normally the staging ring, decompressing it on the way if needed.
+ */
+class AssetPackage {
+public:
+    /* Throws if the file is missing, truncated, inconsistent or from another format version */
+    void open(const std::string& path);
+    bool isOpen() const { return mheader != nullptr; }
+
+    uint32_t meshCount() const { return mheader->meshCount; }
+    const AssetMesh& mesh(uint32_t index) const { return mmeshes[index]; }
+    /* Returns -1 when no mesh has that name */
+    int32_t findMesh(const char* name) const;
+    const AssetChunk& chunk(uint32_t index) const { return mchunks[index]; }
+    size_t fileSize() const { return mfile.size(); }
+
+    /* Asks the kernel to start reading the mesh's chunks in the background */
+    void prefetch(const AssetMesh& mesh) const;
+    /* Writes chunk.bytes bytes to dst; throws if compressed data is corrupt */
+    void read(const AssetChunk& chunk, void* dst) const;
+    /* Drops the chunk's pages from this process; the page cache keeps them */
+    void release(const AssetChunk& chunk) const;
+
+private:
+    void adviseRange(uint64_t offset, uint64_t size, int advice) const;
+
+    MappedFile mfile;
+    const AssetPackageHeader* mheader = nullptr;
+    const AssetMesh* mmeshes = nullptr;
+    const AssetChunk* mchunks = nullptr;
+};
+
+#endif //VULKAN_BASIC_SAMPLES_ASSETPACKAGE_H
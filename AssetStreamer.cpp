@@ -0,0 +1,132 @@
+#include "AssetStreamer.h"
+
+#include <algorithm>
+#include <cstdio>
+
+#include "DeletionQueue.h"
+#include "Log.h"
+
+typedef std::chrono::duration<double> Seconds;
+typedef std::chrono::duration<double, std::milli> Milliseconds;
+
+void AssetStreamer::init(const AssetPackage& package, GpuAllocator& allocator, Uploader& uploader,
+                         DeletionQueue& deletionQueue) {
+    mpackage = &package;
+    mallocator = &allocator;
+    muploader = &uploader;
+    mdeletionQueue = &deletionQueue;
+    mmeshes.resize(package.meshCount());
+}
+
+void AssetStreamer::destroy() {
+    for (Mesh& mesh : mmeshes) {
+        mdeletionQueue->retireBuffer(mesh.buffer, mesh.allocation);
+    }
+    mmeshes.clear();
+    mqueue.clear();
+    minFlight.clear();
+}
+
+void AssetStreamer::request(uint32_t index, float priority) {
+    Mesh& mesh = mmeshes[index];
+    if (mesh.state == MeshState::Resident || (mesh.state != MeshState::Unloaded && priority <= mesh.priority)) {
+        return;
+    }
+    if (mesh.state == MeshState::Unloaded) {
+        mesh.state = MeshState::Queued;
+        mesh.requested = Clock::now();
+        mpackage->prefetch(mpackage->mesh(index));
+    }
+    mesh.priority = priority;
+    /* A mesh already fully staged only waits for its upload, there is nothing to queue */
+    if (mesh.state == MeshState::Queued || mesh.nextChunk < mpackage->mesh(index).chunkCount) {
+        mqueue.push_back({priority, index});
+        std::push_heap(mqueue.begin(), mqueue.end());
+    }
+}
+
+void AssetStreamer::createBuffer(uint32_t index) {
+    VkBufferCreateInfo bufferInfo = {};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = mpackage->mesh(index).payloadBytes;
+    bufferInfo.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT |
+                       VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    Mesh& mesh = mmeshes[index];
+    mallocator->createBuffer(bufferInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, mesh.buffer, mesh.allocation);
+}
+
+void AssetStreamer::update(VkDeviceSize budgetBytes) {
+    for (size_t i = 0; i < minFlight.size();) {
+        Mesh& mesh = mmeshes[minFlight[i]];
+        if (!muploader->isComplete(mesh.ticket)) {
+            i++;
+            continue;
+        }
+        mesh.state = MeshState::Resident;
+        mresidentCount++;
+        double latencyMs = Milliseconds(Clock::now() - mesh.requested).count();
+        mlatencyTotalMs += latencyMs;
+        mlatencyMaxMs = std::max(mlatencyMaxMs, latencyMs);
+        minFlight[i] = minFlight.back();
+        minFlight.pop_back();
+    }
+
+    Clock::time_point start = Clock::now();
+    VkDeviceSize staged = 0;
+    while (!mqueue.empty() && staged < budgetBytes) {
+        QueueEntry top = mqueue.front();
+        Mesh& mesh = mmeshes[top.mesh];
+        const AssetMesh& asset = mpackage->mesh(top.mesh);
+        if (top.priority != mesh.priority || mesh.nextChunk == asset.chunkCount || mesh.state == MeshState::Resident) {
+            std::pop_heap(mqueue.begin(), mqueue.end());
+            mqueue.pop_back();
+            continue;
+        }
+        if (mesh.state == MeshState::Queued) {
+            createBuffer(top.mesh);
+            mesh.state = MeshState::Streaming;
+        }
+
+        while (mesh.nextChunk < asset.chunkCount && staged < budgetBytes) {
+            const AssetChunk& chunk = mpackage->chunk(asset.firstChunk + mesh.nextChunk);
+            VkDeviceSize dstOffset = static_cast<VkDeviceSize>(mesh.nextChunk) * ASSET_CHUNK_BYTES;
+            mpackage->read(chunk, muploader->stageBuffer(mesh.buffer, dstOffset, chunk.bytes, mesh.ticket));
+            mpackage->release(chunk);
+
+            staged += chunk.bytes;
+            mstoredBytes += chunk.storedBytes;
+            mpayloadBytes += chunk.bytes;
+            mchunks++;
+            if (chunk.flags & ASSET_CHUNK_LZ4) {
+                mcompressedChunks++;
+            }
+            mesh.nextChunk++;
+        }
+        if (mesh.nextChunk == asset.chunkCount) {
+            minFlight.push_back(top.mesh);
+            std::pop_heap(mqueue.begin(), mqueue.end());
+            mqueue.pop_back();
+        }
+    }
+    if (staged > 0) {
+        muploader->flush();
+        mstageSeconds += Seconds(Clock::now() - start).count();
+    }
+}
+
+void AssetStreamer::printStats() const {
+    double megabytes = mpayloadBytes / (1024.0 * 1024.0);
+    printf("Asset streaming: %u of %zu meshes resident, %.2f MiB payload from %.2f MiB mapped in %llu chunks "
+           "(%llu LZ4), staged at %.1f MiB/s \n",
+           mresidentCount, mmeshes.size(), megabytes, mstoredBytes / (1024.0 * 1024.0),
+           (unsigned long long) mchunks, (unsigned long long) mcompressedChunks,
+           mstageSeconds > 0.0 ? megabytes / mstageSeconds : 0.0);
+    if (mresidentCount > 0) {
+        printf("Asset streaming: request to resident avg %.2f ms, max %.2f ms \n", mlatencyTotalMs / mresidentCount,
+               mlatencyMaxMs);
+    }
+    if (!idle()) {
+        LOG_INFO(LOG_MEMORY, "Asset streaming had not finished at exit");
+    }
+}
@@ -0,0 +1,93 @@
+#ifndef VULKAN_BASIC_SAMPLES_ASSETSTREAMER_H
+#define VULKAN_BASIC_SAMPLES_ASSETSTREAMER_H
+
+#include <vulkan/vulkan.h>
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#include "AssetPackage.h"
+#include "GpuAllocator.h"
+#include "Uploader.h"
+
+class DeletionQueue;
+
+/*
+ * Streams meshes from an AssetPackage into device-local buffers, on demand
+ * and in priority order.
+ *
+ * request() only queues a mesh and asks the kernel to read ahead. Each
+ * update() takes the highest-priority queued mesh and stages its chunks
+ * straight from the mapping into the uploader's ring: a memcpy for raw
+ * chunks and LZ4 decoding for compressed ones. It stops once its byte budget
+ * for the frame is spent, and a mesh that is cut off resumes at its next
+ * chunk. The pages of a staged chunk are released right away, so resident
+ * memory stays close to what is in flight. A mesh is resident once the
+ * upload of its last chunk has completed.
+ */
+class AssetStreamer {
+public:
+    void init(const AssetPackage& package, GpuAllocator& allocator, Uploader& uploader,
+              DeletionQueue& deletionQueue);
+    /* Retires every mesh buffer */
+    void destroy();
+
+    /* Queues the mesh, or raises its priority if it is already queued; higher loads first */
+    void request(uint32_t mesh, float priority);
+    /* Stages queued chunks until about budgetBytes of payload have gone to the uploader */
+    void update(VkDeviceSize budgetBytes);
+
+    bool isResident(uint32_t mesh) const { return mmeshes[mesh].state == MeshState::Resident; }
+    /* Vertices at offset 0, indices (uint32) at the mesh's indexOffset */
+    VkBuffer buffer(uint32_t mesh) const { return mmeshes[mesh].buffer; }
+    uint32_t residentCount() const { return mresidentCount; }
+    bool idle() const { return mqueue.empty() && minFlight.empty(); }
+
+    void printStats() const;
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    enum class MeshState { Unloaded, Queued, Streaming, Resident };
+
+    struct Mesh {
+        MeshState state = MeshState::Unloaded;
+        float priority = 0.0f;
+        uint32_t nextChunk = 0;
+        VkBuffer buffer = VK_NULL_HANDLE;
+        GpuAllocation allocation;
+        Uploader::Ticket ticket = 0;
+        Clock::time_point requested;
+    };
+
+    struct QueueEntry {
+        float priority;
+        uint32_t mesh;
+        bool operator<(const QueueEntry& other) const { return priority < other.priority; }
+    };
+
+    void createBuffer(uint32_t index);
+
+    const AssetPackage* mpackage = nullptr;
+    GpuAllocator* mallocator = nullptr;
+    Uploader* muploader = nullptr;
+    DeletionQueue* mdeletionQueue = nullptr;
+
+    std::vector<Mesh> mmeshes;
+    /* Max-heap on priority; entries superseded by a later request() are skipped when popped */
+    std::vector<QueueEntry> mqueue;
+    /* Fully staged meshes waiting for their upload to complete */
+    std::vector<uint32_t> minFlight;
+    uint32_t mresidentCount = 0;
+
+    uint64_t mstoredBytes = 0;
+    uint64_t mpayloadBytes = 0;
+    uint64_t mchunks = 0;
+    uint64_t mcompressedChunks = 0;
+    double mstageSeconds = 0.0;
+    double mlatencyTotalMs = 0.0;
+    double mlatencyMaxMs = 0.0;
+};
+
+#endif //VULKAN_BASIC_SAMPLES_ASSETSTREAMER_H
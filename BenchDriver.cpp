@@ -0,0 +1,473 @@
+/*
+ * Benchmark driver behind `make bench`.
+ *
+ *   BenchDriver [options]
+ *     --vulkan-test <path>      binary under test (./VulkanTest)
+ *     --scenes <file>           one scene per line: <name> <VulkanTest arguments> (bench/scenes.txt)
+ *     --frames <n>              frames rendered per run (300)
+ *     --repeat <n>              runs per scene; each metric is the median over them (3)
+ *     --icd <json>              Vulkan ICD manifest the runs are restricted to, such as lavapipe's
+ *     --out <file>              results JSON (bench_results.json)
+ *     --log <file>              output of every run, appended (bench.log)
+ *     --baseline <file>         results JSON to compare against; regressions fail the run
+ *     --threshold <percent>     allowed increase of any metric over the baseline (10)
+ *     --threshold <metric>=<percent>   the same for one metric
+ *
+ * Every run is headless with a cold pipeline cache, so it needs no display
+ * and starts from the same state. Every metric is lower-is-better. Exits 1
+ * if a run fails or a metric regresses, and 2 on bad arguments.
+ */
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char** environ;
+
+namespace {
+
+/* Compared against the baseline, in report order */
+const char* const METRICS[] = {
+    "startup_ms", "first_frame_ms", "frame_mean_ms", "frame_p50_ms", "frame_p95_ms", "frame_p99_ms",
+    "cpu_p50_ms", "cpu_p95_ms", "cpu_p99_ms", "peak_rss_mib", "peak_device_mib",
+};
+
+struct Scene {
+    std::string name;
+    std::vector<std::string> arguments;
+    std::string device;
+    std::map<std::string, double> metrics;
+};
+
+struct Options {
+    std::string vulkanTest = "./VulkanTest";
+    std::string scenesPath = "bench/scenes.txt";
+    unsigned frames = 300;
+    unsigned repeat = 3;
+    std::string icd;
+    std::string outPath = "bench_results.json";
+    std::string logPath = "bench.log";
+    std::string baselinePath;
+    double threshold = 10.0;
+    std::map<std::string, double> metricThresholds;
+};
+
+/*
+ * Just enough JSON for the files this tool and VulkanTest write: objects,
+ * strings without unicode escapes, numbers, true, false and null. Arrays are
+ * not used.
+ */
+struct JsonValue {
+    enum Type { Null, Bool, Number, String, Object } type = Null;
+    double number = 0.0;
+    std::string string;
+    std::vector<std::pair<std::string, JsonValue>> members;
+
+    const JsonValue* find(const std::string& key) const {
+        for (const auto& member : members) {
+            if (member.first == key) {
+                return &member.second;
+            }
+        }
+        return nullptr;
+    }
+};
+
+class JsonParser {
+public:
+    explicit JsonParser(const std::string& text) : mtext(text) {}
+
+    JsonValue parse() {
+        JsonValue value = parseValue();
+        skipSpace();
+        if (mpos != mtext.size()) {
+            fail("trailing characters");
+        }
+        return value;
+    }
+
+private:
+    void fail(const char* what) {
+        throw std::runtime_error(std::string("JSON: ") + what + " at offset " + std::to_string(mpos));
+    }
+
+    void skipSpace() {
+        while (mpos < mtext.size() && isspace(static_cast<unsigned char>(mtext[mpos]))) {
+            mpos++;
+        }
+    }
+
+    void expect(char c) {
+        skipSpace();
+        if (mpos >= mtext.size() || mtext[mpos] != c) {
+            fail("unexpected character");
+        }
+        mpos++;
+    }
+
+    std::string parseString() {
+        expect('"');
+        std::string result;
+        while (mpos < mtext.size() && mtext[mpos] != '"') {
+            if (mtext[mpos] == '\\' && mpos + 1 < mtext.size()) {
+                mpos++;
+            }
+            result += mtext[mpos++];
+        }
+        expect('"');
+        return result;
+    }
+
+    JsonValue parseValue() {
+        skipSpace();
+        if (mpos >= mtext.size()) {
+            fail("unexpected end");
+        }
+        JsonValue value;
+        char c = mtext[mpos];
+        if (c == '{') {
+            value.type = JsonValue::Object;
+            mpos++;
+            skipSpace();
+            if (mpos < mtext.size() && mtext[mpos] == '}') {
+                mpos++;
+                return value;
+            }
+            for (;;) {
+                std::string key = parseString();
+                expect(':');
+                value.members.emplace_back(key, parseValue());
+                skipSpace();
+                if (mpos < mtext.size() && mtext[mpos] == ',') {
+                    mpos++;
+                    continue;
+                }
+                expect('}');
+                return value;
+            }
+        }
+        if (c == '"') {
+            value.type = JsonValue::String;
+            value.string = parseString();
+            return value;
+        }
+        const char* const words[] = {"true", "false", "null"};
+        for (const char* word : words) {
+            if (mtext.compare(mpos, strlen(word), word) == 0) {
+                mpos += strlen(word);
+                value.type = word[0] == 'n' ? JsonValue::Null : JsonValue::Bool;
+                value.number = word[0] == 't' ? 1.0 : 0.0;
+                return value;
+            }
+        }
+        char* end;
+        value.type = JsonValue::Number;
+        value.number = strtod(mtext.c_str() + mpos, &end);
+        if (end == mtext.c_str() + mpos) {
+            fail("expected a value");
+        }
+        mpos = static_cast<size_t>(end - mtext.c_str());
+        return value;
+    }
+
+    const std::string& mtext;
+    size_t mpos = 0;
+};
+
+JsonValue readJson(const std::string& path) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        throw std::runtime_error("Cannot read " + path);
+    }
+    std::stringstream text;
+    text << file.rdbuf();
+    return JsonParser(text.str()).parse();
+}
+
+std::string quoted(const std::string& text) {
+    std::string result = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            result += '\\';
+        }
+        result += c;
+    }
+    return result + "\"";
+}
+
+std::vector<Scene> readScenes(const std::string& path) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        throw std::runtime_error("Cannot read " + path);
+    }
+    std::vector<Scene> scenes;
+    std::string line;
+    while (std::getline(file, line)) {
+        std::istringstream words(line);
+        Scene scene;
+        if (!(words >> scene.name) || scene.name[0] == '#') {
+            continue;
+        }
+        std::string argument;
+        while (words >> argument) {
+            scene.arguments.push_back(argument);
+        }
+        scenes.push_back(scene);
+    }
+    return scenes;
+}
+
+/* Runs VulkanTest once for the scene and returns the results it wrote, or throws */
+JsonValue runOnce(const Options& options, const Scene& scene) {
+    std::string resultsPath = options.outPath + "." + scene.name + ".run.json";
+    unlink(resultsPath.c_str());
+
+    std::vector<std::string> arguments = {options.vulkanTest, "--headless", "--frames", std::to_string(options.frames),
+                                          "--cold-pipeline-cache", "--log-level", "warning", "--bench-json",
+                                          resultsPath};
+    arguments.insert(arguments.end(), scene.arguments.begin(), scene.arguments.end());
+    std::vector<char*> argv;
+    for (std::string& argument : arguments) {
+        argv.push_back(&argument[0]);
+    }
+    argv.push_back(nullptr);
+
+    /* The loader reads VK_ICD_FILENAMES, newer ones VK_DRIVER_FILES; set both */
+    std::vector<std::string> environment;
+    for (char** variable = environ; *variable != nullptr; variable++) {
+        if (options.icd.empty() || (strncmp(*variable, "VK_ICD_FILENAMES=", 17) != 0 &&
+                                    strncmp(*variable, "VK_DRIVER_FILES=", 16) != 0)) {
+            environment.push_back(*variable);
+        }
+    }
+    if (!options.icd.empty()) {
+        environment.push_back("VK_ICD_FILENAMES=" + options.icd);
+        environment.push_back("VK_DRIVER_FILES=" + options.icd);
+    }
+    std::vector<char*> envp;
+    for (std::string& variable : environment) {
+        envp.push_back(&variable[0]);
+    }
+    envp.push_back(nullptr);
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, options.logPath.c_str(),
+                                     O_WRONLY | O_CREAT | O_APPEND, 0644);
+    posix_spawn_file_actions_adddup2(&actions, STDOUT_FILENO, STDERR_FILENO);
+
+    pid_t pid;
+    int spawned = posix_spawn(&pid, options.vulkanTest.c_str(), &actions, nullptr, argv.data(), envp.data());
+    posix_spawn_file_actions_destroy(&actions);
+    if (spawned != 0) {
+        throw std::runtime_error("Cannot run " + options.vulkanTest + ": " + strerror(spawned));
+    }
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+    }
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        throw std::runtime_error("run failed, see " + options.logPath);
+    }
+    JsonValue results = readJson(resultsPath);
+    unlink(resultsPath.c_str());
+    return results;
+}
+
+double median(std::vector<double> values) {
+    std::sort(values.begin(), values.end());
+    size_t middle = values.size() / 2;
+    return values.size() % 2 == 1 ? values[middle] : 0.5 * (values[middle - 1] + values[middle]);
+}
+
+void writeResults(const Options& options, const std::vector<Scene>& scenes) {
+    std::string temporary = options.outPath + ".tmp";
+    FILE* file = fopen(temporary.c_str(), "w");
+    if (file == nullptr) {
+        throw std::runtime_error("Cannot write " + temporary);
+    }
+    fprintf(file, "{\n  \"frames\": %u,\n  \"repeat\": %u,\n  \"scenes\": {", options.frames, options.repeat);
+    bool first = true;
+    for (const Scene& scene : scenes) {
+        /* Failed scenes are left out rather than recorded as zeros */
+        if (scene.metrics.empty()) {
+            continue;
+        }
+        std::string arguments;
+        for (const std::string& argument : scene.arguments) {
+            arguments += (arguments.empty() ? "" : " ") + argument;
+        }
+        fprintf(file, "%s\n    %s: {\n      \"arguments\": %s,\n      \"device\": %s", first ? "" : ",",
+                quoted(scene.name).c_str(), quoted(arguments).c_str(), quoted(scene.device).c_str());
+        first = false;
+        for (const char* metric : METRICS) {
+            auto found = scene.metrics.find(metric);
+            if (found != scene.metrics.end()) {
+                fprintf(file, ",\n      \"%s\": %.4f", metric, found->second);
+            }
+        }
+        fprintf(file, "\n    }");
+    }
+    fprintf(file, "\n  }\n}\n");
+    if (fclose(file) != 0 || rename(temporary.c_str(), options.outPath.c_str()) != 0) {
+        throw std::runtime_error("Cannot write " + options.outPath);
+    }
+}
+
+/* Prints every metric against the baseline; returns the number of regressions */
+unsigned compare(const Options& options, const std::vector<Scene>& scenes) {
+    JsonValue baseline = readJson(options.baselinePath);
+    const JsonValue* baselineScenes = baseline.find("scenes");
+    const JsonValue* baselineFrames = baseline.find("frames");
+    if (baselineScenes == nullptr || baselineScenes->type != JsonValue::Object) {
+        throw std::runtime_error(options.baselinePath + " has no scenes");
+    }
+    if (baselineFrames != nullptr && baselineFrames->number != options.frames) {
+        printf("Baseline was recorded over %.0f frames, this run used %u \n", baselineFrames->number, options.frames);
+    }
+
+    unsigned regressions = 0;
+    printf("%-18s %-16s %12s %12s %9s \n", "scene", "metric", "baseline", "current", "change");
+    for (const Scene& scene : scenes) {
+        if (scene.metrics.empty()) {
+            continue;
+        }
+        const JsonValue* reference = baselineScenes->find(scene.name);
+        if (reference == nullptr) {
+            printf("%-18s not in the baseline \n", scene.name.c_str());
+            continue;
+        }
+        const JsonValue* device = reference->find("device");
+        if (device != nullptr && device->string != scene.device) {
+            printf("%-18s baseline ran on %s, this run on %s \n", scene.name.c_str(), device->string.c_str(),
+                   scene.device.c_str());
+        }
+        for (const char* metric : METRICS) {
+            const JsonValue* before = reference->find(metric);
+            auto after = scene.metrics.find(metric);
+            if (before == nullptr || after == scene.metrics.end() || before->number <= 0.0) {
+                continue;
+            }
+            auto custom = options.metricThresholds.find(metric);
+            double limit = custom != options.metricThresholds.end() ? custom->second : options.threshold;
+            double change = 100.0 * (after->second - before->number) / before->number;
+            bool regressed = change > limit;
+            regressions += regressed ? 1 : 0;
+            printf("%-18s %-16s %12.3f %12.3f %+8.1f%%%s \n", scene.name.c_str(), metric, before->number,
+                   after->second, change, regressed ? ("  REGRESSION, limit +" + std::to_string(
+                           static_cast<int>(std::lround(limit))) + "%").c_str() : "");
+        }
+    }
+    return regressions;
+}
+
+Options parseOptions(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "--vulkan-test") == 0 && hasValue) {
+            options.vulkanTest = argv[++i];
+        } else if (strcmp(argv[i], "--scenes") == 0 && hasValue) {
+            options.scenesPath = argv[++i];
+        } else if (strcmp(argv[i], "--frames") == 0 && hasValue) {
+            options.frames = static_cast<unsigned>(strtoul(argv[++i], nullptr, 10));
+        } else if (strcmp(argv[i], "--repeat") == 0 && hasValue) {
+            options.repeat = static_cast<unsigned>(strtoul(argv[++i], nullptr, 10));
+        } else if (strcmp(argv[i], "--icd") == 0 && hasValue) {
+            options.icd = argv[++i];
+        } else if (strcmp(argv[i], "--out") == 0 && hasValue) {
+            options.outPath = argv[++i];
+        } else if (strcmp(argv[i], "--log") == 0 && hasValue) {
+            options.logPath = argv[++i];
+        } else if (strcmp(argv[i], "--baseline") == 0 && hasValue) {
+            options.baselinePath = argv[++i];
+        } else if (strcmp(argv[i], "--threshold") == 0 && hasValue) {
+            std::string value = argv[++i];
+            size_t equals = value.find('=');
+            if (equals == std::string::npos) {
+                options.threshold = strtod(value.c_str(), nullptr);
+            } else {
+                options.metricThresholds[value.substr(0, equals)] = strtod(value.c_str() + equals + 1, nullptr);
+            }
+        } else {
+            throw std::invalid_argument(std::string("Unknown argument: ") + argv[i]);
+        }
+    }
+    if (options.frames == 0 || options.repeat == 0) {
+        throw std::invalid_argument("--frames and --repeat must be at least 1");
+    }
+    return options;
+}
+
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    try {
+        options = parseOptions(argc, argv);
+    } catch (const std::invalid_argument& e) {
+        fprintf(stderr, "%s \n", e.what());
+        return 2;
+    }
+
+    try {
+        std::vector<Scene> scenes = readScenes(options.scenesPath);
+        bool failed = false;
+        for (Scene& scene : scenes) {
+            std::map<std::string, std::vector<double>> samples;
+            printf("%-18s", scene.name.c_str());
+            fflush(stdout);
+            try {
+                for (unsigned run = 0; run < options.repeat; run++) {
+                    JsonValue results = runOnce(options, scene);
+                    for (const auto& member : results.members) {
+                        if (member.second.type == JsonValue::Number) {
+                            samples[member.first].push_back(member.second.number);
+                        } else if (member.first == "device") {
+                            scene.device = member.second.string;
+                        }
+                    }
+                }
+            } catch (const std::runtime_error& e) {
+                printf(" %s \n", e.what());
+                failed = true;
+                continue;
+            }
+            for (const auto& metric : samples) {
+                scene.metrics[metric.first] = median(metric.second);
+            }
+            printf(" frame p50 %.3f ms, p99 %.3f ms, startup %.1f ms on %s \n", scene.metrics["frame_p50_ms"],
+                   scene.metrics["frame_p99_ms"], scene.metrics["startup_ms"], scene.device.c_str());
+        }
+        writeResults(options, scenes);
+        printf("Results written to %s \n", options.outPath.c_str());
+
+        if (options.baselinePath.empty()) {
+            return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+        }
+        if (access(options.baselinePath.c_str(), R_OK) != 0) {
+            printf("No baseline at %s, nothing to compare; copy %s there to record one \n",
+                   options.baselinePath.c_str(), options.outPath.c_str());
+            return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+        }
+        unsigned regressions = compare(options, scenes);
+        printf("%u regressions against %s \n", regressions, options.baselinePath.c_str());
+        return failed || regressions > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+    } catch (const std::runtime_error& e) {
+        fprintf(stderr, "%s \n", e.what());
+        return EXIT_FAILURE;
+    }
+}
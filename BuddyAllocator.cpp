@@ -0,0 +1,98 @@
+#include "BuddyAllocator.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+const uint64_t BuddyAllocator::INVALID_OFFSET;
+
+static bool isPowerOfTwo(uint64_t value) {
+    return value != 0 && (value & (value - 1)) == 0;
+}
+
+BuddyAllocator::BuddyAllocator(uint64_t capacity, uint64_t minBlockSize) : mcapacity(capacity), mleafLevel(0) {
+    if (!isPowerOfTwo(capacity) || !isPowerOfTwo(minBlockSize) || minBlockSize > capacity) {
+        throw std::runtime_error("Buddy allocator sizes must be powers of two");
+    }
+
+    while ((capacity >> mleafLevel) > minBlockSize) {
+        mleafLevel++;
+    }
+    mfreeLists.resize(mleafLevel + 1);
+    mfreeLists[0].insert(0);
+}
+
+uint64_t BuddyAllocator::allocate(uint64_t size, uint64_t alignment) {
+    uint64_t needed = std::max<uint64_t>(std::max<uint64_t>(size, alignment), 1);
+    if (needed > mcapacity) {
+        return INVALID_OFFSET;
+    }
+
+    /* Deepest level whose blocks still fit the request */
+    uint32_t level = mleafLevel;
+    while (blockSize(level) < needed) {
+        level--;
+    }
+
+    /* Find the smallest free block at or above that level, then split it down */
+    int32_t found = static_cast<int32_t>(level);
+    while (found >= 0 && mfreeLists[found].empty()) {
+        found--;
+    }
+    if (found < 0) {
+        return INVALID_OFFSET;
+    }
+
+    uint64_t offset = *mfreeLists[found].begin();
+    mfreeLists[found].erase(mfreeLists[found].begin());
+    for (uint32_t splitLevel = static_cast<uint32_t>(found) + 1; splitLevel <= level; splitLevel++) {
+        mfreeLists[splitLevel].insert(offset + blockSize(splitLevel));
+    }
+
+    Allocation allocation;
+    allocation.level = level;
+    allocation.requested = size;
+    mallocated[offset] = allocation;
+    musedBytes += blockSize(level);
+    mrequestedBytes += size;
+    return offset;
+}
+
+void BuddyAllocator::free(uint64_t offset) {
+    auto it = mallocated.find(offset);
+    if (it == mallocated.end()) {
+        throw std::runtime_error("Buddy allocator free of unknown offset");
+    }
+
+    uint32_t level = it->second.level;
+    musedBytes -= blockSize(level);
+    mrequestedBytes -= it->second.requested;
+    mallocated.erase(it);
+
+    /* Merge with the buddy for as long as it is free as well */
+    while (level > 0) {
+        uint64_t buddy = offset ^ blockSize(level);
+        auto buddyIt = mfreeLists[level].find(buddy);
+        if (buddyIt == mfreeLists[level].end()) {
+            break;
+        }
+        mfreeLists[level].erase(buddyIt);
+        offset = std::min(offset, buddy);
+        level--;
+    }
+    mfreeLists[level].insert(offset);
+}
+
+BuddyStats BuddyAllocator::stats() const {
+    BuddyStats stats;
+    stats.capacity = mcapacity;
+    stats.usedBytes = musedBytes;
+    stats.requestedBytes = mrequestedBytes;
+    stats.allocationCount = static_cast<uint32_t>(mallocated.size());
+    for (uint32_t level = 0; level <= mleafLevel; level++) {
+        if (!mfreeLists[level].empty()) {
+            stats.largestFreeBlock = blockSize(level);
+            break;
+        }
+    }
+    return stats;
+}
@@ -0,0 +1,61 @@
+#ifndef VULKAN_BASIC_SAMPLES_BUDDYALLOCATOR_H
+#define VULKAN_BASIC_SAMPLES_BUDDYALLOCATOR_H
+
+#include <cstdint>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+struct BuddyStats {
+    uint64_t capacity = 0;
+    uint64_t usedBytes = 0;       // block sizes handed out, including rounding
+    uint64_t requestedBytes = 0;  // sizes actually asked for
+    uint64_t largestFreeBlock = 0;
+    uint32_t allocationCount = 0;
+
+    /* 0 when all free space is one block, approaching 1 as it splinters */
+    double fragmentation() const {
+        uint64_t freeBytes = capacity - usedBytes;
+        return freeBytes == 0 ? 0.0 : 1.0 - double(largestFreeBlock) / double(freeBytes);
+    }
+};
+
+/*
+ * Binary buddy sub-allocator over a power-of-two address range. It only deals
+ * in offsets and knows nothing about Vulkan, so it can be exercised on the CPU.
+ * Every block is aligned to its own size, which satisfies any alignment up to
+ * the rounded allocation size.
+ */
+class BuddyAllocator {
+public:
+    static const uint64_t INVALID_OFFSET = ~0ULL;
+
+    BuddyAllocator(uint64_t capacity, uint64_t minBlockSize);
+
+    /* Returns INVALID_OFFSET when no block is large enough */
+    uint64_t allocate(uint64_t size, uint64_t alignment);
+    void free(uint64_t offset);
+
+    uint64_t capacity() const { return mcapacity; }
+    bool empty() const { return mallocated.empty(); }
+    BuddyStats stats() const;
+
+private:
+    struct Allocation {
+        uint32_t level;
+        uint64_t requested;
+    };
+
+    uint64_t blockSize(uint32_t level) const { return mcapacity >> level; }
+
+    uint64_t mcapacity;
+    uint32_t mleafLevel;
+    uint64_t musedBytes = 0;
+    uint64_t mrequestedBytes = 0;
+
+    /* Free block offsets per level; level 0 is the whole range */
+    std::vector<std::set<uint64_t>> mfreeLists;
+    std::unordered_map<uint64_t, Allocation> mallocated;
+};
+
+#endif //VULKAN_BASIC_SAMPLES_BUDDYALLOCATOR_H
@@ -0,0 +1,194 @@
+#include "DeletionQueue.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <stdexcept>
+
+#include "HostAllocator.h"
+#include "Log.h"
+
+namespace {
+
+const char* objectTypeName(VkObjectType type) {
+    switch (type) {
+        case VK_OBJECT_TYPE_SWAPCHAIN_KHR: return "VkSwapchainKHR";
+        case VK_OBJECT_TYPE_IMAGE_VIEW: return "VkImageView";
+        case VK_OBJECT_TYPE_FRAMEBUFFER: return "VkFramebuffer";
+        case VK_OBJECT_TYPE_RENDER_PASS: return "VkRenderPass";
+        case VK_OBJECT_TYPE_PIPELINE_LAYOUT: return "VkPipelineLayout";
+        case VK_OBJECT_TYPE_PIPELINE: return "VkPipeline";
+        case VK_OBJECT_TYPE_DESCRIPTOR_SET_LAYOUT: return "VkDescriptorSetLayout";
+        case VK_OBJECT_TYPE_SAMPLER: return "VkSampler";
+        case VK_OBJECT_TYPE_SHADER_MODULE: return "VkShaderModule";
+        case VK_OBJECT_TYPE_BUFFER: return "VkBuffer";
+        case VK_OBJECT_TYPE_IMAGE: return "VkImage";
+        case VK_OBJECT_TYPE_DEVICE_MEMORY: return "VkDeviceMemory";
+        default: return "unknown object";
+    }
+}
+
+}
+
+void DeletionQueue::init(VkDevice device, GpuAllocator& allocator) {
+    mdevice = device;
+    mallocator = &allocator;
+}
+
+void DeletionQueue::destroy() {
+    flush();
+    std::lock_guard<std::mutex> lock(mmutex);
+    for (uint32_t i = 0; i < mownedTypes; i++) {
+        if (mowned[i].count != 0) {
+            LOG_WARNING(LOG_DEVICE, "Leak: %lld %s still owned at shutdown", (long long) mowned[i].count,
+                        objectTypeName(mowned[i].type));
+        }
+    }
+    mclosed = true;
+}
+
+void DeletionQueue::setSubmittedSerial(uint64_t serial) {
+    std::lock_guard<std::mutex> lock(mmutex);
+    msubmittedSerial = serial;
+}
+
+void DeletionQueue::retire(VkObjectType type, uint64_t handle) {
+    push(type, handle, GpuAllocation());
+}
+
+void DeletionQueue::retireBuffer(VkBuffer& buffer, GpuAllocation& allocation) {
+    if (buffer != VK_NULL_HANDLE) {
+        push(VK_OBJECT_TYPE_BUFFER, reinterpret_cast<uint64_t>(buffer), allocation);
+    }
+    buffer = VK_NULL_HANDLE;
+    allocation = GpuAllocation();
+}
+
+void DeletionQueue::retireImage(VkImage& image, GpuAllocation& allocation) {
+    if (image != VK_NULL_HANDLE) {
+        push(VK_OBJECT_TYPE_IMAGE, reinterpret_cast<uint64_t>(image), allocation);
+    }
+    image = VK_NULL_HANDLE;
+    allocation = GpuAllocation();
+}
+
+void DeletionQueue::retireAllocation(GpuAllocation& allocation) {
+    if (allocation.memory != VK_NULL_HANDLE) {
+        push(VK_OBJECT_TYPE_DEVICE_MEMORY, reinterpret_cast<uint64_t>(allocation.memory), allocation);
+    }
+    allocation = GpuAllocation();
+}
+
+void DeletionQueue::push(VkObjectType type, uint64_t handle, const GpuAllocation& allocation) {
+    if (handle == 0) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mmutex);
+    if (mclosed) {
+        /* A UniqueHandle that outlived the device: destroy() reported it, and nothing can destroy it now */
+        return;
+    }
+    Entry entry;
+    entry.serial = msubmittedSerial;
+    entry.type = type;
+    entry.handle = handle;
+    entry.allocation = allocation;
+    mpending.push_back(entry);
+    mmaxPending = std::max(mmaxPending, mpending.size());
+}
+
+/*
+ * Serials are stamped in non-decreasing order, so the queue is sorted and
+ * collection stops at the first entry still in flight.
+ */
+void DeletionQueue::collect(uint64_t completedSerial) {
+    std::lock_guard<std::mutex> lock(mmutex);
+    while (!mpending.empty() && mpending.front().serial <= completedSerial) {
+        destroyEntry(mpending.front());
+        mpending.pop_front();
+        mdestroyed++;
+    }
+}
+
+void DeletionQueue::flush() {
+    std::lock_guard<std::mutex> lock(mmutex);
+    mdestroyedAtShutdown += mpending.size();
+    while (!mpending.empty()) {
+        destroyEntry(mpending.front());
+        mpending.pop_front();
+        mdestroyed++;
+    }
+}
+
+void DeletionQueue::destroyEntry(const Entry& entry) {
+    const VkAllocationCallbacks* allocator = HostAllocator::callbacks();
+    switch (entry.type) {
+        case VK_OBJECT_TYPE_SWAPCHAIN_KHR:
+            vkDestroySwapchainKHR(mdevice, reinterpret_cast<VkSwapchainKHR>(entry.handle), allocator);
+            break;
+        case VK_OBJECT_TYPE_IMAGE_VIEW:
+            vkDestroyImageView(mdevice, reinterpret_cast<VkImageView>(entry.handle), allocator);
+            break;
+        case VK_OBJECT_TYPE_FRAMEBUFFER:
+            vkDestroyFramebuffer(mdevice, reinterpret_cast<VkFramebuffer>(entry.handle), allocator);
+            break;
+        case VK_OBJECT_TYPE_RENDER_PASS:
+            vkDestroyRenderPass(mdevice, reinterpret_cast<VkRenderPass>(entry.handle), allocator);
+            break;
+        case VK_OBJECT_TYPE_PIPELINE_LAYOUT:
+            vkDestroyPipelineLayout(mdevice, reinterpret_cast<VkPipelineLayout>(entry.handle), allocator);
+            break;
+        case VK_OBJECT_TYPE_PIPELINE:
+            vkDestroyPipeline(mdevice, reinterpret_cast<VkPipeline>(entry.handle), allocator);
+            break;
+        case VK_OBJECT_TYPE_DESCRIPTOR_SET_LAYOUT:
+            vkDestroyDescriptorSetLayout(mdevice, reinterpret_cast<VkDescriptorSetLayout>(entry.handle), allocator);
+            break;
+        case VK_OBJECT_TYPE_SAMPLER:
+            vkDestroySampler(mdevice, reinterpret_cast<VkSampler>(entry.handle), allocator);
+            break;
+        case VK_OBJECT_TYPE_SHADER_MODULE:
+            vkDestroyShaderModule(mdevice, reinterpret_cast<VkShaderModule>(entry.handle), allocator);
+            break;
+        case VK_OBJECT_TYPE_BUFFER: {
+            VkBuffer buffer = reinterpret_cast<VkBuffer>(entry.handle);
+            GpuAllocation allocation = entry.allocation;
+            mallocator->destroyBuffer(buffer, allocation);
+            break;
+        }
+        case VK_OBJECT_TYPE_IMAGE: {
+            VkImage image = reinterpret_cast<VkImage>(entry.handle);
+            GpuAllocation allocation = entry.allocation;
+            mallocator->destroyImage(image, allocation);
+            break;
+        }
+        case VK_OBJECT_TYPE_DEVICE_MEMORY: {
+            GpuAllocation allocation = entry.allocation;
+            mallocator->free(allocation);
+            break;
+        }
+        default:
+            throw std::runtime_error("DeletionQueue: unsupported object type");
+    }
+}
+
+void DeletionQueue::track(VkObjectType type, int delta) {
+    std::lock_guard<std::mutex> lock(mmutex);
+    for (uint32_t i = 0; i < mownedTypes; i++) {
+        if (mowned[i].type == type) {
+            mowned[i].count += delta;
+            return;
+        }
+    }
+    if (mownedTypes == sizeof(mowned) / sizeof(mowned[0])) {
+        throw std::runtime_error("DeletionQueue: too many object types");
+    }
+    mowned[mownedTypes].type = type;
+    mowned[mownedTypes].count = delta;
+    mownedTypes++;
+}
+
+void DeletionQueue::printStats() const {
+    std::lock_guard<std::mutex> lock(mmutex);
+    printf("Deferred deletion: %llu objects destroyed, %llu of them at shutdown, at most %zu pending \n",
+           (unsigned long long) mdestroyed, (unsigned long long) mdestroyedAtShutdown, mmaxPending);
+}
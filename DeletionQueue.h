@@ -0,0 +1,173 @@
+#ifndef VULKAN_BASIC_SAMPLES_DELETIONQUEUE_H
+#define VULKAN_BASIC_SAMPLES_DELETIONQUEUE_H
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <deque>
+#include <mutex>
+
+#include "GpuAllocator.h"
+
+/*
+ * Maps a handle type to its VkObjectType. Non-dispatchable handles are
+ * distinct pointer types on 64-bit targets, which is all this sample builds
+ * for; on 32-bit they are all uint64_t and these specialisations collide.
+ */
+template <typename T> struct HandleType;
+#define DEFINE_HANDLE_TYPE(Handle, objectType) \
+    template <> struct HandleType<Handle> { static const VkObjectType type = objectType; };
+DEFINE_HANDLE_TYPE(VkSwapchainKHR, VK_OBJECT_TYPE_SWAPCHAIN_KHR)
+DEFINE_HANDLE_TYPE(VkImageView, VK_OBJECT_TYPE_IMAGE_VIEW)
+DEFINE_HANDLE_TYPE(VkFramebuffer, VK_OBJECT_TYPE_FRAMEBUFFER)
+DEFINE_HANDLE_TYPE(VkRenderPass, VK_OBJECT_TYPE_RENDER_PASS)
+DEFINE_HANDLE_TYPE(VkPipelineLayout, VK_OBJECT_TYPE_PIPELINE_LAYOUT)
+DEFINE_HANDLE_TYPE(VkPipeline, VK_OBJECT_TYPE_PIPELINE)
+DEFINE_HANDLE_TYPE(VkDescriptorSetLayout, VK_OBJECT_TYPE_DESCRIPTOR_SET_LAYOUT)
+DEFINE_HANDLE_TYPE(VkSampler, VK_OBJECT_TYPE_SAMPLER)
+DEFINE_HANDLE_TYPE(VkShaderModule, VK_OBJECT_TYPE_SHADER_MODULE)
+#undef DEFINE_HANDLE_TYPE
+
+template <typename T> class UniqueHandle;
+
+/*
+ * Destroys device objects once the GPU can no longer reference them.
+ *
+ * Every retired object is stamped with the serial of the most recent
+ * submission. Frames complete in submission order, so once the fence of
+ * that submission has been waited on, collect() destroys the object. No
+ * retirement ever waits on the device. Entries are plain structs in a
+ * chunked FIFO, and a destroy is a switch on the object type, so retiring
+ * costs no allocation per object.
+ *
+ * The queue also counts the handles that UniqueHandles currently own. At
+ * shutdown, flush() runs with the device idle and destroys everything that
+ * is still queued in a single pass, so it takes time proportional to what
+ * is pending. destroy() then reports every handle still owned, because those
+ * would outlive the device.
+ */
+class DeletionQueue {
+public:
+    void init(VkDevice device, GpuAllocator& allocator);
+    /* Flushes, then logs a warning per object type still owned by a UniqueHandle */
+    void destroy();
+
+    /* Serial of the latest submission; objects retired from now on wait for it */
+    void setSubmittedSerial(uint64_t serial);
+
+    template <typename T>
+    UniqueHandle<T> own(T handle) { return UniqueHandle<T>(*this, handle); }
+
+    template <typename T>
+    void retire(T handle) { retire(HandleType<T>::type, reinterpret_cast<uint64_t>(handle)); }
+    void retire(VkObjectType type, uint64_t handle);
+    /* Takes the allocation too; both arguments are reset */
+    void retireBuffer(VkBuffer& buffer, GpuAllocation& allocation);
+    void retireImage(VkImage& image, GpuAllocation& allocation);
+    /* Memory with nothing of its own bound, such as a heap that images were aliased into */
+    void retireAllocation(GpuAllocation& allocation);
+
+    /* Destroys, in retirement order, everything retired at or before completedSerial */
+    void collect(uint64_t completedSerial);
+    /* With the device idle: destroys everything queued */
+    void flush();
+
+    /* UniqueHandle bookkeeping for the leak report */
+    void track(VkObjectType type, int delta);
+
+    /* Objects destroyed through the queue and the largest backlog seen */
+    void printStats() const;
+
+private:
+    struct Entry {
+        uint64_t serial;
+        VkObjectType type;
+        uint64_t handle;
+        GpuAllocation allocation;
+    };
+
+    struct Owned {
+        VkObjectType type;
+        int64_t count;
+    };
+
+    void push(VkObjectType type, uint64_t handle, const GpuAllocation& allocation);
+    void destroyEntry(const Entry& entry);
+
+    VkDevice mdevice = VK_NULL_HANDLE;
+    GpuAllocator* mallocator = nullptr;
+    /* Set by destroy(); retiring before init() is fine, as nothing is collected until then */
+    bool mclosed = false;
+
+    mutable std::mutex mmutex;
+    std::deque<Entry> mpending;
+    uint64_t msubmittedSerial = 0;
+    /* A handful of object types, so a linear scan beats a map */
+    Owned mowned[16];
+    uint32_t mownedTypes = 0;
+
+    uint64_t mdestroyed = 0;
+    uint64_t mdestroyedAtShutdown = 0;
+    size_t mmaxPending = 0;
+};
+
+/*
+ * Move-only owner of a device object. Destroying or reassigning it hands the
+ * object to its DeletionQueue, which destroys it once the frames submitted
+ * so far have completed. It holds only the handle and the queue pointer.
+ * The implicit conversion lets it be passed straight to Vulkan calls.
+ */
+template <typename T>
+class UniqueHandle {
+public:
+    UniqueHandle() {}
+    UniqueHandle(DeletionQueue& queue, T handle) : mqueue(&queue), mhandle(handle) {
+        if (mhandle != VK_NULL_HANDLE) {
+            mqueue->track(HandleType<T>::type, 1);
+        }
+    }
+    ~UniqueHandle() { reset(); }
+
+    UniqueHandle(UniqueHandle&& other) noexcept : mqueue(other.mqueue), mhandle(other.mhandle) {
+        other.mhandle = VK_NULL_HANDLE;
+    }
+    UniqueHandle& operator=(UniqueHandle&& other) noexcept {
+        if (this != &other) {
+            reset();
+            mqueue = other.mqueue;
+            mhandle = other.mhandle;
+            other.mhandle = VK_NULL_HANDLE;
+        }
+        return *this;
+    }
+    UniqueHandle(const UniqueHandle&) = delete;
+    UniqueHandle& operator=(const UniqueHandle&) = delete;
+
+    T get() const { return mhandle; }
+    operator T() const { return mhandle; }
+
+    /* Retires the object; it stays valid for frames already submitted */
+    void reset() {
+        if (mhandle != VK_NULL_HANDLE) {
+            mqueue->track(HandleType<T>::type, -1);
+            mqueue->retire(mhandle);
+            mhandle = VK_NULL_HANDLE;
+        }
+    }
+
+    /* Gives up ownership without destroying */
+    T release() {
+        T handle = mhandle;
+        if (mhandle != VK_NULL_HANDLE) {
+            mqueue->track(HandleType<T>::type, -1);
+            mhandle = VK_NULL_HANDLE;
+        }
+        return handle;
+    }
+
+private:
+    DeletionQueue* mqueue = nullptr;
+    T mhandle = VK_NULL_HANDLE;
+};
+
+#endif //VULKAN_BASIC_SAMPLES_DELETIONQUEUE_H
@@ -0,0 +1,339 @@
+#include "DescriptorHeap.h"
+#include "HostAllocator.h"
+#include "Log.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <stdexcept>
+
+namespace {
+
+/* Per-set fallback: sets carved from each pool before another is created */
+const uint32_t SETS_PER_POOL = 256;
+
+/* Stages that may index the bindless arrays */
+const VkShaderStageFlags HEAP_STAGES = VK_SHADER_STAGE_ALL_GRAPHICS | VK_SHADER_STAGE_COMPUTE_BIT;
+
+}
+
+const uint32_t HandleAllocator::INVALID_INDEX;
+const uint32_t DescriptorHeap::PUSH_CONSTANT_BYTES;
+
+void HandleAllocator::reset(uint32_t capacity) {
+    mcapacity = capacity;
+    mhighWater = 0;
+    mfree.clear();
+    mpending.clear();
+}
+
+/* Recently freed slots first, so the live range stays dense */
+uint32_t HandleAllocator::allocate() {
+    if (!mfree.empty()) {
+        uint32_t index = mfree.back();
+        mfree.pop_back();
+        return index;
+    }
+    if (mhighWater < mcapacity) {
+        return mhighWater++;
+    }
+    return INVALID_INDEX;
+}
+
+void HandleAllocator::release(uint32_t index, uint64_t lastUseSerial) {
+    if (!mpending.empty() && lastUseSerial < mpending.back().serial) {
+        lastUseSerial = mpending.back().serial;
+    }
+    Pending pending;
+    pending.index = index;
+    pending.serial = lastUseSerial;
+    mpending.push_back(pending);
+}
+
+uint32_t HandleAllocator::recycle(uint64_t completedSerial) {
+    uint32_t recycled = 0;
+    while (!mpending.empty() && mpending.front().serial <= completedSerial) {
+        mfree.push_back(mpending.front().index);
+        mpending.pop_front();
+        recycled++;
+    }
+    return recycled;
+}
+
+void DescriptorHeap::init(VkDevice device, VkPhysicalDevice physicalDevice, bool bindless, uint32_t imageCapacity,
+                          uint32_t storageBufferCapacity) {
+    mdevice = device;
+    mbindless = bindless;
+    if (mbindless) {
+        createBindlessSet(physicalDevice, imageCapacity, storageBufferCapacity);
+    } else {
+        createPerSetLayouts();
+    }
+    mimages.reset(imageCapacity);
+    mstorageBuffers.reset(storageBufferCapacity);
+
+    LOG_DEBUG(LOG_MEMORY, "Descriptor heap: %s, %u images, %u storage buffers",
+              mbindless ? "bindless" : "per-set pools", imageCapacity, storageBufferCapacity);
+}
+
+void DescriptorHeap::destroy() {
+    for (VkDescriptorPool pool : mpools) {
+        vkDestroyDescriptorPool(mdevice, pool, HostAllocator::callbacks());
+    }
+    for (VkDescriptorSetLayout layout : msetLayouts) {
+        vkDestroyDescriptorSetLayout(mdevice, layout, HostAllocator::callbacks());
+    }
+    mpools.clear();
+    msetLayouts.clear();
+    mimageSets.clear();
+    mstorageBufferSets.clear();
+    mglobalSet = VK_NULL_HANDLE;
+    mpoolSetsLeft = 0;
+}
+
+/*
+ * One set with a partially bound array per type. Update-after-bind lets
+ * new handles be written while command buffers that bind the set are still
+ * pending; unused-while-pending covers slots those command buffers never
+ * index.
+ */
+void DescriptorHeap::createBindlessSet(VkPhysicalDevice physicalDevice, uint32_t& imageCapacity,
+                                       uint32_t& storageBufferCapacity) {
+    VkPhysicalDeviceDescriptorIndexingPropertiesEXT indexingProperties = {};
+    indexingProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES_EXT;
+    VkPhysicalDeviceProperties2 properties2 = {};
+    properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    properties2.pNext = &indexingProperties;
+    vkGetPhysicalDeviceProperties2(physicalDevice, &properties2);
+
+    /* Combined image samplers count against both the sampler and the sampled image limits */
+    imageCapacity = std::min({imageCapacity,
+                              indexingProperties.maxDescriptorSetUpdateAfterBindSampledImages,
+                              indexingProperties.maxPerStageDescriptorUpdateAfterBindSampledImages,
+                              indexingProperties.maxDescriptorSetUpdateAfterBindSamplers,
+                              indexingProperties.maxPerStageDescriptorUpdateAfterBindSamplers});
+    storageBufferCapacity = std::min({storageBufferCapacity,
+                                      indexingProperties.maxDescriptorSetUpdateAfterBindStorageBuffers,
+                                      indexingProperties.maxPerStageDescriptorUpdateAfterBindStorageBuffers});
+
+    VkDescriptorSetLayoutBinding bindings[2] = {};
+    bindings[0].binding = 0;
+    bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    bindings[0].descriptorCount = imageCapacity;
+    bindings[0].stageFlags = HEAP_STAGES;
+    bindings[1].binding = 1;
+    bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bindings[1].descriptorCount = storageBufferCapacity;
+    bindings[1].stageFlags = HEAP_STAGES;
+
+    VkDescriptorBindingFlagsEXT bindingFlags[2];
+    bindingFlags[0] = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT |
+                      VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT_EXT;
+    bindingFlags[1] = bindingFlags[0];
+
+    VkDescriptorSetLayoutBindingFlagsCreateInfoEXT bindingFlagsInfo = {};
+    bindingFlagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT;
+    bindingFlagsInfo.bindingCount = 2;
+    bindingFlagsInfo.pBindingFlags = bindingFlags;
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.pNext = &bindingFlagsInfo;
+    layoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT;
+    layoutInfo.bindingCount = 2;
+    layoutInfo.pBindings = bindings;
+
+    VkDescriptorSetLayout layout;
+    if (vkCreateDescriptorSetLayout(mdevice, &layoutInfo, HostAllocator::callbacks(), &layout) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create bindless descriptor set layout");
+    }
+    msetLayouts.push_back(layout);
+
+    VkDescriptorPoolSize poolSizes[2] = {};
+    poolSizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    poolSizes[0].descriptorCount = imageCapacity;
+    poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSizes[1].descriptorCount = storageBufferCapacity;
+
+    VkDescriptorPoolCreateInfo poolInfo = {};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT_EXT;
+    poolInfo.maxSets = 1;
+    poolInfo.poolSizeCount = 2;
+    poolInfo.pPoolSizes = poolSizes;
+
+    VkDescriptorPool pool;
+    if (vkCreateDescriptorPool(mdevice, &poolInfo, HostAllocator::callbacks(), &pool) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create bindless descriptor pool");
+    }
+    mpools.push_back(pool);
+
+    VkDescriptorSetAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = pool;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &layout;
+    if (vkAllocateDescriptorSets(mdevice, &allocInfo, &mglobalSet) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate bindless descriptor set");
+    }
+}
+
+/* Set 0 holds one image, set 1 one storage buffer */
+void DescriptorHeap::createPerSetLayouts() {
+    const VkDescriptorType types[] = {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER};
+    for (VkDescriptorType type : types) {
+        VkDescriptorSetLayoutBinding binding = {};
+        binding.binding = 0;
+        binding.descriptorType = type;
+        binding.descriptorCount = 1;
+        binding.stageFlags = HEAP_STAGES;
+
+        VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layoutInfo.bindingCount = 1;
+        layoutInfo.pBindings = &binding;
+
+        VkDescriptorSetLayout layout;
+        if (vkCreateDescriptorSetLayout(mdevice, &layoutInfo, HostAllocator::callbacks(), &layout) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create descriptor set layout");
+        }
+        msetLayouts.push_back(layout);
+    }
+}
+
+/* Sets are allocated the first time a slot is used and kept for whoever reuses it */
+VkDescriptorSet DescriptorHeap::perSetSlot(std::vector<VkDescriptorSet>& sets, uint32_t index,
+                                           VkDescriptorSetLayout layout) {
+    if (index >= sets.size()) {
+        sets.resize(index + 1, VK_NULL_HANDLE);
+    }
+    if (sets[index] != VK_NULL_HANDLE) {
+        return sets[index];
+    }
+
+    if (mpoolSetsLeft == 0) {
+        VkDescriptorPoolSize poolSizes[2] = {};
+        poolSizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        poolSizes[0].descriptorCount = SETS_PER_POOL;
+        poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        poolSizes[1].descriptorCount = SETS_PER_POOL;
+
+        VkDescriptorPoolCreateInfo poolInfo = {};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.maxSets = SETS_PER_POOL;
+        poolInfo.poolSizeCount = 2;
+        poolInfo.pPoolSizes = poolSizes;
+
+        VkDescriptorPool pool;
+        if (vkCreateDescriptorPool(mdevice, &poolInfo, HostAllocator::callbacks(), &pool) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create descriptor pool");
+        }
+        mpools.push_back(pool);
+        mpoolSetsLeft = SETS_PER_POOL;
+    }
+
+    VkDescriptorSetAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = mpools.back();
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &layout;
+    if (vkAllocateDescriptorSets(mdevice, &allocInfo, &sets[index]) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate descriptor set");
+    }
+    mpoolSetsLeft--;
+    return sets[index];
+}
+
+/* Declared in both modes: one shader serves both, and per-set pipelines simply never push */
+VkPushConstantRange DescriptorHeap::pushConstantRange() const {
+    VkPushConstantRange range = {};
+    range.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    range.offset = 0;
+    range.size = PUSH_CONSTANT_BYTES;
+    return range;
+}
+
+DescriptorHandle DescriptorHeap::createImage(VkImageView view, VkSampler sampler, VkImageLayout layout) {
+    uint32_t index = mimages.allocate();
+    if (index == HandleAllocator::INVALID_INDEX) {
+        throw std::runtime_error("Descriptor heap is out of image slots");
+    }
+
+    VkDescriptorImageInfo imageInfo = {};
+    imageInfo.sampler = sampler;
+    imageInfo.imageView = view;
+    imageInfo.imageLayout = layout;
+
+    VkWriteDescriptorSet write = {};
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstSet = mbindless ? mglobalSet : perSetSlot(mimageSets, index, msetLayouts[0]);
+    write.dstBinding = 0;
+    write.dstArrayElement = mbindless ? index : 0;
+    write.descriptorCount = 1;
+    write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    write.pImageInfo = &imageInfo;
+    vkUpdateDescriptorSets(mdevice, 1, &write, 0, nullptr);
+    return index;
+}
+
+DescriptorHandle DescriptorHeap::createStorageBuffer(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range) {
+    uint32_t index = mstorageBuffers.allocate();
+    if (index == HandleAllocator::INVALID_INDEX) {
+        throw std::runtime_error("Descriptor heap is out of storage buffer slots");
+    }
+
+    VkDescriptorBufferInfo bufferInfo = {};
+    bufferInfo.buffer = buffer;
+    bufferInfo.offset = offset;
+    bufferInfo.range = range;
+
+    VkWriteDescriptorSet write = {};
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstSet = mbindless ? mglobalSet : perSetSlot(mstorageBufferSets, index, msetLayouts[1]);
+    write.dstBinding = mbindless ? 1 : 0;
+    write.dstArrayElement = mbindless ? index : 0;
+    write.descriptorCount = 1;
+    write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    write.pBufferInfo = &bufferInfo;
+    vkUpdateDescriptorSets(mdevice, 1, &write, 0, nullptr);
+    return index | DESCRIPTOR_HANDLE_STORAGE_BUFFER_BIT;
+}
+
+void DescriptorHeap::release(DescriptorHandle handle, uint64_t lastUseSerial) {
+    if (handle == INVALID_DESCRIPTOR_HANDLE) {
+        return;
+    }
+    if (handle & DESCRIPTOR_HANDLE_STORAGE_BUFFER_BIT) {
+        mstorageBuffers.release(index(handle), lastUseSerial);
+    } else {
+        mimages.release(index(handle), lastUseSerial);
+    }
+}
+
+void DescriptorHeap::recycle(uint64_t completedSerial) {
+    mrecycled += mimages.recycle(completedSerial);
+    mrecycled += mstorageBuffers.recycle(completedSerial);
+}
+
+void DescriptorHeap::bindGlobal(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout) const {
+    if (mbindless) {
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &mglobalSet,
+                                0, nullptr);
+    }
+}
+
+void DescriptorHeap::bindDrawImage(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout,
+                                   DescriptorHandle image) const {
+    uint32_t slot = index(image);
+    if (mbindless) {
+        vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, PUSH_CONSTANT_BYTES, &slot);
+    } else {
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1,
+                                &mimageSets[slot], 0, nullptr);
+    }
+}
+
+void DescriptorHeap::printStats() const {
+    printf("Descriptor heap (%s): %u/%u images, %u/%u storage buffers live, %u slots recycled, %zu pools \n",
+           mbindless ? "bindless" : "per-set pools", mimages.liveCount(), mimages.capacity(),
+           mstorageBuffers.liveCount(), mstorageBuffers.capacity(), mrecycled, mpools.size());
+}
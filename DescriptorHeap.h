@@ -0,0 +1,125 @@
+#ifndef VULKAN_BASIC_SAMPLES_DESCRIPTORHEAP_H
+#define VULKAN_BASIC_SAMPLES_DESCRIPTORHEAP_H
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+/*
+ * Slot indices handed out from a free list. A released slot may still be
+ * referenced by frames in flight, so it only returns to the free list once
+ * the frame serial it was last used in has completed.
+ */
+class HandleAllocator {
+public:
+    static const uint32_t INVALID_INDEX = 0xffffffffu;
+
+    void reset(uint32_t capacity);
+
+    /* INVALID_INDEX when every slot is live or waiting to be recycled */
+    uint32_t allocate();
+    void release(uint32_t index, uint64_t lastUseSerial);
+    /* Returns slots whose last use is at or before completedSerial; call once per frame */
+    uint32_t recycle(uint64_t completedSerial);
+
+    uint32_t capacity() const { return mcapacity; }
+    /* Slots ever handed out; everything at or above it has never been written */
+    uint32_t highWater() const { return mhighWater; }
+    uint32_t liveCount() const { return mhighWater - static_cast<uint32_t>(mfree.size() + mpending.size()); }
+
+private:
+    struct Pending {
+        uint32_t index;
+        uint64_t serial;
+    };
+
+    uint32_t mcapacity = 0;
+    uint32_t mhighWater = 0;
+    std::vector<uint32_t> mfree;
+    /* Releases arrive in non-decreasing serial order, so the front is always the oldest */
+    std::deque<Pending> mpending;
+};
+
+/* Index into the heap's image or storage buffer array, with the array encoded in the top bit */
+typedef uint32_t DescriptorHandle;
+const DescriptorHandle DESCRIPTOR_HANDLE_STORAGE_BUFFER_BIT = 1u << 31;
+const DescriptorHandle INVALID_DESCRIPTOR_HANDLE = 0xffffffffu;
+
+/*
+ * Global descriptor heap for sampled images and storage buffers.
+ *
+ * With VK_EXT_descriptor_indexing it is bindless: one update-after-bind set
+ * holds a partially bound array per descriptor type, is bound once per
+ * command buffer and draws select their resources with a push constant
+ * index. Descriptors are written once when a handle is created; the set is
+ * never rewritten while a slot is still in use because slots are only
+ * recycled after the frames that used them retire.
+ *
+ * Without the extension it falls back to one small descriptor set per
+ * handle, carved from fixed-size pools, and every draw binds its own set.
+ * Set layouts differ between the modes; setLayouts() and
+ * pushConstantRange() describe what the pipeline layout must declare, and
+ * shaders select the mode with specialization constants.
+ */
+class DescriptorHeap {
+public:
+    /* Push constant block read by shaders in bindless mode: the texture index of the draw */
+    static const uint32_t PUSH_CONSTANT_BYTES = sizeof(uint32_t);
+
+    /* Capacities are clamped to the device's update-after-bind limits in bindless mode */
+    void init(VkDevice device, VkPhysicalDevice physicalDevice, bool bindless, uint32_t imageCapacity,
+              uint32_t storageBufferCapacity);
+    void destroy();
+
+    bool bindless() const { return mbindless; }
+
+    /* Set layouts in set-number order */
+    const std::vector<VkDescriptorSetLayout>& setLayouts() const { return msetLayouts; }
+    VkPushConstantRange pushConstantRange() const;
+    /* Length of the image array shaders declare at set 0, binding 0: the heap, or the one image of a set */
+    uint32_t shaderImageCount() const { return mbindless ? mimages.capacity() : 1; }
+
+    DescriptorHandle createImage(VkImageView view, VkSampler sampler, VkImageLayout layout);
+    DescriptorHandle createStorageBuffer(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range);
+    /* lastUseSerial: the frame serial of the last submission that may read the descriptor */
+    void release(DescriptorHandle handle, uint64_t lastUseSerial);
+    void recycle(uint64_t completedSerial);
+
+    static uint32_t index(DescriptorHandle handle) { return handle & ~DESCRIPTOR_HANDLE_STORAGE_BUFFER_BIT; }
+
+    /* Bindless: binds the global set. Per-set mode: nothing, draws bind their own sets. */
+    void bindGlobal(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout) const;
+    /* Bindless: pushes the image index. Per-set mode: binds the image's set. */
+    void bindDrawImage(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, DescriptorHandle image) const;
+
+    /* Per-set mode only: layout of the single-image set, for callers that allocate their own sets */
+    VkDescriptorSetLayout imageSetLayout() const { return msetLayouts[0]; }
+
+    void printStats() const;
+
+private:
+    void createBindlessSet(VkPhysicalDevice physicalDevice, uint32_t& imageCapacity,
+                           uint32_t& storageBufferCapacity);
+    void createPerSetLayouts();
+    VkDescriptorSet perSetSlot(std::vector<VkDescriptorSet>& sets, uint32_t index, VkDescriptorSetLayout layout);
+
+    VkDevice mdevice = VK_NULL_HANDLE;
+    bool mbindless = false;
+    std::vector<VkDescriptorSetLayout> msetLayouts;
+    std::vector<VkDescriptorPool> mpools;
+    HandleAllocator mimages;
+    HandleAllocator mstorageBuffers;
+    uint32_t mrecycled = 0;
+
+    /* Bindless */
+    VkDescriptorSet mglobalSet = VK_NULL_HANDLE;
+
+    /* Per-set mode: one set per slot, allocated on first use and rewritten on reuse */
+    std::vector<VkDescriptorSet> mimageSets;
+    std::vector<VkDescriptorSet> mstorageBufferSets;
+    uint32_t mpoolSetsLeft = 0;
+};
+
+#endif //VULKAN_BASIC_SAMPLES_DESCRIPTORHEAP_H
@@ -0,0 +1,393 @@
+#include "DeviceSelector.h"
+#include "Log.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+
+/* Bump when the meaning of a cached field changes */
+const uint32_t CACHE_FORMAT_VERSION = 2;
+
+struct ExtensionBit {
+    DeviceExtensionBits bit;
+    const char* name;
+};
+
+const ExtensionBit KNOWN_EXTENSIONS[] = {
+    {DEVICE_EXTENSION_SWAPCHAIN, VK_KHR_SWAPCHAIN_EXTENSION_NAME},
+    {DEVICE_EXTENSION_DESCRIPTOR_INDEXING, VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME},
+    {DEVICE_EXTENSION_DRAW_INDIRECT_COUNT, VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME},
+};
+
+uint32_t knownExtensionMask() {
+    uint32_t mask = 0;
+    for (const auto& extension : KNOWN_EXTENSIONS) {
+        mask |= extension.bit;
+    }
+    return mask;
+}
+
+const uint32_t KNOWN_FEATURE_MASK = DEVICE_FEATURE_MULTI_DRAW_INDIRECT | DEVICE_FEATURE_DRAW_INDIRECT_FIRST_INSTANCE |
+                                    DEVICE_FEATURE_SAMPLER_ANISOTROPY | DEVICE_FEATURE_PIPELINE_STATISTICS_QUERY |
+                                    DEVICE_FEATURE_SHADER_INT64 | DEVICE_FEATURE_BINDLESS;
+
+const char* deviceTypeName(VkPhysicalDeviceType type) {
+    switch (type) {
+        case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
+            return "discrete";
+        case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:
+            return "integrated";
+        case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:
+            return "virtual";
+        case VK_PHYSICAL_DEVICE_TYPE_CPU:
+            return "cpu";
+        default:
+            return "other";
+    }
+}
+
+std::string lowercase(const std::string& text) {
+    std::string result;
+    for (char c : text) {
+        result += static_cast<char>(tolower(static_cast<unsigned char>(c)));
+    }
+    return result;
+}
+
+bool sameDriver(const DeviceCapabilities& a, const DeviceCapabilities& b) {
+    return a.vendorID == b.vendorID && a.deviceID == b.deviceID && a.driverVersion == b.driverVersion &&
+           a.apiVersion == b.apiVersion && a.features2 == b.features2;
+}
+
+}
+
+DeviceSelector::DeviceSelector(const std::string& cachePath, bool useDeviceIdProperties)
+    : mcachePath(cachePath), museDeviceIdProperties(useDeviceIdProperties) {
+}
+
+int DeviceSelector::score(const DeviceCapabilities& caps, const DeviceRequirements& requirements) {
+    int score = 0;
+    switch (caps.type) {
+        case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
+            score += 10000;
+            break;
+        case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:
+            score += 5000;
+            break;
+        case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:
+            score += 2000;
+            break;
+        default:
+            break;
+    }
+
+    /* One point per 64 MiB, capped so a huge shared heap cannot outweigh the device type */
+    score += static_cast<int>(std::min<VkDeviceSize>(caps.deviceLocalBytes >> 26, 1024));
+
+    if (caps.dedicatedCompute) {
+        score += 200;
+    }
+    if (caps.dedicatedTransfer) {
+        score += 200;
+    }
+
+    uint32_t preferred = caps.features & requirements.preferredFeatures;
+    for (; preferred != 0; preferred &= preferred - 1) {
+        score += 50;
+    }
+    return score;
+}
+
+bool DeviceSelector::meetsRequirements(const DeviceCapabilities& caps, const DeviceRequirements& requirements) {
+    return caps.graphicsQueue &&
+           (caps.extensions & requirements.extensions) == requirements.extensions &&
+           (caps.features & requirements.features) == requirements.features;
+}
+
+std::string DeviceSelector::uuidString(const uint8_t* uuid) {
+    std::string result;
+    char hex[3];
+    for (int i = 0; i < VK_UUID_SIZE; i++) {
+        snprintf(hex, sizeof(hex), "%02x", uuid[i]);
+        result += hex;
+    }
+    return result;
+}
+
+bool DeviceSelector::matchesOverride(const DeviceCapabilities& caps, const std::string& overrideName) {
+    std::string needle = lowercase(overrideName);
+    std::string uuid = needle;
+    uuid.erase(std::remove(uuid.begin(), uuid.end(), '-'), uuid.end());
+    if (uuid == uuidString(caps.uuid)) {
+        return true;
+    }
+    return lowercase(caps.name).find(needle) != std::string::npos;
+}
+
+/*
+ * The queries the cache exists to avoid: queue families, memory heaps,
+ * extensions and features. Extension features need caps.features2.
+ */
+void DeviceSelector::probe(VkPhysicalDevice device, DeviceCapabilities& caps) {
+    uint32_t queueFamilyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, queueFamilies.data());
+
+    for (const auto& family : queueFamilies) {
+        if (family.queueCount == 0) {
+            continue;
+        }
+        if (family.queueFlags & VK_QUEUE_GRAPHICS_BIT) {
+            caps.graphicsQueue = true;
+        } else if (family.queueFlags & VK_QUEUE_COMPUTE_BIT) {
+            caps.dedicatedCompute = true;
+        } else if (family.queueFlags & VK_QUEUE_TRANSFER_BIT) {
+            caps.dedicatedTransfer = true;
+        }
+    }
+
+    VkPhysicalDeviceMemoryProperties memoryProperties;
+    vkGetPhysicalDeviceMemoryProperties(device, &memoryProperties);
+    for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; i++) {
+        if (memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) {
+            caps.deviceLocalBytes = std::max(caps.deviceLocalBytes, memoryProperties.memoryHeaps[i].size);
+        }
+    }
+
+    uint32_t extensionCount = 0;
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+    std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
+    for (const auto& available : availableExtensions) {
+        for (const auto& known : KNOWN_EXTENSIONS) {
+            if (strcmp(available.extensionName, known.name) == 0) {
+                caps.extensions |= known.bit;
+            }
+        }
+    }
+
+    VkPhysicalDeviceFeatures features;
+    vkGetPhysicalDeviceFeatures(device, &features);
+    if (features.multiDrawIndirect) {
+        caps.features |= DEVICE_FEATURE_MULTI_DRAW_INDIRECT;
+    }
+    if (features.drawIndirectFirstInstance) {
+        caps.features |= DEVICE_FEATURE_DRAW_INDIRECT_FIRST_INSTANCE;
+    }
+    if (features.samplerAnisotropy) {
+        caps.features |= DEVICE_FEATURE_SAMPLER_ANISOTROPY;
+    }
+    if (features.pipelineStatisticsQuery) {
+        caps.features |= DEVICE_FEATURE_PIPELINE_STATISTICS_QUERY;
+    }
+    if (features.shaderInt64) {
+        caps.features |= DEVICE_FEATURE_SHADER_INT64;
+    }
+
+    /* Extension feature structs can only be chained through vkGetPhysicalDeviceFeatures2 */
+    if (caps.features2 && (caps.extensions & DEVICE_EXTENSION_DESCRIPTOR_INDEXING)) {
+        VkPhysicalDeviceDescriptorIndexingFeaturesEXT indexingFeatures = {};
+        indexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+        VkPhysicalDeviceFeatures2 features2 = {};
+        features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features2.pNext = &indexingFeatures;
+        vkGetPhysicalDeviceFeatures2(device, &features2);
+        if (indexingFeatures.runtimeDescriptorArray && indexingFeatures.descriptorBindingPartiallyBound &&
+                indexingFeatures.descriptorBindingSampledImageUpdateAfterBind &&
+                indexingFeatures.descriptorBindingStorageBufferUpdateAfterBind &&
+                indexingFeatures.descriptorBindingUpdateUnusedWhilePending &&
+                indexingFeatures.shaderSampledImageArrayNonUniformIndexing) {
+            caps.features |= DEVICE_FEATURE_BINDLESS;
+        }
+    }
+}
+
+DeviceCapabilities DeviceSelector::describe(VkPhysicalDevice device) {
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(device, &properties);
+
+    DeviceCapabilities caps;
+    caps.name = properties.deviceName;
+    caps.vendorID = properties.vendorID;
+    caps.deviceID = properties.deviceID;
+    caps.driverVersion = properties.driverVersion;
+    caps.apiVersion = properties.apiVersion;
+    caps.type = properties.deviceType;
+    caps.features2 = museDeviceIdProperties && properties.apiVersion >= VK_API_VERSION_1_1;
+
+    /* pipelineCacheUUID also changes with the driver, so it is only a stand-in for deviceUUID */
+    memcpy(caps.uuid, properties.pipelineCacheUUID, VK_UUID_SIZE);
+    if (caps.features2) {
+        VkPhysicalDeviceIDProperties idProperties = {};
+        idProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES;
+        VkPhysicalDeviceProperties2 properties2 = {};
+        properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+        properties2.pNext = &idProperties;
+        vkGetPhysicalDeviceProperties2(device, &properties2);
+        memcpy(caps.uuid, idProperties.deviceUUID, VK_UUID_SIZE);
+    }
+
+    for (auto& entry : mcache) {
+        if (sameDriver(entry.caps, caps)) {
+            entry.used = true;
+            mcacheHits++;
+            DeviceCapabilities cached = entry.caps;
+            cached.name = caps.name;
+            cached.type = caps.type;
+            memcpy(cached.uuid, caps.uuid, VK_UUID_SIZE);
+            return cached;
+        }
+    }
+
+    mcacheMisses++;
+    probe(device, caps);
+    CacheEntry entry;
+    entry.caps = caps;
+    entry.used = true;
+    mcache.push_back(entry);
+    mcacheDirty = true;
+    return caps;
+}
+
+VkPhysicalDevice DeviceSelector::select(VkInstance instance, const DeviceRequirements& requirements,
+                                        const SurfaceCheck& surfaceCheck, const std::string& overrideName) {
+    auto startTime = std::chrono::steady_clock::now();
+
+    uint32_t deviceCount = 0;
+    vkEnumeratePhysicalDevices(instance, &deviceCount, nullptr);
+    if (deviceCount == 0) {
+        throw std::runtime_error("Failed to find GPUs with vulkan support");
+    }
+    std::vector<VkPhysicalDevice> devices(deviceCount);
+    vkEnumeratePhysicalDevices(instance, &deviceCount, devices.data());
+
+    loadCache();
+
+    struct Candidate {
+        VkPhysicalDevice device;
+        DeviceCapabilities caps;
+        int score;
+    };
+    std::vector<Candidate> candidates;
+    for (VkPhysicalDevice device : devices) {
+        Candidate candidate;
+        candidate.device = device;
+        candidate.caps = describe(device);
+        candidate.score = meetsRequirements(candidate.caps, requirements) ? score(candidate.caps, requirements) : -1;
+        LOG_DEBUG(LOG_DEVICE, "GPU %s (%s, %llu MiB, uuid %s) score %d", candidate.caps.name.c_str(),
+                  deviceTypeName(candidate.caps.type), (unsigned long long) (candidate.caps.deviceLocalBytes >> 20),
+                  uuidString(candidate.caps.uuid).c_str(), candidate.score);
+
+        if (!overrideName.empty() && !matchesOverride(candidate.caps, overrideName)) {
+            continue;
+        }
+        candidates.push_back(candidate);
+    }
+
+    if (mcacheDirty) {
+        saveCache();
+    }
+
+    std::stable_sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b) {
+        return a.score > b.score;
+    });
+
+    for (const auto& candidate : candidates) {
+        if (candidate.score < 0 || !surfaceCheck(candidate.device)) {
+            continue;
+        }
+        mselected = candidate.caps;
+
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - startTime;
+        printf("Using GPU %s (%s, score %d), selection took %.3f ms (%u cached, %u probed) \n",
+               mselected.name.c_str(), deviceTypeName(mselected.type), candidate.score, elapsed.count(),
+               mcacheHits, mcacheMisses);
+        return candidate.device;
+    }
+
+    if (!overrideName.empty()) {
+        throw std::runtime_error("No suitable GPU matches " + overrideName);
+    }
+    throw std::runtime_error("Failed to find a suitable GPU");
+}
+
+/*
+ * Format: a header line "vkdevcaps <version> <extension mask> <feature mask>"
+ * followed by one line per device and driver. A header that does not match
+ * the bits this build probes invalidates the whole file.
+ */
+void DeviceSelector::loadCache() {
+    mcache.clear();
+    std::ifstream file(mcachePath);
+    if (!file.is_open()) {
+        return;
+    }
+
+    std::string magic;
+    uint32_t version = 0, extensionMask = 0, featureMask = 0;
+    file >> magic >> version >> extensionMask >> featureMask;
+    if (!file || magic != "vkdevcaps" || version != CACHE_FORMAT_VERSION ||
+            extensionMask != knownExtensionMask() || featureMask != KNOWN_FEATURE_MASK) {
+        LOG_INFO(LOG_DEVICE, "Discarding device capability cache %s", mcachePath.c_str());
+        return;
+    }
+
+    std::string line;
+    while (std::getline(file, line)) {
+        std::istringstream fields(line);
+        CacheEntry entry;
+        unsigned long long deviceLocalBytes = 0;
+        int features2 = 0, graphicsQueue = 0, dedicatedCompute = 0, dedicatedTransfer = 0;
+        fields >> entry.caps.vendorID >> entry.caps.deviceID >> entry.caps.driverVersion >> entry.caps.apiVersion >>
+               features2 >> deviceLocalBytes >> graphicsQueue >> dedicatedCompute >> dedicatedTransfer >>
+               entry.caps.extensions >> entry.caps.features;
+        if (!fields) {
+            continue;
+        }
+        entry.caps.features2 = features2 != 0;
+        entry.caps.deviceLocalBytes = deviceLocalBytes;
+        entry.caps.graphicsQueue = graphicsQueue != 0;
+        entry.caps.dedicatedCompute = dedicatedCompute != 0;
+        entry.caps.dedicatedTransfer = dedicatedTransfer != 0;
+        entry.used = false;
+        mcache.push_back(entry);
+    }
+}
+
+/* Entries for drivers no longer present are dropped; temp file and rename as for the pipeline cache */
+void DeviceSelector::saveCache() {
+    std::string tmpPath = mcachePath + ".tmp";
+    std::ofstream file(tmpPath, std::ios::trunc);
+    if (!file.is_open()) {
+        LOG_WARNING(LOG_DEVICE, "Failed to open %s for writing", tmpPath.c_str());
+        return;
+    }
+
+    file << "vkdevcaps " << CACHE_FORMAT_VERSION << " " << knownExtensionMask() << " " << KNOWN_FEATURE_MASK << "\n";
+    for (const auto& entry : mcache) {
+        if (!entry.used) {
+            continue;
+        }
+        const DeviceCapabilities& caps = entry.caps;
+        file << caps.vendorID << " " << caps.deviceID << " " << caps.driverVersion << " " << caps.apiVersion << " "
+             << caps.features2 << " " << (unsigned long long) caps.deviceLocalBytes << " " << caps.graphicsQueue << " "
+             << caps.dedicatedCompute << " " << caps.dedicatedTransfer << " " << caps.extensions << " "
+             << caps.features << "\n";
+    }
+    file.close();
+
+    if (!file || rename(tmpPath.c_str(), mcachePath.c_str()) != 0) {
+        LOG_WARNING(LOG_DEVICE, "Failed to write device capability cache %s", mcachePath.c_str());
+        remove(tmpPath.c_str());
+        return;
+    }
+    mcacheDirty = false;
+}
@@ -0,0 +1,116 @@
+#ifndef VULKAN_BASIC_SAMPLES_DEVICESELECTOR_H
+#define VULKAN_BASIC_SAMPLES_DEVICESELECTOR_H
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+/* Device extensions the renderer may ask for, probed once per driver version */
+enum DeviceExtensionBits : uint32_t {
+    DEVICE_EXTENSION_SWAPCHAIN = 1u << 0,
+    DEVICE_EXTENSION_DESCRIPTOR_INDEXING = 1u << 1,
+    DEVICE_EXTENSION_DRAW_INDIRECT_COUNT = 1u << 2,
+};
+
+/* Subset of VkPhysicalDeviceFeatures (and extension feature structs) the renderer cares about */
+enum DeviceFeatureBits : uint32_t {
+    DEVICE_FEATURE_MULTI_DRAW_INDIRECT = 1u << 0,
+    DEVICE_FEATURE_DRAW_INDIRECT_FIRST_INSTANCE = 1u << 1,
+    DEVICE_FEATURE_SAMPLER_ANISOTROPY = 1u << 2,
+    DEVICE_FEATURE_PIPELINE_STATISTICS_QUERY = 1u << 3,
+    DEVICE_FEATURE_SHADER_INT64 = 1u << 4,
+    /* Every VkPhysicalDeviceDescriptorIndexingFeaturesEXT bit DescriptorHeap needs for a bindless set */
+    DEVICE_FEATURE_BINDLESS = 1u << 5,
+};
+
+/* What selection looks at. Everything except name and uuid comes from the cache when it is warm. */
+struct DeviceCapabilities {
+    std::string name;
+    uint8_t uuid[VK_UUID_SIZE];
+    uint32_t vendorID = 0;
+    uint32_t deviceID = 0;
+    uint32_t driverVersion = 0;
+    uint32_t apiVersion = 0;
+    /*
+     * Instance and device are both Vulkan 1.1, so vkGetPhysicalDeviceFeatures2
+     * and with it the descriptor indexing features were queried. Part of the
+     * cache key, and DEVICE_FEATURE_BINDLESS is only ever set when it holds.
+     */
+    bool features2 = false;
+    VkPhysicalDeviceType type = VK_PHYSICAL_DEVICE_TYPE_OTHER;
+    /* Largest DEVICE_LOCAL heap */
+    VkDeviceSize deviceLocalBytes = 0;
+    bool graphicsQueue = false;
+    /* Compute family without graphics, transfer family without graphics or compute */
+    bool dedicatedCompute = false;
+    bool dedicatedTransfer = false;
+    uint32_t extensions = 0;
+    uint32_t features = 0;
+};
+
+struct DeviceRequirements {
+    uint32_t extensions = 0;
+    uint32_t features = 0;
+    /* Each present feature adds to the score */
+    uint32_t preferredFeatures = 0;
+};
+
+/*
+ * Ranks every physical device and returns the best one that satisfies the
+ * requirements. Discrete beats integrated regardless of the rest; within a
+ * type, larger VRAM heaps, dedicated compute/transfer families and
+ * preferred features break the tie.
+ *
+ * Queue topology, heap sizes, extensions and features are written to a
+ * small text cache keyed by vendor, device, driver and API version and by
+ * whether the Features2 queries were available, so later runs skip those
+ * queries. Surface-dependent checks (present support,
+ * swapchain formats) cannot be cached and go through the caller's callback.
+ */
+class DeviceSelector {
+public:
+    typedef std::function<bool(VkPhysicalDevice)> SurfaceCheck;
+
+    /* useDeviceIdProperties: the instance is Vulkan 1.1, so deviceUUID can be queried */
+    DeviceSelector(const std::string& cachePath, bool useDeviceIdProperties);
+
+    /*
+     * overrideName picks a specific device by deviceUUID (hex, dashes
+     * optional) or a case-insensitive substring of its name; empty selects
+     * automatically. Throws when nothing qualifies.
+     */
+    VkPhysicalDevice select(VkInstance instance, const DeviceRequirements& requirements,
+                            const SurfaceCheck& surfaceCheck, const std::string& overrideName);
+
+    const DeviceCapabilities& selected() const { return mselected; }
+
+    static int score(const DeviceCapabilities& caps, const DeviceRequirements& requirements);
+    static bool meetsRequirements(const DeviceCapabilities& caps, const DeviceRequirements& requirements);
+
+private:
+    struct CacheEntry {
+        DeviceCapabilities caps;
+        bool used;
+    };
+
+    DeviceCapabilities describe(VkPhysicalDevice device);
+    static void probe(VkPhysicalDevice device, DeviceCapabilities& caps);
+    static bool matchesOverride(const DeviceCapabilities& caps, const std::string& overrideName);
+    static std::string uuidString(const uint8_t* uuid);
+
+    void loadCache();
+    void saveCache();
+
+    std::string mcachePath;
+    bool museDeviceIdProperties;
+    std::vector<CacheEntry> mcache;
+    bool mcacheDirty = false;
+    uint32_t mcacheHits = 0;
+    uint32_t mcacheMisses = 0;
+    DeviceCapabilities mselected;
+};
+
+#endif //VULKAN_BASIC_SAMPLES_DEVICESELECTOR_H
@@ -0,0 +1,490 @@
+#include "FrameCapture.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+
+#include <sys/stat.h>
+#include <zlib.h>
+
+#include "JobSystem.h"
+#include "Trace.h"
+
+namespace {
+    const char* const FORMAT_NAMES[] = {"png", "raw", "y4m"};
+    const uint8_t PNG_SIGNATURE[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+
+    void appendBigEndian(std::vector<uint8_t>& out, uint32_t value) {
+        out.push_back(static_cast<uint8_t>(value >> 24));
+        out.push_back(static_cast<uint8_t>(value >> 16));
+        out.push_back(static_cast<uint8_t>(value >> 8));
+        out.push_back(static_cast<uint8_t>(value));
+    }
+
+    /* Chunk data is already at the end of out, after an 8-byte placeholder for length and type */
+    void finishPngChunk(std::vector<uint8_t>& out, size_t chunkStart, const char* type) {
+        uint32_t length = static_cast<uint32_t>(out.size() - chunkStart - 8);
+        for (int i = 0; i < 4; i++) {
+            out[chunkStart + i] = static_cast<uint8_t>(length >> (24 - 8 * i));
+            out[chunkStart + 4 + i] = static_cast<uint8_t>(type[i]);
+        }
+        uLong crc = crc32(0, &out[chunkStart + 4], length + 4);
+        appendBigEndian(out, static_cast<uint32_t>(crc));
+    }
+
+    /* Whether the red and blue channels are swapped; throws for formats capture cannot encode */
+    bool isBgra(VkFormat format) {
+        switch (format) {
+            case VK_FORMAT_B8G8R8A8_UNORM:
+            case VK_FORMAT_B8G8R8A8_SRGB:
+                return true;
+            case VK_FORMAT_R8G8B8A8_UNORM:
+            case VK_FORMAT_R8G8B8A8_SRGB:
+                return false;
+            default:
+                throw std::runtime_error("Frame capture supports 8-bit RGBA and BGRA formats only");
+        }
+    }
+
+    /* BT.601 limited range */
+    uint8_t lumaOf(int r, int g, int b) {
+        return static_cast<uint8_t>(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+    }
+}
+
+bool parseCaptureFormat(const std::string& name, CaptureFormat& format) {
+    for (int i = 0; i <= CAPTURE_Y4M; i++) {
+        if (name == FORMAT_NAMES[i]) {
+            format = static_cast<CaptureFormat>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+FrameCapture::FrameCapture()
+    : mpendingJobs(0), mframesWritten(0), mwriteFailures(0), mbytesWritten(0), mencodeMicroseconds(0) {
+}
+
+FrameCapture::~FrameCapture() {
+    if (my4m != nullptr) {
+        fclose(my4m);
+    }
+}
+
+void FrameCapture::init(GpuAllocator& allocator, const Settings& settings, uint32_t framesInFlight,
+                        VkFormat format, VkExtent2D extent) {
+    mbgra = isBgra(format);
+    msettings = settings;
+    mformat = format;
+    mextent = extent;
+    mframesInFlight = framesInFlight;
+
+    if (mkdir(settings.directory.c_str(), 0755) != 0 && errno != EEXIST) {
+        throw std::runtime_error("Failed to create capture directory " + settings.directory);
+    }
+
+    unsigned encoderThreads = settings.encoderThreads;
+    if (encoderThreads == 0) {
+        unsigned hardwareThreads = std::thread::hardware_concurrency();
+        encoderThreads = hardwareThreads > 2 ? hardwareThreads - 1 : 1;
+    }
+    msettings.encoderThreads = encoderThreads;
+    /* Encoders only ever run on workers; the render thread never helps */
+    mjobs.reset(new JobSystem(encoderThreads));
+
+    /* Slots of frames still on the GPU cannot be freed by waiting, so at least one more is needed */
+    uint32_t ringSize = settings.ringSize != 0 ? settings.ringSize : framesInFlight + encoderThreads;
+    mslots = std::vector<Slot>(std::max(ringSize, framesInFlight + 1));
+    createSlots(allocator);
+    if (msettings.format == CAPTURE_Y4M) {
+        openY4mStream();
+    }
+
+    printf("Capturing %ux%u frames as %s to %s, %zu readback slots, %u encoder threads \n", extent.width,
+           extent.height, FORMAT_NAMES[msettings.format], settings.directory.c_str(), mslots.size(), encoderThreads);
+}
+
+void FrameCapture::destroy(GpuAllocator& allocator) {
+    if (mslots.empty()) {
+        return;
+    }
+    flush();
+    mjobs->wait(mpendingJobs);
+    mjobs.reset();
+    destroySlots(allocator);
+    mslots.clear();
+    if (my4m != nullptr) {
+        fclose(my4m);
+        my4m = nullptr;
+    }
+}
+
+void FrameCapture::resize(GpuAllocator& allocator, VkExtent2D extent, VkFormat format) {
+    bool bgra = isBgra(format);
+    /* The encoders read mbgra, so it changes only once they are done with the old frames */
+    flush();
+    mbgra = bgra;
+    mformat = format;
+    destroySlots(allocator);
+    mextent = extent;
+    createSlots(allocator);
+    if (msettings.format == CAPTURE_Y4M) {
+        /* A Y4M stream has one frame size, so the new size starts a new file */
+        fclose(my4m);
+        my4m = nullptr;
+        my4mSegment++;
+        openY4mStream();
+    }
+}
+
+void FrameCapture::createSlots(GpuAllocator& allocator) {
+    mframeBytes = static_cast<VkDeviceSize>(mextent.width) * mextent.height * 4;
+    for (Slot& slot : mslots) {
+        VkBufferCreateInfo bufferInfo = {};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = mframeBytes;
+        bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        /* Cached memory makes the encoders' reads fast; coherent saves an invalidate per frame */
+        allocator.createBuffer(bufferInfo, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                               slot.buffer, slot.allocation, VK_MEMORY_PROPERTY_HOST_CACHED_BIT);
+        slot.state = SLOT_FREE;
+    }
+}
+
+void FrameCapture::destroySlots(GpuAllocator& allocator) {
+    for (Slot& slot : mslots) {
+        allocator.destroyBuffer(slot.buffer, slot.allocation);
+    }
+}
+
+uint32_t FrameCapture::acquire() {
+    typedef std::chrono::steady_clock Clock;
+
+    std::unique_lock<std::mutex> lock(mmutex);
+    if (mnextFrame == 0) {
+        mfirstAcquire = Clock::now();
+    }
+
+    bool stalled = false;
+    Clock::time_point stallStart;
+    for (;;) {
+        for (uint32_t i = 0; i < mslots.size(); i++) {
+            if (mslots[i].state == SLOT_FREE) {
+                if (stalled) {
+                    mstallMs += std::chrono::duration<double, std::milli>(Clock::now() - stallStart).count();
+                }
+                mslots[i].state = SLOT_RECORDING;
+                mslots[i].frame = mnextFrame++;
+                return i;
+            }
+        }
+        if (!stalled) {
+            stalled = true;
+            stallStart = Clock::now();
+            mstalls++;
+        }
+        TRACE_SCOPE("captureStall", "capture");
+        mslotFreed.wait(lock);
+    }
+}
+
+void FrameCapture::recordCopy(VkCommandBuffer commandBuffer, VkImage image, VkImageLayout layout,
+                              uint32_t slot) const {
+    VkImageMemoryBarrier toTransfer = {};
+    toTransfer.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    toTransfer.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    toTransfer.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    toTransfer.oldLayout = layout;
+    toTransfer.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    toTransfer.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    toTransfer.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    toTransfer.image = image;
+    toTransfer.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    toTransfer.subresourceRange.levelCount = 1;
+    toTransfer.subresourceRange.layerCount = 1;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         0, 0, nullptr, 0, nullptr, 1, &toTransfer);
+
+    VkBufferImageCopy region = {};
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.layerCount = 1;
+    region.imageExtent.width = mextent.width;
+    region.imageExtent.height = mextent.height;
+    region.imageExtent.depth = 1;
+    vkCmdCopyImageToBuffer(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, mslots[slot].buffer, 1,
+                           &region);
+
+    VkBufferMemoryBarrier toHost = {};
+    toHost.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    toHost.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    toHost.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    toHost.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    toHost.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    toHost.buffer = mslots[slot].buffer;
+    toHost.size = VK_WHOLE_SIZE;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr,
+                         1, &toHost, 0, nullptr);
+
+    if (layout != VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL) {
+        VkImageMemoryBarrier restore = toTransfer;
+        restore.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        restore.dstAccessMask = 0;
+        restore.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        restore.newLayout = layout;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                             0, 0, nullptr, 0, nullptr, 1, &restore);
+    }
+}
+
+void FrameCapture::submitted(uint32_t slot, uint64_t serial) {
+    std::lock_guard<std::mutex> lock(mmutex);
+    mslots[slot].state = SLOT_IN_FLIGHT;
+    mslots[slot].serial = serial;
+}
+
+void FrameCapture::collect(uint64_t completedSerial) {
+    std::vector<uint32_t> ready;
+    {
+        std::lock_guard<std::mutex> lock(mmutex);
+        for (uint32_t i = 0; i < mslots.size(); i++) {
+            if (mslots[i].state == SLOT_IN_FLIGHT && mslots[i].serial <= completedSerial) {
+                mslots[i].state = SLOT_ENCODING;
+                ready.push_back(i);
+            }
+        }
+    }
+    for (uint32_t slot : ready) {
+        mjobs->submit([this, slot](unsigned) { encode(slot); }, mpendingJobs);
+    }
+}
+
+void FrameCapture::flush() {
+    collect(UINT64_MAX);
+    std::unique_lock<std::mutex> lock(mmutex);
+    mslotFreed.wait(lock, [this] {
+        for (const Slot& slot : mslots) {
+            if (slot.state == SLOT_ENCODING) {
+                return false;
+            }
+        }
+        return true;
+    });
+}
+
+/* Runs on an encoder thread; the slot's mapped memory is not touched by anyone else until it is freed */
+void FrameCapture::encode(uint32_t index) {
+    TRACE_SCOPE("encodeFrame", "capture");
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    Slot& slot = mslots[index];
+    const uint8_t* pixels = static_cast<const uint8_t*>(slot.allocation.mapped);
+    char path[64];
+    bool freeNow = true;
+    switch (msettings.format) {
+        case CAPTURE_PNG:
+            encodePng(pixels, slot.encoded);
+            snprintf(path, sizeof(path), "/frame_%06u.png", slot.frame);
+            writeFile(msettings.directory + path, slot.encoded.data(), slot.encoded.size());
+            break;
+        case CAPTURE_RAW:
+            /* Written straight from the mapped readback memory */
+            snprintf(path, sizeof(path), "/frame_%06u.raw", slot.frame);
+            writeFile(msettings.directory + path, pixels, static_cast<size_t>(mframeBytes));
+            break;
+        case CAPTURE_Y4M: {
+            convertY4m(pixels, slot.encoded);
+            std::lock_guard<std::mutex> lock(my4mMutex);
+            mpendingY4m[slot.frame] = index;
+            writePendingY4m();
+            freeNow = false;
+            break;
+        }
+    }
+
+    mencodeMicroseconds += static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+    if (freeNow) {
+        freeSlot(index);
+    }
+}
+
+/* RGB with the Sub filter on every row, deflated at the fastest level */
+void FrameCapture::encodePng(const uint8_t* pixels, std::vector<uint8_t>& out) const {
+    static thread_local std::vector<uint8_t> filtered;
+    static thread_local std::vector<uint8_t> compressed;
+
+    uint32_t width = mextent.width;
+    uint32_t height = mextent.height;
+    size_t rowBytes = static_cast<size_t>(width) * 3 + 1;
+    filtered.resize(rowBytes * height);
+    int red = mbgra ? 2 : 0;
+    int blue = mbgra ? 0 : 2;
+    for (uint32_t y = 0; y < height; y++) {
+        const uint8_t* source = pixels + static_cast<size_t>(y) * width * 4;
+        uint8_t* row = &filtered[y * rowBytes];
+        row[0] = 1;
+        uint8_t previous[3] = {0, 0, 0};
+        for (uint32_t x = 0; x < width; x++) {
+            uint8_t rgb[3] = {source[x * 4 + red], source[x * 4 + 1], source[x * 4 + blue]};
+            for (int c = 0; c < 3; c++) {
+                row[1 + x * 3 + c] = static_cast<uint8_t>(rgb[c] - previous[c]);
+                previous[c] = rgb[c];
+            }
+        }
+    }
+
+    uLongf compressedSize = compressBound(static_cast<uLong>(filtered.size()));
+    compressed.resize(compressedSize);
+    compress2(compressed.data(), &compressedSize, filtered.data(), static_cast<uLong>(filtered.size()),
+              Z_BEST_SPEED);
+
+    out.clear();
+    out.insert(out.end(), PNG_SIGNATURE, PNG_SIGNATURE + sizeof(PNG_SIGNATURE));
+
+    size_t chunk = out.size();
+    out.resize(out.size() + 8);
+    appendBigEndian(out, width);
+    appendBigEndian(out, height);
+    /* 8 bits per channel, colour type 2 (RGB), deflate, adaptive filtering, no interlace */
+    const uint8_t header[5] = {8, 2, 0, 0, 0};
+    out.insert(out.end(), header, header + sizeof(header));
+    finishPngChunk(out, chunk, "IHDR");
+
+    chunk = out.size();
+    out.resize(out.size() + 8);
+    out.insert(out.end(), compressed.data(), compressed.data() + compressedSize);
+    finishPngChunk(out, chunk, "IDAT");
+
+    chunk = out.size();
+    out.resize(out.size() + 8);
+    finishPngChunk(out, chunk, "IEND");
+}
+
+/* 4:2:0, each chroma sample averaged over a 2x2 block, clamped at odd edges */
+void FrameCapture::convertY4m(const uint8_t* pixels, std::vector<uint8_t>& out) const {
+    uint32_t width = mextent.width;
+    uint32_t height = mextent.height;
+    uint32_t chromaWidth = (width + 1) / 2;
+    uint32_t chromaHeight = (height + 1) / 2;
+    size_t lumaBytes = static_cast<size_t>(width) * height;
+    size_t chromaBytes = static_cast<size_t>(chromaWidth) * chromaHeight;
+    out.resize(lumaBytes + 2 * chromaBytes);
+    uint8_t* luma = out.data();
+    uint8_t* cb = luma + lumaBytes;
+    uint8_t* cr = cb + chromaBytes;
+    int red = mbgra ? 2 : 0;
+    int blue = mbgra ? 0 : 2;
+
+    for (uint32_t y = 0; y < height; y++) {
+        const uint8_t* row = pixels + static_cast<size_t>(y) * width * 4;
+        for (uint32_t x = 0; x < width; x++) {
+            luma[static_cast<size_t>(y) * width + x] = lumaOf(row[x * 4 + red], row[x * 4 + 1], row[x * 4 + blue]);
+        }
+    }
+    for (uint32_t cy = 0; cy < chromaHeight; cy++) {
+        for (uint32_t cx = 0; cx < chromaWidth; cx++) {
+            int r = 0, g = 0, b = 0;
+            for (uint32_t dy = 0; dy < 2; dy++) {
+                for (uint32_t dx = 0; dx < 2; dx++) {
+                    uint32_t x = std::min(cx * 2 + dx, width - 1);
+                    uint32_t y = std::min(cy * 2 + dy, height - 1);
+                    const uint8_t* pixel = pixels + (static_cast<size_t>(y) * width + x) * 4;
+                    r += pixel[red];
+                    g += pixel[1];
+                    b += pixel[blue];
+                }
+            }
+            r = (r + 2) / 4;
+            g = (g + 2) / 4;
+            b = (b + 2) / 4;
+            cb[static_cast<size_t>(cy) * chromaWidth + cx] =
+                static_cast<uint8_t>(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+            cr[static_cast<size_t>(cy) * chromaWidth + cx] =
+                static_cast<uint8_t>(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+        }
+    }
+}
+
+void FrameCapture::openY4mStream() {
+    char name[64];
+    if (my4mSegment == 0) {
+        snprintf(name, sizeof(name), "/capture.y4m");
+    } else {
+        snprintf(name, sizeof(name), "/capture_%u.y4m", my4mSegment);
+    }
+    std::string path = msettings.directory + name;
+    my4m = fopen(path.c_str(), "wb");
+    if (my4m == nullptr) {
+        throw std::runtime_error("Failed to create " + path);
+    }
+    fprintf(my4m, "YUV4MPEG2 W%u H%u F%u:1 Ip A1:1 C420jpeg\n", mextent.width, mextent.height,
+            msettings.framesPerSecond);
+}
+
+/* With my4mMutex held: appends every converted frame that is next in order */
+void FrameCapture::writePendingY4m() {
+    static const char FRAME_HEADER[] = "FRAME\n";
+    for (auto next = mpendingY4m.find(mnextY4mFrame); next != mpendingY4m.end();
+         next = mpendingY4m.find(mnextY4mFrame)) {
+        uint32_t index = next->second;
+        const std::vector<uint8_t>& frame = mslots[index].encoded;
+        if (fwrite(FRAME_HEADER, 1, sizeof(FRAME_HEADER) - 1, my4m) != sizeof(FRAME_HEADER) - 1 ||
+            fwrite(frame.data(), 1, frame.size(), my4m) != frame.size()) {
+            if (mwriteFailures++ == 0) {
+                printf("Failed to write to the Y4M capture stream \n");
+            }
+        } else {
+            mframesWritten++;
+            mbytesWritten += frame.size() + sizeof(FRAME_HEADER) - 1;
+        }
+        mpendingY4m.erase(next);
+        mnextY4mFrame++;
+        freeSlot(index);
+    }
+}
+
+bool FrameCapture::writeFile(const std::string& path, const void* data, size_t size) {
+    FILE* file = fopen(path.c_str(), "wb");
+    bool written = file != nullptr && fwrite(data, 1, size, file) == size;
+    if (file != nullptr && fclose(file) != 0) {
+        written = false;
+    }
+    if (!written) {
+        if (mwriteFailures++ == 0) {
+            printf("Failed to write capture %s \n", path.c_str());
+        }
+        return false;
+    }
+    mframesWritten++;
+    mbytesWritten += size;
+    return true;
+}
+
+void FrameCapture::freeSlot(uint32_t index) {
+    {
+        std::lock_guard<std::mutex> lock(mmutex);
+        mslots[index].state = SLOT_FREE;
+        mlastWrite = std::chrono::steady_clock::now();
+    }
+    mslotFreed.notify_all();
+}
+
+void FrameCapture::printReport() const {
+    double seconds = std::chrono::duration<double>(mlastWrite - mfirstAcquire).count();
+    uint32_t frames = mframesWritten.load();
+    if (frames == 0 || seconds <= 0.0) {
+        printf("Capture: no frames written \n");
+        return;
+    }
+    printf("Capture: %u frames, %.1f frames/s, %.1f MB/s, %.2f ms encode per frame on %u threads \n", frames,
+           frames / seconds, mbytesWritten.load() / seconds / (1024.0 * 1024.0),
+           mencodeMicroseconds.load() / 1000.0 / frames, msettings.encoderThreads);
+    printf("Capture: render thread waited for a free slot %u times, %.1f ms in total \n", mstalls, mstallMs);
+    if (mwriteFailures.load() > 0) {
+        printf("Capture: %u frames failed to write \n", mwriteFailures.load());
+    }
+}
@@ -0,0 +1,142 @@
+#ifndef VULKAN_BASIC_SAMPLES_FRAMECAPTURE_H
+#define VULKAN_BASIC_SAMPLES_FRAMECAPTURE_H
+
+#include <vulkan/vulkan.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "GpuAllocator.h"
+
+class JobSystem;
+
+enum CaptureFormat {
+    /* One zlib-compressed RGB PNG per frame */
+    CAPTURE_PNG,
+    /* One file per frame, pixels tightly packed in the image's own format */
+    CAPTURE_RAW,
+    /* A single YUV4MPEG2 4:2:0 stream, frames in order */
+    CAPTURE_Y4M
+};
+
+/* Returns false for an unknown name */
+bool parseCaptureFormat(const std::string& name, CaptureFormat& format);
+
+/*
+ * Copies rendered frames to disk without stalling the render thread on
+ * encoding.
+ *
+ * Each frame is copied into a slot of a ring of persistently mapped,
+ * host-visible readback buffers (host-cached where the device offers it).
+ * Once the frame's fence has passed, collect() hands the slot to an encoder
+ * thread, which reads the mapped memory directly and frees the slot when the
+ * file is written. When every slot is still being encoded, acquire() blocks
+ * until one frees. This backpressure keeps memory bounded and never drops a
+ * frame. Y4M frames are converted in parallel, but each encoder appends
+ * whichever frames are next in order, so the stream stays sequential
+ * without any encoder waiting on another.
+ */
+class FrameCapture {
+public:
+    struct Settings {
+        std::string directory;
+        CaptureFormat format = CAPTURE_PNG;
+        /* Readback slots; raised to at least framesInFlight + 1 */
+        uint32_t ringSize = 0;
+        unsigned encoderThreads = 0;
+        uint32_t framesPerSecond = 60;
+    };
+
+    FrameCapture();
+    ~FrameCapture();
+
+    /* Throws unless format is an 8-bit RGBA or BGRA format */
+    void init(GpuAllocator& allocator, const Settings& settings, uint32_t framesInFlight, VkFormat format,
+              VkExtent2D extent);
+    /* Frames must have completed on the GPU; waits for the encoders */
+    void destroy(GpuAllocator& allocator);
+    /* After a swapchain resize or format change, with the device idle; Y4M continues in a new file */
+    void resize(GpuAllocator& allocator, VkExtent2D extent, VkFormat format);
+
+    /* Blocks while every free-able slot is still encoding; the slot is recorded into this frame */
+    uint32_t acquire();
+    /* Outside a render pass; the image is in layout before and after */
+    void recordCopy(VkCommandBuffer commandBuffer, VkImage image, VkImageLayout layout, uint32_t slot) const;
+    void submitted(uint32_t slot, uint64_t serial);
+    /* Hands every slot whose submission has completed to the encoders */
+    void collect(uint64_t completedSerial);
+    /* With the device idle: encodes everything outstanding and waits for it */
+    void flush();
+
+    void printReport() const;
+
+private:
+    enum SlotState {
+        SLOT_FREE,
+        SLOT_RECORDING,
+        SLOT_IN_FLIGHT,
+        SLOT_ENCODING
+    };
+
+    struct Slot {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        GpuAllocation allocation;
+        SlotState state = SLOT_FREE;
+        uint64_t serial = 0;
+        uint32_t frame = 0;
+        /* Encoded file or converted Y4M frame, reused between frames */
+        std::vector<uint8_t> encoded;
+    };
+
+    void createSlots(GpuAllocator& allocator);
+    void destroySlots(GpuAllocator& allocator);
+    void encode(uint32_t slot);
+    void encodePng(const uint8_t* pixels, std::vector<uint8_t>& out) const;
+    void convertY4m(const uint8_t* pixels, std::vector<uint8_t>& out) const;
+    bool writeFile(const std::string& path, const void* data, size_t size);
+    void openY4mStream();
+    void writePendingY4m();
+    void freeSlot(uint32_t slot);
+
+    Settings msettings;
+    VkFormat mformat = VK_FORMAT_UNDEFINED;
+    bool mbgra = false;
+    VkExtent2D mextent = {};
+    VkDeviceSize mframeBytes = 0;
+    uint32_t mframesInFlight = 0;
+
+    std::unique_ptr<JobSystem> mjobs;
+    std::atomic<size_t> mpendingJobs;
+
+    std::mutex mmutex;
+    std::condition_variable mslotFreed;
+    std::vector<Slot> mslots;
+    uint32_t mnextFrame = 0;
+
+    /* Y4M: converted frames waiting for their turn, by frame number; taken before mmutex */
+    std::mutex my4mMutex;
+    FILE* my4m = nullptr;
+    uint32_t my4mSegment = 0;
+    uint32_t mnextY4mFrame = 0;
+    std::map<uint32_t, uint32_t> mpendingY4m;
+
+    /* Statistics */
+    std::chrono::steady_clock::time_point mfirstAcquire;
+    std::chrono::steady_clock::time_point mlastWrite;
+    uint32_t mstalls = 0;
+    double mstallMs = 0.0;
+    std::atomic<uint32_t> mframesWritten;
+    std::atomic<uint32_t> mwriteFailures;
+    std::atomic<uint64_t> mbytesWritten;
+    std::atomic<uint64_t> mencodeMicroseconds;
+};
+
+#endif //VULKAN_BASIC_SAMPLES_FRAMECAPTURE_H
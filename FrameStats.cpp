@@ -0,0 +1,87 @@
+#include "FrameStats.h"
+
+#include <algorithm>
+#include <cstdio>
+
+FrameStats::FrameStats(size_t capacity) : msamples(capacity) {
+}
+
+void FrameStats::record(const FrameSample& sample) {
+    msamples[mnext] = sample;
+    mnext = (mnext + 1) % msamples.size();
+    mtotalFrames++;
+}
+
+double FrameStats::percentile(std::vector<double> values, double p) {
+    if (values.empty()) {
+        return 0.0;
+    }
+    size_t index = static_cast<size_t>(p * (values.size() - 1) + 0.5);
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index];
+}
+
+void FrameStats::report() const {
+    size_t count = static_cast<size_t>(std::min<uint64_t>(mtotalFrames, msamples.size()));
+    if (count == 0) {
+        printf("No frames rendered \n");
+        return;
+    }
+
+    std::vector<double> frame, cpu, fence, present, input;
+    frame.reserve(count);
+    cpu.reserve(count);
+    fence.reserve(count);
+    present.reserve(count);
+
+    double totalFrameMs = 0.0;
+    for (size_t i = 0; i < count; i++) {
+        const FrameSample& sample = msamples[i];
+        frame.push_back(sample.frameMs);
+        cpu.push_back(sample.cpuMs);
+        fence.push_back(sample.fenceWaitMs);
+        present.push_back(sample.presentMs);
+        if (sample.inputToPresentMs >= 0.0) {
+            input.push_back(sample.inputToPresentMs);
+        }
+        totalFrameMs += sample.frameMs;
+    }
+
+    printf("Frame stats over last %zu of %llu frames (%.1f fps) \n", count,
+           (unsigned long long) mtotalFrames, totalFrameMs > 0.0 ? 1000.0 * count / totalFrameMs : 0.0);
+    printf("  %-12s %9s %9s \n", "", "p50 ms", "p99 ms");
+    printf("  %-12s %9.3f %9.3f \n", "frame", percentile(frame, 0.50), percentile(frame, 0.99));
+    printf("  %-12s %9.3f %9.3f \n", "cpu", percentile(cpu, 0.50), percentile(cpu, 0.99));
+    printf("  %-12s %9.3f %9.3f \n", "fence wait", percentile(fence, 0.50), percentile(fence, 0.99));
+    printf("  %-12s %9.3f %9.3f \n", "present", percentile(present, 0.50), percentile(present, 0.99));
+    if (!input.empty()) {
+        printf("  %-12s %9.3f %9.3f   (%zu input events) \n", "input->present", percentile(input, 0.50),
+               percentile(input, 0.99), input.size());
+    }
+}
+
+FrameSummary FrameStats::summary() const {
+    FrameSummary summary;
+    summary.frames = static_cast<size_t>(std::min<uint64_t>(mtotalFrames, msamples.size()));
+    if (summary.frames == 0) {
+        return summary;
+    }
+
+    std::vector<double> frame, cpu;
+    frame.reserve(summary.frames);
+    cpu.reserve(summary.frames);
+    double totalFrameMs = 0.0;
+    for (size_t i = 0; i < summary.frames; i++) {
+        frame.push_back(msamples[i].frameMs);
+        cpu.push_back(msamples[i].cpuMs);
+        totalFrameMs += msamples[i].frameMs;
+    }
+    summary.meanFrameMs = totalFrameMs / summary.frames;
+    summary.frameP50Ms = percentile(frame, 0.50);
+    summary.frameP95Ms = percentile(frame, 0.95);
+    summary.frameP99Ms = percentile(frame, 0.99);
+    summary.cpuP50Ms = percentile(cpu, 0.50);
+    summary.cpuP95Ms = percentile(cpu, 0.95);
+    summary.cpuP99Ms = percentile(cpu, 0.99);
+    return summary;
+}
@@ -0,0 +1,52 @@
+#ifndef VULKAN_BASIC_SAMPLES_FRAMESTATS_H
+#define VULKAN_BASIC_SAMPLES_FRAMESTATS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/* Per-frame timings in milliseconds */
+struct FrameSample {
+    double frameMs = 0.0;     // start of this frame to start of the next
+    double cpuMs = 0.0;       // recording and submission
+    double fenceWaitMs = 0.0; // blocked on the frame-in-flight fence
+    double presentMs = 0.0;   // inside vkQueuePresentKHR
+    double inputToPresentMs = -1.0; // oldest input sampled by this frame to present, <0 without input
+};
+
+/* Percentiles over the samples still in the ring, in milliseconds */
+struct FrameSummary {
+    size_t frames = 0;
+    double meanFrameMs = 0.0;
+    double frameP50Ms = 0.0;
+    double frameP95Ms = 0.0;
+    double frameP99Ms = 0.0;
+    double cpuP50Ms = 0.0;
+    double cpuP95Ms = 0.0;
+    double cpuP99Ms = 0.0;
+};
+
+/*
+ * Fixed-size ring of the most recent frame samples. Recording never
+ * allocates, so it is safe to call on every frame; percentiles are only
+ * computed in report().
+ */
+class FrameStats {
+public:
+    explicit FrameStats(size_t capacity = 4096);
+
+    void record(const FrameSample& sample);
+    void report() const;
+    FrameSummary summary() const;
+
+    uint64_t frameCount() const { return mtotalFrames; }
+
+private:
+    static double percentile(std::vector<double> values, double p);
+
+    std::vector<FrameSample> msamples;
+    size_t mnext = 0;
+    uint64_t mtotalFrames = 0;
+};
+
+#endif //VULKAN_BASIC_SAMPLES_FRAMESTATS_H
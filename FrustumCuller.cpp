@@ -0,0 +1,146 @@
+#include "FrustumCuller.h"
+
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define FRUSTUM_CULLER_SSE 1
+#else
+#define FRUSTUM_CULLER_SSE 0
+#endif
+
+Mat4 Mat4::identity() {
+    Mat4 result = {};
+    result.m[0] = result.m[5] = result.m[10] = result.m[15] = 1.0f;
+    return result;
+}
+
+Mat4 Mat4::perspective(float fovY, float aspect, float zNear, float zFar) {
+    float focal = 1.0f / std::tan(fovY * 0.5f);
+    Mat4 result = {};
+    result.m[0] = focal / aspect;
+    result.m[5] = focal;
+    result.m[10] = zFar / (zNear - zFar);
+    result.m[11] = -1.0f;
+    result.m[14] = zNear * zFar / (zNear - zFar);
+    return result;
+}
+
+Mat4 Mat4::rotationY(float radians) {
+    Mat4 result = identity();
+    float c = std::cos(radians);
+    float s = std::sin(radians);
+    result.m[0] = c;
+    result.m[2] = -s;
+    result.m[8] = s;
+    result.m[10] = c;
+    return result;
+}
+
+Mat4 Mat4::operator*(const Mat4& other) const {
+    Mat4 result;
+    for (int column = 0; column < 4; column++) {
+        for (int row = 0; row < 4; row++) {
+            float sum = 0.0f;
+            for (int k = 0; k < 4; k++) {
+                sum += at(row, k) * other.at(k, column);
+            }
+            result.m[column * 4 + row] = sum;
+        }
+    }
+    return result;
+}
+
+/*
+ * Gribb/Hartmann plane extraction: left/right are w +- x, bottom/top w +- y,
+ * near is z alone (clip depth starts at 0) and far is w - z.
+ */
+Frustum Frustum::fromViewProjection(const Mat4& viewProjection) {
+    Frustum frustum;
+    for (int p = 0; p < 6; p++) {
+        int axis = p / 2;
+        float sign = (p % 2 == 0) ? 1.0f : -1.0f;
+        for (int c = 0; c < 4; c++) {
+            float w = (p == 4) ? 0.0f : viewProjection.at(3, c);
+            frustum.planes[p][c] = w + sign * viewProjection.at(axis, c);
+        }
+        float length = std::sqrt(frustum.planes[p][0] * frustum.planes[p][0] +
+                                 frustum.planes[p][1] * frustum.planes[p][1] +
+                                 frustum.planes[p][2] * frustum.planes[p][2]);
+        for (int c = 0; c < 4; c++) {
+            frustum.planes[p][c] /= length;
+        }
+    }
+    return frustum;
+}
+
+float sphereMargin(const Frustum& frustum, float x, float y, float z, float radius) {
+    float margin = INFINITY;
+    for (int p = 0; p < 6; p++) {
+        const float* plane = frustum.planes[p];
+        float distance = plane[0] * x + plane[1] * y + plane[2] * z + plane[3];
+        margin = std::fmin(margin, distance + radius);
+    }
+    return margin;
+}
+
+size_t cullSpheresScalar(const Frustum& frustum, const SphereStreams& spheres, uint32_t* visible) {
+    size_t visibleCount = 0;
+    for (size_t i = 0; i < spheres.count; i++) {
+        float negRadius = -spheres.radius[i];
+        bool inside = true;
+        for (int p = 0; p < 6; p++) {
+            const float* plane = frustum.planes[p];
+            float distance = plane[0] * spheres.x[i] + plane[1] * spheres.y[i] + plane[2] * spheres.z[i] + plane[3];
+            inside = inside && distance >= negRadius;
+        }
+        visible[visibleCount] = static_cast<uint32_t>(i);
+        visibleCount += inside ? 1 : 0;
+    }
+    return visibleCount;
+}
+
+size_t cullSpheresSimd(const Frustum& frustum, const SphereStreams& spheres, uint32_t* visible) {
+#if FRUSTUM_CULLER_SSE
+    __m128 planes[6][4];
+    for (int p = 0; p < 6; p++) {
+        for (int c = 0; c < 4; c++) {
+            planes[p][c] = _mm_set1_ps(frustum.planes[p][c]);
+        }
+    }
+
+    size_t visibleCount = 0;
+    size_t i = 0;
+    for (; i + 4 <= spheres.count; i += 4) {
+        __m128 x = _mm_loadu_ps(spheres.x + i);
+        __m128 y = _mm_loadu_ps(spheres.y + i);
+        __m128 z = _mm_loadu_ps(spheres.z + i);
+        __m128 negRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(spheres.radius + i));
+
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (int p = 0; p < 6; p++) {
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(planes[p][0], x),
+                                                               _mm_mul_ps(planes[p][1], y)),
+                                                    _mm_mul_ps(planes[p][2], z)),
+                                         planes[p][3]);
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negRadius));
+        }
+
+        /* Branchless compaction: always store, only advance for set lanes */
+        int mask = _mm_movemask_ps(inside);
+        for (int lane = 0; lane < 4; lane++) {
+            visible[visibleCount] = static_cast<uint32_t>(i + lane);
+            visibleCount += (mask >> lane) & 1;
+        }
+    }
+
+    SphereStreams tail = {spheres.x + i, spheres.y + i, spheres.z + i, spheres.radius + i, spheres.count - i};
+    size_t tailCount = cullSpheresScalar(frustum, tail, visible + visibleCount);
+    for (size_t t = 0; t < tailCount; t++) {
+        visible[visibleCount + t] += static_cast<uint32_t>(i);
+    }
+    return visibleCount + tailCount;
+#else
+    return cullSpheresScalar(frustum, spheres, visible);
+#endif
+}
@@ -0,0 +1,53 @@
+#ifndef VULKAN_BASIC_SAMPLES_FRUSTUMCULLER_H
+#define VULKAN_BASIC_SAMPLES_FRUSTUMCULLER_H
+
+#include <cstddef>
+#include <cstdint>
+
+/* Column-major 4x4 matrix, as GLSL expects it in a push constant block */
+struct Mat4 {
+    float m[16];
+
+    static Mat4 identity();
+    /* Vulkan clip space: depth 0..1, no Y flip */
+    static Mat4 perspective(float fovY, float aspect, float zNear, float zFar);
+    static Mat4 rotationY(float radians);
+
+    Mat4 operator*(const Mat4& other) const;
+    float at(int row, int column) const { return m[column * 4 + row]; }
+};
+
+/*
+ * Six inward-facing planes (a, b, c, d) with normalised (a, b, c), so
+ * a*x + b*y + c*z + d is the signed distance of a point from the plane.
+ */
+struct Frustum {
+    float planes[6][4];
+
+    static Frustum fromViewProjection(const Mat4& viewProjection);
+};
+
+/* Bounding spheres as separate float streams, one element per instance */
+struct SphereStreams {
+    const float* x;
+    const float* y;
+    const float* z;
+    const float* radius;
+    size_t count;
+};
+
+/*
+ * CPU reference for the culling compute shader: writes the indices of the
+ * spheres that touch the frustum to visible, in ascending order, and
+ * returns how many there are. Both versions evaluate the plane distances in
+ * the same order so they agree bit for bit; the SIMD version tests four
+ * spheres per iteration with SSE and falls back to the scalar loop on
+ * other targets.
+ */
+size_t cullSpheresScalar(const Frustum& frustum, const SphereStreams& spheres, uint32_t* visible);
+size_t cullSpheresSimd(const Frustum& frustum, const SphereStreams& spheres, uint32_t* visible);
+
+/* Smallest plane distance plus radius; a sphere is visible when this is not negative */
+float sphereMargin(const Frustum& frustum, float x, float y, float z, float radius);
+
+#endif //VULKAN_BASIC_SAMPLES_FRUSTUMCULLER_H
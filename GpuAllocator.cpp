@@ -0,0 +1,285 @@
+#include "GpuAllocator.h"
+#include "HostAllocator.h"
+#include "Log.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+/* Default size of one VkDeviceMemory block, shrunk for small heaps */
+static const VkDeviceSize DEFAULT_BLOCK_SIZE = 64ull * 1024 * 1024;
+static const VkDeviceSize MIN_SUBALLOCATION = 256;
+
+static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+void GpuAllocator::init(VkPhysicalDevice physicalDevice, VkDevice device) {
+    mdevice = device;
+    vkGetPhysicalDeviceProperties(physicalDevice, &mproperties);
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &mmemoryProperties);
+    mpools.clear();
+    mpools.resize(mmemoryProperties.memoryTypeCount * 2);
+}
+
+void GpuAllocator::destroy() {
+    std::lock_guard<std::mutex> lock(mmutex);
+    for (auto& p : mpools) {
+        for (auto& block : p.blocks) {
+            if (!block->suballocator->empty()) {
+                LOG_WARNING(LOG_MEMORY, "Leaked %u allocations in a device memory block",
+                            block->suballocator->stats().allocationCount);
+            }
+            freeDeviceMemory(block->memory, block->suballocator->stats().capacity, block->mapped != nullptr);
+        }
+        p.blocks.clear();
+    }
+    if (mdedicatedCount > 0) {
+        LOG_WARNING(LOG_MEMORY, "Leaked %u dedicated allocations", mdedicatedCount);
+    }
+}
+
+uint32_t GpuAllocator::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags required,
+                                      VkMemoryPropertyFlags preferred) const {
+    int32_t fallback = -1;
+    for (uint32_t i = 0; i < mmemoryProperties.memoryTypeCount; i++) {
+        VkMemoryPropertyFlags flags = mmemoryProperties.memoryTypes[i].propertyFlags;
+        if (!(typeFilter & (1u << i)) || (flags & required) != required) {
+            continue;
+        }
+        if ((flags & preferred) == preferred) {
+            return i;
+        }
+        if (fallback < 0) {
+            fallback = static_cast<int32_t>(i);
+        }
+    }
+
+    if (fallback < 0) {
+        throw std::runtime_error("Failed to find suitable memory type");
+    }
+    return static_cast<uint32_t>(fallback);
+}
+
+VkDeviceSize GpuAllocator::blockSizeFor(uint32_t memoryType) const {
+    VkDeviceSize heapSize = mmemoryProperties.memoryHeaps[mmemoryProperties.memoryTypes[memoryType].heapIndex].size;
+    VkDeviceSize blockSize = DEFAULT_BLOCK_SIZE;
+    while (blockSize > MIN_SUBALLOCATION && blockSize > heapSize / 8) {
+        blockSize /= 2;
+    }
+    return blockSize;
+}
+
+VkDeviceMemory GpuAllocator::allocateDeviceMemory(VkDeviceSize size, uint32_t memoryType, void** mapped) {
+    if (mdeviceMemoryCount >= mproperties.limits.maxMemoryAllocationCount) {
+        throw std::runtime_error("maxMemoryAllocationCount exceeded");
+    }
+
+    VkMemoryAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = size;
+    allocInfo.memoryTypeIndex = memoryType;
+
+    VkDeviceMemory memory;
+    if (vkAllocateMemory(mdevice, &allocInfo, HostAllocator::callbacks(), &memory) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate device memory");
+    }
+    mdeviceMemoryCount++;
+    mdeviceBytes += size;
+    mpeakDeviceBytes = std::max(mpeakDeviceBytes, mdeviceBytes);
+
+    *mapped = nullptr;
+    if (mmemoryProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+        if (vkMapMemory(mdevice, memory, 0, VK_WHOLE_SIZE, 0, mapped) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to map device memory");
+        }
+    }
+    return memory;
+}
+
+void GpuAllocator::freeDeviceMemory(VkDeviceMemory memory, VkDeviceSize size, bool mapped) {
+    if (mapped) {
+        vkUnmapMemory(mdevice, memory);
+    }
+    vkFreeMemory(mdevice, memory, HostAllocator::callbacks());
+    mdeviceMemoryCount--;
+    mdeviceBytes -= size;
+}
+
+GpuAllocation GpuAllocator::allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags required,
+                                     ResourceKind kind, VkMemoryPropertyFlags preferred) {
+    GpuAllocation allocation;
+    allocation.memoryType = findMemoryType(requirements.memoryTypeBits, required, preferred);
+    allocation.kind = kind;
+    allocation.size = requirements.size;
+
+    std::lock_guard<std::mutex> lock(mmutex);
+
+    VkDeviceSize blockSize = blockSizeFor(allocation.memoryType);
+    if (std::max(requirements.size, requirements.alignment) >= blockSize / 2) {
+        allocation.memory = allocateDeviceMemory(requirements.size, allocation.memoryType, &allocation.mapped);
+        mdedicatedCount++;
+        mdedicatedBytes += requirements.size;
+        return allocation;
+    }
+
+    Pool& p = pool(allocation.memoryType, kind);
+    for (size_t i = 0; i <= p.blocks.size(); i++) {
+        if (i == p.blocks.size()) {
+            std::unique_ptr<Block> block(new Block());
+            block->memory = allocateDeviceMemory(blockSize, allocation.memoryType, &block->mapped);
+            block->suballocator.reset(new BuddyAllocator(blockSize, MIN_SUBALLOCATION));
+            p.blocks.push_back(std::move(block));
+        }
+
+        Block& block = *p.blocks[i];
+        uint64_t offset = block.suballocator->allocate(requirements.size, requirements.alignment);
+        if (offset == BuddyAllocator::INVALID_OFFSET) {
+            continue;
+        }
+
+        allocation.memory = block.memory;
+        allocation.offset = offset;
+        allocation.blockIndex = static_cast<int32_t>(i);
+        if (block.mapped != nullptr) {
+            allocation.mapped = static_cast<char*>(block.mapped) + offset;
+        }
+        return allocation;
+    }
+
+    throw std::runtime_error("Failed to sub-allocate device memory");
+}
+
+void GpuAllocator::free(GpuAllocation& allocation) {
+    if (allocation.memory == VK_NULL_HANDLE) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mmutex);
+    if (allocation.blockIndex < 0) {
+        freeDeviceMemory(allocation.memory, allocation.size, allocation.mapped != nullptr);
+        mdedicatedCount--;
+        mdedicatedBytes -= allocation.size;
+    } else {
+        pool(allocation.memoryType, allocation.kind).blocks[allocation.blockIndex]->suballocator->free(allocation.offset);
+    }
+    allocation = GpuAllocation();
+}
+
+void GpuAllocator::createBuffer(const VkBufferCreateInfo& createInfo, VkMemoryPropertyFlags properties,
+                                VkBuffer& buffer, GpuAllocation& allocation, VkMemoryPropertyFlags preferred) {
+    if (vkCreateBuffer(mdevice, &createInfo, HostAllocator::callbacks(), &buffer) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create buffer");
+    }
+
+    VkMemoryRequirements requirements;
+    vkGetBufferMemoryRequirements(mdevice, buffer, &requirements);
+
+    allocation = allocate(requirements, properties, ResourceKind::Linear, preferred);
+    vkBindBufferMemory(mdevice, buffer, allocation.memory, allocation.offset);
+}
+
+void GpuAllocator::destroyBuffer(VkBuffer& buffer, GpuAllocation& allocation) {
+    vkDestroyBuffer(mdevice, buffer, HostAllocator::callbacks());
+    buffer = VK_NULL_HANDLE;
+    free(allocation);
+}
+
+void GpuAllocator::createImage(const VkImageCreateInfo& createInfo, VkMemoryPropertyFlags properties,
+                               VkImage& image, GpuAllocation& allocation) {
+    if (vkCreateImage(mdevice, &createInfo, HostAllocator::callbacks(), &image) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create image");
+    }
+
+    VkMemoryRequirements requirements;
+    vkGetImageMemoryRequirements(mdevice, image, &requirements);
+
+    ResourceKind kind = createInfo.tiling == VK_IMAGE_TILING_OPTIMAL ? ResourceKind::Optimal : ResourceKind::Linear;
+    allocation = allocate(requirements, properties, kind);
+    vkBindImageMemory(mdevice, image, allocation.memory, allocation.offset);
+}
+
+void GpuAllocator::destroyImage(VkImage& image, GpuAllocation& allocation) {
+    vkDestroyImage(mdevice, image, HostAllocator::callbacks());
+    image = VK_NULL_HANDLE;
+    free(allocation);
+}
+
+VkDeviceSize GpuAllocator::peakDeviceBytes() const {
+    std::lock_guard<std::mutex> lock(mmutex);
+    return mpeakDeviceBytes;
+}
+
+void GpuAllocator::printStats() const {
+    std::lock_guard<std::mutex> lock(mmutex);
+
+    printf("GPU memory: %u VkDeviceMemory objects (limit %u), %u dedicated totalling %llu KiB \n",
+           mdeviceMemoryCount, mproperties.limits.maxMemoryAllocationCount, mdedicatedCount,
+           (unsigned long long) (mdedicatedBytes / 1024));
+
+    for (uint32_t i = 0; i < mpools.size(); i++) {
+        const Pool& p = mpools[i];
+        if (p.blocks.empty()) {
+            continue;
+        }
+
+        uint64_t capacity = 0, used = 0, requested = 0, freeBytes = 0, largestFree = 0;
+        uint32_t allocations = 0;
+        for (const auto& block : p.blocks) {
+            BuddyStats stats = block->suballocator->stats();
+            capacity += stats.capacity;
+            used += stats.usedBytes;
+            requested += stats.requestedBytes;
+            freeBytes += stats.capacity - stats.usedBytes;
+            largestFree = std::max(largestFree, stats.largestFreeBlock);
+            allocations += stats.allocationCount;
+        }
+
+        printf("  type %2u %-7s %zu blocks, %u allocations, %llu/%llu KiB used (%llu KiB requested), "
+               "fragmentation %.2f \n",
+               i / 2, (i % 2) ? "optimal" : "linear", p.blocks.size(), allocations,
+               (unsigned long long) (used / 1024), (unsigned long long) (capacity / 1024),
+               (unsigned long long) (requested / 1024),
+               freeBytes == 0 ? 0.0 : 1.0 - double(largestFree) / double(freeBytes));
+    }
+}
+
+void FrameLinearAllocator::create(GpuAllocator& allocator, VkDeviceSize regionSize, uint32_t frameCount,
+                                  VkBufferUsageFlags usage) {
+    const VkPhysicalDeviceLimits& limits = allocator.deviceProperties().limits;
+    malignment = std::max<VkDeviceSize>(limits.minUniformBufferOffsetAlignment, limits.minStorageBufferOffsetAlignment);
+    malignment = std::max<VkDeviceSize>(malignment, 1);
+    mregionSize = alignUp(regionSize, malignment);
+
+    VkBufferCreateInfo bufferInfo = {};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = mregionSize * frameCount;
+    bufferInfo.usage = usage;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    allocator.createBuffer(bufferInfo, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                           mbuffer, mallocation);
+    beginFrame(0);
+}
+
+void FrameLinearAllocator::destroy(GpuAllocator& allocator) {
+    if (mbuffer != VK_NULL_HANDLE) {
+        allocator.destroyBuffer(mbuffer, mallocation);
+    }
+}
+
+void FrameLinearAllocator::beginFrame(uint32_t frameIndex) {
+    mregionStart = mregionSize * frameIndex;
+    mhead = 0;
+}
+
+void* FrameLinearAllocator::allocate(VkDeviceSize size, VkDeviceSize& offset) {
+    VkDeviceSize start = alignUp(mhead, malignment);
+    if (start + size > mregionSize) {
+        return nullptr;
+    }
+
+    mhead = start + size;
+    mhighWaterMark = std::max(mhighWaterMark, mhead);
+    offset = mregionStart + start;
+    return static_cast<char*>(mallocation.mapped) + offset;
+}
@@ -0,0 +1,128 @@
+#ifndef VULKAN_BASIC_SAMPLES_GPUALLOCATOR_H
+#define VULKAN_BASIC_SAMPLES_GPUALLOCATOR_H
+
+#include <vulkan/vulkan.h>
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "BuddyAllocator.h"
+
+/*
+ * Linear resources (buffers, linear images) and optimally tiled images are
+ * never placed in the same VkDeviceMemory block, so bufferImageGranularity
+ * can never cause aliasing between neighbouring allocations.
+ */
+enum class ResourceKind {
+    Linear = 0,
+    Optimal = 1,
+};
+
+struct GpuAllocation {
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize offset = 0;
+    VkDeviceSize size = 0;
+    void* mapped = nullptr;      // non-null for host-visible memory, persistently mapped
+    uint32_t memoryType = 0;
+    ResourceKind kind = ResourceKind::Linear;
+    int32_t blockIndex = -1;     // -1 for a dedicated VkDeviceMemory
+};
+
+/*
+ * Device memory allocator. Requests are sub-allocated from large
+ * VkDeviceMemory blocks with a buddy scheme, one set of blocks per memory type
+ * and resource kind, so the application stays far below
+ * maxMemoryAllocationCount. Requests of half a block or more get a dedicated
+ * allocation. All entry points are thread safe.
+ */
+class GpuAllocator {
+public:
+    void init(VkPhysicalDevice physicalDevice, VkDevice device);
+    void destroy();
+
+    /* Picks a type with all of required set, favouring one that also has preferred */
+    uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags required,
+                            VkMemoryPropertyFlags preferred = 0) const;
+
+    GpuAllocation allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags required,
+                           ResourceKind kind, VkMemoryPropertyFlags preferred = 0);
+    void free(GpuAllocation& allocation);
+
+    void createBuffer(const VkBufferCreateInfo& createInfo, VkMemoryPropertyFlags properties,
+                      VkBuffer& buffer, GpuAllocation& allocation, VkMemoryPropertyFlags preferred = 0);
+    void destroyBuffer(VkBuffer& buffer, GpuAllocation& allocation);
+
+    void createImage(const VkImageCreateInfo& createInfo, VkMemoryPropertyFlags properties,
+                     VkImage& image, GpuAllocation& allocation);
+    void destroyImage(VkImage& image, GpuAllocation& allocation);
+
+    const VkPhysicalDeviceProperties& deviceProperties() const { return mproperties; }
+
+    /* Most VkDeviceMemory bytes ever allocated at once, blocks and dedicated allocations alike */
+    VkDeviceSize peakDeviceBytes() const;
+    /* Per memory type usage, block count and fragmentation */
+    void printStats() const;
+
+private:
+    struct Block {
+        VkDeviceMemory memory;
+        void* mapped;
+        std::unique_ptr<BuddyAllocator> suballocator;
+    };
+
+    struct Pool {
+        std::vector<std::unique_ptr<Block>> blocks;
+    };
+
+    Pool& pool(uint32_t memoryType, ResourceKind kind) {
+        return mpools[memoryType * 2 + static_cast<uint32_t>(kind)];
+    }
+
+    VkDeviceMemory allocateDeviceMemory(VkDeviceSize size, uint32_t memoryType, void** mapped);
+    void freeDeviceMemory(VkDeviceMemory memory, VkDeviceSize size, bool mapped);
+    VkDeviceSize blockSizeFor(uint32_t memoryType) const;
+
+    VkDevice mdevice = VK_NULL_HANDLE;
+    VkPhysicalDeviceProperties mproperties;
+    VkPhysicalDeviceMemoryProperties mmemoryProperties;
+
+    mutable std::mutex mmutex;
+    std::vector<Pool> mpools;
+    uint32_t mdeviceMemoryCount = 0;
+    uint32_t mdedicatedCount = 0;
+    VkDeviceSize mdedicatedBytes = 0;
+    VkDeviceSize mdeviceBytes = 0;
+    VkDeviceSize mpeakDeviceBytes = 0;
+};
+
+/*
+ * Persistently mapped host-visible buffer split into one region per frame in
+ * flight. Transient per-frame data such as uniforms is bump-allocated from
+ * the current region, and the whole region is recycled by beginFrame() once
+ * that frame's fence has been waited on.
+ */
+class FrameLinearAllocator {
+public:
+    void create(GpuAllocator& allocator, VkDeviceSize regionSize, uint32_t frameCount, VkBufferUsageFlags usage);
+    void destroy(GpuAllocator& allocator);
+
+    void beginFrame(uint32_t frameIndex);
+
+    /* Returns the mapped pointer, or nullptr when the frame's region is exhausted */
+    void* allocate(VkDeviceSize size, VkDeviceSize& offset);
+
+    VkBuffer buffer() const { return mbuffer; }
+    VkDeviceSize highWaterMark() const { return mhighWaterMark; }
+
+private:
+    VkBuffer mbuffer = VK_NULL_HANDLE;
+    GpuAllocation mallocation;
+    VkDeviceSize mregionSize = 0;
+    VkDeviceSize malignment = 1;
+    VkDeviceSize mregionStart = 0;
+    VkDeviceSize mhead = 0;
+    VkDeviceSize mhighWaterMark = 0;
+};
+
+#endif //VULKAN_BASIC_SAMPLES_GPUALLOCATOR_H
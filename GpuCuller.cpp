@@ -0,0 +1,261 @@
+#include "GpuCuller.h"
+#include "HostAllocator.h"
+#include "Log.h"
+#include "PipelineDescription.h"
+
+#include <stdexcept>
+
+namespace {
+
+/* Streams start on 64-byte boundaries, so strides are whole multiples of 16 floats */
+const uint32_t STREAM_ALIGNMENT_FLOATS = 16;
+
+}
+
+const uint32_t GpuCuller::WORKGROUP_SIZE;
+
+void GpuCuller::init(GpuAllocator& allocator, VkDevice device, VkPipelineCache pipelineCache,
+                     const MappedFile& cullShaderCode, uint32_t capacity, uint32_t frameCount,
+                     const std::vector<uint32_t>& queueFamilies, bool useDrawIndirectCount) {
+    mdevice = device;
+    mqueueFamilies = queueFamilies;
+    mcapacity = capacity;
+    mstride = (capacity + STREAM_ALIGNMENT_FLOATS - 1) / STREAM_ALIGNMENT_FLOATS * STREAM_ALIGNMENT_FLOATS;
+
+    if (useDrawIndirectCount) {
+        mcmdDrawIndexedIndirectCount = reinterpret_cast<PFN_vkCmdDrawIndexedIndirectCountKHR>(
+                vkGetDeviceProcAddr(device, "vkCmdDrawIndexedIndirectCountKHR"));
+    }
+    mdrawIndirectCount = mcmdDrawIndexedIndirectCount != nullptr;
+
+    createBuffer(allocator, sizeof(float) * mstride * STREAM_COUNT, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, minstances,
+                 minstancesAllocation);
+    mstreams = static_cast<float*>(minstancesAllocation.mapped);
+
+    mframes.resize(frameCount);
+    for (auto& frame : mframes) {
+        createBuffer(allocator, sizeof(VkDrawIndexedIndirectCommand) * capacity,
+                     VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+                     VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                     VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, frame.commands, frame.commandsAllocation);
+        createBuffer(allocator, sizeof(uint32_t),
+                     VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+                     VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                     VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, frame.count, frame.countAllocation);
+    }
+
+    createDescriptors();
+    createPipeline(pipelineCache, cullShaderCode);
+
+    LOG_DEBUG(LOG_RENDER, "GPU culler: %u instances, %u frames, %s", capacity, frameCount,
+              mdrawIndirectCount ? "draw indirect count" : "fixed-count indirect draws");
+}
+
+void GpuCuller::destroy(GpuAllocator& allocator) {
+    if (mdevice == VK_NULL_HANDLE) {
+        return;
+    }
+    vkDestroyPipeline(mdevice, mpipeline, HostAllocator::callbacks());
+    vkDestroyPipelineLayout(mdevice, mpipelineLayout, HostAllocator::callbacks());
+    vkDestroyDescriptorPool(mdevice, mpool, HostAllocator::callbacks());
+    vkDestroyDescriptorSetLayout(mdevice, msetLayout, HostAllocator::callbacks());
+    for (auto& frame : mframes) {
+        allocator.destroyBuffer(frame.commands, frame.commandsAllocation);
+        allocator.destroyBuffer(frame.count, frame.countAllocation);
+    }
+    mframes.clear();
+    allocator.destroyBuffer(minstances, minstancesAllocation);
+    mstreams = nullptr;
+    mdevice = VK_NULL_HANDLE;
+}
+
+SphereStreams GpuCuller::spheres() const {
+    SphereStreams spheres;
+    spheres.x = mstreams + STREAM_X * mstride;
+    spheres.y = mstreams + STREAM_Y * mstride;
+    spheres.z = mstreams + STREAM_Z * mstride;
+    spheres.radius = mstreams + STREAM_RADIUS * mstride;
+    spheres.count = minstanceCount;
+    return spheres;
+}
+
+void GpuCuller::createBuffer(GpuAllocator& allocator, VkDeviceSize size, VkBufferUsageFlags usage,
+                             VkMemoryPropertyFlags properties, VkBuffer& buffer, GpuAllocation& allocation) {
+    VkBufferCreateInfo bufferInfo = {};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = size;
+    bufferInfo.usage = usage;
+    if (mqueueFamilies.size() > 1) {
+        bufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+        bufferInfo.queueFamilyIndexCount = static_cast<uint32_t>(mqueueFamilies.size());
+        bufferInfo.pQueueFamilyIndices = mqueueFamilies.data();
+    } else {
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    }
+    allocator.createBuffer(bufferInfo, properties, buffer, allocation);
+}
+
+/* One set per frame: instances, that frame's commands and its count */
+void GpuCuller::createDescriptors() {
+    VkDescriptorSetLayoutBinding bindings[3] = {};
+    for (uint32_t i = 0; i < 3; i++) {
+        bindings[i].binding = i;
+        bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_VERTEX_BIT;
+    }
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = 3;
+    layoutInfo.pBindings = bindings;
+    if (vkCreateDescriptorSetLayout(mdevice, &layoutInfo, HostAllocator::callbacks(), &msetLayout) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create culling descriptor set layout");
+    }
+
+    VkDescriptorPoolSize poolSize = {};
+    poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSize.descriptorCount = 3 * static_cast<uint32_t>(mframes.size());
+
+    VkDescriptorPoolCreateInfo poolInfo = {};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.maxSets = static_cast<uint32_t>(mframes.size());
+    poolInfo.poolSizeCount = 1;
+    poolInfo.pPoolSizes = &poolSize;
+    if (vkCreateDescriptorPool(mdevice, &poolInfo, HostAllocator::callbacks(), &mpool) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create culling descriptor pool");
+    }
+
+    for (auto& frame : mframes) {
+        VkDescriptorSetAllocateInfo allocInfo = {};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = mpool;
+        allocInfo.descriptorSetCount = 1;
+        allocInfo.pSetLayouts = &msetLayout;
+        if (vkAllocateDescriptorSets(mdevice, &allocInfo, &frame.set) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to allocate culling descriptor set");
+        }
+
+        VkDescriptorBufferInfo bufferInfos[3] = {};
+        bufferInfos[0].buffer = minstances;
+        bufferInfos[0].range = VK_WHOLE_SIZE;
+        bufferInfos[1].buffer = frame.commands;
+        bufferInfos[1].range = VK_WHOLE_SIZE;
+        bufferInfos[2].buffer = frame.count;
+        bufferInfos[2].range = VK_WHOLE_SIZE;
+
+        VkWriteDescriptorSet writes[3] = {};
+        for (uint32_t i = 0; i < 3; i++) {
+            writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            writes[i].dstSet = frame.set;
+            writes[i].dstBinding = i;
+            writes[i].descriptorCount = 1;
+            writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            writes[i].pBufferInfo = &bufferInfos[i];
+        }
+        vkUpdateDescriptorSets(mdevice, 3, writes, 0, nullptr);
+    }
+}
+
+/* The COMPACT specialisation constant selects atomic compaction or one fixed slot per instance */
+void GpuCuller::createPipeline(VkPipelineCache pipelineCache, const MappedFile& cullShaderCode) {
+    VkPushConstantRange pushConstantRange = {};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.size = sizeof(CullConstants);
+
+    VkPipelineLayoutCreateInfo layoutInfo = {};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    layoutInfo.setLayoutCount = 1;
+    layoutInfo.pSetLayouts = &msetLayout;
+    layoutInfo.pushConstantRangeCount = 1;
+    layoutInfo.pPushConstantRanges = &pushConstantRange;
+    if (vkCreatePipelineLayout(mdevice, &layoutInfo, HostAllocator::callbacks(), &mpipelineLayout) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create culling pipeline layout");
+    }
+
+    VkShaderModuleCreateInfo moduleInfo = {};
+    moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    moduleInfo.codeSize = cullShaderCode.size();
+    moduleInfo.pCode = static_cast<const uint32_t*>(cullShaderCode.data());
+    VkShaderModule module;
+    if (vkCreateShaderModule(mdevice, &moduleInfo, HostAllocator::callbacks(), &module) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create culling shader module");
+    }
+
+    VkBool32 compact = mdrawIndirectCount ? VK_TRUE : VK_FALSE;
+    const SpecializationConstants<1> constants = {{compact}};
+    std::array<VkSpecializationMapEntry, 1> constantEntries;
+    VkSpecializationInfo specialization = constants.info(constantEntries);
+
+    VkComputePipelineCreateInfo pipelineInfo = {};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module = module;
+    pipelineInfo.stage.pName = "main";
+    pipelineInfo.stage.pSpecializationInfo = &specialization;
+    pipelineInfo.layout = mpipelineLayout;
+
+    VkResult result = vkCreateComputePipelines(mdevice, pipelineCache, 1, &pipelineInfo, HostAllocator::callbacks(),
+                                               &mpipeline);
+    vkDestroyShaderModule(mdevice, module, HostAllocator::callbacks());
+    if (result != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create culling pipeline");
+    }
+}
+
+void GpuCuller::recordCull(VkCommandBuffer commandBuffer, uint32_t frame, const Frustum& frustum,
+                           uint32_t indexCount, bool sameQueue) const {
+    const FrameBuffers& buffers = mframes[frame];
+
+    if (mdrawIndirectCount) {
+        vkCmdFillBuffer(commandBuffer, buffers.count, 0, sizeof(uint32_t), 0);
+
+        VkMemoryBarrier cleared = {};
+        cleared.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        cleared.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        cleared.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+                             1, &cleared, 0, nullptr, 0, nullptr);
+    }
+
+    CullConstants constants = {};
+    for (int p = 0; p < 6; p++) {
+        for (int c = 0; c < 4; c++) {
+            constants.planes[p][c] = frustum.planes[p][c];
+        }
+    }
+    constants.instanceCount = minstanceCount;
+    constants.stride = mstride;
+    constants.indexCount = indexCount;
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, mpipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, mpipelineLayout, 0, 1, &buffers.set, 0,
+                            nullptr);
+    vkCmdPushConstants(commandBuffer, mpipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants),
+                       &constants);
+    vkCmdDispatch(commandBuffer, (minstanceCount + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, 1, 1);
+
+    if (sameQueue) {
+        VkMemoryBarrier culled = {};
+        culled.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        culled.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        culled.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                             VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 0, 1, &culled, 0, nullptr, 0, nullptr);
+    }
+}
+
+void GpuCuller::recordDraw(VkCommandBuffer commandBuffer, uint32_t frame, VkPipelineLayout pipelineLayout) const {
+    const FrameBuffers& buffers = mframes[frame];
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &buffers.set, 0,
+                            nullptr);
+    if (mdrawIndirectCount) {
+        mcmdDrawIndexedIndirectCount(commandBuffer, buffers.commands, 0, buffers.count, 0, minstanceCount,
+                                     sizeof(VkDrawIndexedIndirectCommand));
+    } else {
+        vkCmdDrawIndexedIndirect(commandBuffer, buffers.commands, 0, minstanceCount,
+                                 sizeof(VkDrawIndexedIndirectCommand));
+    }
+}
@@ -0,0 +1,129 @@
+#ifndef VULKAN_BASIC_SAMPLES_GPUCULLER_H
+#define VULKAN_BASIC_SAMPLES_GPUCULLER_H
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <vector>
+
+#include "FrustumCuller.h"
+#include "GpuAllocator.h"
+#include "ShaderCache.h"
+
+/*
+ * GPU-driven drawing: a compute shader tests every instance's bounding
+ * sphere against the frustum and writes a VkDrawIndexedIndirectCommand per
+ * survivor, so the CPU records the same handful of commands per frame
+ * whatever the instance count.
+ *
+ * Instances live in one persistently mapped buffer as separate streams (see
+ * InstanceStream), each padded to a 64-byte boundary. Every frame in flight
+ * has its own command and count buffers. With VK_KHR_draw_indirect_count
+ * the shader compacts survivors with an atomic counter and the draw reads
+ * the count from the GPU; without it each instance owns a fixed command
+ * slot whose instanceCount is 0 or 1, and the draw covers every slot.
+ *
+ * Buffers are shared concurrently between the queue families passed to
+ * init(), so culling can run on an async compute queue without ownership
+ * transfers.
+ */
+class GpuCuller {
+public:
+    enum InstanceStream {
+        STREAM_X,
+        STREAM_Y,
+        STREAM_Z,
+        STREAM_RADIUS,
+        /* RGBA8 packed into the float's bits */
+        STREAM_COLOR,
+        STREAM_COUNT
+    };
+
+    /* Push constants of shaders/cull.comp */
+    struct CullConstants {
+        float planes[6][4];
+        uint32_t instanceCount;
+        uint32_t stride;
+        uint32_t indexCount;
+        uint32_t padding;
+    };
+
+    /* Push constants of shaders/instanced.vert */
+    struct DrawConstants {
+        Mat4 viewProjection;
+        /* Projection x/y scale, to size billboards in clip space */
+        float scale[2];
+        uint32_t stride;
+        uint32_t padding;
+    };
+
+    /* Threads per workgroup, matching local_size_x in cull.comp */
+    static const uint32_t WORKGROUP_SIZE = 64;
+
+    void init(GpuAllocator& allocator, VkDevice device, VkPipelineCache pipelineCache,
+              const MappedFile& cullShaderCode, uint32_t capacity, uint32_t frameCount,
+              const std::vector<uint32_t>& queueFamilies, bool useDrawIndirectCount);
+    void destroy(GpuAllocator& allocator);
+
+    bool drawIndirectCount() const { return mdrawIndirectCount; }
+    uint32_t capacity() const { return mcapacity; }
+    /* Floats between the starts of consecutive streams */
+    uint32_t stride() const { return mstride; }
+
+    /* Mapped and coherent; write instances here, then setInstanceCount() */
+    float* stream(InstanceStream stream) { return mstreams + stream * mstride; }
+    void setInstanceCount(uint32_t count) { minstanceCount = count; }
+    uint32_t instanceCount() const { return minstanceCount; }
+    SphereStreams spheres() const;
+
+    /* Set 0 of both the cull and the draw pipeline layouts; binding 0 is the instance buffer */
+    VkDescriptorSetLayout setLayout() const { return msetLayout; }
+
+    /*
+     * Resets the frame's count, dispatches the cull shader and, when the
+     * draw follows on the same queue, adds the barrier to indirect reads.
+     * Across queues the semaphore between the submissions orders them instead.
+     */
+    void recordCull(VkCommandBuffer commandBuffer, uint32_t frame, const Frustum& frustum, uint32_t indexCount,
+                    bool sameQueue) const;
+    /* Inside a render pass with a pipeline whose layout has setLayout() as set 0 */
+    void recordDraw(VkCommandBuffer commandBuffer, uint32_t frame, VkPipelineLayout pipelineLayout) const;
+
+    /* Read back after recordCull() to validate; count is unused in the fixed-count fallback */
+    VkBuffer commandBuffer(uint32_t frame) const { return mframes[frame].commands; }
+    VkBuffer countBuffer(uint32_t frame) const { return mframes[frame].count; }
+
+private:
+    struct FrameBuffers {
+        VkBuffer commands = VK_NULL_HANDLE;
+        GpuAllocation commandsAllocation;
+        VkBuffer count = VK_NULL_HANDLE;
+        GpuAllocation countAllocation;
+        VkDescriptorSet set = VK_NULL_HANDLE;
+    };
+
+    void createBuffer(GpuAllocator& allocator, VkDeviceSize size, VkBufferUsageFlags usage,
+                      VkMemoryPropertyFlags properties, VkBuffer& buffer, GpuAllocation& allocation);
+    void createDescriptors();
+    void createPipeline(VkPipelineCache pipelineCache, const MappedFile& cullShaderCode);
+
+    VkDevice mdevice = VK_NULL_HANDLE;
+    std::vector<uint32_t> mqueueFamilies;
+    bool mdrawIndirectCount = false;
+    PFN_vkCmdDrawIndexedIndirectCountKHR mcmdDrawIndexedIndirectCount = nullptr;
+
+    uint32_t mcapacity = 0;
+    uint32_t mstride = 0;
+    uint32_t minstanceCount = 0;
+    VkBuffer minstances = VK_NULL_HANDLE;
+    GpuAllocation minstancesAllocation;
+    float* mstreams = nullptr;
+    std::vector<FrameBuffers> mframes;
+
+    VkDescriptorSetLayout msetLayout = VK_NULL_HANDLE;
+    VkDescriptorPool mpool = VK_NULL_HANDLE;
+    VkPipelineLayout mpipelineLayout = VK_NULL_HANDLE;
+    VkPipeline mpipeline = VK_NULL_HANDLE;
+};
+
+#endif //VULKAN_BASIC_SAMPLES_GPUCULLER_H
@@ -0,0 +1,159 @@
+#include "GpuProfiler.h"
+
+#if ENABLE_GPU_PROFILER
+
+#include "HostAllocator.h"
+#include "Log.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <stdexcept>
+
+namespace {
+
+/* Two timestamps per scope */
+const uint32_t MAX_SCOPES_PER_SLOT = 32;
+const uint32_t QUERIES_PER_SLOT = MAX_SCOPES_PER_SLOT * 2;
+
+}
+
+const uint32_t GpuProfiler::INVALID_SCOPE;
+
+void GpuProfiler::init(VkDevice device, const VkPhysicalDeviceProperties& properties, uint32_t timestampValidBits,
+                       bool canResetQueries, uint32_t slotCount, const char* trackName) {
+    mdevice = device;
+    mtrackName = trackName;
+    if (timestampValidBits == 0 || !canResetQueries) {
+        LOG_INFO(LOG_RENDER, "GPU timestamps unavailable for %s", trackName);
+        return;
+    }
+
+    mnanosecondsPerTick = properties.limits.timestampPeriod;
+    mtimestampMask = timestampValidBits >= 64 ? ~0ull : (1ull << timestampValidBits) - 1;
+    mslots.resize(slotCount);
+    mresults.resize(QUERIES_PER_SLOT);
+
+    VkQueryPoolCreateInfo poolInfo = {};
+    poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    poolInfo.queryCount = QUERIES_PER_SLOT * slotCount;
+
+    if (vkCreateQueryPool(mdevice, &poolInfo, HostAllocator::callbacks(), &mqueryPool) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create timestamp query pool");
+    }
+}
+
+void GpuProfiler::destroy() {
+    if (mqueryPool != VK_NULL_HANDLE) {
+        vkDestroyQueryPool(mdevice, mqueryPool, HostAllocator::callbacks());
+        mqueryPool = VK_NULL_HANDLE;
+    }
+    mslots.clear();
+}
+
+void GpuProfiler::beginSlot(VkCommandBuffer commandBuffer, uint32_t slot) {
+    if (mqueryPool == VK_NULL_HANDLE) {
+        return;
+    }
+
+    readBack(slot);
+    mslots[slot].scopes.clear();
+    mslots[slot].submitted = false;
+    mcurrentSlot = slot;
+    vkCmdResetQueryPool(commandBuffer, mqueryPool, slot * QUERIES_PER_SLOT, QUERIES_PER_SLOT);
+}
+
+void GpuProfiler::markSubmitted(uint32_t slot) {
+    if (mqueryPool == VK_NULL_HANDLE) {
+        return;
+    }
+    mslots[slot].submitted = true;
+    mslots[slot].submitTime = std::chrono::steady_clock::now();
+}
+
+uint32_t GpuProfiler::beginScope(VkCommandBuffer commandBuffer, const char* name) {
+    if (mqueryPool == VK_NULL_HANDLE) {
+        return INVALID_SCOPE;
+    }
+
+    Slot& slot = mslots[mcurrentSlot];
+    if (slot.scopes.size() >= MAX_SCOPES_PER_SLOT) {
+        return INVALID_SCOPE;
+    }
+
+    uint32_t scope = static_cast<uint32_t>(slot.scopes.size());
+    Scope entry;
+    entry.name = name;
+    slot.scopes.push_back(entry);
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, mqueryPool,
+                        mcurrentSlot * QUERIES_PER_SLOT + scope * 2);
+    return scope;
+}
+
+void GpuProfiler::endScope(VkCommandBuffer commandBuffer, uint32_t scope) {
+    if (scope == INVALID_SCOPE) {
+        return;
+    }
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, mqueryPool,
+                        mcurrentSlot * QUERIES_PER_SLOT + scope * 2 + 1);
+}
+
+void GpuProfiler::readBack(uint32_t slotIndex) {
+    Slot& slot = mslots[slotIndex];
+    if (!slot.submitted || slot.scopes.empty()) {
+        return;
+    }
+
+    /* No WAIT flag: the slot's fence has signaled, anything not ready is dropped rather than waited for */
+    uint32_t queryCount = static_cast<uint32_t>(slot.scopes.size() * 2);
+    VkResult result = vkGetQueryPoolResults(mdevice, mqueryPool, slotIndex * QUERIES_PER_SLOT, queryCount,
+                                            queryCount * sizeof(uint64_t), mresults.data(), sizeof(uint64_t),
+                                            VK_QUERY_RESULT_64_BIT);
+    if (result != VK_SUCCESS) {
+        return;
+    }
+
+    uint64_t firstTick = mresults[0] & mtimestampMask;
+    double submitNs = Trace::toTraceMicroseconds(slot.submitTime) * 1000.0;
+    double candidateOffset = submitNs - firstTick * mnanosecondsPerTick;
+    if (!mhaveOffset || candidateOffset > moffsetNs) {
+        moffsetNs = candidateOffset;
+        mhaveOffset = true;
+    }
+
+    bool tracing = Trace::enabled();
+    for (size_t i = 0; i < slot.scopes.size(); i++) {
+        uint64_t begin = mresults[i * 2] & mtimestampMask;
+        uint64_t end = mresults[i * 2 + 1] & mtimestampMask;
+        uint64_t ticks = (end - begin) & mtimestampMask;
+        double durationMs = ticks * mnanosecondsPerTick * 1e-6;
+
+        ScopeStats& stats = mstats[slot.scopes[i].name];
+        stats.count++;
+        stats.totalMs += durationMs;
+        stats.maxMs = std::max(stats.maxMs, durationMs);
+
+        if (tracing) {
+            double startNs = begin * mnanosecondsPerTick + moffsetNs;
+            Trace::completeOnTrack(slot.scopes[i].name, "gpu", mtrackName, static_cast<int64_t>(startNs / 1000.0),
+                                   static_cast<int64_t>(durationMs * 1000.0));
+        }
+    }
+}
+
+void GpuProfiler::report() const {
+    if (mstats.empty()) {
+        return;
+    }
+
+    printf("GPU time on %s \n", mtrackName);
+    printf("  %-16s %9s %9s %9s \n", "", "count", "avg ms", "max ms");
+    for (const auto& entry : mstats) {
+        const ScopeStats& stats = entry.second;
+        printf("  %-16s %9llu %9.3f %9.3f \n", entry.first.c_str(), (unsigned long long) stats.count,
+               stats.totalMs / stats.count, stats.maxMs);
+    }
+}
+
+#endif
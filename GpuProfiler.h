@@ -0,0 +1,135 @@
+#ifndef VULKAN_BASIC_SAMPLES_GPUPROFILER_H
+#define VULKAN_BASIC_SAMPLES_GPUPROFILER_H
+
+#include <vulkan/vulkan.h>
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+/* Timestamp queries are compiled in unless NDEBUG is defined (make release) */
+#ifndef ENABLE_GPU_PROFILER
+#ifdef NDEBUG
+#define ENABLE_GPU_PROFILER 0
+#else
+#define ENABLE_GPU_PROFILER 1
+#endif
+#endif
+
+#if ENABLE_GPU_PROFILER
+
+/*
+ * Named GPU scopes measured with vkCmdWriteTimestamp, one query range per
+ * slot. A slot is a command buffer whose previous submission the caller
+ * has already waited for (a frame in flight, an upload batch), so its
+ * results are read back without blocking when the slot is next begun,
+ * frames after they were recorded.
+ *
+ * Ticks are scaled by timestampPeriod. They are placed on the CPU trace
+ * timeline with the assumption that a slot's first timestamp is no
+ * earlier than its CPU submission. The offset only ever moves forward, so
+ * it converges on the smallest submit-to-execute delay seen.
+ */
+class GpuProfiler {
+public:
+    static const uint32_t INVALID_SCOPE = ~0u;
+
+    /*
+     * timestampValidBits of the queue family the slots are submitted to;
+     * canResetQueries is false for transfer-only families, which cannot
+     * record vkCmdResetQueryPool. Either disables the profiler.
+     */
+    void init(VkDevice device, const VkPhysicalDeviceProperties& properties, uint32_t timestampValidBits,
+              bool canResetQueries, uint32_t slotCount, const char* trackName);
+    void destroy();
+
+    /* Reads back the slot's previous results and resets its queries. Records outside a render pass. */
+    void beginSlot(VkCommandBuffer commandBuffer, uint32_t slot);
+    /* The CPU time the slot's command buffer was submitted; results of unsubmitted slots are dropped */
+    void markSubmitted(uint32_t slot);
+
+    uint32_t beginScope(VkCommandBuffer commandBuffer, const char* name);
+    void endScope(VkCommandBuffer commandBuffer, uint32_t scope);
+
+    /* Average and maximum GPU time per scope name */
+    void report() const;
+
+private:
+    struct Scope {
+        const char* name;
+    };
+
+    struct Slot {
+        std::vector<Scope> scopes;
+        bool submitted = false;
+        std::chrono::steady_clock::time_point submitTime;
+    };
+
+    struct ScopeStats {
+        uint64_t count = 0;
+        double totalMs = 0.0;
+        double maxMs = 0.0;
+    };
+
+    void readBack(uint32_t slot);
+
+    VkDevice mdevice = VK_NULL_HANDLE;
+    VkQueryPool mqueryPool = VK_NULL_HANDLE;
+    const char* mtrackName = "";
+    double mnanosecondsPerTick = 1.0;
+    uint64_t mtimestampMask = 0;
+    std::vector<Slot> mslots;
+    uint32_t mcurrentSlot = 0;
+    bool mhaveOffset = false;
+    double moffsetNs = 0.0;
+    std::vector<uint64_t> mresults;
+    std::map<std::string, ScopeStats> mstats;
+};
+
+class GpuProfileScope {
+public:
+    GpuProfileScope(GpuProfiler& profiler, VkCommandBuffer commandBuffer, const char* name)
+        : mprofiler(profiler), mcommandBuffer(commandBuffer), mscope(profiler.beginScope(commandBuffer, name)) {
+    }
+
+    ~GpuProfileScope() {
+        mprofiler.endScope(mcommandBuffer, mscope);
+    }
+
+private:
+    GpuProfileScope(const GpuProfileScope&) = delete;
+    GpuProfileScope& operator=(const GpuProfileScope&) = delete;
+
+    GpuProfiler& mprofiler;
+    VkCommandBuffer mcommandBuffer;
+    uint32_t mscope;
+};
+
+#define GPU_PROFILE_CONCAT_INNER(a, b) a##b
+#define GPU_PROFILE_CONCAT(a, b) GPU_PROFILE_CONCAT_INNER(a, b)
+#define GPU_PROFILE_SCOPE(profiler, commandBuffer, name) \
+    GpuProfileScope GPU_PROFILE_CONCAT(gpuProfileScope, __LINE__)(profiler, commandBuffer, name)
+
+#else
+
+/* Release builds: every call is an empty inline function and scopes vanish */
+class GpuProfiler {
+public:
+    static const uint32_t INVALID_SCOPE = ~0u;
+
+    void init(VkDevice, const VkPhysicalDeviceProperties&, uint32_t, bool, uint32_t, const char*) {}
+    void destroy() {}
+    void beginSlot(VkCommandBuffer, uint32_t) {}
+    void markSubmitted(uint32_t) {}
+    uint32_t beginScope(VkCommandBuffer, const char*) { return INVALID_SCOPE; }
+    void endScope(VkCommandBuffer, uint32_t) {}
+    void report() const {}
+};
+
+#define GPU_PROFILE_SCOPE(profiler, commandBuffer, name)
+
+#endif
+
+#endif //VULKAN_BASIC_SAMPLES_GPUPROFILER_H
@@ -2,6 +2,12 @@
 #include <vulkan/vulkan.h>
 #include <GLFW/glfw3.h>
 
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/mat4x4.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
 
 #include <iostream>
 #include <stdexcept>
@@ -10,20 +16,254 @@
 #include <vector>
 #include <cstring>
 #include <set>
+#include <map>
+#include <iterator>
 #include <limits>
+#include <fstream>
+#include <chrono>
+#include <memory>
+#include <random>
+#include <cstddef>
+#include <algorithm>
+#include <cmath>
+#include <future>
+#include <thread>
+
+#include <fcntl.h>
+#include <unistd.h>
 
 #include "HelloTriangleApplication.h"
-
-#if 1
-#define print_d(...) printf("%s: ", __func__); printf(__VA_ARGS__)
-#else
-#define print_d
-#endif
+#include "Log.h"
+#include "PipelineCache.h"
+#include "FrameStats.h"
+#include "JobSystem.h"
+#include "GpuAllocator.h"
+#include "Uploader.h"
+#include "PresentProfile.h"
+#include "DeviceSelector.h"
+#include "TaskGraph.h"
+#include "Trace.h"
+#include "GpuProfiler.h"
+#include "DescriptorHeap.h"
+#include "GpuCuller.h"
+#include "TransformSystem.h"
+#include "ShaderCache.h"
+#include "FrameCapture.h"
+#include "RenderGraph.h"
+#include "HostAllocator.h"
+#include "AssetPackage.h"
+#include "AssetStreamer.h"
+#include "MeshCooker.h"
+#include "InstanceRing.h"
+#include "InstanceBatcher.h"
+#include "PipelineRegistry.h"
 
 
 const int WIDTH = 800;
 const int HEIGHT = 600;
 
+/* Number of images in the offscreen ring used instead of a swapchain when headless */
+const uint32_t OFFSCREEN_IMAGE_COUNT = 3;
+
+/* Frames rendered when headless and no explicit --frames count is given */
+const uint32_t HEADLESS_DEFAULT_FRAMES = 1000;
+
+/* Below this many draws a single inline command buffer is cheaper than fanning out */
+const uint32_t PARALLEL_RECORD_MIN_DRAWS = 1024;
+
+/* Per frame in flight budget for transient uniform/storage data */
+const VkDeviceSize FRAME_TRANSIENT_BYTES = 256 * 1024;
+
+/* Persistently mapped staging ring shared by all uploads */
+const VkDeviceSize STAGING_RING_BYTES = 32 * 1024 * 1024;
+
+/* Init stages are mostly short driver calls; a few workers cover the widest level of the graph */
+const unsigned INIT_WORKER_THREADS = 3;
+
+/* Pipeline permutations are compiled by at most this many threads at startup */
+const unsigned PIPELINE_PREWARM_THREADS = 4;
+
+/* Descriptor heap capacities, clamped to the device's update-after-bind limits when bindless */
+const uint32_t HEAP_IMAGE_CAPACITY = 4096;
+const uint32_t HEAP_STORAGE_BUFFER_CAPACITY = 4096;
+
+/* Procedural checkerboards sampled by the triangle draws, cycled through per draw */
+const uint32_t SCENE_TEXTURE_COUNT = 64;
+const uint32_t SCENE_TEXTURE_SIZE = 16;
+
+/* Instance field for --gpu-cull: a flat slab around the camera, which spins about Y */
+const float CULL_FIELD_EXTENT = 250.0f;
+const float CULL_FOV_Y = 1.0f;
+const float CULL_FAR_PLANE = 500.0f;
+const float CULL_CAMERA_RADIANS_PER_FRAME = 0.005f;
+/* --validate-cull: instances when --gpu-cull is not given, camera angles compared */
+const uint32_t CULL_VALIDATION_INSTANCES = 100000;
+const int CULL_VALIDATION_VIEWS = 8;
+/* Spheres this close to a plane may land on either side between GPU and CPU arithmetic */
+const float CULL_VALIDATION_EPSILON = 1e-3f;
+/* --scene-nodes and --bench-transforms hierarchy: a forest where every node has this many children */
+const uint32_t TRANSFORM_ROOTS = 64;
+const uint32_t TRANSFORM_BRANCHING = 4;
+/* Every n-th scene node spins, dirtying its subtree */
+const uint32_t TRANSFORM_ANIMATED_STRIDE = 64;
+const float TRANSFORM_RADIANS_PER_FRAME = 0.01f;
+/* --render-graph sample frame: shadow map edge */
+const uint32_t RENDER_GRAPH_SHADOW_SIZE = 1024;
+/* --package: mesh payload staged per frame, so streaming never holds up a frame for long */
+const VkDeviceSize ASSET_STREAM_BYTES_PER_FRAME = 8 * 1024 * 1024;
+/* --stream-upload: slots beyond one per frame in flight, covering copies still on the transfer queue */
+const uint32_t STREAM_UPLOAD_TRANSFER_SLOTS = 2;
+/* --instances: objects in a slab around the camera, the same view as --gpu-cull, each spinning about Y */
+const float INSTANCE_FIELD_EXTENT = 150.0f;
+const float INSTANCE_SPIN_RADIANS_PER_FRAME = 0.02f;
+/* Instances per frame the ring starts with; it grows from there as needed */
+const uint32_t INSTANCE_RING_INITIAL_CAPACITY = 4096;
+/* --bench-instancing: object counts, and frames written, recorded and submitted per count and path */
+const uint32_t INSTANCE_BENCH_MAX_OBJECTS = 100000;
+const int INSTANCE_BENCH_ITERATIONS = 20;
+/* Matches MATERIAL_TINTS in shaders/instance_ring.vert */
+const uint32_t INSTANCE_MATERIAL_COUNT = 4;
+
+/*
+ * Calls visit(node, parent, position, rotation, scale) for every node of the
+ * transform benchmark hierarchy, parents first. Rotations are random unit
+ * quaternions (x, y, z, w).
+ */
+template <typename Visit>
+void generateTransformHierarchy(uint32_t nodeCount, Visit visit) {
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<float> offset(-10.0f, 10.0f);
+    std::uniform_real_distribution<float> scale(0.5f, 1.5f);
+    std::normal_distribution<float> gaussian(0.0f, 1.0f);
+
+    for (uint32_t node = 0; node < nodeCount; node++) {
+        uint32_t parent = node < TRANSFORM_ROOTS ? TransformSystem::INVALID_NODE
+                                                 : (node - TRANSFORM_ROOTS) / TRANSFORM_BRANCHING;
+        float position[3] = {offset(rng), offset(rng), offset(rng)};
+        float rotation[4] = {gaussian(rng), gaussian(rng), gaussian(rng), gaussian(rng)};
+        float length = std::sqrt(rotation[0] * rotation[0] + rotation[1] * rotation[1] +
+                                 rotation[2] * rotation[2] + rotation[3] * rotation[3]);
+        for (float& component : rotation) {
+            component /= length;
+        }
+        float uniformScale = scale(rng);
+        float scales[3] = {uniformScale, uniformScale, uniformScale};
+        visit(node, parent, position, rotation, scales);
+    }
+}
+
+/* Ids in mshaders, registered in this order by readShaders() */
+enum ShaderIndex {
+    SHADER_TRIANGLE_VERT,
+    SHADER_TRIANGLE_FRAG,
+    SHADER_CULL_COMP,
+    SHADER_INSTANCED_VERT,
+    SHADER_INSTANCED_FRAG,
+    SHADER_INSTANCE_RING_VERT,
+    SHADER_COUNT
+};
+
+/* Prebuilt by the Makefile; the GLSL source is the same path without .spv */
+const char* const SHADER_PATHS[SHADER_COUNT] = {
+    "shaders/triangle.vert.spv",
+    "shaders/triangle.frag.spv",
+    "shaders/cull.comp.spv",
+    "shaders/instanced.vert.spv",
+    "shaders/instanced.frag.spv",
+    "shaders/instance_ring.vert.spv",
+};
+
+const std::vector<Vertex> triangleVertices = {
+    {{0.0f, -0.5f}, {1.0f, 0.0f, 0.0f}},
+    {{0.5f, 0.5f}, {0.0f, 1.0f, 0.0f}},
+    {{-0.5f, 0.5f}, {0.0f, 0.0f, 1.0f}}
+};
+
+const std::vector<uint16_t> triangleIndices = {
+    0, 1, 2
+};
+
+/* --instances meshes share one vertex and one index buffer; vertexOffset rebases each mesh's indices */
+struct InstanceMesh {
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    int32_t vertexOffset;
+};
+
+const std::vector<Vertex> instanceMeshVertices = {
+    /* Triangle */
+    {{0.0f, -0.5f}, {1.0f, 0.0f, 0.0f}}, {{0.5f, 0.5f}, {0.0f, 1.0f, 0.0f}}, {{-0.5f, 0.5f}, {0.0f, 0.0f, 1.0f}},
+    /* Quad */
+    {{-0.5f, -0.5f}, {1.0f, 1.0f, 1.0f}}, {{0.5f, -0.5f}, {1.0f, 1.0f, 0.0f}},
+    {{0.5f, 0.5f}, {0.0f, 1.0f, 1.0f}}, {{-0.5f, 0.5f}, {1.0f, 0.0f, 1.0f}},
+    /* Hexagon, centre first */
+    {{0.0f, 0.0f}, {1.0f, 1.0f, 1.0f}}, {{0.5f, 0.0f}, {1.0f, 0.0f, 0.0f}}, {{0.25f, 0.433f}, {1.0f, 1.0f, 0.0f}},
+    {{-0.25f, 0.433f}, {0.0f, 1.0f, 0.0f}}, {{-0.5f, 0.0f}, {0.0f, 1.0f, 1.0f}},
+    {{-0.25f, -0.433f}, {0.0f, 0.0f, 1.0f}}, {{0.25f, -0.433f}, {1.0f, 0.0f, 1.0f}}
+};
+
+const std::vector<uint16_t> instanceMeshIndices = {
+    0, 1, 2,
+    0, 1, 2, 0, 2, 3,
+    0, 1, 2, 0, 2, 3, 0, 3, 4, 0, 4, 5, 0, 5, 6, 0, 6, 1
+};
+
+const InstanceMesh INSTANCE_MESHES[] = {{0, 3, 0}, {3, 6, 3}, {9, 18, 7}};
+const uint32_t INSTANCE_MESH_COUNT = sizeof(INSTANCE_MESHES) / sizeof(INSTANCE_MESHES[0]);
+
+/* Pipelines the --instances objects are spread over */
+enum InstancePipeline {
+    INSTANCE_PIPELINE_OPAQUE,
+    INSTANCE_PIPELINE_ADDITIVE,
+    INSTANCE_PIPELINE_COUNT
+};
+
+/* A --instances object; its InstanceData is rebuilt from this every frame */
+struct InstanceObject {
+    float position[3];
+    float scale;
+    float spin;
+    uint32_t color;
+    uint32_t material;
+    uint16_t pipeline;
+    uint16_t mesh;
+};
+
+/* Graphics pipeline states, see PipelineDescription.h */
+constexpr VertexBinding VERTEX_BINDINGS[] = {{0, sizeof(Vertex), VK_VERTEX_INPUT_RATE_VERTEX}};
+constexpr VertexAttribute VERTEX_ATTRIBUTES[] = {
+    VERTEX_ATTRIBUTE(0, 0, Vertex, pos),
+    VERTEX_ATTRIBUTE(1, 0, Vertex, color)
+};
+
+/* Binding 1 feeds InstanceData at instance rate to locations 2-6 */
+constexpr VertexBinding INSTANCE_RING_BINDINGS[] = {
+    {0, sizeof(Vertex), VK_VERTEX_INPUT_RATE_VERTEX},
+    {1, sizeof(InstanceData), VK_VERTEX_INPUT_RATE_INSTANCE}
+};
+constexpr VertexAttribute INSTANCE_RING_ATTRIBUTES[] = {
+    VERTEX_ATTRIBUTE(0, 0, Vertex, pos),
+    VERTEX_ATTRIBUTE(1, 0, Vertex, color),
+    {2, 1, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(InstanceData, transform)},
+    {3, 1, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(InstanceData, transform) + 4 * sizeof(float)},
+    {4, 1, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(InstanceData, transform) + 8 * sizeof(float)},
+    {5, 1, VK_FORMAT_R8G8B8A8_UNORM, offsetof(InstanceData, color)},
+    VERTEX_ATTRIBUTE(6, 1, InstanceData, material)
+};
+
+/* The textured triangle draws and the --gpu-cull field */
+constexpr PipelineState TRIANGLE_PIPELINE = describeVertexInput(VERTEX_BINDINGS, VERTEX_ATTRIBUTES);
+/* --instances objects spin about Y, so both faces show */
+constexpr PipelineState INSTANCE_RING_OPAQUE_PIPELINE =
+    describeVertexInput(INSTANCE_RING_BINDINGS, INSTANCE_RING_ATTRIBUTES).withCullMode(VK_CULL_MODE_NONE);
+constexpr PipelineState INSTANCE_RING_ADDITIVE_PIPELINE = INSTANCE_RING_OPAQUE_PIPELINE.withBlend(BLEND_ADDITIVE);
+static_assert(INSTANCE_RING_OPAQUE_PIPELINE.hash() != INSTANCE_RING_ADDITIVE_PIPELINE.hash(),
+              "Instance ring pipelines share a key");
+static_assert(TRIANGLE_PIPELINE.hash() != INSTANCE_RING_OPAQUE_PIPELINE.hash(), "Pipeline states share a key");
+
+/* Specialization constants of shaders/triangle.frag: BINDLESS, TEXTURE_COUNT */
+typedef SpecializationConstants<2> TriangleConstants;
+
 const std::vector<const char*> validationLayers = {
 		"VK_LAYER_LUNARG_standard_validation"
 };
@@ -38,92 +278,515 @@ const  std::vector<const char*> deviceExtensions = {
 	const bool enableValidationLayers = true;
 #endif
 
+static LogLevel messageLevel(VkDebugUtilsMessageSeverityFlagBitsEXT severity) {
+    if (severity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT) {
+        return LOG_LEVEL_ERROR;
+    } else if (severity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT) {
+        return LOG_LEVEL_WARNING;
+    } else if (severity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT) {
+        return LOG_LEVEL_DEBUG;
+    }
+    return LOG_LEVEL_TRACE;
+}
+
+/* Objects named with vkSetDebugUtilsObjectNameEXT arrive with their names */
 static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(
-    VkDebugReportFlagsEXT flags,
-    VkDebugReportObjectTypeEXT objType,
-    uint64_t obj,
-    size_t location,
-    int32_t code,
-    const char* layerPrefix,
-    const char* msg,
+    VkDebugUtilsMessageSeverityFlagBitsEXT severity,
+    VkDebugUtilsMessageTypeFlagsEXT types,
+    const VkDebugUtilsMessengerCallbackDataEXT* data,
     void* userData) {
 
-    std::cerr << "validation layer: " << msg << std::endl;
+    LogLevel level = messageLevel(severity);
+    if (!Log::enabled(level, LOG_VALIDATION)) {
+        return VK_FALSE;
+    }
+
+    char objects[512] = "";
+    size_t used = 0;
+    for (uint32_t i = 0; i < data->objectCount && used < sizeof(objects); i++) {
+        const VkDebugUtilsObjectNameInfoEXT& object = data->pObjects[i];
+        int written = snprintf(objects + used, sizeof(objects) - used, " [%s 0x%llx]",
+                               object.pObjectName != nullptr ? object.pObjectName : "unnamed",
+                               (unsigned long long) object.objectHandle);
+        if (written < 0) {
+            break;
+        }
+        used += written;
+    }
+    Log::write(level, LOG_VALIDATION, nullptr, "%s%s%s",
+               (types & VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT) ? "performance: " : "", data->pMessage,
+               objects);
 
     return VK_FALSE;
 }
 
-VkResult CreateDebugReportCallbackEXT(VkInstance instance, const VkDebugReportCallbackCreateInfoEXT* pCreateInfo, const VkAllocationCallbacks* pAllocator, VkDebugReportCallbackEXT* pCallback) {
-    auto func = (PFN_vkCreateDebugReportCallbackEXT) vkGetInstanceProcAddr(instance, "vkCreateDebugReportCallbackEXT");
+/* Only the severities the log would keep are requested, so filtered messages are never generated */
+static VkDebugUtilsMessengerCreateInfoEXT debugMessengerCreateInfo() {
+    const VkDebugUtilsMessageSeverityFlagBitsEXT severities[] = {
+        VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT, VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT,
+        VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT, VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT};
+
+    VkDebugUtilsMessengerCreateInfoEXT createInfo = {};
+    createInfo.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
+    for (VkDebugUtilsMessageSeverityFlagBitsEXT severity : severities) {
+        if (Log::enabled(messageLevel(severity), LOG_VALIDATION)) {
+            createInfo.messageSeverity |= severity;
+        }
+    }
+    createInfo.messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT |
+                             VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT |
+                             VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
+    createInfo.pfnUserCallback = debugCallback;
+    return createInfo;
+}
+
+VkResult CreateDebugUtilsMessengerEXT(VkInstance instance, const VkDebugUtilsMessengerCreateInfoEXT* pCreateInfo, const VkAllocationCallbacks* pAllocator, VkDebugUtilsMessengerEXT* pMessenger) {
+    auto func = (PFN_vkCreateDebugUtilsMessengerEXT) vkGetInstanceProcAddr(instance, "vkCreateDebugUtilsMessengerEXT");
     if (func != nullptr) {
-        return func(instance, pCreateInfo, pAllocator, pCallback);
+        return func(instance, pCreateInfo, pAllocator, pMessenger);
     } else {
         return VK_ERROR_EXTENSION_NOT_PRESENT;
     }
 }
 
-void DestroyDebugReportCallbackEXT(VkInstance instance, VkDebugReportCallbackEXT callback, const VkAllocationCallbacks* pAllocator) {
-    auto func = (PFN_vkDestroyDebugReportCallbackEXT) vkGetInstanceProcAddr(instance, "vkDestroyDebugReportCallbackEXT");
+void DestroyDebugUtilsMessengerEXT(VkInstance instance, VkDebugUtilsMessengerEXT messenger, const VkAllocationCallbacks* pAllocator) {
+    auto func = (PFN_vkDestroyDebugUtilsMessengerEXT) vkGetInstanceProcAddr(instance, "vkDestroyDebugUtilsMessengerEXT");
     if (func != nullptr) {
-        func(instance, callback, pAllocator);
+        func(instance, messenger, pAllocator);
+    }
+}
+
+/* Render graph pass helpers: the sample frame is built from transfer commands, so it needs no pipelines */
+static void clearGraphImage(VkCommandBuffer commandBuffer, VkImage image, float r, float g, float b) {
+    VkClearColorValue color = {};
+    color.float32[0] = r;
+    color.float32[1] = g;
+    color.float32[2] = b;
+    color.float32[3] = 1.0f;
+    VkImageSubresourceRange range = {};
+    range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    range.levelCount = 1;
+    range.layerCount = 1;
+    vkCmdClearColorImage(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &color, 1, &range);
+}
+
+/*
+ * Scales all of src into the given fraction of dst, (0, 0, 1, 1) being the
+ * whole image. Nearest filtering, as linear blits from R32_SFLOAT are optional.
+ */
+static void blitGraphImage(VkCommandBuffer commandBuffer, const RenderGraph& graph, RenderGraph::ResourceId src,
+                           RenderGraph::ResourceId dst, float x0, float y0, float x1, float y1) {
+    VkExtent2D srcExtent = graph.extent(src);
+    VkExtent2D dstExtent = graph.extent(dst);
+    VkImageBlit blit = {};
+    blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    blit.srcSubresource.layerCount = 1;
+    blit.srcOffsets[1] = {static_cast<int32_t>(srcExtent.width), static_cast<int32_t>(srcExtent.height), 1};
+    blit.dstSubresource = blit.srcSubresource;
+    blit.dstOffsets[0] = {static_cast<int32_t>(x0 * dstExtent.width), static_cast<int32_t>(y0 * dstExtent.height), 0};
+    blit.dstOffsets[1] = {static_cast<int32_t>(x1 * dstExtent.width), static_cast<int32_t>(y1 * dstExtent.height), 1};
+    vkCmdBlitImage(commandBuffer, graph.image(src), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, graph.image(dst),
+                   VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_NEAREST);
+}
+
+/* Resets VmHWM to the current RSS (Linux 4.0 and later); false if the kernel refused */
+static bool resetPeakResidentSize() {
+    int fd = open("/proc/self/clear_refs", O_WRONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    bool reset = write(fd, "5", 1) == 1;
+    close(fd);
+    return reset;
+}
+
+/* A "Vm...:" line of /proc/self/status, in KiB; 0 if missing */
+static uint64_t readStatusKiB(const char* field) {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    size_t length = strlen(field);
+    while (std::getline(status, line)) {
+        if (line.compare(0, length, field) == 0) {
+            return strtoull(line.c_str() + length, nullptr, 10);
+        }
     }
+    return 0;
 }
 
 class HelloTriangleApplication {
 public:
+    explicit HelloTriangleApplication(const AppConfig& config)
+        : mconfig(config), mpresentProfile(findPresentProfile(config.presentProfile)) {
+        if (mpresentProfile == nullptr) {
+            throw std::runtime_error("Unknown present profile " + config.presentProfile + ", expected one of: " +
+                                     presentProfileNames());
+        }
+        if (mconfig.framesInFlight == 0) {
+            mconfig.framesInFlight = mpresentProfile->framesInFlight;
+        }
+        if (mconfig.validateCulling && mconfig.cullInstances == 0) {
+            mconfig.cullInstances = CULL_VALIDATION_INSTANCES;
+        }
+    }
+
     void run() {
-		initWindow();
+		if (mconfig.testAllocator) {
+			testAllocator();
+			return;
+		}
+		if (mconfig.benchAllocator) {
+			benchmarkAllocator();
+			return;
+		}
+		if (mconfig.benchTransforms) {
+			benchmarkTransforms();
+			return;
+		}
+		if (mconfig.benchLog) {
+			benchmarkLog();
+			return;
+		}
+		if (!mconfig.benchAssets.empty()) {
+			benchmarkAssets(mconfig.benchAssets);
+			return;
+		}
+
+        Trace::setThreadName("main");
         initVulkan();
-        //mainLoop();
+        if (mconfig.benchRecord) {
+            benchmarkRecording();
+        } else if (mconfig.benchDescriptors) {
+            benchmarkDescriptors();
+        } else if (mconfig.benchInstancing) {
+            benchmarkInstancing();
+        } else if (mconfig.validateCulling) {
+            validateCulling();
+        } else {
+            mainLoop();
+        }
         cleanup();
+        Trace::write();
     }
 
 private:
-	void initWindow() {
+	void initGlfw() {
+		if (mconfig.headless) {
+			LOG_DEBUG(LOG_GENERAL, "Headless mode, no window created");
+			return;
+		}
+
 		glfwInit();
 		glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-		glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+		glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
+	}
+
+	void initWindow() {
+		if (mconfig.headless) {
+			return;
+		}
 
 		window = glfwCreateWindow(WIDTH, HEIGHT, "YA's Vulkan", nullptr, nullptr);
+		glfwSetWindowUserPointer(window, this);
+		glfwSetFramebufferSizeCallback(window, framebufferResizeCallback);
+		glfwSetKeyCallback(window, keyCallback);
+		glfwSetCursorPosCallback(window, cursorPosCallback);
 	
 	}
 
+	static void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods) {
+		reinterpret_cast<HelloTriangleApplication*>(glfwGetWindowUserPointer(window))->noteInput();
+	}
+
+	static void cursorPosCallback(GLFWwindow* window, double x, double y) {
+		reinterpret_cast<HelloTriangleApplication*>(glfwGetWindowUserPointer(window))->noteInput();
+	}
+
+	/* Only the oldest unserviced event is kept, so the latency is the worst case for that frame */
+	void noteInput() {
+		if (!minputPending) {
+			minputPending = true;
+			minputTime = std::chrono::steady_clock::now();
+		}
+	}
+
+	static void framebufferResizeCallback(GLFWwindow* window, int width, int height) {
+		auto app = reinterpret_cast<HelloTriangleApplication*>(glfwGetWindowUserPointer(window));
+		app->requestSwapChainRecreation();
+	}
+
+	/*
+	 * Startup as a dependency graph: window creation, shader and pipeline
+	 * cache file reads overlap instance and device creation, and once the
+	 * device exists the swapchain, pipeline compilation, per-frame resources
+	 * and the initial uploads proceed in parallel. GLFW window calls stay on
+	 * the main thread.
+	 */
 	void initVulkan() {
-		createInstance();
-		setupDebugCallback();
+		auto startTime = std::chrono::steady_clock::now();
+
+		TaskGraph graph;
+		/* The instance asks GLFW for its surface extensions, so glfwInit goes first */
+		auto glfwTask = graph.add("glfwInit", [this]() { initGlfw(); }, {}, true);
+		auto windowTask = graph.add("createWindow", [this]() { initWindow(); }, {glfwTask}, true);
+		auto instanceTask = graph.add("createInstance", [this]() {
+			createInstance();
+			setupDebugCallback();
+		}, {glfwTask});
+		auto shadersTask = graph.add("readShaders", [this]() { readShaders(); });
+		auto cacheFileTask = graph.add("readPipelineCache", [this]() {
+			if (!mconfig.coldPipelineCache) {
+				mpipelineCache.preload(mconfig.pipelineCachePath);
+			}
+		});
+
+		auto surfaceTask = graph.add("createSurface", [this]() { createSurface(); }, {instanceTask, windowTask});
+		auto physicalTask = graph.add("pickPhysicalDevice", [this]() { pickPhysicalDevice(); }, {surfaceTask});
+		auto logicalTask = graph.add("createLogicalDevice", [this]() { createLogicalDevice(); }, {physicalTask});
+		auto allocatorTask = graph.add("initAllocator", [this]() {
+			mallocator.init(physicalDevice, device);
+			mdeletionQueue.init(device, mallocator);
+		}, {logicalTask});
+		auto formatTask = graph.add("chooseSurfaceFormat", [this]() { chooseSurfaceFormat(); }, {physicalTask});
+		auto heapTask = graph.add("createDescriptorHeap", [this]() { createDescriptorHeap(); }, {logicalTask});
+
+		auto swapChainTask = graph.add("createSwapChain", [this]() {
+			if (mconfig.headless) {
+				createOffscreenTargets();
+			} else {
+				createSwapChain();
+			}
+		}, {logicalTask, allocatorTask, formatTask});
+		auto imageViewsTask = graph.add("createImageViews", [this]() { createImageViews(); }, {swapChainTask});
+		if (mconfig.renderGraph) {
+			graph.add("buildRenderGraph", [this]() { buildRenderGraph(); }, {imageViewsTask});
+		}
 
-        createSurface();
-		pickPhysicalDevice();
-		createLogicalDevice();
+		auto pipelineCacheTask = graph.add("createPipelineCache", [this]() { createPipelineCache(); },
+		                                   {logicalTask, cacheFileTask});
+		auto renderPassTask = graph.add("createRenderPass", [this]() { createRenderPass(); }, {logicalTask, formatTask});
+		auto cullerTask = graph.add("createGpuCuller", [this]() { createGpuCuller(); },
+		                            {allocatorTask, pipelineCacheTask, shadersTask});
+		/* Every permutation is requested first, so prewarming compiles them side by side */
+		auto pipelineTask = graph.add("createGraphicsPipeline", [this]() {
+			mpipelines.init(device, mpipelineCache.handle(), mrenderPass, mdeletionQueue, mshaders);
+			mpipelineLayout = mdeletionQueue.own(createPipelineLayout(mheap));
+			nameObject(VK_OBJECT_TYPE_PIPELINE_LAYOUT, (uint64_t) mpipelineLayout.get(), "triangle layout");
+			VkBool32 bindless = mheap.bindless() ? VK_TRUE : VK_FALSE;
+			mtrianglePipeline = mpipelines.request<TRIANGLE_PIPELINE>(
+				mpipelineLayout, SHADER_TRIANGLE_VERT, SHADER_TRIANGLE_FRAG,
+				TriangleConstants{{bindless, mheap.shaderImageCount()}});
+			if (mgpuCulling) {
+				mcullPipelineLayout = mdeletionQueue.own(createCullPipelineLayout());
+				nameObject(VK_OBJECT_TYPE_PIPELINE_LAYOUT, (uint64_t) mcullPipelineLayout.get(), "instanced layout");
+				mcullPipeline = mpipelines.request<TRIANGLE_PIPELINE>(mcullPipelineLayout, SHADER_INSTANCED_VERT,
+				                                                      SHADER_INSTANCED_FRAG);
+			}
+			if (instancing()) {
+				createInstancePipelines();
+			}
+			mpipelines.prewarm(PIPELINE_PREWARM_THREADS);
+		}, {renderPassTask, pipelineCacheTask, shadersTask, heapTask, cullerTask});
+		graph.add("createFramebuffers", [this]() { createFramebuffers(); }, {renderPassTask, imageViewsTask});
+
+		auto frameResourcesTask = graph.add("createFrameResources", [this]() {
+			mjobSystem.reset(new JobSystem(mconfig.recordThreads == 0 ? 0 : mconfig.recordThreads - 1));
+			createFrameResources();
+		}, {allocatorTask, swapChainTask});
+		graph.add("createSceneTransforms", [this]() { createSceneTransforms(); }, {frameResourcesTask});
+		graph.add("createFrameCapture", [this]() { createFrameCapture(); }, {frameResourcesTask});
+		if (instancing()) {
+			graph.add("createInstanceObjects", [this]() { createInstanceObjects(); },
+			          {allocatorTask, frameResourcesTask, pipelineTask});
+		}
+		auto profilerTask = graph.add("createGpuProfilers", [this]() { createGpuProfilers(); }, {logicalTask});
+		graph.add("uploadScene", [this]() {
+			createUploader();
+			createMeshBuffers();
+			createSceneTextures();
+			if (!mconfig.packagePath.empty()) {
+				createAssetStreaming();
+			}
+		}, {allocatorTask, profilerTask, heapTask});
 
-        createSwapChain();
-        createImageViews();
+		graph.run(INIT_WORKER_THREADS);
+		if (mconfig.hotReload) {
+			mshaders.watch();
+		}
 
-        createGraphicsPipeline();
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - startTime;
+        mstartupMs = elapsed.count();
+        printf("Startup took %.2f ms (%s pipeline cache, %.2f ms since process start) \n", elapsed.count(),
+               mpipelineCache.isWarm() ? "warm" : "cold", Trace::sinceProcessStartMs());
+        mshaders.printStats();
+        mpipelines.printStats();
    	}	
 
 	void mainLoop() {
-		while(!glfwWindowShouldClose(window)) {
-			glfwPollEvents();
+		uint32_t frameLimit = mconfig.frameCount;
+		if (mconfig.headless && frameLimit == 0) {
+			frameLimit = HEADLESS_DEFAULT_FRAMES;
+		}
+
+		mlastFrameStart = std::chrono::steady_clock::now();
+		while(frameLimit == 0 || mframeStats.frameCount() < frameLimit) {
+			if (!mconfig.headless) {
+				if (glfwWindowShouldClose(window)) {
+					break;
+				}
+				glfwPollEvents();
+				/* A minimised window has a zero-sized framebuffer; sleep until it comes back */
+				if (mswapChainDirty && !recreateSwapChain()) {
+					glfwWaitEvents();
+					continue;
+				}
+			}
+			drawFrame();
 		}
 
+		vkDeviceWaitIdle(device);
+		printf("Present profile %s: %s, %zu images, %u frames in flight \n", mpresentProfile->name,
+		       mconfig.headless ? "headless" : presentModeName(mpresentMode), mswapChainImages.size(),
+		       mconfig.framesInFlight);
+		mframeStats.report();
+		mgpuProfiler.report();
+		mtransferProfiler.report();
+		muploader.printStats();
+		if (mconfig.streamUploadKiB > 0) {
+			printf("Stream upload: %u frames skipped with every slot busy \n", mstreamSkipped);
+		}
+		if (mpackage.isOpen()) {
+			mstreamer.printStats();
+		}
+		mheap.printStats();
+		if (!minstanceObjects.empty()) {
+			printf("Instancing: %zu objects in %u draws with %u pipeline binds per frame (%s) \n",
+			       minstanceObjects.size(), minstanceDraws, minstanceBinds,
+			       minstancePerObject ? "one draw per object" : "sorted by pipeline and mesh");
+			minstanceRing.printStats();
+		}
+		Log::printStats();
+		HostAllocator::printReport();
+		if (mcapturing) {
+			mcapture.flush();
+			mcapture.printReport();
+		}
+		if (mconfig.renderGraph) {
+			mrenderGraph.printReport();
+		}
+		if (mresizeCount > 0) {
+			printf("Swapchain recreated %u times, resize to first frame avg %.2f ms, max %.2f ms \n",
+			       mresizeCount, mresizeLatencyTotalMs / mresizeCount, mresizeLatencyMaxMs);
+		}
+		if (!mconfig.benchJsonPath.empty()) {
+			writeBenchResults(mconfig.benchJsonPath);
+		}
 	}
 
+    /* One flat JSON object of numbers for BenchDriver; every timing is in milliseconds */
+    void writeBenchResults(const std::string& path) {
+        FrameSummary frames = mframeStats.summary();
+        std::string deviceName;
+        for (const char* c = mallocator.deviceProperties().deviceName; *c != '\0'; c++) {
+            if (*c == '"' || *c == '\\') {
+                deviceName += '\\';
+            }
+            deviceName += *c;
+        }
+
+        FILE* file = fopen(path.c_str(), "w");
+        if (file == nullptr) {
+            throw std::runtime_error("Failed to write benchmark results to " + path);
+        }
+        fprintf(file, "{\n");
+        fprintf(file, "  \"device\": \"%s\",\n", deviceName.c_str());
+        fprintf(file, "  \"frames\": %zu,\n", frames.frames);
+        fprintf(file, "  \"startup_ms\": %.4f,\n", mstartupMs);
+        fprintf(file, "  \"first_frame_ms\": %.4f,\n", mfirstFrameMs);
+        fprintf(file, "  \"frame_mean_ms\": %.4f,\n", frames.meanFrameMs);
+        fprintf(file, "  \"frame_p50_ms\": %.4f,\n", frames.frameP50Ms);
+        fprintf(file, "  \"frame_p95_ms\": %.4f,\n", frames.frameP95Ms);
+        fprintf(file, "  \"frame_p99_ms\": %.4f,\n", frames.frameP99Ms);
+        fprintf(file, "  \"cpu_p50_ms\": %.4f,\n", frames.cpuP50Ms);
+        fprintf(file, "  \"cpu_p95_ms\": %.4f,\n", frames.cpuP95Ms);
+        fprintf(file, "  \"cpu_p99_ms\": %.4f,\n", frames.cpuP99Ms);
+        fprintf(file, "  \"peak_rss_mib\": %.2f,\n", readStatusKiB("VmHWM:") / 1024.0);
+        fprintf(file, "  \"peak_device_mib\": %.2f\n", mallocator.peakDeviceBytes() / (1024.0 * 1024.0));
+        fprintf(file, "}\n");
+        if (fclose(file) != 0) {
+            throw std::runtime_error("Failed to write benchmark results to " + path);
+        }
+    }
+
 	void cleanup() {
-		print_d("Cleanup Called \n");
+		TRACE_SCOPE("cleanup", "shutdown");
+		LOG_DEBUG(LOG_GENERAL, "Cleanup Called");
 		if (enableValidationLayers) {
-			DestroyDebugReportCallbackEXT(instance, callback, nullptr);
+			DestroyDebugUtilsMessengerEXT(instance, mdebugMessenger, HostAllocator::callbacks());
 		}
-        for (auto imageView : mswapChainImageViews) {
-            vkDestroyImageView(device, imageView, nullptr);
+        mshaders.destroy();
+        if (mcapturing) {
+            mcapture.destroy(mallocator);
+        }
+        destroySceneTextures();
+        destroyMeshBuffers();
+        if (mpackage.isOpen()) {
+            mstreamer.destroy();
+        }
+        if (instancing()) {
+            minstanceRing.destroy();
+        }
+        if (mtransformBuffer != VK_NULL_HANDLE) {
+            mallocator.destroyBuffer(mtransformBuffer, mtransformAllocation);
+        }
+        muploader.destroy();
+        mgpuProfiler.destroy();
+        mtransferProfiler.destroy();
+
+        destroyFrameResources();
+
+        /*
+         * Owned objects are retired views-first so the queue destroys them
+         * before the images and chain they reference. The device is idle, so
+         * the flush is a single pass over whatever is still queued.
+         */
+        mswapChainFramebuffers.clear();
+        mswapChainImageViews.clear();
+        mswapChain.reset();
+        mpipelines.destroy();
+        mpipelineLayout.reset();
+        mcullPipelineLayout.reset();
+        minstancePipelineLayout.reset();
+        mrenderPass.reset();
+        mrenderGraph.destroy();
+        mdeletionQueue.destroy();
+        mdeletionQueue.printStats();
+
+        mheap.destroy();
+        if (minstanceDescriptorPool != VK_NULL_HANDLE) {
+            vkDestroyDescriptorPool(device, minstanceDescriptorPool, HostAllocator::callbacks());
+            vkDestroyDescriptorSetLayout(device, minstanceSetLayout, HostAllocator::callbacks());
+        }
+        mculler.destroy(mallocator);
+
+        mpipelineCache.save();
+        mpipelineCache.destroy();
+
+        if (mconfig.headless) {
+            destroyOffscreenTargets();
         }
-        vkDestroySwapchainKHR(device, mswapChain, nullptr);
-	    vkDestroyDevice(device, nullptr);
-		vkDestroySurfaceKHR(instance, msurface, nullptr);
-		vkDestroyInstance(instance, nullptr);
-		glfwDestroyWindow(window);
 
-		glfwTerminate();
+        mallocator.printStats();
+        mallocator.destroy();
+	    vkDestroyDevice(device, HostAllocator::callbacks());
+		if (!mconfig.headless) {
+			vkDestroySurfaceKHR(instance, msurface, HostAllocator::callbacks());
+		}
+		vkDestroyInstance(instance, HostAllocator::callbacks());
+
+		if (!mconfig.headless) {
+			glfwDestroyWindow(window);
+			glfwTerminate();
+		}
 
     }
 
@@ -138,6 +801,16 @@ private:
 		appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
 		appInfo.apiVersion = VK_API_VERSION_1_0;
 
+		/* Vulkan 1.0 loaders lack vkEnumerateInstanceVersion and reject any other apiVersion */
+		auto enumerateInstanceVersion = reinterpret_cast<PFN_vkEnumerateInstanceVersion>(
+				vkGetInstanceProcAddr(nullptr, "vkEnumerateInstanceVersion"));
+		uint32_t loaderVersion = VK_API_VERSION_1_0;
+		if (enumerateInstanceVersion != nullptr && enumerateInstanceVersion(&loaderVersion) == VK_SUCCESS &&
+				loaderVersion >= VK_API_VERSION_1_1) {
+			appInfo.apiVersion = VK_API_VERSION_1_1;
+		}
+		minstanceApiVersion = appInfo.apiVersion;
+
 		VkInstanceCreateInfo createInfo = {};
 		createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
 		createInfo.pApplicationInfo = &appInfo;
@@ -156,9 +829,14 @@ private:
 			createInfo.enabledLayerCount = static_cast<uint32_t>(validationLayers.size());
 			createInfo.ppEnabledLayerNames = validationLayers.data();
 		}
+		/* Covers vkCreateInstance and vkDestroyInstance, which the messenger cannot */
+		VkDebugUtilsMessengerCreateInfoEXT messengerInfo = debugMessengerCreateInfo();
+		if (enableValidationLayers) {
+			createInfo.pNext = &messengerInfo;
+		}
 
 
-		if( vkCreateInstance(&createInfo, nullptr, &instance) != VK_SUCCESS) {
+		if( vkCreateInstance(&createInfo, HostAllocator::callbacks(), &instance) != VK_SUCCESS) {
 			throw std::runtime_error("failed to create instance !\n");
 		}
 	}
@@ -192,15 +870,20 @@ private:
 
 
 	std::vector<const char*> getRequiredExtensions() {
-		uint32_t glfwExtensionCount = 0;
-		const char** glfwExtensions;
-		glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
-		printf("Found %d extensions \n", glfwExtensionCount);
+		std::vector<const char*> extensions;
+
+		/* GLFW is never initialised when headless, so no surface extensions are needed */
+		if (!mconfig.headless) {
+			uint32_t glfwExtensionCount = 0;
+			const char** glfwExtensions;
+			glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+			printf("Found %d extensions \n", glfwExtensionCount);
 
-		std::vector<const char*> extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
+			extensions.assign(glfwExtensions, glfwExtensions + glfwExtensionCount);
+		}
 
 		if(enableValidationLayers) {
-			extensions.push_back(VK_EXT_DEBUG_REPORT_EXTENSION_NAME);
+			extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
 		}
 
 		return extensions;
@@ -209,42 +892,71 @@ private:
 	void setupDebugCallback() {
 		if (!enableValidationLayers) return;
 
-		VkDebugReportCallbackCreateInfoEXT createInfo = {};
-		createInfo.sType = VK_STRUCTURE_TYPE_DEBUG_REPORT_CALLBACK_CREATE_INFO_EXT;
-		createInfo.flags = VK_DEBUG_REPORT_ERROR_BIT_EXT | VK_DEBUG_REPORT_WARNING_BIT_EXT;
-		createInfo.pfnCallback = debugCallback;
-
-		if (CreateDebugReportCallbackEXT(instance, &createInfo, nullptr, &callback) != VK_SUCCESS) {
+		VkDebugUtilsMessengerCreateInfoEXT createInfo = debugMessengerCreateInfo();
+		if (CreateDebugUtilsMessengerEXT(instance, &createInfo, HostAllocator::callbacks(), &mdebugMessenger) !=
+			VK_SUCCESS) {
 			throw std::runtime_error("failed to set up debug callback!");
 		}
+		msetObjectName = (PFN_vkSetDebugUtilsObjectNameEXT) vkGetInstanceProcAddr(instance,
+		                                                                         "vkSetDebugUtilsObjectNameEXT");
 	}
 
-	void pickPhysicalDevice() {
-		uint32_t deviceCount = 0;
-		vkEnumeratePhysicalDevices(instance, &deviceCount, nullptr);
-		if(deviceCount == 0) {
-			throw std::runtime_error("Failed to find GPUs with vulkan support \n");
+	/* Validation messages show the name next to the handle; a no-op without validation */
+	void nameObject(VkObjectType type, uint64_t handle, const std::string& name) {
+		if (msetObjectName == nullptr || handle == 0) {
+			return;
 		}
+		VkDebugUtilsObjectNameInfoEXT nameInfo = {};
+		nameInfo.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_OBJECT_NAME_INFO_EXT;
+		nameInfo.objectType = type;
+		nameInfo.objectHandle = handle;
+		nameInfo.pObjectName = name.c_str();
+		msetObjectName(device, &nameInfo);
+	}
 
-		print_d("GPU device count %d \n", deviceCount);
-
-		std::vector<VkPhysicalDevice> devices(deviceCount);
-		vkEnumeratePhysicalDevices(instance, &deviceCount, devices.data());
-
-		for(const auto& device : devices) {
-			if(isDeviceSuitable(device)) {
-				physicalDevice = device;
-				break;
-			}
+	void pickPhysicalDevice() {
+		DeviceRequirements requirements;
+		/* Nothing is presented when headless, so the swapchain extension is optional */
+		if (!mconfig.headless) {
+			requirements.extensions |= DEVICE_EXTENSION_SWAPCHAIN;
 		}
-
-		if(physicalDevice == VK_NULL_HANDLE) {
-			throw std::runtime_error("Failed to find a suitable GPU");
+		requirements.preferredFeatures = DEVICE_FEATURE_MULTI_DRAW_INDIRECT | DEVICE_FEATURE_PIPELINE_STATISTICS_QUERY |
+		                                 DEVICE_FEATURE_BINDLESS;
+		/* One indirect command per surviving instance, identified by its firstInstance */
+		if (mconfig.cullInstances > 0) {
+			requirements.features |= DEVICE_FEATURE_MULTI_DRAW_INDIRECT | DEVICE_FEATURE_DRAW_INDIRECT_FIRST_INSTANCE;
 		}
 
+		DeviceSelector selector(mconfig.deviceCachePath, minstanceApiVersion >= VK_API_VERSION_1_1);
+		physicalDevice = selector.select(instance, requirements,
+		                                 [this](VkPhysicalDevice device) { return isDeviceSuitable(device); },
+		                                 mconfig.gpuOverride);
+
+		/*
+		 * The bindless bit is only set when the indexing features were probed through
+		 * vkGetPhysicalDeviceFeatures2 on a 1.1 instance and device, where the extension's
+		 * maintenance3 dependency is core; the capability cache keys its entries on that.
+		 */
+		mbindless = !mconfig.noBindless && (selector.selected().features & DEVICE_FEATURE_BINDLESS);
+
+		mgpuCulling = mconfig.cullInstances > 0;
+		mdrawIndirectCount = mgpuCulling && !mconfig.noDrawIndirectCount &&
+		                     (selector.selected().extensions & DEVICE_EXTENSION_DRAW_INDIRECT_COUNT);
+		masyncCompute = mgpuCulling && findQueueFamilies(physicalDevice).computeFamily !=
+		                               findQueueFamilies(physicalDevice).graphicsFamily;
 	}
 
+	/*
+	 * Results are memoised per device: selection, device creation, the
+	 * swapchain, frame resources and the uploader all ask. Only device
+	 * selection can miss, so the parallel init stages that follow it only read.
+	 */
 	QueueFamilyIndices findQueueFamilies(VkPhysicalDevice device) {
+		auto cached = mqueueFamilyCache.find(device);
+		if (cached != mqueueFamilyCache.end()) {
+			return cached->second;
+		}
+
 		QueueFamilyIndices indices;
 		uint32_t  queueFamilyCount = 0;
 		vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, nullptr);
@@ -254,57 +966,81 @@ private:
 
 		VkBool32 presentSupport = false;
 
+		/* Lower is better: transfer-only, then transfer+compute, anything else is not dedicated */
+		int transferRank = 3;
+
 		int i = 0;
 		for(const auto& queueFamily : queueFamilies) {
-			if(queueFamily.queueCount > 0 && queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) {
+			if(queueFamily.queueCount > 0 && queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT &&
+					indices.graphicsFamily < 0) {
 				indices.graphicsFamily = i;
 			}
 
-			vkGetPhysicalDeviceSurfaceSupportKHR(device, i, msurface, &presentSupport);
-			if(queueFamily.queueCount > 0 && presentSupport) {
-				indices.presentFamily = i;
+			if (!mconfig.headless && indices.presentFamily < 0) {
+				vkGetPhysicalDeviceSurfaceSupportKHR(device, i, msurface, &presentSupport);
+				if(queueFamily.queueCount > 0 && presentSupport) {
+					indices.presentFamily = i;
+				}
+			}
+
+			/* A compute family without graphics can cull while the graphics queue renders */
+			if(queueFamily.queueCount > 0 && queueFamily.queueFlags & VK_QUEUE_COMPUTE_BIT &&
+					!(queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) && indices.computeFamily < 0) {
+				indices.computeFamily = i;
 			}
 
-			if(indices.isComplete()) {
-				break;
+			if(queueFamily.queueCount > 0 && queueFamily.queueFlags & VK_QUEUE_TRANSFER_BIT &&
+					!(queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT)) {
+				int rank = (queueFamily.queueFlags & VK_QUEUE_COMPUTE_BIT) ? 2 : 1;
+				if (rank < transferRank) {
+					transferRank = rank;
+					indices.transferFamily = i;
+				}
 			}
 			i++;
 
 		}
 
+		/* Graphics queues always support transfers and compute */
+		if (indices.transferFamily < 0) {
+			indices.transferFamily = indices.graphicsFamily;
+		}
+		if (indices.computeFamily < 0) {
+			indices.computeFamily = indices.graphicsFamily;
+		}
 
+
+		mqueueFamilyCache[device] = indices;
 		return indices;
 	}
 
+	/*
+	 * Surface-dependent checks only; extensions, features and queue topology
+	 * were already checked by DeviceSelector.
+	 */
 	bool isDeviceSuitable(VkPhysicalDevice device) {
-		VkPhysicalDeviceProperties deviceProperties;
-		VkPhysicalDeviceFeatures deviceFeatures;
-
-		vkGetPhysicalDeviceProperties(device, &deviceProperties);
-		vkGetPhysicalDeviceFeatures(device, &deviceFeatures);
-
-        bool extensionSupported = checkDeviceExtensionSupport(device);
-
         bool swapChainAdequate = false;
-        if(extensionSupported) {
-            print_d("extension supported \n");
+        if(mconfig.headless) {
+            /* Offscreen targets only need a colour attachment format, checked at creation */
+            swapChainAdequate = true;
+        } else {
             SwapChainSupportDetails swapChainSupport = querySwapChainSupport(device);
             swapChainAdequate = !swapChainSupport.formats.empty() &&
                     !swapChainSupport.presentModes.empty();
-            print_d("swapChainAdequate %d \n", swapChainAdequate);
+            LOG_DEBUG(LOG_DEVICE, "swapChainAdequate %d", swapChainAdequate);
         }
 
-		print_d("deviceType %x \n", deviceProperties.deviceType);
-
-		return findQueueFamilies(device).isComplete() && swapChainAdequate;
-		//return (deviceFeatures.geometryShader);
+		return findQueueFamilies(device).isComplete(!mconfig.headless) && swapChainAdequate;
 	}
 
 	void createLogicalDevice() {
 		QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
 
 		std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-		std::set<int> uniqueQueueFamilies = {indices.graphicsFamily, indices.presentFamily};
+		std::set<int> uniqueQueueFamilies = {indices.graphicsFamily, indices.transferFamily, indices.computeFamily};
+		if (!mconfig.headless) {
+			uniqueQueueFamilies.insert(indices.presentFamily);
+		}
 
 		float queuePriority = 1.0f;
 		for(int queueFamily : uniqueQueueFamilies) {
@@ -318,58 +1054,105 @@ private:
 
 
 		VkPhysicalDeviceFeatures deviceFeatures = {};
+		deviceFeatures.multiDrawIndirect = mgpuCulling ? VK_TRUE : VK_FALSE;
+		deviceFeatures.drawIndirectFirstInstance = mgpuCulling ? VK_TRUE : VK_FALSE;
+		/* triangle.frag indexes its texture array with the pushed, dynamically uniform, index */
+		deviceFeatures.shaderSampledImageArrayDynamicIndexing = mbindless ? VK_TRUE : VK_FALSE;
+
+		/* Exactly the bits DeviceSelector checked for DEVICE_FEATURE_BINDLESS */
+		VkPhysicalDeviceDescriptorIndexingFeaturesEXT indexingFeatures = {};
+		indexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+		indexingFeatures.runtimeDescriptorArray = VK_TRUE;
+		indexingFeatures.descriptorBindingPartiallyBound = VK_TRUE;
+		indexingFeatures.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+		indexingFeatures.descriptorBindingStorageBufferUpdateAfterBind = VK_TRUE;
+		indexingFeatures.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+		indexingFeatures.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
 
 		VkDeviceCreateInfo createInfo = {};
 		createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
 		createInfo.pQueueCreateInfos = queueCreateInfos.data();
 		createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
 		createInfo.pEnabledFeatures = &deviceFeatures;
+		if (mbindless) {
+			createInfo.pNext = &indexingFeatures;
+		}
 
 		/*Enable Validation layers and extensions*/
-		createInfo.enabledExtensionCount = static_cast<uint32_t >(deviceExtensions.size());
-        createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+		std::vector<const char*> extensions = getRequiredDeviceExtensions();
+		createInfo.enabledExtensionCount = static_cast<uint32_t >(extensions.size());
+        createInfo.ppEnabledExtensionNames = extensions.data();
 		createInfo.enabledLayerCount = 0;
 		if(enableValidationLayers) {
 			createInfo.enabledLayerCount = static_cast<uint32_t >(validationLayers.size());
 			createInfo.ppEnabledLayerNames = validationLayers.data();
 		}
 
-		if (vkCreateDevice(physicalDevice, &createInfo, nullptr, &device) != VK_SUCCESS) {
+		if (vkCreateDevice(physicalDevice, &createInfo, HostAllocator::callbacks(), &device) != VK_SUCCESS) {
 			throw std::runtime_error("Failed to create logical device");
 		}
 
 		vkGetDeviceQueue(device, indices.graphicsFamily, 0, &mgraphicsQueue);
-		vkGetDeviceQueue(device, indices.presentFamily, 0, &mpresentQueue);
+		if (!mconfig.headless) {
+			vkGetDeviceQueue(device, indices.presentFamily, 0, &mpresentQueue);
+		}
+		vkGetDeviceQueue(device, indices.transferFamily, 0, &mtransferQueue);
+		vkGetDeviceQueue(device, indices.computeFamily, 0, &mcomputeQueue);
+		nameObject(VK_OBJECT_TYPE_DEVICE, (uint64_t) device, "device");
+		nameObject(VK_OBJECT_TYPE_QUEUE, (uint64_t) mgraphicsQueue, "graphics queue");
+		if (mtransferQueue != mgraphicsQueue) {
+			nameObject(VK_OBJECT_TYPE_QUEUE, (uint64_t) mtransferQueue, "transfer queue");
+		}
+		if (mcomputeQueue != mgraphicsQueue) {
+			nameObject(VK_OBJECT_TYPE_QUEUE, (uint64_t) mcomputeQueue, "compute queue");
+		}
+		LOG_DEBUG(LOG_DEVICE, "graphics family %d, transfer family %d, compute family %d",
+		          indices.graphicsFamily, indices.transferFamily, indices.computeFamily);
 
 	}
 
 	void createSurface(){
-		if(glfwCreateWindowSurface(instance, window, nullptr, &msurface) != VK_SUCCESS) {
+		if (mconfig.headless) {
+			return;
+		}
+		if(glfwCreateWindowSurface(instance, window, HostAllocator::callbacks(), &msurface) != VK_SUCCESS) {
 			throw std::runtime_error("Failed to create Window Surface");
 		}
 	}
 
-    bool  checkDeviceExtensionSupport(VkPhysicalDevice device) {
-        uint32_t extensionCount = 0;
-        vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
-        print_d("Found %d extensions \n", extensionCount);
-
-        std::vector<VkExtensionProperties> availableExtensions(extensionCount);
-        vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
-
-        std::set<std::string> requiredExtensions(deviceExtensions.begin(), deviceExtensions.end());
-
-        for(const auto& extension : availableExtensions) {
-//            print_d("checkDeviceExtensionSupport found %s extension \n", extension.extensionName);
-            requiredExtensions.erase(extension.extensionName);
+    std::vector<const char*> getRequiredDeviceExtensions() {
+        std::vector<const char*> extensions;
+        /* Nothing is presented when headless, so the swapchain extension is optional */
+        if (!mconfig.headless) {
+            extensions = deviceExtensions;
+        }
+        if (mbindless) {
+            extensions.push_back(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
         }
-        return requiredExtensions.empty();
+        if (mdrawIndirectCount) {
+            extensions.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+        }
+        return extensions;
     }
 
+    /*
+     * Capabilities carry the current extent and are queried every time.
+     * Formats and present modes are memoised like findQueueFamilies(), so
+     * device selection and the parallel init stages query each device once;
+     * they can change with the surface (e.g. the window moving to another
+     * display), so recreateSwapChain() drops the entry to query them again.
+     */
     SwapChainSupportDetails querySwapChainSupport(VkPhysicalDevice device) {
         SwapChainSupportDetails details;
         vkGetPhysicalDeviceSurfaceCapabilitiesKHR(device, msurface, &details.capabilities);
 
+        auto cached = msurfaceSupportCache.find(device);
+        if (cached != msurfaceSupportCache.end()) {
+            details.formats = cached->second.formats;
+            details.presentModes = cached->second.presentModes;
+            return details;
+        }
+
         VkResult result;
         /*Query Formats*/
         uint32_t  formatCount;
@@ -378,7 +1161,7 @@ private:
             details.formats.resize(formatCount);
             result = vkGetPhysicalDeviceSurfaceFormatsKHR(device, msurface, &formatCount, details.formats.data());
 
-            print_d("result %d count %lu\n", result, details.formats.size());
+            LOG_DEBUG(LOG_SWAPCHAIN, "result %d count %lu", result, details.formats.size());
         }
 
         /*Query Presentation*/
@@ -389,7 +1172,8 @@ private:
             result =  vkGetPhysicalDeviceSurfacePresentModesKHR(device, msurface, &presentModeCount, details.presentModes.data());
         }
 
-        print_d("formatCount %d, presentModeCount %d \n", formatCount, presentModeCount);
+        LOG_DEBUG(LOG_SWAPCHAIN, "formatCount %d, presentModeCount %d", formatCount, presentModeCount);
+        msurfaceSupportCache[device] = details;
         return  details;
     }
 
@@ -408,23 +1192,18 @@ private:
     }
 
     VkPresentModeKHR chooseSwapPresentMode(const std::vector<VkPresentModeKHR> availablePresentModes) {
-        VkPresentModeKHR bestMode = VK_PRESENT_MODE_FIFO_KHR;
-        for(const auto& availablePresentMode : availablePresentModes) {
-            if(availablePresentMode == VK_PRESENT_MODE_MAILBOX_KHR) {
-                return availablePresentMode;
-            } else if (availablePresentMode == VK_PRESENT_MODE_IMMEDIATE_KHR) {
-                bestMode = availablePresentMode;
-            }
-        }
-
-        return bestMode;
+        return choosePresentMode(*mpresentProfile, availablePresentModes);
     }
 
     VkExtent2D chooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabilities) {
         if(capabilities.currentExtent.width != std::numeric_limits<uint32_t>::max()) {
             return capabilities.currentExtent;
         } else {
-            VkExtent2D actualExtent = {WIDTH, HEIGHT};
+            int width = WIDTH, height = HEIGHT;
+            if (window) {
+                glfwGetFramebufferSize(window, &width, &height);
+            }
+            VkExtent2D actualExtent = {static_cast<uint32_t>(width), static_cast<uint32_t>(height)};
 
             actualExtent.width = std::max(capabilities.minImageExtent.width,
                                           std::min(capabilities.maxImageExtent.width, actualExtent.width));
@@ -435,19 +1214,23 @@ private:
     }
 
 
-    void createSwapChain() {
+    /*
+     * Passing the current chain as oldSwapChain lets the driver hand its
+     * resources over; the old chain is retired and may no longer be acquired
+     * from. Returns false when the surface currently has a zero extent.
+     */
+    bool createSwapChain(VkSwapchainKHR oldSwapChain = VK_NULL_HANDLE) {
         SwapChainSupportDetails swapChainSupport = querySwapChainSupport(physicalDevice);
 
-        VkSurfaceFormatKHR surfaceFormat = chooseSwapSurfaceFormat(swapChainSupport.formats);
+        const VkSurfaceFormatKHR& surfaceFormat = msurfaceFormat;
         VkPresentModeKHR presentMode = chooseSwapPresentMode(swapChainSupport.presentModes);
         VkExtent2D extent = chooseSwapExtent(swapChainSupport.capabilities);
+        if (extent.width == 0 || extent.height == 0) {
+            return false;
+        }
 
 
-        uint32_t  imageCount = swapChainSupport.capabilities.minImageCount + 1;
-        if(swapChainSupport.capabilities.maxImageCount > 0 &&
-                imageCount > swapChainSupport.capabilities.maxImageCount) {
-            imageCount = swapChainSupport.capabilities.maxImageCount;
-        }
+        uint32_t  imageCount = chooseImageCount(*mpresentProfile, swapChainSupport.capabilities);
 
         VkSwapchainCreateInfoKHR createInfo = {};
         createInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
@@ -458,11 +1241,23 @@ private:
         createInfo.imageExtent = extent;
         createInfo.imageArrayLayers = 1;
         createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+        if (!mconfig.captureDirectory.empty()) {
+            if (!(swapChainSupport.capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_SRC_BIT)) {
+                throw std::runtime_error("Swapchain images cannot be copied from for --capture, use --headless");
+            }
+            createInfo.imageUsage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+        }
+        if (mconfig.renderGraph) {
+            if (!(swapChainSupport.capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_DST_BIT)) {
+                throw std::runtime_error("Swapchain images cannot be blitted to for --render-graph, use --headless");
+            }
+            createInfo.imageUsage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+        }
 
         /* Create Queue */
         QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
         if(indices.graphicsFamily != indices.presentFamily) {
-            print_d("Different queue family");
+            LOG_DEBUG(LOG_SWAPCHAIN, "Different queue family");
             uint32_t queueFamilyIndices[] = {(uint32_t)indices.graphicsFamily,
                                              (uint32_t)indices.presentFamily};
             createInfo.imageSharingMode = VK_SHARING_MODE_CONCURRENT;
@@ -479,21 +1274,94 @@ private:
 
         createInfo.presentMode = presentMode;
         createInfo.clipped = VK_TRUE;
-        createInfo.oldSwapchain = VK_NULL_HANDLE;
+        createInfo.oldSwapchain = oldSwapChain;
 
-        /* Now create the swap chain */
-        if(vkCreateSwapchainKHR(device, &createInfo, nullptr, &mswapChain) != VK_SUCCESS) {
+        /* Now create the swap chain; assigning retires the previous one */
+        VkSwapchainKHR swapChain;
+        if(vkCreateSwapchainKHR(device, &createInfo, HostAllocator::callbacks(), &swapChain) != VK_SUCCESS) {
             throw std::runtime_error("Failed to create swapchain");
         }
+        mswapChain = mdeletionQueue.own(swapChain);
 
         vkGetSwapchainImagesKHR(device, mswapChain, &imageCount, nullptr);
         mswapChainImages.resize(imageCount);
         vkGetSwapchainImagesKHR(device, mswapChain, &imageCount, mswapChainImages.data());
 
-        mswapChainImageFormat = surfaceFormat.format;
         mswapChainExtent = extent;
+        mpresentMode = presentMode;
+        LOG_DEBUG(LOG_SWAPCHAIN, "Swapchain: %s, %u images", presentModeName(presentMode), imageCount);
+        return true;
+    }
+
+    void requestSwapChainRecreation() {
+        if (!mswapChainDirty) {
+            mswapChainDirty = true;
+            mresizeStart = std::chrono::steady_clock::now();
+        }
     }
 
+    /*
+     * Rebuilds the swapchain and the objects sized by it (image views and
+     * framebuffers) without idling the device. The surface format is chosen
+     * again; while it keeps its format the render pass and pipelines survive,
+     * since viewport and scissor are dynamic state. A new format rebuilds the
+     * render pass and every pipeline against it. The previous chain, its
+     * views and framebuffers go to the deletion queue, which destroys them
+     * once the frames already submitted against them have retired. Their
+     * final presents were queued before that fence signaled and wait on the
+     * same frame's renderFinished semaphore, so they have been consumed by
+     * then too.
+     */
+    bool recreateSwapChain() {
+        auto startTime = std::chrono::steady_clock::now();
+        VkExtent2D previousExtent = mswapChainExtent;
+        VkSurfaceFormatKHR previousFormat = msurfaceFormat;
+
+        /* Retired ahead of the chain so they are destroyed before the images they view */
+        mswapChainFramebuffers.clear();
+        mswapChainImageViews.clear();
+        /* Read fresh from the surface; createSwapChain() then reuses the new entry */
+        msurfaceSupportCache.erase(physicalDevice);
+        chooseSurfaceFormat();
+        if (!createSwapChain(mswapChain)) {
+            /* Compared again on the next attempt */
+            msurfaceFormat = previousFormat;
+            mswapChainImageFormat = previousFormat.format;
+            return false;
+        }
+
+        bool formatChanged = msurfaceFormat.format != previousFormat.format;
+        if (formatChanged || msurfaceFormat.colorSpace != previousFormat.colorSpace) {
+            LOG_INFO(LOG_SWAPCHAIN, "Surface format changed from %d/%d to %d/%d", previousFormat.format,
+                     previousFormat.colorSpace, msurfaceFormat.format, msurfaceFormat.colorSpace);
+        }
+        /* The colour space is the chain's alone; the format is baked into the pass and its pipelines */
+        if (formatChanged) {
+            createRenderPass();
+            mpipelines.setRenderPass(mrenderPass, PIPELINE_PREWARM_THREADS);
+        }
+
+        createImageViews();
+        createFramebuffers();
+        if (mconfig.renderGraph) {
+            buildRenderGraph();
+        }
+        mimagesInFlight.assign(mswapChainImages.size(), VK_NULL_HANDLE);
+        if (mcapturing && (formatChanged || mswapChainExtent.width != previousExtent.width ||
+                           mswapChainExtent.height != previousExtent.height)) {
+            /* The readback slots are sized by the image; the only resize that idles the device */
+            vkDeviceWaitIdle(device);
+            mcapture.resize(mallocator, mswapChainExtent, mswapChainImageFormat);
+        }
+
+        mswapChainDirty = false;
+        mawaitingResizedFrame = true;
+
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - startTime;
+        LOG_DEBUG(LOG_SWAPCHAIN, "Swapchain recreated at %ux%u in %.3f ms", mswapChainExtent.width,
+                  mswapChainExtent.height, elapsed.count());
+        return true;
+    }
 
     void createImageViews() {
         mswapChainImageViews.resize(mswapChainImages.size());
@@ -517,45 +1385,2442 @@ private:
             createInfo.subresourceRange.layerCount = 1;
 
 
-            if (vkCreateImageView(device, &createInfo, nullptr, &mswapChainImageViews[i]) !=
-                VK_SUCCESS) {
+            VkImageView imageView;
+            if (vkCreateImageView(device, &createInfo, HostAllocator::callbacks(), &imageView) != VK_SUCCESS) {
                 throw std::runtime_error("failed to create image views!");
             }
+            mswapChainImageViews[i] = mdeletionQueue.own(imageView);
+            std::string name = (mconfig.headless ? "offscreen target " : "swapchain image ") + std::to_string(i);
+            nameObject(VK_OBJECT_TYPE_IMAGE, (uint64_t) mswapChainImages[i], name);
+            nameObject(VK_OBJECT_TYPE_IMAGE_VIEW, (uint64_t) imageView, name + " view");
+        }
+    }
+
+
+    /*
+     * Picks the colour format up front so the render pass does not have to
+     * wait for the swapchain (or offscreen targets) to be created.
+     */
+    void chooseSurfaceFormat() {
+        if (mconfig.headless) {
+            mswapChainImageFormat = chooseOffscreenFormat();
+            return;
+        }
+        msurfaceFormat = chooseSwapSurfaceFormat(querySwapChainSupport(physicalDevice).formats);
+        mswapChainImageFormat = msurfaceFormat.format;
+    }
+
+    VkFormat chooseOffscreenFormat() {
+        const VkFormat candidates[] = {VK_FORMAT_B8G8R8A8_UNORM, VK_FORMAT_R8G8B8A8_UNORM};
+        for (VkFormat format : candidates) {
+            VkFormatProperties props;
+            vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &props);
+            if (props.optimalTilingFeatures & VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT) {
+                return format;
+            }
         }
+        throw std::runtime_error("Failed to find an offscreen colour attachment format");
     }
 
+    /*
+     * Headless replacement for createSwapChain(): a ring of device-local images
+     * that the rest of the pipeline treats exactly like swapchain images.
+     */
+    void createOffscreenTargets() {
+        mswapChainExtent = {static_cast<uint32_t>(WIDTH), static_cast<uint32_t>(HEIGHT)};
+
+        mswapChainImages.resize(OFFSCREEN_IMAGE_COUNT);
+        moffscreenAllocations.resize(OFFSCREEN_IMAGE_COUNT);
+
+        for (uint32_t i = 0; i < OFFSCREEN_IMAGE_COUNT; i++) {
+            VkImageCreateInfo imageInfo = {};
+            imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+            imageInfo.imageType = VK_IMAGE_TYPE_2D;
+            imageInfo.format = mswapChainImageFormat;
+            imageInfo.extent.width = mswapChainExtent.width;
+            imageInfo.extent.height = mswapChainExtent.height;
+            imageInfo.extent.depth = 1;
+            imageInfo.mipLevels = 1;
+            imageInfo.arrayLayers = 1;
+            imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+            imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+            imageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT |
+                              VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+            imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+            imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+            mallocator.createImage(imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                                   mswapChainImages[i], moffscreenAllocations[i]);
+        }
 
-    void createGraphicsPipeline() {
+        LOG_DEBUG(LOG_SWAPCHAIN, "%u offscreen targets %ux%u format %d", OFFSCREEN_IMAGE_COUNT,
+                  mswapChainExtent.width, mswapChainExtent.height, mswapChainImageFormat);
+    }
 
+    void destroyOffscreenTargets() {
+        for (size_t i = 0; i < mswapChainImages.size(); i++) {
+            mallocator.destroyImage(mswapChainImages[i], moffscreenAllocations[i]);
+        }
+        mswapChainImages.clear();
+        moffscreenAllocations.clear();
     }
-private:
-	GLFWwindow* window;
 
-	VkInstance instance;
-	VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
-	VkDevice device;
-	VkQueue  mgraphicsQueue;
-	VkQueue  mpresentQueue;
-	VkSurfaceKHR  msurface;
-	VkDebugReportCallbackEXT callback;
+    void createPipelineCache() {
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
 
-    std::vector<VkImage> mswapChainImages;
-    VkSwapchainKHR mswapChain;
-    VkFormat mswapChainImageFormat;
-    VkExtent2D mswapChainExtent;
+        mpipelineCache.create(device, properties, mconfig.pipelineCachePath, !mconfig.coldPipelineCache);
+    }
 
-    std::vector<VkImageView> mswapChainImageViews;
-};
+    void createRenderPass() {
+        VkAttachmentDescription colorAttachment = {};
+        colorAttachment.format = mswapChainImageFormat;
+        colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+        /* The render graph's composite is the background the triangles are drawn over */
+        colorAttachment.loadOp = mconfig.renderGraph ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR;
+        colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+        colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        colorAttachment.initialLayout = mconfig.renderGraph ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
+                                                            : VK_IMAGE_LAYOUT_UNDEFINED;
+        /* Offscreen targets are never presented, leave them ready for readback instead */
+        colorAttachment.finalLayout = mconfig.headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL
+                                                       : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+        VkAttachmentReference colorAttachmentRef = {};
+        colorAttachmentRef.attachment = 0;
+        colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+        VkSubpassDescription subpass = {};
+        subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+        subpass.colorAttachmentCount = 1;
+        subpass.pColorAttachments = &colorAttachmentRef;
+
+        VkSubpassDependency dependency = {};
+        dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+        dependency.dstSubpass = 0;
+        dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        dependency.srcAccessMask = 0;
+        dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+
+        VkRenderPassCreateInfo renderPassInfo = {};
+        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+        renderPassInfo.attachmentCount = 1;
+        renderPassInfo.pAttachments = &colorAttachment;
+        renderPassInfo.subpassCount = 1;
+        renderPassInfo.pSubpasses = &subpass;
+        renderPassInfo.dependencyCount = 1;
+        renderPassInfo.pDependencies = &dependency;
+
+        VkRenderPass renderPass;
+        if (vkCreateRenderPass(device, &renderPassInfo, HostAllocator::callbacks(), &renderPass) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create render pass");
+        }
+        mrenderPass = mdeletionQueue.own(renderPass);
+        nameObject(VK_OBJECT_TYPE_RENDER_PASS, (uint64_t) renderPass, "main pass");
+    }
 
-int main() {
-    HelloTriangleApplication app;
+    /*
+     * Queues every shader on the shader cache's own threads, so hashing,
+     * mapping and any compilation overlap device creation. Each pipeline
+     * waits only for the shaders it uses. It is not yet known whether the
+     * descriptor heap will be bindless or culling runs on the GPU, so every
+     * variant is requested.
+     */
+    void readShaders() {
+        mshaders.init(mconfig.shaderCacheDirectory, mconfig.shaderCompiler, 0);
+        for (int i = 0; i < SHADER_COUNT; i++) {
+            std::string spirvPath = SHADER_PATHS[i];
+            mshaders.add(spirvPath.substr(0, spirvPath.size() - strlen(".spv")), spirvPath);
+        }
+    }
 
-    try {
-        app.run();
-    } catch (const std::runtime_error& e) {
-        std::cerr << e.what() << std::endl;
-        return EXIT_FAILURE;
+    void createDescriptorHeap() {
+        mheap.init(device, physicalDevice, mbindless, HEAP_IMAGE_CAPACITY, HEAP_STORAGE_BUFFER_CAPACITY);
     }
 
-    return EXIT_SUCCESS;
-}
+    VkPipelineLayout createPipelineLayout(const DescriptorHeap& heap) {
+        VkPushConstantRange pushConstantRange = heap.pushConstantRange();
+
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(heap.setLayouts().size());
+        pipelineLayoutInfo.pSetLayouts = heap.setLayouts().data();
+        pipelineLayoutInfo.pushConstantRangeCount = pushConstantRange.size > 0 ? 1 : 0;
+        pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+        VkPipelineLayout pipelineLayout;
+        if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, HostAllocator::callbacks(), &pipelineLayout) !=
+            VK_SUCCESS) {
+            throw std::runtime_error("Failed to create pipeline layout");
+        }
+        return pipelineLayout;
+    }
+
+    void createFramebuffers() {
+        mswapChainFramebuffers.resize(mswapChainImageViews.size());
+
+        for (size_t i = 0; i < mswapChainImageViews.size(); i++) {
+            VkImageView attachments[] = {mswapChainImageViews[i]};
+
+            VkFramebufferCreateInfo framebufferInfo = {};
+            framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+            framebufferInfo.renderPass = mrenderPass;
+            framebufferInfo.attachmentCount = 1;
+            framebufferInfo.pAttachments = attachments;
+            framebufferInfo.width = mswapChainExtent.width;
+            framebufferInfo.height = mswapChainExtent.height;
+            framebufferInfo.layers = 1;
+
+            VkFramebuffer framebuffer;
+            if (vkCreateFramebuffer(device, &framebufferInfo, HostAllocator::callbacks(), &framebuffer) != VK_SUCCESS) {
+                throw std::runtime_error("Failed to create framebuffer");
+            }
+            mswapChainFramebuffers[i] = mdeletionQueue.own(framebuffer);
+            nameObject(VK_OBJECT_TYPE_FRAMEBUFFER, (uint64_t) framebuffer, "framebuffer " + std::to_string(i));
+        }
+    }
+
+    /*
+     * --render-graph: a deferred-style sample frame recorded ahead of the
+     * main pass, whose composite the triangles are then drawn over. Passes
+     * only clear and blit, but the shape is that of a real frame: shadow and
+     * G-buffer, SSAO, lighting, bloom, tonemapping and a composite into the
+     * swapchain image. debugView writes an image nothing reads, so the graph
+     * culls it. Rebuilt whenever the swapchain is, since sizes follow it.
+     */
+    void buildRenderGraph() {
+        typedef RenderGraph::ResourceId ResourceId;
+        typedef RenderGraph::PassId PassId;
+        RenderGraph& graph = mrenderGraph;
+        graph.init(device, mallocator, mdeletionQueue);
+        graph.clear();
+
+        VkExtent2D full = mswapChainExtent;
+        VkExtent2D half = {std::max(full.width / 2, 1u), std::max(full.height / 2, 1u)};
+        VkExtent2D shadowExtent = {RENDER_GRAPH_SHADOW_SIZE, RENDER_GRAPH_SHADOW_SIZE};
+        mgraphBackbuffer = graph.importImage("backbuffer", mswapChainImageFormat, full,
+                                             RenderAccess::ColorAttachment);
+        ResourceId backbuffer = mgraphBackbuffer;
+        ResourceId shadow = graph.createImage("shadow", VK_FORMAT_R32_SFLOAT, shadowExtent);
+        ResourceId albedo = graph.createImage("albedo", VK_FORMAT_R8G8B8A8_UNORM, full);
+        ResourceId normal = graph.createImage("normal", VK_FORMAT_R8G8B8A8_UNORM, full);
+        ResourceId ao = graph.createImage("ao", VK_FORMAT_R8G8B8A8_UNORM, half);
+        ResourceId hdr = graph.createImage("hdr", VK_FORMAT_R16G16B16A16_SFLOAT, full);
+        ResourceId bloom = graph.createImage("bloom", VK_FORMAT_R16G16B16A16_SFLOAT, half);
+        ResourceId ldr = graph.createImage("ldr", mswapChainImageFormat, full);
+        ResourceId debugView = graph.createImage("debugView", VK_FORMAT_R8G8B8A8_UNORM, full);
+
+        PassId pass = graph.addPass("shadow", [shadow](VkCommandBuffer commandBuffer, const RenderGraph& g) {
+            clearGraphImage(commandBuffer, g.image(shadow), 0.6f, 0.0f, 0.0f);
+        });
+        graph.write(pass, shadow, RenderAccess::TransferDst);
+
+        pass = graph.addPass("gbuffer", [albedo, normal](VkCommandBuffer commandBuffer, const RenderGraph& g) {
+            clearGraphImage(commandBuffer, g.image(albedo), 0.05f, 0.08f, 0.15f);
+            clearGraphImage(commandBuffer, g.image(normal), 0.5f, 0.5f, 1.0f);
+        });
+        graph.write(pass, albedo, RenderAccess::TransferDst);
+        graph.write(pass, normal, RenderAccess::TransferDst);
+
+        pass = graph.addPass("ssao", [normal, ao](VkCommandBuffer commandBuffer, const RenderGraph& g) {
+            blitGraphImage(commandBuffer, g, normal, ao, 0.0f, 0.0f, 1.0f, 1.0f);
+        });
+        graph.read(pass, normal, RenderAccess::TransferSrc);
+        graph.write(pass, ao, RenderAccess::TransferDst);
+
+        pass = graph.addPass("debugView", [normal, debugView](VkCommandBuffer commandBuffer, const RenderGraph& g) {
+            blitGraphImage(commandBuffer, g, normal, debugView, 0.0f, 0.0f, 1.0f, 1.0f);
+        });
+        graph.read(pass, normal, RenderAccess::TransferSrc);
+        graph.write(pass, debugView, RenderAccess::TransferDst);
+
+        pass = graph.addPass("lighting", [albedo, ao, shadow, hdr](VkCommandBuffer commandBuffer,
+                                                                   const RenderGraph& g) {
+            blitGraphImage(commandBuffer, g, albedo, hdr, 0.0f, 0.0f, 1.0f, 1.0f);
+            blitGraphImage(commandBuffer, g, ao, hdr, 0.0f, 0.0f, 0.25f, 0.25f);
+            blitGraphImage(commandBuffer, g, shadow, hdr, 0.75f, 0.0f, 1.0f, 0.25f);
+        });
+        graph.read(pass, albedo, RenderAccess::TransferSrc);
+        graph.read(pass, ao, RenderAccess::TransferSrc);
+        graph.read(pass, shadow, RenderAccess::TransferSrc);
+        graph.write(pass, hdr, RenderAccess::TransferDst);
+
+        pass = graph.addPass("bloom", [hdr, bloom](VkCommandBuffer commandBuffer, const RenderGraph& g) {
+            blitGraphImage(commandBuffer, g, hdr, bloom, 0.0f, 0.0f, 1.0f, 1.0f);
+        });
+        graph.read(pass, hdr, RenderAccess::TransferSrc);
+        graph.write(pass, bloom, RenderAccess::TransferDst);
+
+        pass = graph.addPass("tonemap", [hdr, bloom, ldr](VkCommandBuffer commandBuffer, const RenderGraph& g) {
+            blitGraphImage(commandBuffer, g, hdr, ldr, 0.0f, 0.0f, 1.0f, 1.0f);
+            blitGraphImage(commandBuffer, g, bloom, ldr, 0.0f, 0.75f, 0.25f, 1.0f);
+        });
+        graph.read(pass, hdr, RenderAccess::TransferSrc);
+        graph.read(pass, bloom, RenderAccess::TransferSrc);
+        graph.write(pass, ldr, RenderAccess::TransferDst);
+
+        pass = graph.addPass("composite", [ldr, backbuffer](VkCommandBuffer commandBuffer, const RenderGraph& g) {
+            blitGraphImage(commandBuffer, g, ldr, backbuffer, 0.0f, 0.0f, 1.0f, 1.0f);
+        });
+        graph.read(pass, ldr, RenderAccess::TransferSrc);
+        graph.write(pass, backbuffer, RenderAccess::TransferDst);
+
+        graph.compile();
+        const RenderGraph::Stats& stats = graph.stats();
+        LOG_INFO(LOG_RENDER, "Render graph compiled at %ux%u: %u barriers in %u batches, %.2f MiB transient memory",
+                 full.width, full.height, stats.imageBarriers, stats.barrierBatches,
+                 stats.peakTransientBytes / (1024.0 * 1024.0));
+    }
+
+    /*
+     * Every frame in flight owns its command pool, command buffer, semaphores
+     * and fence, so the CPU can record frame N+1 while the GPU executes frame N.
+     */
+    void createFrameResources() {
+        QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
+
+        mframes.resize(mconfig.framesInFlight);
+        mimagesInFlight.assign(mswapChainImages.size(), VK_NULL_HANDLE);
+
+        VkCommandPoolCreateInfo poolInfo = {};
+        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+        poolInfo.queueFamilyIndex = indices.graphicsFamily;
+
+        VkSemaphoreCreateInfo semaphoreInfo = {};
+        semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+        VkFenceCreateInfo fenceInfo = {};
+        fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+        fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+        const VkAllocationCallbacks* allocator = HostAllocator::callbacks();
+        for (auto& frame : mframes) {
+            if (vkCreateCommandPool(device, &poolInfo, allocator, &frame.commandPool) != VK_SUCCESS) {
+                throw std::runtime_error("Failed to create command pool");
+            }
+
+            VkCommandBufferAllocateInfo allocInfo = {};
+            allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+            allocInfo.commandPool = frame.commandPool;
+            allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+            allocInfo.commandBufferCount = 1;
+
+            if (vkAllocateCommandBuffers(device, &allocInfo, &frame.commandBuffer) != VK_SUCCESS) {
+                throw std::runtime_error("Failed to allocate command buffer");
+            }
+
+            frame.threadPools.resize(mjobSystem->threadCount());
+            for (auto& threadPool : frame.threadPools) {
+                if (vkCreateCommandPool(device, &poolInfo, allocator, &threadPool.commandPool) != VK_SUCCESS) {
+                    throw std::runtime_error("Failed to create recording thread command pool");
+                }
+            }
+
+            if (masyncCompute) {
+                VkCommandPoolCreateInfo computePoolInfo = poolInfo;
+                computePoolInfo.queueFamilyIndex = indices.computeFamily;
+                if (vkCreateCommandPool(device, &computePoolInfo, allocator, &frame.computePool) != VK_SUCCESS ||
+                    vkCreateSemaphore(device, &semaphoreInfo, allocator, &frame.cullFinished) != VK_SUCCESS) {
+                    throw std::runtime_error("Failed to create culling frame resources");
+                }
+                allocInfo.commandPool = frame.computePool;
+                if (vkAllocateCommandBuffers(device, &allocInfo, &frame.computeCommandBuffer) != VK_SUCCESS) {
+                    throw std::runtime_error("Failed to allocate culling command buffer");
+                }
+            }
+
+            if (vkCreateSemaphore(device, &semaphoreInfo, allocator, &frame.imageAvailable) != VK_SUCCESS ||
+                vkCreateSemaphore(device, &semaphoreInfo, allocator, &frame.renderFinished) != VK_SUCCESS ||
+                vkCreateFence(device, &fenceInfo, allocator, &frame.inFlight) != VK_SUCCESS) {
+                throw std::runtime_error("Failed to create frame synchronization objects");
+            }
+
+            std::string name = "frame " + std::to_string(&frame - mframes.data());
+            nameObject(VK_OBJECT_TYPE_COMMAND_BUFFER, (uint64_t) frame.commandBuffer, name + " commands");
+            nameObject(VK_OBJECT_TYPE_SEMAPHORE, (uint64_t) frame.imageAvailable, name + " imageAvailable");
+            nameObject(VK_OBJECT_TYPE_SEMAPHORE, (uint64_t) frame.renderFinished, name + " renderFinished");
+            nameObject(VK_OBJECT_TYPE_FENCE, (uint64_t) frame.inFlight, name + " inFlight");
+            nameObject(VK_OBJECT_TYPE_COMMAND_BUFFER, (uint64_t) frame.computeCommandBuffer, name + " cull commands");
+            nameObject(VK_OBJECT_TYPE_SEMAPHORE, (uint64_t) frame.cullFinished, name + " cullFinished");
+        }
+
+        mframeTransient.create(mallocator, FRAME_TRANSIENT_BYTES, mconfig.framesInFlight,
+                               VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+
+        LOG_DEBUG(LOG_RENDER, "%u frames in flight, %u recording threads", mconfig.framesInFlight,
+                  mjobSystem->threadCount());
+    }
+
+    void destroyFrameResources() {
+        for (auto& frame : mframes) {
+            vkDestroySemaphore(device, frame.imageAvailable, HostAllocator::callbacks());
+            vkDestroySemaphore(device, frame.renderFinished, HostAllocator::callbacks());
+            vkDestroyFence(device, frame.inFlight, HostAllocator::callbacks());
+            vkDestroyCommandPool(device, frame.commandPool, HostAllocator::callbacks());
+            vkDestroyCommandPool(device, frame.computePool, HostAllocator::callbacks());
+            vkDestroySemaphore(device, frame.cullFinished, HostAllocator::callbacks());
+            for (auto& threadPool : frame.threadPools) {
+                vkDestroyCommandPool(device, threadPool.commandPool, HostAllocator::callbacks());
+            }
+        }
+        mframes.clear();
+        mjobSystem.reset();
+        mframeTransient.destroy(mallocator);
+    }
+
+    void resetFrameCommandPools(FrameData& frame) {
+        vkResetCommandPool(device, frame.commandPool, 0);
+        if (frame.computePool != VK_NULL_HANDLE) {
+            vkResetCommandPool(device, frame.computePool, 0);
+        }
+        for (auto& threadPool : frame.threadPools) {
+            vkResetCommandPool(device, threadPool.commandPool, 0);
+            threadPool.used = 0;
+        }
+    }
+
+    VkCommandBuffer acquireSecondary(ThreadCommandPool& threadPool) {
+        if (threadPool.used == threadPool.secondaries.size()) {
+            VkCommandBufferAllocateInfo allocInfo = {};
+            allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+            allocInfo.commandPool = threadPool.commandPool;
+            allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+            allocInfo.commandBufferCount = 1;
+
+            VkCommandBuffer commandBuffer;
+            if (vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer) != VK_SUCCESS) {
+                throw std::runtime_error("Failed to allocate secondary command buffer");
+            }
+            threadPool.secondaries.push_back(commandBuffer);
+        }
+        return threadPool.secondaries[threadPool.used++];
+    }
+
+    /* Dynamic state and bound sets are not inherited by secondaries, so every command buffer sets them */
+    void recordDrawState(VkCommandBuffer commandBuffer) {
+        bindPipelineState(commandBuffer, mpipelines.get(mtrianglePipeline));
+        mheap.bindGlobal(commandBuffer, mpipelineLayout);
+    }
+
+    void bindPipelineState(VkCommandBuffer commandBuffer, VkPipeline pipeline) {
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+
+        VkViewport viewport = {};
+        viewport.width = (float) mswapChainExtent.width;
+        viewport.height = (float) mswapChainExtent.height;
+        viewport.maxDepth = 1.0f;
+        vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+        VkRect2D scissor = {};
+        scissor.extent = mswapChainExtent;
+        vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+        VkDeviceSize offset = 0;
+        vkCmdBindVertexBuffers(commandBuffer, 0, 1, &mvertexBuffer, &offset);
+        vkCmdBindIndexBuffer(commandBuffer, mindexBuffer, 0, VK_INDEX_TYPE_UINT16);
+    }
+
+    /* Bindless draws push a texture index; per-set draws each bind the texture's set */
+    void recordDraws(VkCommandBuffer commandBuffer, size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            mheap.bindDrawImage(commandBuffer, mpipelineLayout, mtextureHandles[i % mtextureHandles.size()]);
+            vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(triangleIndices.size()), 1, 0, 0, 0);
+        }
+    }
+
+    /*
+     * Splits the draw list into one slice per chunk; each job records its slice
+     * into a secondary buffer from the executing thread's own command pool.
+     * Results are stored by chunk index so submission order stays deterministic.
+     */
+    void recordSecondaries(FrameData& frame, uint32_t imageIndex, uint32_t drawCount, size_t chunkCount,
+                           std::vector<VkCommandBuffer>& secondaries) {
+        VkCommandBufferInheritanceInfo inheritanceInfo = {};
+        inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+        inheritanceInfo.renderPass = mrenderPass;
+        inheritanceInfo.subpass = 0;
+        inheritanceInfo.framebuffer = mswapChainFramebuffers[imageIndex];
+
+        secondaries.assign(std::min<size_t>(chunkCount, drawCount), VK_NULL_HANDLE);
+
+        mjobSystem->parallelFor(drawCount, secondaries.size(),
+                                [&](size_t begin, size_t end, size_t chunk, unsigned threadIndex) {
+            VkCommandBuffer commandBuffer = acquireSecondary(frame.threadPools[threadIndex]);
+
+            VkCommandBufferBeginInfo beginInfo = {};
+            beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+            beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT |
+                              VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+            beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+            vkBeginCommandBuffer(commandBuffer, &beginInfo);
+            recordDrawState(commandBuffer);
+            recordDraws(commandBuffer, begin, end);
+            vkEndCommandBuffer(commandBuffer);
+
+            secondaries[chunk] = commandBuffer;
+        });
+    }
+
+    void recordCommandBuffer(FrameData& frame, uint32_t imageIndex, uint32_t drawCount, size_t recordThreads) {
+        VkCommandBuffer commandBuffer = frame.commandBuffer;
+        uint32_t frameIndex = static_cast<uint32_t>(&frame - mframes.data());
+
+        /* Culled instances replace the plain triangle draws */
+        bool culling = mgpuCulling;
+        if (culling) {
+            drawCount = 0;
+        }
+        /* So do --instances objects */
+        bool instances = !minstanceObjects.empty();
+        if (instances) {
+            drawCount = 0;
+        }
+        /* Nothing is drawn until the mesh and texture uploads have landed on the graphics queue */
+        if (!muploader.isComplete(msceneTicket)) {
+            drawCount = 0;
+            culling = false;
+            instances = false;
+        }
+        bool parallel = recordThreads > 1 && drawCount >= PARALLEL_RECORD_MIN_DRAWS;
+
+        VkCommandBufferBeginInfo beginInfo = {};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+        if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to begin recording command buffer");
+        }
+
+        mgpuProfiler.beginSlot(commandBuffer, frameIndex);
+        {
+            GPU_PROFILE_SCOPE(mgpuProfiler, commandBuffer, "frame");
+            muploader.takeAcquires(commandBuffer);
+            if (culling && !masyncCompute) {
+                GPU_PROFILE_SCOPE(mgpuProfiler, commandBuffer, "cull");
+                mculler.recordCull(commandBuffer, frameIndex, mcullFrustum,
+                                   static_cast<uint32_t>(triangleIndices.size()), true);
+            }
+
+            VkClearValue clearColor = {};
+            clearColor.color.float32[3] = 1.0f;
+
+            VkRenderPassBeginInfo renderPassInfo = {};
+            renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+            renderPassInfo.renderPass = mrenderPass;
+            renderPassInfo.framebuffer = mswapChainFramebuffers[imageIndex];
+            renderPassInfo.renderArea.offset = {0, 0};
+            renderPassInfo.renderArea.extent = mswapChainExtent;
+            renderPassInfo.clearValueCount = 1;
+            renderPassInfo.pClearValues = &clearColor;
+
+            if (parallel) {
+                recordSecondaries(frame, imageIndex, drawCount, recordThreads, msecondaries);
+            }
+            if (mconfig.renderGraph) {
+                GPU_PROFILE_SCOPE(mgpuProfiler, commandBuffer, "renderGraph");
+                mrenderGraph.setImportedImage(mgraphBackbuffer, mswapChainImages[imageIndex],
+                                              mswapChainImageViews[imageIndex]);
+                mrenderGraph.execute(commandBuffer);
+            }
+
+            {
+                GPU_PROFILE_SCOPE(mgpuProfiler, commandBuffer, "mainPass");
+                if (parallel) {
+                    vkCmdBeginRenderPass(commandBuffer, &renderPassInfo,
+                                         VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+                    vkCmdExecuteCommands(commandBuffer, static_cast<uint32_t>(msecondaries.size()),
+                                         msecondaries.data());
+                } else {
+                    vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+                    if (drawCount > 0) {
+                        recordDrawState(commandBuffer);
+                        recordDraws(commandBuffer, 0, drawCount);
+                    } else if (culling) {
+                        bindPipelineState(commandBuffer, mpipelines.get(mcullPipeline));
+                        vkCmdPushConstants(commandBuffer, mcullPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0,
+                                           sizeof(mcullConstants), &mcullConstants);
+                        mculler.recordDraw(commandBuffer, frameIndex, mcullPipelineLayout);
+                    }
+                    if (instances) {
+                        recordInstances(commandBuffer, frameIndex);
+                    }
+                }
+                vkCmdEndRenderPass(commandBuffer);
+            }
+            if (frame.captureSlot >= 0) {
+                GPU_PROFILE_SCOPE(mgpuProfiler, commandBuffer, "capture");
+                VkImageLayout layout = mconfig.headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL
+                                                        : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+                mcapture.recordCopy(commandBuffer, mswapChainImages[imageIndex], layout,
+                                    static_cast<uint32_t>(frame.captureSlot));
+            }
+        }
+
+        if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to record command buffer");
+        }
+    }
+
+    void drawFrame() {
+        typedef std::chrono::steady_clock Clock;
+        typedef std::chrono::duration<double, std::milli> Milliseconds;
+
+        TRACE_SCOPE("drawFrame", "frame");
+        Clock::time_point frameStart = Clock::now();
+        FrameSample sample;
+        sample.frameMs = Milliseconds(frameStart - mlastFrameStart).count();
+        mlastFrameStart = frameStart;
+
+        FrameData& frame = mframes[mcurrentFrame];
+
+        vkWaitForFences(device, 1, &frame.inFlight, VK_TRUE, std::numeric_limits<uint64_t>::max());
+        Clock::time_point fenceDone = Clock::now();
+        sample.fenceWaitMs = Milliseconds(fenceDone - frameStart).count();
+        mcompletedSerial = std::max(mcompletedSerial, frame.submitSerial);
+        if (mcapturing) {
+            mcapture.collect(mcompletedSerial);
+        }
+        mdeletionQueue.collect(mcompletedSerial);
+        if (mconfig.hotReload) {
+            mpipelines.poll(mshaders.takeReloaded());
+        }
+        mheap.recycle(mcompletedSerial);
+        mframeTransient.beginFrame(static_cast<uint32_t>(mcurrentFrame));
+        muploader.collect();
+        if (mconfig.streamUploadKiB > 0) {
+            streamUpload();
+        }
+        if (mpackage.isOpen()) {
+            mstreamer.update(ASSET_STREAM_BYTES_PER_FRAME);
+        }
+        if (mconfig.sceneNodes > 0) {
+            updateSceneTransforms();
+        }
+
+        uint32_t imageIndex;
+        if (mconfig.headless) {
+            imageIndex = static_cast<uint32_t>(mframeStats.frameCount() % mswapChainImages.size());
+        } else {
+            VkResult result = vkAcquireNextImageKHR(device, mswapChain, std::numeric_limits<uint64_t>::max(),
+                                                    frame.imageAvailable, VK_NULL_HANDLE, &imageIndex);
+            if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+                /* Nothing was acquired, so the frame slot is reused after recreation */
+                requestSwapChainRecreation();
+                return;
+            } else if (result == VK_SUBOPTIMAL_KHR) {
+                /* The semaphore is signaled; render this frame and recreate before the next */
+                requestSwapChainRecreation();
+            } else if (result != VK_SUCCESS) {
+                throw std::runtime_error("Failed to acquire swapchain image");
+            }
+        }
+
+        /* The image may still be in use by an older frame when there are more frames than images */
+        if (mimagesInFlight[imageIndex] != VK_NULL_HANDLE && mimagesInFlight[imageIndex] != frame.inFlight) {
+            vkWaitForFences(device, 1, &mimagesInFlight[imageIndex], VK_TRUE, std::numeric_limits<uint64_t>::max());
+        }
+        mimagesInFlight[imageIndex] = frame.inFlight;
+        /* Blocks while the encoders are behind; counted as fence wait */
+        frame.captureSlot = mcapturing ? static_cast<int>(mcapture.acquire()) : -1;
+        Clock::time_point recordStart = Clock::now();
+        sample.fenceWaitMs += Milliseconds(recordStart - fenceDone).count();
+
+        /* This frame is the first to reflect any input gathered before recording starts */
+        bool sampledInput = minputPending;
+        Clock::time_point inputTime = minputTime;
+        minputPending = false;
+
+        resetFrameCommandPools(frame);
+        if (!minstanceObjects.empty()) {
+            writeInstances(static_cast<uint32_t>(mcurrentFrame));
+        }
+        /* Culling only starts once the scene upload has landed, matching recordCommandBuffer() */
+        bool asyncCull = masyncCompute && muploader.isComplete(msceneTicket);
+        if (mgpuCulling) {
+            updateCullCamera(mframeSerial * CULL_CAMERA_RADIANS_PER_FRAME);
+            if (asyncCull) {
+                submitCull(frame);
+            }
+        }
+        recordCommandBuffer(frame, imageIndex, mconfig.drawCount, mjobSystem->threadCount());
+
+        VkSemaphore waitSemaphores[2];
+        VkPipelineStageFlags waitStages[2];
+        uint32_t waitCount = 0;
+        if (!mconfig.headless) {
+            waitSemaphores[waitCount] = frame.imageAvailable;
+            /* The render graph blits into the image before the main pass writes it */
+            waitStages[waitCount++] = mconfig.renderGraph ? VK_PIPELINE_STAGE_TRANSFER_BIT |
+                                                                VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT
+                                                          : VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        }
+        if (asyncCull) {
+            waitSemaphores[waitCount] = frame.cullFinished;
+            waitStages[waitCount++] = VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT;
+        }
+
+        VkSubmitInfo submitInfo = {};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &frame.commandBuffer;
+        submitInfo.waitSemaphoreCount = waitCount;
+        submitInfo.pWaitSemaphores = waitSemaphores;
+        submitInfo.pWaitDstStageMask = waitStages;
+        if (!mconfig.headless) {
+            submitInfo.signalSemaphoreCount = 1;
+            submitInfo.pSignalSemaphores = &frame.renderFinished;
+        }
+
+        vkResetFences(device, 1, &frame.inFlight);
+        if (vkQueueSubmit(mgraphicsQueue, 1, &submitInfo, frame.inFlight) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to submit draw command buffer");
+        }
+        frame.submitSerial = ++mframeSerial;
+        mdeletionQueue.setSubmittedSerial(mframeSerial);
+        if (frame.captureSlot >= 0) {
+            mcapture.submitted(static_cast<uint32_t>(frame.captureSlot), frame.submitSerial);
+        }
+        mgpuProfiler.markSubmitted(static_cast<uint32_t>(mcurrentFrame));
+        Clock::time_point submitDone = Clock::now();
+        sample.cpuMs = Milliseconds(submitDone - recordStart).count();
+
+        if (!mconfig.headless) {
+            VkPresentInfoKHR presentInfo = {};
+            presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+            presentInfo.waitSemaphoreCount = 1;
+            presentInfo.pWaitSemaphores = &frame.renderFinished;
+            presentInfo.swapchainCount = 1;
+            VkSwapchainKHR swapChain = mswapChain;
+            presentInfo.pSwapchains = &swapChain;
+            presentInfo.pImageIndices = &imageIndex;
+
+            VkResult result = vkQueuePresentKHR(mpresentQueue, &presentInfo);
+            if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR) {
+                requestSwapChainRecreation();
+            } else if (result != VK_SUCCESS) {
+                throw std::runtime_error("Failed to present swapchain image");
+            }
+            Clock::time_point presentDone = Clock::now();
+            sample.presentMs = Milliseconds(presentDone - submitDone).count();
+            if (sampledInput) {
+                sample.inputToPresentMs = Milliseconds(presentDone - inputTime).count();
+            }
+
+            if (mawaitingResizedFrame) {
+                double latencyMs = Milliseconds(presentDone - mresizeStart).count();
+                mresizeCount++;
+                mresizeLatencyTotalMs += latencyMs;
+                mresizeLatencyMaxMs = std::max(mresizeLatencyMaxMs, latencyMs);
+                mawaitingResizedFrame = false;
+                LOG_DEBUG(LOG_SWAPCHAIN, "Resize to first frame took %.3f ms", latencyMs);
+            }
+        }
+
+        if (mframeStats.frameCount() == 0) {
+            mfirstFrameMs = Trace::sinceProcessStartMs();
+            printf("Cold start: first frame %s after %.2f ms \n", mconfig.headless ? "submitted" : "presented",
+                   mfirstFrameMs);
+        }
+        mframeStats.record(sample);
+        HostAllocator::markFrame();
+        mcurrentFrame = (mcurrentFrame + 1) % mframes.size();
+    }
+
+    /*
+     * One profiler per queue: frames in flight are the graphics slots, upload
+     * batches the transfer slots.
+     */
+    void createGpuProfilers() {
+        QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+        uint32_t queueFamilyCount = 0;
+        vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+        std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+        vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+
+        const VkQueueFamilyProperties& graphics = queueFamilies[indices.graphicsFamily];
+        const VkQueueFamilyProperties& transfer = queueFamilies[indices.transferFamily];
+        bool transferCanReset = (transfer.queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)) != 0;
+
+        mgpuProfiler.init(device, properties, graphics.timestampValidBits, true, mconfig.framesInFlight,
+                          "graphics queue");
+        mtransferProfiler.init(device, properties, transfer.timestampValidBits, transferCanReset,
+                               Uploader::BATCH_COUNT, "transfer queue");
+    }
+
+    void createUploader() {
+        QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
+        muploader.init(mallocator, device, mtransferQueue, indices.transferFamily, indices.graphicsFamily,
+                       STAGING_RING_BYTES);
+        muploader.setProfiler(&mtransferProfiler);
+    }
+
+    void createDeviceLocalBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkBuffer& buffer,
+                                 GpuAllocation& allocation) {
+        VkBufferCreateInfo bufferInfo = {};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = size;
+        bufferInfo.usage = usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        mallocator.createBuffer(bufferInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, buffer, allocation);
+    }
+
+    void createMeshBuffers() {
+        VkDeviceSize vertexBytes = sizeof(triangleVertices[0]) * triangleVertices.size();
+        VkDeviceSize indexBytes = sizeof(triangleIndices[0]) * triangleIndices.size();
+
+        createDeviceLocalBuffer(vertexBytes, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, mvertexBuffer, mvertexAllocation);
+        createDeviceLocalBuffer(indexBytes, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, mindexBuffer, mindexAllocation);
+        nameObject(VK_OBJECT_TYPE_BUFFER, (uint64_t) mvertexBuffer, "vertices");
+        nameObject(VK_OBJECT_TYPE_BUFFER, (uint64_t) mindexBuffer, "indices");
+
+        if (instancing()) {
+            VkDeviceSize instanceVertexBytes = sizeof(instanceMeshVertices[0]) * instanceMeshVertices.size();
+            VkDeviceSize instanceIndexBytes = sizeof(instanceMeshIndices[0]) * instanceMeshIndices.size();
+            createDeviceLocalBuffer(instanceVertexBytes, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, minstanceVertexBuffer,
+                                    minstanceVertexAllocation);
+            createDeviceLocalBuffer(instanceIndexBytes, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, minstanceIndexBuffer,
+                                    minstanceIndexAllocation);
+            muploader.uploadBuffer(minstanceVertexBuffer, 0, instanceMeshVertices.data(), instanceVertexBytes);
+            muploader.uploadBuffer(minstanceIndexBuffer, 0, instanceMeshIndices.data(), instanceIndexBytes);
+        }
+
+        muploader.uploadBuffer(mvertexBuffer, 0, triangleVertices.data(), vertexBytes);
+        msceneTicket = muploader.uploadBuffer(mindexBuffer, 0, triangleIndices.data(), indexBytes);
+    }
+
+    /*
+     * Maps the --package file and queues every mesh, nearest to the origin
+     * first. Only the tables are read here; chunks stream in from drawFrame().
+     */
+    void createAssetStreaming() {
+        mpackage.open(mconfig.packagePath);
+        mstreamer.init(mpackage, mallocator, muploader, mdeletionQueue);
+        for (uint32_t m = 0; m < mpackage.meshCount(); m++) {
+            const AssetMesh& mesh = mpackage.mesh(m);
+            float distanceSquared = 0.0f;
+            for (int axis = 0; axis < 3; axis++) {
+                float center = 0.5f * (mesh.boundsMin[axis] + mesh.boundsMax[axis]);
+                distanceSquared += center * center;
+            }
+            mstreamer.request(m, -std::sqrt(distanceSquared));
+        }
+        LOG_INFO(LOG_MEMORY, "Streaming %u meshes from %s (%.2f MiB)", mpackage.meshCount(),
+                 mconfig.packagePath.c_str(), mpackage.fileSize() / (1024.0 * 1024.0));
+    }
+
+    /*
+     * Small checkerboards in distinct tints, each registered with the
+     * descriptor heap. Uploads land in the same batch as the mesh, so one
+     * ticket covers the whole scene.
+     */
+    void createSceneTextures() {
+        VkSamplerCreateInfo samplerInfo = {};
+        samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+        samplerInfo.magFilter = VK_FILTER_NEAREST;
+        samplerInfo.minFilter = VK_FILTER_NEAREST;
+        samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+        samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+        samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+        samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+        samplerInfo.maxLod = 0.0f;
+        if (vkCreateSampler(device, &samplerInfo, HostAllocator::callbacks(), &msampler) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create sampler");
+        }
+
+        VkExtent3D extent = {SCENE_TEXTURE_SIZE, SCENE_TEXTURE_SIZE, 1};
+        std::vector<uint8_t> texels(SCENE_TEXTURE_SIZE * SCENE_TEXTURE_SIZE * 4);
+
+        mtextureImages.resize(SCENE_TEXTURE_COUNT);
+        mtextureAllocations.resize(SCENE_TEXTURE_COUNT);
+        mtextureViews.resize(SCENE_TEXTURE_COUNT);
+        for (uint32_t t = 0; t < SCENE_TEXTURE_COUNT; t++) {
+            VkImageCreateInfo imageInfo = {};
+            imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+            imageInfo.imageType = VK_IMAGE_TYPE_2D;
+            imageInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
+            imageInfo.extent = extent;
+            imageInfo.mipLevels = 1;
+            imageInfo.arrayLayers = 1;
+            imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+            imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+            imageInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+            imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+            imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+            mallocator.createImage(imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, mtextureImages[t],
+                                   mtextureAllocations[t]);
+
+            uint8_t tint[3] = {static_cast<uint8_t>(64 + (t * 37) % 192), static_cast<uint8_t>(64 + (t * 91) % 192),
+                               static_cast<uint8_t>(64 + (t * 53) % 192)};
+            for (uint32_t y = 0; y < SCENE_TEXTURE_SIZE; y++) {
+                for (uint32_t x = 0; x < SCENE_TEXTURE_SIZE; x++) {
+                    uint8_t* texel = &texels[(y * SCENE_TEXTURE_SIZE + x) * 4];
+                    bool light = ((x / 4) + (y / 4)) % 2 == 0;
+                    for (int c = 0; c < 3; c++) {
+                        texel[c] = light ? 255 : tint[c];
+                    }
+                    texel[3] = 255;
+                }
+            }
+            msceneTicket = muploader.uploadImage(mtextureImages[t], extent, VK_IMAGE_ASPECT_COLOR_BIT, texels.data(),
+                                                 texels.size(), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+            VkImageViewCreateInfo viewInfo = {};
+            viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+            viewInfo.image = mtextureImages[t];
+            viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+            viewInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
+            viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            viewInfo.subresourceRange.levelCount = 1;
+            viewInfo.subresourceRange.layerCount = 1;
+            if (vkCreateImageView(device, &viewInfo, HostAllocator::callbacks(), &mtextureViews[t]) != VK_SUCCESS) {
+                throw std::runtime_error("Failed to create texture image view");
+            }
+
+            mtextureHandles.push_back(mheap.createImage(mtextureViews[t], msampler,
+                                                        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL));
+        }
+        muploader.flush();
+    }
+
+    /* Runs after the device is idle, so every slot can be released as already retired */
+    void destroySceneTextures() {
+        for (DescriptorHandle handle : mtextureHandles) {
+            mheap.release(handle, mcompletedSerial);
+        }
+        mtextureHandles.clear();
+        for (size_t i = 0; i < mtextureImages.size(); i++) {
+            mdeletionQueue.retire(mtextureViews[i]);
+            mdeletionQueue.retireImage(mtextureImages[i], mtextureAllocations[i]);
+        }
+        mtextureImages.clear();
+        mtextureAllocations.clear();
+        mtextureViews.clear();
+        mdeletionQueue.retire(msampler);
+        msampler = VK_NULL_HANDLE;
+    }
+
+    void destroyMeshBuffers() {
+        mallocator.destroyBuffer(mvertexBuffer, mvertexAllocation);
+        mallocator.destroyBuffer(mindexBuffer, mindexAllocation);
+        if (minstanceVertexBuffer != VK_NULL_HANDLE) {
+            mallocator.destroyBuffer(minstanceVertexBuffer, minstanceVertexAllocation);
+            mallocator.destroyBuffer(minstanceIndexBuffer, minstanceIndexAllocation);
+        }
+        if (mstreamBuffer != VK_NULL_HANDLE) {
+            mallocator.destroyBuffer(mstreamBuffer, mstreamAllocation);
+        }
+    }
+
+    /*
+     * Buffers are shared with the compute family when culling runs there;
+     * otherwise the graphics queue dispatches the cull ahead of the render pass.
+     */
+    void createGpuCuller() {
+        if (!mgpuCulling) {
+            return;
+        }
+        QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
+        std::vector<uint32_t> families = {static_cast<uint32_t>(indices.graphicsFamily)};
+        if (masyncCompute) {
+            families.push_back(static_cast<uint32_t>(indices.computeFamily));
+        }
+
+        mculler.init(mallocator, device, mpipelineCache.handle(), *mshaders.get(SHADER_CULL_COMP),
+                     mconfig.cullInstances, mconfig.framesInFlight, families, mdrawIndirectCount);
+        createCullInstances();
+        printf("GPU culling %u instances on the %s queue with %s \n", mconfig.cullInstances,
+               masyncCompute ? "async compute" : "graphics",
+               mculler.drawIndirectCount() ? "vkCmdDrawIndexedIndirectCount" : "fixed-count indirect draws");
+    }
+
+    VkPipelineLayout createCullPipelineLayout() {
+        VkDescriptorSetLayout setLayout = mculler.setLayout();
+        VkPushConstantRange pushConstantRange = {};
+        pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+        pushConstantRange.size = sizeof(GpuCuller::DrawConstants);
+
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutInfo.setLayoutCount = 1;
+        pipelineLayoutInfo.pSetLayouts = &setLayout;
+        pipelineLayoutInfo.pushConstantRangeCount = 1;
+        pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+        VkPipelineLayout pipelineLayout;
+        if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, HostAllocator::callbacks(), &pipelineLayout) !=
+            VK_SUCCESS) {
+            throw std::runtime_error("Failed to create culling draw pipeline layout");
+        }
+        return pipelineLayout;
+    }
+
+    /* Random spheres written straight into the culler's mapped streams */
+    void createCullInstances() {
+        std::mt19937 rng(42);
+        std::uniform_real_distribution<float> horizontal(-CULL_FIELD_EXTENT, CULL_FIELD_EXTENT);
+        std::uniform_real_distribution<float> vertical(-CULL_FIELD_EXTENT * 0.1f, CULL_FIELD_EXTENT * 0.1f);
+        std::uniform_real_distribution<float> radius(0.5f, 2.0f);
+
+        float* x = mculler.stream(GpuCuller::STREAM_X);
+        float* y = mculler.stream(GpuCuller::STREAM_Y);
+        float* z = mculler.stream(GpuCuller::STREAM_Z);
+        float* r = mculler.stream(GpuCuller::STREAM_RADIUS);
+        float* color = mculler.stream(GpuCuller::STREAM_COLOR);
+        for (uint32_t i = 0; i < mconfig.cullInstances; i++) {
+            x[i] = horizontal(rng);
+            y[i] = vertical(rng);
+            z[i] = horizontal(rng);
+            r[i] = radius(rng);
+            uint32_t rgba = static_cast<uint32_t>(rng()) | 0xff000000u;
+            memcpy(&color[i], &rgba, sizeof(rgba));
+        }
+        mculler.setInstanceCount(mconfig.cullInstances);
+    }
+
+    /* The frustum and the vertex shader's transform come from the same matrix */
+    void updateCullCamera(float yaw) {
+        float aspect = static_cast<float>(mswapChainExtent.width) / static_cast<float>(mswapChainExtent.height);
+        Mat4 projection = Mat4::perspective(CULL_FOV_Y, aspect, 0.1f, CULL_FAR_PLANE);
+        mcullConstants.viewProjection = projection * Mat4::rotationY(yaw);
+        mcullConstants.scale[0] = projection.m[0];
+        mcullConstants.scale[1] = projection.m[5];
+        mcullConstants.stride = mculler.stride();
+        mcullFrustum = Frustum::fromViewProjection(mcullConstants.viewProjection);
+    }
+
+    /* Async path: this frame's cull goes to the compute queue ahead of the graphics submit */
+    void submitCull(FrameData& frame) {
+        VkCommandBufferBeginInfo beginInfo = {};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        if (vkBeginCommandBuffer(frame.computeCommandBuffer, &beginInfo) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to begin recording culling command buffer");
+        }
+        mculler.recordCull(frame.computeCommandBuffer, static_cast<uint32_t>(&frame - mframes.data()), mcullFrustum,
+                           static_cast<uint32_t>(triangleIndices.size()), false);
+        if (vkEndCommandBuffer(frame.computeCommandBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to record culling command buffer");
+        }
+
+        VkSubmitInfo submitInfo = {};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &frame.computeCommandBuffer;
+        submitInfo.signalSemaphoreCount = 1;
+        submitInfo.pSignalSemaphores = &frame.cullFinished;
+        if (vkQueueSubmit(mcomputeQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to submit culling command buffer");
+        }
+    }
+
+    bool instancing() const {
+        return mconfig.instanceObjects > 0 || mconfig.benchInstancing;
+    }
+
+    /*
+     * Both pipelines share one layout, so the camera bound once serves
+     * either. The camera is a dynamic uniform buffer over the frame
+     * transient buffer: one set, rebound each frame at that frame's offset.
+     */
+    void createInstancePipelines() {
+        VkDescriptorSetLayoutBinding cameraBinding = {};
+        cameraBinding.binding = 0;
+        cameraBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+        cameraBinding.descriptorCount = 1;
+        cameraBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+        VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layoutInfo.bindingCount = 1;
+        layoutInfo.pBindings = &cameraBinding;
+        if (vkCreateDescriptorSetLayout(device, &layoutInfo, HostAllocator::callbacks(), &minstanceSetLayout) !=
+            VK_SUCCESS) {
+            throw std::runtime_error("Failed to create instance camera set layout");
+        }
+
+        VkDescriptorPoolSize poolSize = {};
+        poolSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+        poolSize.descriptorCount = 1;
+        VkDescriptorPoolCreateInfo poolInfo = {};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.maxSets = 1;
+        poolInfo.poolSizeCount = 1;
+        poolInfo.pPoolSizes = &poolSize;
+        if (vkCreateDescriptorPool(device, &poolInfo, HostAllocator::callbacks(), &minstanceDescriptorPool) !=
+            VK_SUCCESS) {
+            throw std::runtime_error("Failed to create instance camera descriptor pool");
+        }
+
+        VkDescriptorSetAllocateInfo allocInfo = {};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = minstanceDescriptorPool;
+        allocInfo.descriptorSetCount = 1;
+        allocInfo.pSetLayouts = &minstanceSetLayout;
+        if (vkAllocateDescriptorSets(device, &allocInfo, &minstanceCameraSet) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to allocate instance camera set");
+        }
+
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutInfo.setLayoutCount = 1;
+        pipelineLayoutInfo.pSetLayouts = &minstanceSetLayout;
+
+        VkPipelineLayout pipelineLayout;
+        if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, HostAllocator::callbacks(), &pipelineLayout) !=
+            VK_SUCCESS) {
+            throw std::runtime_error("Failed to create instance pipeline layout");
+        }
+        minstancePipelineLayout = mdeletionQueue.own(pipelineLayout);
+        nameObject(VK_OBJECT_TYPE_PIPELINE_LAYOUT, (uint64_t) pipelineLayout, "instance ring layout");
+
+        minstancePipelines[INSTANCE_PIPELINE_OPAQUE] = mpipelines.request<INSTANCE_RING_OPAQUE_PIPELINE>(
+            pipelineLayout, SHADER_INSTANCE_RING_VERT, SHADER_INSTANCED_FRAG);
+        minstancePipelines[INSTANCE_PIPELINE_ADDITIVE] = mpipelines.request<INSTANCE_RING_ADDITIVE_PIPELINE>(
+            pipelineLayout, SHADER_INSTANCE_RING_VERT, SHADER_INSTANCED_FRAG);
+    }
+
+    /*
+     * Random objects over every pipeline, mesh and material, in no
+     * particular order, as a scene would hold them. The ring starts small
+     * and grows to fit on the first frame. Also points the camera set at the
+     * frame transient buffer, which exists once the frame resources do.
+     */
+    void createInstanceObjects() {
+        uint32_t count = mconfig.benchInstancing ? INSTANCE_BENCH_MAX_OBJECTS : mconfig.instanceObjects;
+        std::mt19937 rng(42);
+        std::uniform_real_distribution<float> horizontal(-INSTANCE_FIELD_EXTENT, INSTANCE_FIELD_EXTENT);
+        std::uniform_real_distribution<float> vertical(-INSTANCE_FIELD_EXTENT * 0.1f, INSTANCE_FIELD_EXTENT * 0.1f);
+        std::uniform_real_distribution<float> scale(0.5f, 2.0f);
+        std::uniform_real_distribution<float> spin(-1.0f, 1.0f);
+
+        mbatcher.init(INSTANCE_PIPELINE_COUNT, INSTANCE_MESH_COUNT);
+        minstanceObjects.resize(count);
+        minstanceKeys.resize(count);
+        for (uint32_t i = 0; i < count; i++) {
+            InstanceObject& object = minstanceObjects[i];
+            object.position[0] = horizontal(rng);
+            object.position[1] = vertical(rng);
+            object.position[2] = horizontal(rng);
+            object.scale = scale(rng);
+            object.spin = spin(rng);
+            object.color = static_cast<uint32_t>(rng()) | 0xff000000u;
+            object.material = static_cast<uint32_t>(rng()) % INSTANCE_MATERIAL_COUNT;
+            object.pipeline = static_cast<uint16_t>(rng() % INSTANCE_PIPELINE_COUNT);
+            object.mesh = static_cast<uint16_t>(rng() % INSTANCE_MESH_COUNT);
+            minstanceKeys[i] = mbatcher.key(object.pipeline, object.mesh);
+        }
+        minstancePerObject = mconfig.noInstancing;
+        minstanceRing.init(mallocator, mdeletionQueue, mconfig.framesInFlight, INSTANCE_RING_INITIAL_CAPACITY);
+
+        VkDescriptorBufferInfo cameraInfo = {};
+        cameraInfo.buffer = mframeTransient.buffer();
+        cameraInfo.offset = 0;
+        cameraInfo.range = sizeof(Mat4);
+        VkWriteDescriptorSet write = {};
+        write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write.dstSet = minstanceCameraSet;
+        write.dstBinding = 0;
+        write.descriptorCount = 1;
+        write.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+        write.pBufferInfo = &cameraInfo;
+        vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
+    }
+
+    /*
+     * Rebuilds every object's InstanceData straight into the frame's ring
+     * region, sorted by pipeline and mesh, or in scene order for per-object
+     * draws. The frame's fence has been waited on, so the GPU is done with
+     * the region, and with the frame transient region the camera goes to.
+     */
+    void writeInstances(uint32_t frame) {
+        TRACE_SCOPE("writeInstances", "frame");
+        float aspect = static_cast<float>(mswapChainExtent.width) / static_cast<float>(mswapChainExtent.height);
+        Mat4 viewProjection = Mat4::perspective(CULL_FOV_Y, aspect, 0.1f, CULL_FAR_PLANE) *
+                              Mat4::rotationY(mframeSerial * CULL_CAMERA_RADIANS_PER_FRAME);
+        VkDeviceSize cameraOffset;
+        void* camera = mframeTransient.allocate(sizeof(Mat4), cameraOffset);
+        if (camera == nullptr) {
+            throw std::runtime_error("Frame transient region exhausted");
+        }
+        memcpy(camera, &viewProjection, sizeof(Mat4));
+        minstanceCameraOffset = static_cast<uint32_t>(cameraOffset);
+
+        uint32_t count = static_cast<uint32_t>(minstanceObjects.size());
+        InstanceData* region = minstanceRing.begin(frame, count);
+        const uint32_t* order = nullptr;
+        if (!minstancePerObject) {
+            mbatcher.sort(minstanceKeys.data(), count);
+            order = mbatcher.order().data();
+        }
+
+        float angle = mframeSerial * INSTANCE_SPIN_RADIANS_PER_FRAME;
+        mjobSystem->parallelFor(count, 0, [&](size_t begin, size_t end, size_t, unsigned) {
+            for (size_t i = begin; i < end; i++) {
+                const InstanceObject& object = minstanceObjects[order != nullptr ? order[i] : i];
+                float c = std::cos(angle * object.spin) * object.scale;
+                float s = std::sin(angle * object.spin) * object.scale;
+                /* Built whole, then stored, so the mapped memory only sees sequential writes */
+                InstanceData instance = {{{c, 0.0f, s, object.position[0]},
+                                          {0.0f, object.scale, 0.0f, object.position[1]},
+                                          {-s, 0.0f, c, object.position[2]}},
+                                         object.color, object.material, {0, 0}};
+                region[i] = instance;
+            }
+        });
+    }
+
+    /* Inside the main pass: one draw per batch, or with --no-instancing one per object */
+    void recordInstances(VkCommandBuffer commandBuffer, uint32_t frame) {
+        VkViewport viewport = {};
+        viewport.width = (float) mswapChainExtent.width;
+        viewport.height = (float) mswapChainExtent.height;
+        viewport.maxDepth = 1.0f;
+        vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+        VkRect2D scissor = {};
+        scissor.extent = mswapChainExtent;
+        vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+        VkBuffer vertexBuffers[2] = {minstanceVertexBuffer, minstanceRing.buffer()};
+        VkDeviceSize offsets[2] = {0, minstanceRing.offset(frame)};
+        vkCmdBindVertexBuffers(commandBuffer, 0, 2, vertexBuffers, offsets);
+        vkCmdBindIndexBuffer(commandBuffer, minstanceIndexBuffer, 0, VK_INDEX_TYPE_UINT16);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, minstancePipelineLayout, 0, 1,
+                                &minstanceCameraSet, 1, &minstanceCameraOffset);
+
+        uint32_t bound = INSTANCE_PIPELINE_COUNT;
+        minstanceDraws = 0;
+        minstanceBinds = 0;
+        auto draw = [&](uint32_t pipeline, uint32_t mesh, uint32_t firstInstance, uint32_t instanceCount) {
+            if (pipeline != bound) {
+                vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                                  mpipelines.get(minstancePipelines[pipeline]));
+                bound = pipeline;
+                minstanceBinds++;
+            }
+            const InstanceMesh& instanceMesh = INSTANCE_MESHES[mesh];
+            vkCmdDrawIndexed(commandBuffer, instanceMesh.indexCount, instanceCount, instanceMesh.firstIndex,
+                             instanceMesh.vertexOffset, firstInstance);
+            minstanceDraws++;
+        };
+        if (minstancePerObject) {
+            for (uint32_t i = 0; i < minstanceObjects.size(); i++) {
+                draw(minstanceObjects[i].pipeline, minstanceObjects[i].mesh, i, 1);
+            }
+        } else {
+            for (const InstanceBatch& batch : mbatcher.batches()) {
+                draw(batch.pipeline, batch.mesh, batch.firstInstance, batch.instanceCount);
+            }
+        }
+    }
+
+    /* --capture: every submitted frame is copied out and written by background encoders */
+    void createFrameCapture() {
+        if (mconfig.captureDirectory.empty()) {
+            return;
+        }
+        FrameCapture::Settings settings;
+        settings.directory = mconfig.captureDirectory;
+        settings.format = mconfig.captureFormat;
+        settings.ringSize = mconfig.captureRing;
+        settings.encoderThreads = mconfig.captureThreads;
+        mcapture.init(mallocator, settings, mconfig.framesInFlight, mswapChainImageFormat, mswapChainExtent);
+        mcapturing = true;
+    }
+
+    /*
+     * --scene-nodes: a transform hierarchy updated every frame straight into
+     * that frame's region of a persistently mapped storage buffer.
+     */
+    void createSceneTransforms() {
+        if (mconfig.sceneNodes == 0) {
+            return;
+        }
+        mtransforms.reserve(mconfig.sceneNodes);
+        generateTransformHierarchy(mconfig.sceneNodes, [this](uint32_t node, uint32_t parent, const float* position,
+                                                              const float* rotation, const float* scale) {
+            mtransforms.create(parent);
+            mtransforms.setPosition(node, position[0], position[1], position[2]);
+            mtransforms.setRotation(node, rotation[0], rotation[1], rotation[2], rotation[3]);
+            mtransforms.setScale(node, scale[0], scale[1], scale[2]);
+        });
+
+        VkBufferCreateInfo bufferInfo = {};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = transformRegionSize() * mconfig.framesInFlight;
+        bufferInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        mallocator.createBuffer(bufferInfo, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                mtransformBuffer, mtransformAllocation);
+        mtransformVersions.assign(mconfig.framesInFlight, 0);
+        LOG_DEBUG(LOG_RENDER, "%u scene transforms, %s update", mconfig.sceneNodes,
+                  TransformSystem::simdPathName(mtransforms.simdPath()));
+    }
+
+    VkDeviceSize transformRegionSize() const {
+        return static_cast<VkDeviceSize>(mconfig.sceneNodes) * 16 * sizeof(float);
+    }
+
+    /* The frame's fence has been waited on, so its region is no longer read by the GPU */
+    void updateSceneTransforms() {
+        TRACE_SCOPE("updateTransforms", "frame");
+        float angle = mframeSerial * TRANSFORM_RADIANS_PER_FRAME;
+        float rotation[2] = {std::sin(angle * 0.5f), std::cos(angle * 0.5f)};
+        for (uint32_t node = 0; node < mconfig.sceneNodes; node += TRANSFORM_ANIMATED_STRIDE) {
+            mtransforms.setRotation(node, 0.0f, rotation[0], 0.0f, rotation[1]);
+        }
+
+        char* region = static_cast<char*>(mtransformAllocation.mapped) + transformRegionSize() * mcurrentFrame;
+        mtransforms.update(mjobSystem.get(), reinterpret_cast<float*>(region), mtransformVersions[mcurrentFrame]);
+    }
+
+    /*
+     * Pushes --stream-upload KiB per frame into a scratch buffer to load the
+     * transfer path. Each frame copies into the next slot of the buffer, and
+     * a slot is only written again once its last copy has landed and the
+     * graphics frame that acquired it has retired, so no copy overlaps the
+     * one before it or graphics' acquire. A copy replaces the whole slot, so
+     * the transfer queue takes it back without a release from graphics and
+     * the old contents are discarded. With every slot busy the frame pushes
+     * nothing.
+     */
+    void streamUpload() {
+        VkDeviceSize bytes = static_cast<VkDeviceSize>(mconfig.streamUploadKiB) * 1024;
+        if (mstreamBuffer == VK_NULL_HANDLE) {
+            mstreamSlots.assign(mframes.size() + STREAM_UPLOAD_TRANSFER_SLOTS, StreamSlot());
+            createDeviceLocalBuffer(bytes * mstreamSlots.size(), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, mstreamBuffer,
+                                    mstreamAllocation);
+            mstreamData.resize(bytes);
+            for (size_t i = 0; i < mstreamData.size(); i++) {
+                mstreamData[i] = static_cast<char>(i);
+            }
+        }
+
+        StreamSlot& slot = mstreamSlots[mstreamNext];
+        if (slot.ticket != 0) {
+            if (slot.acquireSerial == 0) {
+                if (!muploader.isComplete(slot.ticket)) {
+                    mstreamSkipped++;
+                    return;
+                }
+                /* Retired batches are acquired by the next frame submitted, if not by an earlier one */
+                slot.acquireSerial = mframeSerial + 1;
+            }
+            if (mcompletedSerial < slot.acquireSerial) {
+                mstreamSkipped++;
+                return;
+            }
+        }
+        slot.ticket = muploader.uploadBuffer(mstreamBuffer, mstreamNext * bytes, mstreamData.data(), bytes);
+        slot.acquireSerial = 0;
+        muploader.flush();
+        mstreamNext = (mstreamNext + 1) % mstreamSlots.size();
+    }
+
+    /*
+     * Records (but never submits) frames of 10k-100k draws with an increasing
+     * number of recording threads and prints the average record time. Each
+     * row swaps in a job system of exactly that many threads, one chunk per
+     * thread; a single thread records inline and needs none.
+     */
+    void benchmarkRecording() {
+        const uint32_t drawCounts[] = {10000, 25000, 50000, 100000};
+        const int iterations = 20;
+
+        typedef std::chrono::steady_clock Clock;
+        typedef std::chrono::duration<double, std::milli> Milliseconds;
+
+        vkDeviceWaitIdle(device);
+        muploader.collect();
+        FrameData& frame = mframes[0];
+
+        std::vector<unsigned> threadCounts;
+        for (unsigned threads = 1; threads < mjobSystem->threadCount(); threads *= 2) {
+            threadCounts.push_back(threads);
+        }
+        threadCounts.push_back(mjobSystem->threadCount());
+
+        printf("%10s %8s %12s %14s \n", "draws", "threads", "record ms", "Mdraws/s");
+        for (uint32_t drawCount : drawCounts) {
+            for (unsigned threads : threadCounts) {
+                /* Thread indices stay below the full pool's count, so the frame's thread pools still cover them */
+                std::unique_ptr<JobSystem> rowJobSystem;
+                if (threads > 1 && threads < mjobSystem->threadCount()) {
+                    rowJobSystem.reset(new JobSystem(threads - 1));
+                    std::swap(mjobSystem, rowJobSystem);
+                }
+                double totalMs = 0.0;
+                for (int i = 0; i < iterations; i++) {
+                    resetFrameCommandPools(frame);
+                    Clock::time_point start = Clock::now();
+                    recordCommandBuffer(frame, 0, drawCount, threads);
+                    totalMs += Milliseconds(Clock::now() - start).count();
+                }
+                if (rowJobSystem) {
+                    std::swap(mjobSystem, rowJobSystem);
+                }
+                double averageMs = totalMs / iterations;
+                printf("%10u %8u %12.3f %14.2f \n", drawCount, threads, averageMs,
+                       drawCount / (averageMs * 1000.0));
+            }
+        }
+        resetFrameCommandPools(frame);
+    }
+
+    /*
+     * Records (but never submits) frames of textured draws, each draw
+     * selecting one of the scene textures, and prints draws per second for:
+     *   bindless        global set bound once, one push constant per draw
+     *   per-draw bind   a persistent set per texture, bound before every draw
+     *   per-draw write  a set allocated and written per draw, then bound
+     * The per-set paths get their own heap and pipeline, so both sides are
+     * measured on a bindless device; bindless is skipped without one.
+     */
+    void benchmarkDescriptors() {
+        const uint32_t drawCounts[] = {10000, 25000, 50000, 100000};
+        const uint32_t maxDrawCount = 100000;
+        const int iterations = 20;
+        enum Path { PATH_BINDLESS, PATH_PER_DRAW_BIND, PATH_PER_DRAW_WRITE, PATH_COUNT };
+        const char* pathNames[PATH_COUNT] = {"bindless", "per-draw bind", "per-draw write"};
+
+        typedef std::chrono::steady_clock Clock;
+        typedef std::chrono::duration<double, std::milli> Milliseconds;
+
+        vkDeviceWaitIdle(device);
+        muploader.collect();
+        FrameData& frame = mframes[0];
+
+        DescriptorHeap perSetHeap;
+        perSetHeap.init(device, physicalDevice, false, HEAP_IMAGE_CAPACITY, HEAP_STORAGE_BUFFER_CAPACITY);
+        std::vector<DescriptorHandle> perSetHandles;
+        for (VkImageView view : mtextureViews) {
+            perSetHandles.push_back(perSetHeap.createImage(view, msampler, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL));
+        }
+        VkPipelineLayout perSetLayout = createPipelineLayout(perSetHeap);
+        /* The same shaders specialised for per-set descriptors; built here, as it was never prewarmed */
+        VkPipeline perSetPipeline = mpipelines.get(mpipelines.request<TRIANGLE_PIPELINE>(
+            perSetLayout, SHADER_TRIANGLE_VERT, SHADER_TRIANGLE_FRAG, TriangleConstants{{VK_FALSE, 1}}));
+
+        /* Per-draw writes come from a pool sized for the largest frame and reset every frame */
+        VkDescriptorPoolSize poolSize = {};
+        poolSize.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        poolSize.descriptorCount = maxDrawCount;
+        VkDescriptorPoolCreateInfo poolInfo = {};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.maxSets = maxDrawCount;
+        poolInfo.poolSizeCount = 1;
+        poolInfo.pPoolSizes = &poolSize;
+        VkDescriptorPool transientPool;
+        if (vkCreateDescriptorPool(device, &poolInfo, HostAllocator::callbacks(), &transientPool) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create per-draw descriptor pool");
+        }
+        VkDescriptorSetLayout imageSetLayout = perSetHeap.imageSetLayout();
+
+        VkClearValue clearColor = {};
+        VkRenderPassBeginInfo renderPassInfo = {};
+        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+        renderPassInfo.renderPass = mrenderPass;
+        renderPassInfo.framebuffer = mswapChainFramebuffers[0];
+        renderPassInfo.renderArea.extent = mswapChainExtent;
+        renderPassInfo.clearValueCount = 1;
+        renderPassInfo.pClearValues = &clearColor;
+
+        auto recordPath = [&](VkCommandBuffer commandBuffer, Path path, uint32_t drawCount) {
+            VkCommandBufferBeginInfo beginInfo = {};
+            beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+            beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+            vkBeginCommandBuffer(commandBuffer, &beginInfo);
+            vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+            if (path == PATH_BINDLESS) {
+                recordDrawState(commandBuffer);
+                recordDraws(commandBuffer, 0, drawCount);
+            } else if (path == PATH_PER_DRAW_BIND) {
+                bindPipelineState(commandBuffer, perSetPipeline);
+                for (uint32_t i = 0; i < drawCount; i++) {
+                    perSetHeap.bindDrawImage(commandBuffer, perSetLayout, perSetHandles[i % perSetHandles.size()]);
+                    vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(triangleIndices.size()), 1, 0, 0, 0);
+                }
+            } else {
+                vkResetDescriptorPool(device, transientPool, 0);
+                bindPipelineState(commandBuffer, perSetPipeline);
+
+                VkDescriptorSetAllocateInfo allocInfo = {};
+                allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+                allocInfo.descriptorPool = transientPool;
+                allocInfo.descriptorSetCount = 1;
+                allocInfo.pSetLayouts = &imageSetLayout;
+
+                VkDescriptorImageInfo imageInfo = {};
+                imageInfo.sampler = msampler;
+                imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+                VkWriteDescriptorSet write = {};
+                write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                write.descriptorCount = 1;
+                write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+                write.pImageInfo = &imageInfo;
+
+                for (uint32_t i = 0; i < drawCount; i++) {
+                    VkDescriptorSet set;
+                    vkAllocateDescriptorSets(device, &allocInfo, &set);
+                    imageInfo.imageView = mtextureViews[i % mtextureViews.size()];
+                    write.dstSet = set;
+                    vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
+                    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, perSetLayout, 0, 1, &set,
+                                            0, nullptr);
+                    vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(triangleIndices.size()), 1, 0, 0, 0);
+                }
+            }
+
+            vkCmdEndRenderPass(commandBuffer);
+            vkEndCommandBuffer(commandBuffer);
+        };
+
+        printf("%10s %16s %12s %14s \n", "draws", "path", "record ms", "Mdraws/s");
+        for (uint32_t drawCount : drawCounts) {
+            for (int path = 0; path < PATH_COUNT; path++) {
+                if (path == PATH_BINDLESS && !mheap.bindless()) {
+                    printf("%10u %16s %12s %14s \n", drawCount, pathNames[path], "-", "unsupported");
+                    continue;
+                }
+                double totalMs = 0.0;
+                for (int i = 0; i < iterations; i++) {
+                    resetFrameCommandPools(frame);
+                    Clock::time_point start = Clock::now();
+                    recordPath(frame.commandBuffer, static_cast<Path>(path), drawCount);
+                    totalMs += Milliseconds(Clock::now() - start).count();
+                }
+                double averageMs = totalMs / iterations;
+                printf("%10u %16s %12.3f %14.2f \n", drawCount, pathNames[path], averageMs,
+                       drawCount / (averageMs * 1000.0));
+            }
+        }
+        resetFrameCommandPools(frame);
+
+        vkDestroyDescriptorPool(device, transientPool, HostAllocator::callbacks());
+        vkDestroyPipelineLayout(device, perSetLayout, HostAllocator::callbacks());
+        perSetHeap.destroy();
+    }
+
+    /*
+     * Writes, records and submits headless frames of 1k to 100k objects,
+     * drawn instanced (one draw per pipeline and mesh) and one draw per
+     * object, and prints each path's draws, pipeline binds and CPU time.
+     * Record time covers writing the instance ring too. The GPU is waited on
+     * between frames, outside the timings.
+     */
+    void benchmarkInstancing() {
+        const uint32_t objectCounts[] = {1000, 10000, INSTANCE_BENCH_MAX_OBJECTS};
+        const char* pathNames[2] = {"instanced", "per-object"};
+
+        typedef std::chrono::steady_clock Clock;
+        typedef std::chrono::duration<double, std::milli> Milliseconds;
+
+        vkDeviceWaitIdle(device);
+        muploader.collect();
+        FrameData& frame = mframes[0];
+        std::vector<InstanceObject> objects = minstanceObjects;
+        std::vector<uint32_t> keys = minstanceKeys;
+
+        VkSubmitInfo submitInfo = {};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &frame.commandBuffer;
+
+        printf("%10s %12s %8s %8s %12s %12s \n", "objects", "path", "draws", "binds", "record ms", "submit ms");
+        for (uint32_t objectCount : objectCounts) {
+            minstanceObjects.assign(objects.begin(), objects.begin() + objectCount);
+            minstanceKeys.assign(keys.begin(), keys.begin() + objectCount);
+            for (int path = 0; path < 2; path++) {
+                minstancePerObject = path == 1;
+                double recordMs = 0.0;
+                double submitMs = 0.0;
+                for (int i = 0; i < INSTANCE_BENCH_ITERATIONS; i++) {
+                    resetFrameCommandPools(frame);
+                    mframeTransient.beginFrame(0);
+                    Clock::time_point start = Clock::now();
+                    writeInstances(0);
+                    recordCommandBuffer(frame, 0, 0, 1);
+                    Clock::time_point recorded = Clock::now();
+                    vkResetFences(device, 1, &frame.inFlight);
+                    if (vkQueueSubmit(mgraphicsQueue, 1, &submitInfo, frame.inFlight) != VK_SUCCESS) {
+                        throw std::runtime_error("Failed to submit instancing benchmark frame");
+                    }
+                    Clock::time_point submitted = Clock::now();
+                    vkWaitForFences(device, 1, &frame.inFlight, VK_TRUE, std::numeric_limits<uint64_t>::max());
+                    recordMs += Milliseconds(recorded - start).count();
+                    submitMs += Milliseconds(submitted - recorded).count();
+                }
+                printf("%10u %12s %8u %8u %12.3f %12.3f \n", objectCount, pathNames[path], minstanceDraws,
+                       minstanceBinds, recordMs / INSTANCE_BENCH_ITERATIONS, submitMs / INSTANCE_BENCH_ITERATIONS);
+            }
+        }
+        resetFrameCommandPools(frame);
+        minstanceObjects = objects;
+        minstanceKeys = keys;
+        minstancePerObject = mconfig.noInstancing;
+        minstanceRing.printStats();
+    }
+
+    /*
+     * Culls the instance field from several camera angles on the GPU, reads
+     * the indirect commands back and compares the surviving instances with
+     * the CPU reference culler. Spheres within CULL_VALIDATION_EPSILON of a
+     * plane may land either way and are not counted as mismatches.
+     */
+    void validateCulling() {
+        typedef std::chrono::steady_clock Clock;
+        typedef std::chrono::duration<double, std::milli> Milliseconds;
+
+        vkDeviceWaitIdle(device);
+        muploader.collect();
+        FrameData& frame = mframes[0];
+        uint32_t instanceCount = mculler.instanceCount();
+        VkDeviceSize commandBytes = sizeof(VkDrawIndexedIndirectCommand) * static_cast<VkDeviceSize>(instanceCount);
+
+        VkBufferCreateInfo readbackInfo = {};
+        readbackInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        readbackInfo.size = commandBytes + sizeof(uint32_t);
+        readbackInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+        readbackInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        VkBuffer readback;
+        GpuAllocation readbackAllocation;
+        mallocator.createBuffer(readbackInfo, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                readback, readbackAllocation);
+
+        SphereStreams spheres = mculler.spheres();
+        std::vector<uint32_t> cpuVisible(instanceCount);
+        std::vector<uint32_t> scalarVisible(instanceCount);
+        std::vector<uint32_t> gpuVisible;
+        std::vector<char> gpuMask(instanceCount);
+        size_t mismatches = 0;
+        size_t borderline = 0;
+
+        printf("%6s %10s %10s %12s %12s %12s \n", "view", "cpu", "gpu", "scalar ms", "simd ms", "gpu ms");
+        for (uint32_t view = 0; view < CULL_VALIDATION_VIEWS; view++) {
+            updateCullCamera(view * 6.2831853f / CULL_VALIDATION_VIEWS);
+
+            Clock::time_point start = Clock::now();
+            size_t scalarCount = cullSpheresScalar(mcullFrustum, spheres, scalarVisible.data());
+            Clock::time_point scalarDone = Clock::now();
+            size_t cpuCount = cullSpheresSimd(mcullFrustum, spheres, cpuVisible.data());
+            Clock::time_point simdDone = Clock::now();
+            if (scalarCount != cpuCount ||
+                !std::equal(cpuVisible.begin(), cpuVisible.begin() + cpuCount, scalarVisible.begin())) {
+                throw std::runtime_error("SIMD culling disagrees with the scalar reference");
+            }
+
+            resetFrameCommandPools(frame);
+            VkCommandBufferBeginInfo beginInfo = {};
+            beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+            beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+            vkBeginCommandBuffer(frame.commandBuffer, &beginInfo);
+            mculler.recordCull(frame.commandBuffer, 0, mcullFrustum, static_cast<uint32_t>(triangleIndices.size()),
+                               false);
+
+            VkMemoryBarrier culled = {};
+            culled.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+            culled.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+            culled.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+            vkCmdPipelineBarrier(frame.commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                                 VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &culled, 0, nullptr, 0, nullptr);
+            VkBufferCopy commandCopy = {0, 0, commandBytes};
+            vkCmdCopyBuffer(frame.commandBuffer, mculler.commandBuffer(0), readback, 1, &commandCopy);
+            if (mculler.drawIndirectCount()) {
+                VkBufferCopy countCopy = {0, commandBytes, sizeof(uint32_t)};
+                vkCmdCopyBuffer(frame.commandBuffer, mculler.countBuffer(0), readback, 1, &countCopy);
+            }
+
+            VkMemoryBarrier copied = {};
+            copied.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+            copied.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            copied.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+            vkCmdPipelineBarrier(frame.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0,
+                                 1, &copied, 0, nullptr, 0, nullptr);
+            vkEndCommandBuffer(frame.commandBuffer);
+
+            VkSubmitInfo submitInfo = {};
+            submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+            submitInfo.commandBufferCount = 1;
+            submitInfo.pCommandBuffers = &frame.commandBuffer;
+            Clock::time_point submitStart = Clock::now();
+            if (vkQueueSubmit(mgraphicsQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+                throw std::runtime_error("Failed to submit culling validation");
+            }
+            vkQueueWaitIdle(mgraphicsQueue);
+            double gpuMs = Milliseconds(Clock::now() - submitStart).count();
+
+            /* Compacted commands arrive in atomic order; fixed slots carry instanceCount 0 or 1 */
+            const char* mapped = static_cast<const char*>(readbackAllocation.mapped);
+            const VkDrawIndexedIndirectCommand* commands = reinterpret_cast<const VkDrawIndexedIndirectCommand*>(mapped);
+            gpuVisible.clear();
+            if (mculler.drawIndirectCount()) {
+                uint32_t count;
+                memcpy(&count, mapped + commandBytes, sizeof(count));
+                for (uint32_t i = 0; i < std::min(count, instanceCount); i++) {
+                    gpuVisible.push_back(commands[i].firstInstance);
+                }
+            } else {
+                for (uint32_t i = 0; i < instanceCount; i++) {
+                    if (commands[i].instanceCount != 0) {
+                        gpuVisible.push_back(commands[i].firstInstance);
+                    }
+                }
+            }
+
+            std::fill(gpuMask.begin(), gpuMask.end(), 0);
+            for (uint32_t index : gpuVisible) {
+                if (index < instanceCount) {
+                    gpuMask[index] ^= 1;
+                }
+            }
+            for (size_t i = 0; i < cpuCount; i++) {
+                gpuMask[cpuVisible[i]] ^= 2;
+            }
+            for (uint32_t i = 0; i < instanceCount; i++) {
+                /* 1 or 2 means exactly one side kept the instance; 3 is agreement */
+                if (gpuMask[i] == 1 || gpuMask[i] == 2) {
+                    float margin = sphereMargin(mcullFrustum, spheres.x[i], spheres.y[i], spheres.z[i],
+                                                spheres.radius[i]);
+                    if (std::fabs(margin) < CULL_VALIDATION_EPSILON) {
+                        borderline++;
+                    } else {
+                        mismatches++;
+                    }
+                }
+            }
+
+            printf("%6u %10zu %10zu %12.3f %12.3f %12.3f \n", view, cpuCount, gpuVisible.size(),
+                   Milliseconds(scalarDone - start).count(), Milliseconds(simdDone - scalarDone).count(), gpuMs);
+        }
+        resetFrameCommandPools(frame);
+        mallocator.destroyBuffer(readback, readbackAllocation);
+
+        printf("Culling validation: %zu mismatches, %zu borderline spheres within %g of a plane \n", mismatches,
+               borderline, CULL_VALIDATION_EPSILON);
+        if (mismatches > 0) {
+            throw std::runtime_error("GPU culling disagrees with the CPU reference");
+        }
+    }
+
+    /*
+     * Cost of a message on the logging thread. The flusher writes to a
+     * temporary file. Bursts are flushed between timings so the ring never fills;
+     * the saturated run shows what happens when producers outpace the flusher
+     * for a sustained period. The baseline is the previous print-and-flush
+     * per message.
+     */
+    static void benchmarkLog() {
+        typedef std::chrono::steady_clock Clock;
+        typedef std::chrono::duration<double, std::nano> Nanoseconds;
+
+        const size_t messages = 1000000;
+        const size_t burst = 256;
+        const unsigned threadCounts[] = {1, 2, 4};
+
+        FILE* sink = tmpfile();
+        if (sink == nullptr) {
+            throw std::runtime_error("Failed to create a temporary file");
+        }
+        Log::start(LOG_LEVEL_INFO, LOG_ALL_CATEGORIES);
+        Log::setOutput(sink);
+
+        printf("%-28s %8s %10s \n", "path", "threads", "ns/msg");
+
+        Clock::time_point start = Clock::now();
+        for (size_t i = 0; i < messages; i++) {
+            fprintf(sink, "frame %zu draw %zu culled %u instances\n", i, i % 64, 42u);
+            fflush(sink);
+        }
+        printf("%-28s %8u %10.1f \n", "fprintf and fflush", 1u,
+               Nanoseconds(Clock::now() - start).count() / messages);
+
+        char buffer[256];
+        start = Clock::now();
+        for (size_t i = 0; i < messages; i++) {
+            snprintf(buffer, sizeof(buffer), "frame %zu draw %zu culled %u instances", i, i % 64, 42u);
+            /* Keeps the formatting from being optimised away */
+            __asm__ __volatile__("" : : "r"(buffer) : "memory");
+        }
+        printf("%-28s %8u %10.1f \n", "snprintf only", 1u, Nanoseconds(Clock::now() - start).count() / messages);
+
+        start = Clock::now();
+        for (size_t i = 0; i < messages; i++) {
+            LOG_DEBUG(LOG_RENDER, "frame %zu draw %zu culled %u instances", i, i % 64, 42u);
+        }
+        printf("%-28s %8u %10.1f \n", LOG_COMPILED_LEVEL > LOG_LEVEL_DEBUG ? "debug, compiled out" :
+               "debug, filtered at runtime", 1u, Nanoseconds(Clock::now() - start).count() / messages);
+
+        /* Each thread times only its own bursts and flushes between them */
+        auto timedBursts = [burst](size_t count, unsigned threadCount, bool repeated) {
+            std::vector<double> threadNs(threadCount);
+            std::vector<std::thread> threads;
+            for (unsigned t = 0; t < threadCount; t++) {
+                threads.emplace_back([&threadNs, burst, count, threadCount, repeated, t]() {
+                    Nanoseconds elapsed(0);
+                    for (size_t i = 0; i < count / threadCount; i += burst) {
+                        Clock::time_point burstStart = Clock::now();
+                        for (size_t j = i; j < i + burst; j++) {
+                            if (repeated) {
+                                LOG_INFO(LOG_RENDER, "the same message every time");
+                            } else {
+                                LOG_INFO(LOG_RENDER, "frame %zu draw %u culled %u instances", j, t, 42u);
+                            }
+                        }
+                        elapsed += Clock::now() - burstStart;
+                        Log::flush();
+                    }
+                    threadNs[t] = elapsed.count() / (count / threadCount);
+                });
+            }
+            for (auto& thread : threads) {
+                thread.join();
+            }
+            double total = 0.0;
+            for (double ns : threadNs) {
+                total += ns;
+            }
+            return total / threadCount;
+        };
+        for (unsigned threadCount : threadCounts) {
+            printf("%-28s %8u %10.1f \n", "info, unique", threadCount, timedBursts(messages, threadCount, false));
+        }
+        printf("%-28s %8u %10.1f \n", "info, repeated", 1u, timedBursts(messages, 1, true));
+
+        Log::printStats();
+        unsigned saturatedThreads = threadCounts[sizeof(threadCounts) / sizeof(threadCounts[0]) - 1];
+        std::vector<std::thread> threads;
+        start = Clock::now();
+        for (unsigned t = 0; t < saturatedThreads; t++) {
+            threads.emplace_back([messages, saturatedThreads, t]() {
+                for (size_t i = 0; i < messages / saturatedThreads; i++) {
+                    LOG_INFO(LOG_RENDER, "saturated frame %zu draw %u", i, t);
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        printf("%-28s %8u %10.1f \n", "info, saturated", saturatedThreads,
+               Nanoseconds(Clock::now() - start).count() / (messages / saturatedThreads));
+
+        /* The repeat summary goes to the sink too */
+        Log::stop();
+        Log::setOutput(nullptr);
+        fclose(sink);
+        Log::printStats();
+    }
+
+    /*
+     * Updates 10k-1M node hierarchies with a naive array of glm::mat4 nodes
+     * and with TransformSystem on each SIMD path, single-threaded and across
+     * the job system, then with a tenth of the nodes dirty. Needs no Vulkan
+     * device.
+     */
+    static void benchmarkTransforms() {
+        typedef std::chrono::steady_clock Clock;
+        typedef std::chrono::duration<double, std::milli> Milliseconds;
+
+        struct AosNode {
+            glm::vec3 position;
+            glm::quat rotation;
+            glm::vec3 scale;
+            uint32_t parent;
+            glm::mat4 world;
+        };
+
+        const uint32_t nodeCounts[] = {10000, 100000, 1000000};
+        const int iterations = 10;
+        JobSystem jobs;
+        TransformSystem::SimdPath bestPath = TransformSystem::detectSimdPath();
+
+        printf("%10s %24s %10s %12s %12s \n", "nodes", "path", "ms", "Mnodes/s", "max error");
+        for (uint32_t nodeCount : nodeCounts) {
+            std::vector<AosNode> aos(nodeCount);
+            TransformSystem soa;
+            soa.reserve(nodeCount);
+            generateTransformHierarchy(nodeCount, [&](uint32_t node, uint32_t parent, const float* position,
+                                                      const float* rotation, const float* scale) {
+                aos[node].position = glm::vec3(position[0], position[1], position[2]);
+                aos[node].rotation = glm::quat(rotation[3], rotation[0], rotation[1], rotation[2]);
+                aos[node].scale = glm::vec3(scale[0], scale[1], scale[2]);
+                aos[node].parent = parent;
+                soa.create(parent);
+                soa.setPosition(node, position[0], position[1], position[2]);
+                soa.setRotation(node, rotation[0], rotation[1], rotation[2], rotation[3]);
+                soa.setScale(node, scale[0], scale[1], scale[2]);
+            });
+            AlignedVector<float> output(static_cast<size_t>(nodeCount) * 16);
+
+            double totalMs = 0.0;
+            for (int i = 0; i < iterations; i++) {
+                Clock::time_point start = Clock::now();
+                for (AosNode& node : aos) {
+                    glm::mat4 local = glm::translate(glm::mat4(1.0f), node.position) * glm::mat4_cast(node.rotation) *
+                                      glm::scale(glm::mat4(1.0f), node.scale);
+                    node.world = node.parent == TransformSystem::INVALID_NODE ? local : aos[node.parent].world * local;
+                }
+                for (uint32_t node = 0; node < nodeCount; node++) {
+                    memcpy(&output[static_cast<size_t>(node) * 16], &aos[node].world, sizeof(glm::mat4));
+                }
+                totalMs += Milliseconds(Clock::now() - start).count();
+            }
+            printf("%10u %24s %10.3f %12.2f %12s \n", nodeCount, "aos glm::mat4", totalMs / iterations,
+                   nodeCount / (totalMs / iterations * 1000.0), "-");
+
+            /* Rewrites every rotation unchanged, so all nodes are dirty but the result stays comparable */
+            auto dirtyNodes = [&](uint32_t stride) {
+                for (uint32_t node = 0; node < nodeCount; node += stride) {
+                    const glm::quat& q = aos[node].rotation;
+                    soa.setRotation(node, q.x, q.y, q.z, q.w);
+                }
+            };
+            auto runSoa = [&](TransformSystem::SimdPath path, JobSystem* jobSystem, uint32_t dirtyStride) {
+                soa.setSimdPath(path);
+                double soaMs = 0.0;
+                uint64_t version = 0;
+                for (int i = 0; i < iterations; i++) {
+                    dirtyNodes(dirtyStride);
+                    Clock::time_point start = Clock::now();
+                    soa.update(jobSystem, output.data(), version);
+                    soaMs += Milliseconds(Clock::now() - start).count();
+                }
+
+                float maxError = 0.0f;
+                for (uint32_t node = 0; node < nodeCount; node++) {
+                    const float* expected = &aos[node].world[0][0];
+                    for (int e = 0; e < 16; e++) {
+                        maxError = std::max(maxError, std::fabs(output[static_cast<size_t>(node) * 16 + e] -
+                                                                expected[e]));
+                    }
+                }
+                char name[64];
+                snprintf(name, sizeof(name), "soa %s %ut%s", TransformSystem::simdPathName(path),
+                         jobSystem == nullptr ? 1u : jobSystem->threadCount(), dirtyStride > 1 ? " 10% dirty" : "");
+                printf("%10u %24s %10.3f %12.2f %12.2e \n", nodeCount, name, soaMs / iterations,
+                       nodeCount / (soaMs / iterations * 1000.0), maxError);
+            };
+
+            runSoa(TransformSystem::SIMD_SCALAR, nullptr, 1);
+            if (bestPath >= TransformSystem::SIMD_SSE) {
+                runSoa(TransformSystem::SIMD_SSE, nullptr, 1);
+            }
+            if (bestPath >= TransformSystem::SIMD_AVX2) {
+                runSoa(TransformSystem::SIMD_AVX2, nullptr, 1);
+            }
+            runSoa(bestPath, &jobs, 1);
+            runSoa(bestPath, &jobs, 10);
+        }
+    }
+
+    /*
+     * Checks the buddy sub-allocator's invariants over a randomised
+     * allocate/free mix with random power-of-two alignments, then exhausts a
+     * block and frees everything. Throws on the first violation. Needs no
+     * Vulkan device.
+     */
+    static void testAllocator() {
+        const uint64_t blockSize = 16ull * 1024 * 1024;
+        const uint64_t minBlockSize = 256;
+        const size_t operations = 200000;
+
+        BuddyAllocator allocator(blockSize, minBlockSize);
+        std::mt19937_64 rng(7);
+        std::uniform_int_distribution<uint64_t> sizeDist(1, 512 * 1024);
+        std::uniform_int_distribution<uint32_t> alignmentShift(0, 16);
+        /* Live ranges by offset, as [offset, offset + requested size) */
+        std::map<uint64_t, uint64_t> live;
+
+        auto check = [](bool condition, const char* what) {
+            if (!condition) {
+                throw std::runtime_error(std::string("Buddy allocator self-test failed: ") + what);
+            }
+        };
+        auto insertLive = [&](uint64_t offset, uint64_t size) {
+            auto next = live.lower_bound(offset);
+            check(next == live.end() || offset + size <= next->first, "live ranges overlap");
+            if (next != live.begin()) {
+                auto previous = std::prev(next);
+                check(previous->first + previous->second <= offset, "live ranges overlap");
+            }
+            check(offset + size <= blockSize, "range ends past the block");
+            live[offset] = size;
+        };
+
+        for (size_t i = 0; i < operations; i++) {
+            if (live.empty() || rng() % 100 < 55) {
+                uint64_t size = sizeDist(rng);
+                uint64_t alignment = 1ull << alignmentShift(rng);
+                uint64_t offset = allocator.allocate(size, alignment);
+                if (offset != BuddyAllocator::INVALID_OFFSET) {
+                    check(offset % alignment == 0, "offset misses the requested alignment");
+                    insertLive(offset, size);
+                }
+            } else {
+                auto it = live.begin();
+                std::advance(it, rng() % live.size());
+                allocator.free(it->first);
+                live.erase(it);
+            }
+        }
+        check(allocator.stats().allocationCount == live.size(), "allocation count disagrees with live ranges");
+
+        for (const auto& range : live) {
+            allocator.free(range.first);
+        }
+        live.clear();
+
+        /* Exhaustion: every smallest block handed out, then nothing more */
+        for (uint64_t i = 0; i < blockSize / minBlockSize; i++) {
+            uint64_t offset = allocator.allocate(minBlockSize, 1);
+            check(offset != BuddyAllocator::INVALID_OFFSET, "allocation failed before the block was full");
+            insertLive(offset, minBlockSize);
+        }
+        check(allocator.allocate(1, 1) == BuddyAllocator::INVALID_OFFSET, "exhausted block still allocated");
+        check(allocator.allocate(blockSize * 2, 1) == BuddyAllocator::INVALID_OFFSET,
+              "request larger than the block allocated");
+
+        /* Freeing everything in random order coalesces back to one full-size block */
+        std::vector<uint64_t> offsets;
+        for (const auto& range : live) {
+            offsets.push_back(range.first);
+        }
+        std::shuffle(offsets.begin(), offsets.end(), rng);
+        for (uint64_t offset : offsets) {
+            allocator.free(offset);
+        }
+        BuddyStats stats = allocator.stats();
+        check(allocator.empty() && stats.usedBytes == 0, "allocations left after freeing everything");
+        check(stats.largestFreeBlock == blockSize, "free space did not coalesce into one block");
+        uint64_t whole = allocator.allocate(blockSize, blockSize);
+        check(whole == 0, "full-size allocation failed after coalescing");
+        allocator.free(whole);
+
+        printf("Buddy allocator self-test passed (%zu random operations, %llu blocks to exhaustion) \n", operations,
+               (unsigned long long) (blockSize / minBlockSize));
+    }
+
+    /*
+     * Exercises the buddy sub-allocator with a randomised allocate/free mix of
+     * uniform-, vertex- and texture-sized requests. Needs no Vulkan device.
+     */
+    static void benchmarkAllocator() {
+        typedef std::chrono::steady_clock Clock;
+        typedef std::chrono::duration<double, std::nano> Nanoseconds;
+
+        const uint64_t blockSize = 256ull * 1024 * 1024;
+        const size_t operations = 1000000;
+        const uint64_t maxSizes[] = {4 * 1024, 256 * 1024, 4 * 1024 * 1024};
+
+        printf("%12s %12s %10s %12s %14s \n", "max size", "ops", "ns/op", "live allocs", "fragmentation");
+        for (uint64_t maxSize : maxSizes) {
+            BuddyAllocator allocator(blockSize, 256);
+            std::mt19937_64 rng(42);
+            std::uniform_int_distribution<uint64_t> sizeDist(256, maxSize);
+            std::vector<uint64_t> live;
+
+            Clock::time_point start = Clock::now();
+            for (size_t i = 0; i < operations; i++) {
+                /* Bias towards allocation until a steady population is reached */
+                bool doAllocate = live.empty() || rng() % 100 < (live.size() < 4096 ? 60u : 50u);
+                if (doAllocate) {
+                    uint64_t offset = allocator.allocate(sizeDist(rng), 256);
+                    if (offset != BuddyAllocator::INVALID_OFFSET) {
+                        live.push_back(offset);
+                    }
+                } else {
+                    size_t index = rng() % live.size();
+                    allocator.free(live[index]);
+                    live[index] = live.back();
+                    live.pop_back();
+                }
+            }
+            double nsPerOp = Nanoseconds(Clock::now() - start).count() / operations;
+
+            BuddyStats stats = allocator.stats();
+            printf("%12llu %12zu %10.1f %12u %14.3f \n", (unsigned long long) maxSize, operations, nsPerOp,
+                   stats.allocationCount, stats.fragmentation());
+        }
+    }
+
+    /*
+     * Gets every mesh of an OBJ file into staging memory three ways: parsing
+     * the OBJ and copying the arrays, then from a raw and an LZ4 package
+     * cooked from it beforehand. Every file has just been written, so all
+     * three read from a warm page cache. Needs no Vulkan device.
+     */
+    static void benchmarkAssets(const std::string& objPath) {
+        typedef std::chrono::steady_clock Clock;
+        typedef std::chrono::duration<double, std::milli> Milliseconds;
+
+        const std::string packagePaths[] = {objPath + ".bench.pak", objPath + ".bench.lz4.pak"};
+        {
+            std::vector<MeshData> meshes;
+            loadObj(objPath, meshes);
+            writeAssetPackage(packagePaths[0], meshes, false);
+            writeAssetPackage(packagePaths[1], meshes, true);
+        }
+
+        /* Stands in for the staging ring; everything passes through it in pieces of at most half its size */
+        std::vector<char> staging(STAGING_RING_BYTES, 0);
+        size_t head = 0;
+        auto stage = [&](size_t size) {
+            if (head + size > staging.size()) {
+                head = 0;
+            }
+            char* destination = &staging[head];
+            head += size;
+            return destination;
+        };
+        auto copyToStaging = [&](const void* data, size_t size) {
+            const char* source = static_cast<const char*>(data);
+            while (size > 0) {
+                size_t piece = std::min(size, staging.size() / 2);
+                memcpy(stage(piece), source, piece);
+                source += piece;
+                size -= piece;
+            }
+        };
+
+        bool peakReset = true;
+        printf("%-16s %10s %10s %16s \n", "loader", "ms", "MiB/s", "peak RSS +MiB");
+        auto measure = [&](const char* name, const std::function<uint64_t()>& load) {
+            peakReset = resetPeakResidentSize() && peakReset;
+            uint64_t baseKiB = readStatusKiB("VmRSS:");
+            Clock::time_point start = Clock::now();
+            uint64_t bytes = load();
+            double ms = Milliseconds(Clock::now() - start).count();
+            uint64_t peakKiB = readStatusKiB("VmHWM:");
+            printf("%-16s %10.2f %10.1f %16.2f \n", name, ms, bytes / (1024.0 * 1024.0) / (ms / 1000.0),
+                   (peakKiB > baseKiB ? peakKiB - baseKiB : 0) / 1024.0);
+        };
+
+        measure("parse OBJ", [&]() {
+            std::vector<MeshData> meshes;
+            loadObj(objPath, meshes);
+            uint64_t bytes = 0;
+            for (const MeshData& mesh : meshes) {
+                copyToStaging(mesh.vertices.data(), mesh.vertices.size() * sizeof(PackedVertex));
+                copyToStaging(mesh.indices.data(), mesh.indices.size() * sizeof(uint32_t));
+                bytes += mesh.vertices.size() * sizeof(PackedVertex) + mesh.indices.size() * sizeof(uint32_t);
+            }
+            return bytes;
+        });
+        const char* const packageNames[] = {"package raw", "package LZ4"};
+        for (int p = 0; p < 2; p++) {
+            measure(packageNames[p], [&]() {
+                AssetPackage package;
+                package.open(packagePaths[p]);
+                uint64_t bytes = 0;
+                for (uint32_t m = 0; m < package.meshCount(); m++) {
+                    const AssetMesh& mesh = package.mesh(m);
+                    for (uint32_t c = 0; c < mesh.chunkCount; c++) {
+                        const AssetChunk& chunk = package.chunk(mesh.firstChunk + c);
+                        package.read(chunk, stage(chunk.bytes));
+                        package.release(chunk);
+                        bytes += chunk.bytes;
+                    }
+                }
+                return bytes;
+            });
+        }
+        if (!peakReset) {
+            printf("Peak RSS could not be reset between loaders, later rows may include earlier peaks \n");
+        }
+        for (const std::string& path : packagePaths) {
+            remove(path.c_str());
+        }
+    }
+private:
+    AppConfig mconfig;
+    std::map<VkPhysicalDevice, QueueFamilyIndices> mqueueFamilyCache;
+    std::map<VkPhysicalDevice, SwapChainSupportDetails> msurfaceSupportCache;
+    VkSurfaceFormatKHR msurfaceFormat = {};
+    ShaderCache mshaders;
+    uint32_t minstanceApiVersion = VK_API_VERSION_1_0;
+    const PresentProfile* mpresentProfile;
+    VkPresentModeKHR mpresentMode = VK_PRESENT_MODE_FIFO_KHR;
+    bool minputPending = false;
+    std::chrono::steady_clock::time_point minputTime;
+
+	GLFWwindow* window = nullptr;
+
+	VkInstance instance;
+	VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+	VkDevice device;
+	VkQueue  mgraphicsQueue;
+	VkQueue  mpresentQueue;
+	VkQueue  mtransferQueue;
+	VkQueue  mcomputeQueue;
+	VkSurfaceKHR  msurface = VK_NULL_HANDLE;
+	VkDebugUtilsMessengerEXT mdebugMessenger = VK_NULL_HANDLE;
+	PFN_vkSetDebugUtilsObjectNameEXT msetObjectName = nullptr;
+
+    /* Declared ahead of every UniqueHandle so it outlives them */
+    DeletionQueue mdeletionQueue;
+
+    std::vector<VkImage> mswapChainImages;
+    UniqueHandle<VkSwapchainKHR> mswapChain;
+    VkFormat mswapChainImageFormat;
+    VkExtent2D mswapChainExtent;
+
+    std::vector<UniqueHandle<VkImageView>> mswapChainImageViews;
+    std::vector<GpuAllocation> moffscreenAllocations;
+
+    GpuAllocator mallocator;
+    FrameLinearAllocator mframeTransient;
+
+    GpuProfiler mgpuProfiler;
+    GpuProfiler mtransferProfiler;
+    Uploader muploader;
+    Uploader::Ticket msceneTicket = 0;
+    VkBuffer mvertexBuffer = VK_NULL_HANDLE;
+    GpuAllocation mvertexAllocation;
+    VkBuffer mindexBuffer = VK_NULL_HANDLE;
+    GpuAllocation mindexAllocation;
+
+    VkBuffer mstreamBuffer = VK_NULL_HANDLE;
+    GpuAllocation mstreamAllocation;
+    std::vector<char> mstreamData;
+    /* One per frame's copy; acquireSerial is the frame that acquired it, 0 until its copy lands */
+    struct StreamSlot {
+        Uploader::Ticket ticket = 0;
+        uint64_t acquireSerial = 0;
+    };
+    std::vector<StreamSlot> mstreamSlots;
+    size_t mstreamNext = 0;
+    uint32_t mstreamSkipped = 0;
+
+    bool mbindless = false;
+    DescriptorHeap mheap;
+    VkSampler msampler = VK_NULL_HANDLE;
+    std::vector<VkImage> mtextureImages;
+    std::vector<GpuAllocation> mtextureAllocations;
+    std::vector<VkImageView> mtextureViews;
+    std::vector<DescriptorHandle> mtextureHandles;
+
+    FrameCapture mcapture;
+    bool mcapturing = false;
+
+    RenderGraph mrenderGraph;
+    RenderGraph::ResourceId mgraphBackbuffer = 0;
+
+    AssetPackage mpackage;
+    AssetStreamer mstreamer;
+
+    TransformSystem mtransforms;
+    VkBuffer mtransformBuffer = VK_NULL_HANDLE;
+    GpuAllocation mtransformAllocation;
+    /* Version of mtransforms each frame's region of mtransformBuffer was last written at */
+    std::vector<uint64_t> mtransformVersions;
+
+    /* GPU-driven culling of the --gpu-cull instance field */
+    bool mgpuCulling = false;
+    bool mdrawIndirectCount = false;
+    bool masyncCompute = false;
+    GpuCuller mculler;
+    GpuCuller::DrawConstants mcullConstants = {};
+    Frustum mcullFrustum = {};
+    UniqueHandle<VkPipelineLayout> mcullPipelineLayout;
+    PipelineRegistry::PipelineId mcullPipeline = 0;
+
+    /* --instances objects, written to the instance ring and drawn by pipeline and mesh every frame */
+    std::vector<InstanceObject> minstanceObjects;
+    std::vector<uint32_t> minstanceKeys;
+    InstanceBatcher mbatcher;
+    InstanceRing minstanceRing;
+    bool minstancePerObject = false;
+    /* Camera view-projection, a dynamic uniform buffer into mframeTransient */
+    VkDescriptorSetLayout minstanceSetLayout = VK_NULL_HANDLE;
+    VkDescriptorPool minstanceDescriptorPool = VK_NULL_HANDLE;
+    VkDescriptorSet minstanceCameraSet = VK_NULL_HANDLE;
+    uint32_t minstanceCameraOffset = 0;
+    VkBuffer minstanceVertexBuffer = VK_NULL_HANDLE;
+    GpuAllocation minstanceVertexAllocation;
+    VkBuffer minstanceIndexBuffer = VK_NULL_HANDLE;
+    GpuAllocation minstanceIndexAllocation;
+    UniqueHandle<VkPipelineLayout> minstancePipelineLayout;
+    PipelineRegistry::PipelineId minstancePipelines[INSTANCE_PIPELINE_COUNT] = {};
+    /* Draws and pipeline binds recorded for the objects in the latest frame */
+    uint32_t minstanceDraws = 0;
+    uint32_t minstanceBinds = 0;
+
+    PipelineCache mpipelineCache;
+    UniqueHandle<VkRenderPass> mrenderPass;
+    UniqueHandle<VkPipelineLayout> mpipelineLayout;
+    PipelineRegistry mpipelines;
+    PipelineRegistry::PipelineId mtrianglePipeline = 0;
+
+    std::vector<UniqueHandle<VkFramebuffer>> mswapChainFramebuffers;
+
+    /* Swapchain recreation */
+    bool mswapChainDirty = false;
+    bool mawaitingResizedFrame = false;
+    uint64_t mframeSerial = 0;
+    uint64_t mcompletedSerial = 0;
+    std::chrono::steady_clock::time_point mresizeStart;
+    uint32_t mresizeCount = 0;
+    double mresizeLatencyTotalMs = 0.0;
+    double mresizeLatencyMaxMs = 0.0;
+
+    /* initVulkan() duration and process start to first frame, for --bench-json */
+    double mstartupMs = 0.0;
+    double mfirstFrameMs = 0.0;
+
+    std::unique_ptr<JobSystem> mjobSystem;
+    std::vector<FrameData> mframes;
+    std::vector<VkCommandBuffer> msecondaries;
+    std::vector<VkFence> mimagesInFlight;
+    size_t mcurrentFrame = 0;
+
+    FrameStats mframeStats;
+    std::chrono::steady_clock::time_point mlastFrameStart;
+};
+
+static bool envFlagSet(const char* name) {
+    const char* value = getenv(name);
+    return value != nullptr && value[0] != '\0' && strcmp(value, "0") != 0;
+}
+
+static AppConfig parseAppConfig(int argc, char** argv) {
+    AppConfig config;
+    config.headless = envFlagSet("VK_HEADLESS");
+    if (const char* profile = getenv("VK_PRESENT_PROFILE")) {
+        config.presentProfile = profile;
+    }
+    if (const char* gpu = getenv("VK_GPU")) {
+        config.gpuOverride = gpu;
+    }
+    if (const char* trace = getenv("VK_TRACE")) {
+        config.tracePath = trace;
+    }
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--headless") == 0) {
+            config.headless = true;
+        } else if (strcmp(argv[i], "--pipeline-cache") == 0 && i + 1 < argc) {
+            config.pipelineCachePath = argv[++i];
+        } else if (strcmp(argv[i], "--cold-pipeline-cache") == 0) {
+            config.coldPipelineCache = true;
+        } else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            config.frameCount = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+        } else if (strcmp(argv[i], "--draws") == 0 && i + 1 < argc) {
+            config.drawCount = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+        } else if (strcmp(argv[i], "--record-threads") == 0 && i + 1 < argc) {
+            config.recordThreads = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+        } else if (strcmp(argv[i], "--bench-record") == 0) {
+            config.benchRecord = true;
+        } else if (strcmp(argv[i], "--bench-allocator") == 0) {
+            config.benchAllocator = true;
+        } else if (strcmp(argv[i], "--test-allocator") == 0) {
+            config.testAllocator = true;
+        } else if (strcmp(argv[i], "--shader-cache") == 0 && i + 1 < argc) {
+            config.shaderCacheDirectory = argv[++i];
+        } else if (strcmp(argv[i], "--shader-compiler") == 0 && i + 1 < argc) {
+            config.shaderCompiler = argv[++i];
+        } else if (strcmp(argv[i], "--hot-reload") == 0) {
+            config.hotReload = true;
+        } else if (strcmp(argv[i], "--log-level") == 0 && i + 1 < argc) {
+            if (!Log::parseLevel(argv[++i], config.logLevel)) {
+                throw std::runtime_error(std::string("Unknown log level: ") + argv[i]);
+            }
+        } else if (strcmp(argv[i], "--log-categories") == 0 && i + 1 < argc) {
+            if (!Log::parseCategories(argv[++i], config.logCategories)) {
+                throw std::runtime_error(std::string("Unknown log category in: ") + argv[i]);
+            }
+        } else if (strcmp(argv[i], "--bench-log") == 0) {
+            config.benchLog = true;
+        } else if (strcmp(argv[i], "--bench-transforms") == 0) {
+            config.benchTransforms = true;
+        } else if (strcmp(argv[i], "--scene-nodes") == 0 && i + 1 < argc) {
+            config.sceneNodes = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+        } else if (strcmp(argv[i], "--bench-descriptors") == 0) {
+            config.benchDescriptors = true;
+        } else if (strcmp(argv[i], "--no-bindless") == 0) {
+            config.noBindless = true;
+        } else if (strcmp(argv[i], "--gpu-cull") == 0 && i + 1 < argc) {
+            config.cullInstances = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+        } else if (strcmp(argv[i], "--no-draw-indirect-count") == 0) {
+            config.noDrawIndirectCount = true;
+        } else if (strcmp(argv[i], "--validate-cull") == 0) {
+            config.validateCulling = true;
+        } else if (strcmp(argv[i], "--stream-upload") == 0 && i + 1 < argc) {
+            config.streamUploadKiB = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+        } else if (strcmp(argv[i], "--instances") == 0 && i + 1 < argc) {
+            config.instanceObjects = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+        } else if (strcmp(argv[i], "--no-instancing") == 0) {
+            config.noInstancing = true;
+        } else if (strcmp(argv[i], "--bench-instancing") == 0) {
+            /* Frames are submitted but never presented */
+            config.benchInstancing = true;
+            config.headless = true;
+        } else if (strcmp(argv[i], "--render-graph") == 0) {
+            config.renderGraph = true;
+        } else if (strcmp(argv[i], "--no-host-allocator") == 0) {
+            config.noHostAllocator = true;
+        } else if (strcmp(argv[i], "--package") == 0 && i + 1 < argc) {
+            config.packagePath = argv[++i];
+        } else if (strcmp(argv[i], "--bench-assets") == 0 && i + 1 < argc) {
+            config.benchAssets = argv[++i];
+        } else if (strcmp(argv[i], "--bench-json") == 0 && i + 1 < argc) {
+            config.benchJsonPath = argv[++i];
+        } else if (strcmp(argv[i], "--capture") == 0 && i + 1 < argc) {
+            config.captureDirectory = argv[++i];
+        } else if (strcmp(argv[i], "--capture-format") == 0 && i + 1 < argc) {
+            if (!parseCaptureFormat(argv[++i], config.captureFormat)) {
+                throw std::runtime_error(std::string("Unknown capture format: ") + argv[i]);
+            }
+        } else if (strcmp(argv[i], "--capture-ring") == 0 && i + 1 < argc) {
+            config.captureRing = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+        } else if (strcmp(argv[i], "--capture-threads") == 0 && i + 1 < argc) {
+            config.captureThreads = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+        } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            config.tracePath = argv[++i];
+        } else if (strcmp(argv[i], "--gpu") == 0 && i + 1 < argc) {
+            config.gpuOverride = argv[++i];
+        } else if (strcmp(argv[i], "--device-cache") == 0 && i + 1 < argc) {
+            config.deviceCachePath = argv[++i];
+        } else if (strcmp(argv[i], "--present-profile") == 0 && i + 1 < argc) {
+            config.presentProfile = argv[++i];
+        } else if (strcmp(argv[i], "--frames-in-flight") == 0 && i + 1 < argc) {
+            config.framesInFlight = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+            if (config.framesInFlight == 0) {
+                throw std::runtime_error("--frames-in-flight must be at least 1");
+            }
+        } else {
+            throw std::runtime_error(std::string("Unknown argument: ") + argv[i]);
+        }
+    }
+    return config;
+}
+
+int main(int argc, char** argv) {
+    try {
+        AppConfig config = parseAppConfig(argc, argv);
+        Log::start(config.logLevel, config.logCategories);
+        if (!config.noHostAllocator) {
+            HostAllocator::enable();
+        }
+        if (!config.tracePath.empty()) {
+            Trace::enable(config.tracePath);
+        }
+        HelloTriangleApplication app(config);
+        app.run();
+    } catch (const std::runtime_error& e) {
+        Log::stop();
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    Log::stop();
+    return EXIT_SUCCESS;
+}
+
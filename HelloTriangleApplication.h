@@ -5,15 +5,145 @@
 #ifndef VULKAN_BASIC_SAMPLES_HELLOTRIANGLEAPPLICATION_H
 #define VULKAN_BASIC_SAMPLES_HELLOTRIANGLEAPPLICATION_H
 
+/* The Makefile points this at the SDK's glslangValidator */
+#ifndef DEFAULT_SHADER_COMPILER
+#define DEFAULT_SHADER_COMPILER "glslangValidator"
+#endif
+
+#include "DeletionQueue.h"
+#include "FrameCapture.h"
+#include "Log.h"
+
+struct AppConfig {
+    /* Render into offscreen images instead of a GLFW window and swapchain */
+    bool headless = false;
+
+    /* Chrome trace JSON of startup stages and frames, empty disables tracing */
+    std::string tracePath;
+
+    /* Messages below the level or outside the categories are skipped before formatting */
+    LogLevel logLevel = LOG_LEVEL_INFO;
+    uint32_t logCategories = LOG_ALL_CATEGORIES;
+    /* Measure the cost of a logged message on the calling thread; no Vulkan device is created */
+    bool benchLog = false;
+
+    /* Device name substring or deviceUUID to use instead of the highest scoring GPU */
+    std::string gpuOverride;
+    /* Per-driver capability cache used by device selection */
+    std::string deviceCachePath = "device_caps.cache";
+
+    /* On-disk VkPipelineCache blob, reloaded at startup and rewritten on cleanup */
+    std::string pipelineCachePath = "pipeline_cache.bin";
+    /* Ignore the on-disk cache to measure cold pipeline compilation */
+    bool coldPipelineCache = false;
+
+    /* SPIR-V compiled from GLSL, keyed by a hash of the source */
+    std::string shaderCacheDirectory = "shader_cache";
+    std::string shaderCompiler = DEFAULT_SHADER_COMPILER;
+    /* Recompile shaders when their source changes and rebuild the pipelines using them */
+    bool hotReload = false;
+
+    /* Present mode, swapchain image count and frames in flight, see PresentProfile.cpp */
+    std::string presentProfile = "default";
+    /* Frames recorded ahead of the GPU, each with its own command buffer and sync objects.
+     * 0 takes the value from the present profile. */
+    uint32_t framesInFlight = 0;
+    /* Stop after this many frames, 0 runs until the window is closed */
+    uint32_t frameCount = 0;
+
+    /* Triangle draws recorded per frame */
+    uint32_t drawCount = 1;
+    /* Threads recording secondary command buffers, 0 uses every hardware thread */
+    uint32_t recordThreads = 0;
+    /* Measure command recording time against thread count instead of rendering */
+    bool benchRecord = false;
+    /* Run the CPU-only sub-allocator benchmark; no Vulkan device is created */
+    bool benchAllocator = false;
+    /* Run the CPU-only sub-allocator self-test, which throws on a violated invariant */
+    bool testAllocator = false;
+    /* Run the CPU-only transform hierarchy benchmark, SoA against an array of glm::mat4 */
+    bool benchTransforms = false;
+    /* Transform hierarchy nodes updated every frame into a mapped storage buffer; 0 disables */
+    uint32_t sceneNodes = 0;
+    /* Compare bindless descriptor indexing against per-draw descriptor set binds */
+    bool benchDescriptors = false;
+    /* Use per-set descriptor pools even when VK_EXT_descriptor_indexing is available */
+    bool noBindless = false;
+    /* Instances culled on the GPU and drawn indirectly each frame, replacing the plain draws; 0 disables */
+    uint32_t cullInstances = 0;
+    /* Use fixed-count indirect draws even when VK_KHR_draw_indirect_count is available */
+    bool noDrawIndirectCount = false;
+    /* Compare GPU culling results against the CPU reference culler instead of rendering */
+    bool validateCulling = false;
+    /* KiB streamed through the transfer queue every frame to load the upload path */
+    uint32_t streamUploadKiB = 0;
+    /* Objects drawn each frame from a per-frame instance ring, replacing the plain draws; 0 disables */
+    uint32_t instanceObjects = 0;
+    /* Draw every --instances object on its own, in scene order, instead of one draw per pipeline and mesh */
+    bool noInstancing = false;
+    /* Compare instanced draws against one draw per object, headless, instead of rendering */
+    bool benchInstancing = false;
+    /* Record a sample multi-pass frame through the render graph ahead of the main pass */
+    bool renderGraph = false;
+    /* Let the driver allocate host memory itself instead of through HostAllocator */
+    bool noHostAllocator = false;
+    /* Asset package (made by AssetCooker) whose meshes are streamed in while rendering */
+    std::string packagePath;
+    /* OBJ file loaded by parsing and from packages cooked from it; no Vulkan device is created */
+    std::string benchAssets;
+    /* Startup, frame time percentiles and memory written as JSON after the frame loop, for BenchDriver */
+    std::string benchJsonPath;
+    /* Directory every presented frame is written to, empty disables capture */
+    std::string captureDirectory;
+    CaptureFormat captureFormat = CAPTURE_PNG;
+    /* Readback slots and encoder threads, 0 picks from the frames in flight and hardware threads */
+    uint32_t captureRing = 0;
+    uint32_t captureThreads = 0;
+};
+
 struct QueueFamilyIndices {
     int graphicsFamily = -1;
     int presentFamily = -1;
+    /* Transfer-only family when the device has one, otherwise the graphics family */
+    int transferFamily = -1;
+    /* Compute family without graphics when the device has one, otherwise the graphics family */
+    int computeFamily = -1;
 
-    bool isComplete() {
-        return (graphicsFamily >= 0 && presentFamily >= 0);
+    /* Headless devices only need a graphics queue, nothing is presented */
+    bool isComplete(bool requirePresent = true) {
+        return (graphicsFamily >= 0 && (presentFamily >= 0 || !requirePresent));
     }
 };
 
+/* Secondary command buffers recorded by one job system thread for one frame in flight */
+struct ThreadCommandPool {
+    VkCommandPool commandPool;
+    std::vector<VkCommandBuffer> secondaries;
+    size_t used = 0;
+};
+
+struct FrameData {
+    VkCommandPool commandPool;
+    VkCommandBuffer commandBuffer;
+    std::vector<ThreadCommandPool> threadPools;
+    VkSemaphore imageAvailable;
+    VkSemaphore renderFinished;
+    VkFence inFlight;
+    /* Async culling on the compute queue; null when culling shares the graphics queue */
+    VkCommandPool computePool = VK_NULL_HANDLE;
+    VkCommandBuffer computeCommandBuffer = VK_NULL_HANDLE;
+    VkSemaphore cullFinished = VK_NULL_HANDLE;
+    /* Serial of the last submission guarded by inFlight */
+    uint64_t submitSerial = 0;
+    /* Frame capture readback slot recorded into this frame, -1 when not capturing */
+    int captureSlot = -1;
+};
+
+struct Vertex {
+    float pos[2];
+    float color[3];
+};
+
 struct SwapChainSupportDetails {
     VkSurfaceCapabilitiesKHR capabilities;
     std::vector<VkSurfaceFormatKHR> formats;
@@ -0,0 +1,440 @@
+#include "HostAllocator.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+const uint32_t SCOPE_COUNT = VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE + 1;
+const char* const SCOPE_NAMES[SCOPE_COUNT] = {"command", "object", "cache", "device", "instance"};
+
+/* Size classes 32 B to 8 KiB, powers of two; the header is included in the class size */
+const uint32_t CLASS_COUNT = 9;
+const size_t MIN_CLASS_SIZE = 32;
+const size_t POOL_CHUNK_BYTES = 64 * 1024;
+const size_t ARENA_CHUNK_BYTES = 64 * 1024;
+/* Start of the bump space in an arena chunk, past the chunk header and 64-byte aligned */
+const size_t ARENA_CHUNK_DATA = 64;
+/* Frames skipped before markFrame() counts towards the steady-state figures */
+const uint64_t WARMUP_FRAMES = 60;
+
+const uint16_t CLASS_LARGE = 0xFFFF;
+const uint16_t CLASS_ARENA = 0xFFFE;
+
+/* Sits right before every pointer handed to the driver */
+struct Header {
+    uint64_t size;
+    uint16_t sizeClass;
+    uint8_t scope;
+    uint8_t unused;
+    /* Distance back to the block, chunk slot or system allocation */
+    uint32_t offset;
+};
+static_assert(sizeof(Header) == 16, "Header must keep 16-byte alignment");
+
+struct FreeBlock {
+    FreeBlock* next;
+};
+
+struct ScopeCounters {
+    std::atomic<uint64_t> allocations{0};
+    std::atomic<uint64_t> reallocations{0};
+    std::atomic<uint64_t> frees{0};
+    std::atomic<uint64_t> bytes{0};
+    std::atomic<int64_t> liveBytes{0};
+    std::atomic<int64_t> peakBytes{0};
+    std::atomic<int64_t> internalBytes{0};
+};
+
+/* Per-frame deltas kept by markFrame(), only touched by the render thread */
+struct FrameCounters {
+    uint64_t lastCalls[SCOPE_COUNT] = {};
+    uint64_t lastBytes[SCOPE_COUNT] = {};
+    uint64_t frames = 0;
+    uint64_t steadyFrames = 0;
+    uint64_t steadyCalls[SCOPE_COUNT] = {};
+    uint64_t steadyBytes[SCOPE_COUNT] = {};
+    uint64_t maxCallsPerFrame = 0;
+};
+
+struct AllocatorState {
+    VkAllocationCallbacks callbacks = {};
+    bool enabled = false;
+    ScopeCounters scopes[SCOPE_COUNT];
+    std::atomic<uint64_t> arenaResets{0};
+    std::atomic<uint64_t> poolChunks{0};
+    std::atomic<uint64_t> largeAllocations{0};
+
+    /* Free blocks left behind by exited threads */
+    std::mutex depotMutex;
+    FreeBlock* depot[SCOPE_COUNT][CLASS_COUNT] = {};
+
+    FrameCounters frame;
+};
+
+AllocatorState& state() {
+    static AllocatorState allocatorState;
+    return allocatorState;
+}
+
+struct Arena;
+
+struct ArenaChunk {
+    Arena* arena;
+    ArenaChunk* next;
+};
+
+/*
+ * Command-scoped bump arena. Such allocations are freed before the Vulkan
+ * call that made them returns, so the arena is rewound as soon as nothing
+ * in it is live. Frees may come from another thread, hence the atomic count.
+ */
+struct Arena {
+    ~Arena() {
+        if (live.load(std::memory_order_acquire) != 0) {
+            return;
+        }
+        while (first != nullptr) {
+            ArenaChunk* next = first->next;
+            free(first);
+            first = next;
+        }
+    }
+
+    std::atomic<uint32_t> live{0};
+    ArenaChunk* first = nullptr;
+    ArenaChunk* current = nullptr;
+    size_t offset = ARENA_CHUNK_DATA;
+};
+
+struct ThreadCache {
+    ~ThreadCache() {
+        AllocatorState& s = state();
+        std::lock_guard<std::mutex> lock(s.depotMutex);
+        for (uint32_t scope = 0; scope < SCOPE_COUNT; scope++) {
+            for (uint32_t sizeClass = 0; sizeClass < CLASS_COUNT; sizeClass++) {
+                FreeBlock* list = lists[scope][sizeClass];
+                while (list != nullptr) {
+                    FreeBlock* next = list->next;
+                    list->next = s.depot[scope][sizeClass];
+                    s.depot[scope][sizeClass] = list;
+                    list = next;
+                }
+            }
+        }
+    }
+
+    FreeBlock* lists[SCOPE_COUNT][CLASS_COUNT] = {};
+    Arena arena;
+};
+
+ThreadCache& threadCache() {
+    static thread_local ThreadCache cache;
+    return cache;
+}
+
+size_t classSize(uint32_t sizeClass) {
+    return MIN_CLASS_SIZE << sizeClass;
+}
+
+uintptr_t alignUp(uintptr_t value, size_t alignment) {
+    return (value + alignment - 1) & ~static_cast<uintptr_t>(alignment - 1);
+}
+
+Header* headerOf(void* memory) {
+    return reinterpret_cast<Header*>(static_cast<char*>(memory) - sizeof(Header));
+}
+
+void* place(char* base, size_t alignment, size_t size, uint16_t sizeClass, uint32_t scope) {
+    char* user = reinterpret_cast<char*>(alignUp(reinterpret_cast<uintptr_t>(base) + sizeof(Header), alignment));
+    Header* header = headerOf(user);
+    header->size = size;
+    header->sizeClass = sizeClass;
+    header->scope = static_cast<uint8_t>(scope);
+    header->unused = 0;
+    header->offset = static_cast<uint32_t>(user - base);
+    return user;
+}
+
+/* Takes the depot's list for the class, or carves a fresh chunk into blocks */
+FreeBlock* refill(uint32_t scope, uint32_t sizeClass) {
+    AllocatorState& s = state();
+    {
+        std::lock_guard<std::mutex> lock(s.depotMutex);
+        FreeBlock* list = s.depot[scope][sizeClass];
+        if (list != nullptr) {
+            s.depot[scope][sizeClass] = nullptr;
+            return list;
+        }
+    }
+    void* chunk = nullptr;
+    if (posix_memalign(&chunk, 4096, POOL_CHUNK_BYTES) != 0) {
+        return nullptr;
+    }
+    s.poolChunks.fetch_add(1, std::memory_order_relaxed);
+    size_t blockSize = classSize(sizeClass);
+    char* bytes = static_cast<char*>(chunk);
+    FreeBlock* list = nullptr;
+    for (size_t offset = POOL_CHUNK_BYTES; offset >= blockSize; offset -= blockSize) {
+        FreeBlock* block = reinterpret_cast<FreeBlock*>(bytes + offset - blockSize);
+        block->next = list;
+        list = block;
+    }
+    return list;
+}
+
+void* allocateLarge(size_t size, size_t alignment, uint32_t scope) {
+    size_t headerSpace = alignUp(sizeof(Header), alignment);
+    void* base = nullptr;
+    if (posix_memalign(&base, alignment, headerSpace + size) != 0) {
+        return nullptr;
+    }
+    state().largeAllocations.fetch_add(1, std::memory_order_relaxed);
+    return place(static_cast<char*>(base), alignment, size, CLASS_LARGE, scope);
+}
+
+void* allocateArena(size_t size, size_t alignment) {
+    Arena& arena = threadCache().arena;
+    if (arena.live.load(std::memory_order_acquire) == 0 && arena.first != nullptr &&
+        (arena.current != arena.first || arena.offset != ARENA_CHUNK_DATA)) {
+        arena.current = arena.first;
+        arena.offset = ARENA_CHUNK_DATA;
+        state().arenaResets.fetch_add(1, std::memory_order_relaxed);
+    }
+    /* A request that cannot fit in an empty chunk goes to the system allocator */
+    if (ARENA_CHUNK_DATA + sizeof(Header) + alignment + size > ARENA_CHUNK_BYTES) {
+        return allocateLarge(size, alignment, VK_SYSTEM_ALLOCATION_SCOPE_COMMAND);
+    }
+    for (;;) {
+        if (arena.current != nullptr) {
+            char* chunk = reinterpret_cast<char*>(arena.current);
+            uintptr_t user = alignUp(reinterpret_cast<uintptr_t>(chunk + arena.offset) + sizeof(Header), alignment);
+            if (user + size <= reinterpret_cast<uintptr_t>(chunk + ARENA_CHUNK_BYTES)) {
+                arena.live.fetch_add(1, std::memory_order_relaxed);
+                void* memory = place(chunk + arena.offset, alignment, size, CLASS_ARENA,
+                                     VK_SYSTEM_ALLOCATION_SCOPE_COMMAND);
+                arena.offset = user + size - reinterpret_cast<uintptr_t>(chunk);
+                return memory;
+            }
+            if (arena.current->next != nullptr) {
+                arena.current = arena.current->next;
+                arena.offset = ARENA_CHUNK_DATA;
+                continue;
+            }
+        }
+        void* memory = nullptr;
+        if (posix_memalign(&memory, ARENA_CHUNK_BYTES, ARENA_CHUNK_BYTES) != 0) {
+            return nullptr;
+        }
+        ArenaChunk* chunk = static_cast<ArenaChunk*>(memory);
+        chunk->arena = &arena;
+        chunk->next = nullptr;
+        if (arena.current == nullptr) {
+            arena.first = chunk;
+        } else {
+            arena.current->next = chunk;
+        }
+        arena.current = chunk;
+        arena.offset = ARENA_CHUNK_DATA;
+    }
+}
+
+void countAllocation(uint32_t scope, size_t size) {
+    ScopeCounters& counters = state().scopes[scope];
+    counters.allocations.fetch_add(1, std::memory_order_relaxed);
+    counters.bytes.fetch_add(size, std::memory_order_relaxed);
+    int64_t live = counters.liveBytes.fetch_add(static_cast<int64_t>(size), std::memory_order_relaxed) +
+                   static_cast<int64_t>(size);
+    int64_t peak = counters.peakBytes.load(std::memory_order_relaxed);
+    while (live > peak && !counters.peakBytes.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {
+    }
+}
+
+void* allocate(size_t size, size_t alignment, uint32_t scope) {
+    alignment = std::max(alignment, sizeof(Header));
+    void* memory = nullptr;
+    if (scope == VK_SYSTEM_ALLOCATION_SCOPE_COMMAND) {
+        memory = allocateArena(size, alignment);
+    } else {
+        /* Blocks are at least 16-byte aligned, so this is the worst-case padding */
+        size_t need = size + sizeof(Header) + alignment - sizeof(Header);
+        uint32_t sizeClass = 0;
+        while (sizeClass < CLASS_COUNT && classSize(sizeClass) < need) {
+            sizeClass++;
+        }
+        if (sizeClass == CLASS_COUNT) {
+            memory = allocateLarge(size, alignment, scope);
+        } else {
+            FreeBlock*& list = threadCache().lists[scope][sizeClass];
+            if (list == nullptr) {
+                list = refill(scope, sizeClass);
+            }
+            if (list != nullptr) {
+                FreeBlock* block = list;
+                list = block->next;
+                memory = place(reinterpret_cast<char*>(block), alignment, size, static_cast<uint16_t>(sizeClass),
+                               scope);
+            }
+        }
+    }
+    if (memory != nullptr) {
+        countAllocation(scope, size);
+    }
+    return memory;
+}
+
+void release(void* memory) {
+    Header* header = headerOf(memory);
+    char* base = static_cast<char*>(memory) - header->offset;
+    uint32_t scope = header->scope;
+    ScopeCounters& counters = state().scopes[scope];
+    counters.frees.fetch_add(1, std::memory_order_relaxed);
+    counters.liveBytes.fetch_sub(static_cast<int64_t>(header->size), std::memory_order_relaxed);
+
+    if (header->sizeClass == CLASS_LARGE) {
+        free(base);
+    } else if (header->sizeClass == CLASS_ARENA) {
+        uintptr_t chunk = reinterpret_cast<uintptr_t>(memory) & ~static_cast<uintptr_t>(ARENA_CHUNK_BYTES - 1);
+        reinterpret_cast<ArenaChunk*>(chunk)->arena->live.fetch_sub(1, std::memory_order_release);
+    } else {
+        FreeBlock* block = reinterpret_cast<FreeBlock*>(base);
+        FreeBlock*& list = threadCache().lists[scope][header->sizeClass];
+        block->next = list;
+        list = block;
+    }
+}
+
+VKAPI_ATTR void* VKAPI_CALL allocationCallback(void*, size_t size, size_t alignment,
+                                               VkSystemAllocationScope scope) {
+    return allocate(size, alignment, static_cast<uint32_t>(scope));
+}
+
+VKAPI_ATTR void* VKAPI_CALL reallocationCallback(void*, void* original, size_t size, size_t alignment,
+                                                 VkSystemAllocationScope scope) {
+    if (original == nullptr) {
+        return allocate(size, alignment, static_cast<uint32_t>(scope));
+    }
+    if (size == 0) {
+        release(original);
+        return nullptr;
+    }
+    Header* header = headerOf(original);
+    ScopeCounters& counters = state().scopes[header->scope];
+    counters.reallocations.fetch_add(1, std::memory_order_relaxed);
+
+    /* Grow in place when the pool block already has room and the alignment still holds */
+    if (header->sizeClass < CLASS_COUNT && header->scope == static_cast<uint32_t>(scope) &&
+        reinterpret_cast<uintptr_t>(original) % std::max(alignment, sizeof(Header)) == 0 &&
+        header->offset + size <= classSize(header->sizeClass)) {
+        counters.liveBytes.fetch_add(static_cast<int64_t>(size) - static_cast<int64_t>(header->size),
+                                     std::memory_order_relaxed);
+        header->size = size;
+        return original;
+    }
+    void* memory = allocate(size, alignment, static_cast<uint32_t>(scope));
+    if (memory == nullptr) {
+        return nullptr;
+    }
+    memcpy(memory, original, std::min<size_t>(size, header->size));
+    release(original);
+    return memory;
+}
+
+VKAPI_ATTR void VKAPI_CALL freeCallback(void*, void* memory) {
+    if (memory != nullptr) {
+        release(memory);
+    }
+}
+
+VKAPI_ATTR void VKAPI_CALL internalAllocationCallback(void*, size_t size, VkInternalAllocationType,
+                                                      VkSystemAllocationScope scope) {
+    state().scopes[scope].internalBytes.fetch_add(static_cast<int64_t>(size), std::memory_order_relaxed);
+}
+
+VKAPI_ATTR void VKAPI_CALL internalFreeCallback(void*, size_t size, VkInternalAllocationType,
+                                                VkSystemAllocationScope scope) {
+    state().scopes[scope].internalBytes.fetch_sub(static_cast<int64_t>(size), std::memory_order_relaxed);
+}
+
+}
+
+void HostAllocator::enable() {
+    AllocatorState& s = state();
+    s.callbacks.pUserData = nullptr;
+    s.callbacks.pfnAllocation = allocationCallback;
+    s.callbacks.pfnReallocation = reallocationCallback;
+    s.callbacks.pfnFree = freeCallback;
+    s.callbacks.pfnInternalAllocation = internalAllocationCallback;
+    s.callbacks.pfnInternalFree = internalFreeCallback;
+    s.enabled = true;
+}
+
+const VkAllocationCallbacks* HostAllocator::callbacks() {
+    AllocatorState& s = state();
+    return s.enabled ? &s.callbacks : nullptr;
+}
+
+void HostAllocator::markFrame() {
+    AllocatorState& s = state();
+    FrameCounters& frame = s.frame;
+    uint64_t frameCalls = 0;
+    for (uint32_t scope = 0; scope < SCOPE_COUNT; scope++) {
+        uint64_t calls = s.scopes[scope].allocations.load(std::memory_order_relaxed) +
+                         s.scopes[scope].reallocations.load(std::memory_order_relaxed);
+        uint64_t bytes = s.scopes[scope].bytes.load(std::memory_order_relaxed);
+        if (frame.frames >= WARMUP_FRAMES) {
+            frame.steadyCalls[scope] += calls - frame.lastCalls[scope];
+            frame.steadyBytes[scope] += bytes - frame.lastBytes[scope];
+            frameCalls += calls - frame.lastCalls[scope];
+        }
+        frame.lastCalls[scope] = calls;
+        frame.lastBytes[scope] = bytes;
+    }
+    if (frame.frames >= WARMUP_FRAMES) {
+        frame.steadyFrames++;
+        frame.maxCallsPerFrame = std::max(frame.maxCallsPerFrame, frameCalls);
+    }
+    frame.frames++;
+}
+
+void HostAllocator::printReport() {
+    AllocatorState& s = state();
+    if (!s.enabled) {
+        printf("Host allocator: disabled, the driver uses its own \n");
+        return;
+    }
+    const FrameCounters& frame = s.frame;
+    if (frame.steadyFrames > 0) {
+        uint64_t calls = 0;
+        for (uint32_t scope = 0; scope < SCOPE_COUNT; scope++) {
+            calls += frame.steadyCalls[scope];
+        }
+        printf("Host allocator: %.2f driver allocation calls per frame at steady state (max %llu) over %llu frames \n",
+               static_cast<double>(calls) / frame.steadyFrames, (unsigned long long) frame.maxCallsPerFrame,
+               (unsigned long long) frame.steadyFrames);
+    } else {
+        printf("Host allocator: fewer than %llu frames, no steady-state figures \n",
+               (unsigned long long) WARMUP_FRAMES + 1);
+    }
+    for (uint32_t scope = 0; scope < SCOPE_COUNT; scope++) {
+        const ScopeCounters& counters = s.scopes[scope];
+        double perFrame = frame.steadyFrames > 0 ? static_cast<double>(frame.steadyCalls[scope]) / frame.steadyFrames
+                                                 : 0.0;
+        double bytesPerFrame = frame.steadyFrames > 0
+                                   ? static_cast<double>(frame.steadyBytes[scope]) / frame.steadyFrames : 0.0;
+        printf("  %-8s %8llu allocs %6llu reallocs %8llu frees, %9.1f KiB total, live %8.1f KiB, peak %8.1f KiB, "
+               "%.2f calls %.0f B per frame, internal %.1f KiB \n",
+               SCOPE_NAMES[scope], (unsigned long long) counters.allocations.load(),
+               (unsigned long long) counters.reallocations.load(), (unsigned long long) counters.frees.load(),
+               counters.bytes.load() / 1024.0, counters.liveBytes.load() / 1024.0,
+               counters.peakBytes.load() / 1024.0, perFrame, bytesPerFrame, counters.internalBytes.load() / 1024.0);
+    }
+    printf("  %llu pool chunks of %zu KiB, %llu large allocations, %llu command arena rewinds \n",
+           (unsigned long long) s.poolChunks.load(), POOL_CHUNK_BYTES / 1024,
+           (unsigned long long) s.largeAllocations.load(), (unsigned long long) s.arenaResets.load());
+}
@@ -0,0 +1,39 @@
+#ifndef VULKAN_BASIC_SAMPLES_HOSTALLOCATOR_H
+#define VULKAN_BASIC_SAMPLES_HOSTALLOCATOR_H
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+
+/*
+ * VkAllocationCallbacks for every driver host allocation, with statistics.
+ *
+ * Scope routing:
+ * - Command-scoped requests live only for the duration of one Vulkan call.
+ *   They are bump-allocated from a per-thread arena, which rewinds whenever
+ *   nothing in it is live.
+ * - Object, cache, device and instance scopes each have their own
+ *   size-class pools, so long-lived objects never share pages with the
+ *   churn of short-lived ones.
+ * - Requests above the largest class go to the system allocator.
+ *
+ * Each thread keeps its own free lists, so the common path takes no lock.
+ * A thread that exits hands its free blocks to a shared depot.
+ *
+ * Counters for calls and bytes are kept per scope. markFrame() splits them
+ * by frame, so printReport() can show how many host allocations the driver
+ * makes per frame once the renderer has reached steady state.
+ */
+class HostAllocator {
+public:
+    /* Before the instance is created; until then callbacks() is nullptr */
+    static void enable();
+    /* Pass to every vkCreate and vkDestroy call; nullptr when disabled */
+    static const VkAllocationCallbacks* callbacks();
+
+    /* Once per frame, from the render thread */
+    static void markFrame();
+    static void printReport();
+};
+
+#endif //VULKAN_BASIC_SAMPLES_HOSTALLOCATOR_H
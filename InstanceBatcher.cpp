@@ -0,0 +1,30 @@
+#include "InstanceBatcher.h"
+
+#include <algorithm>
+
+void InstanceBatcher::init(uint32_t pipelineCount, uint32_t meshCount) {
+    mmeshCount = meshCount;
+    mstarts.assign(static_cast<size_t>(pipelineCount) * meshCount + 1, 0);
+}
+
+void InstanceBatcher::sort(const uint32_t* keys, size_t count) {
+    std::fill(mstarts.begin(), mstarts.end(), 0);
+    for (size_t i = 0; i < count; i++) {
+        mstarts[keys[i] + 1]++;
+    }
+
+    mbatches.clear();
+    for (uint32_t key = 0; key + 1 < mstarts.size(); key++) {
+        uint32_t instanceCount = mstarts[key + 1];
+        mstarts[key + 1] += mstarts[key];
+        if (instanceCount > 0) {
+            mbatches.push_back({key / mmeshCount, key % mmeshCount, mstarts[key], instanceCount});
+        }
+    }
+
+    /* mstarts[key] now runs from the batch's first instance to its end as objects are placed */
+    morder.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        morder[mstarts[keys[i]]++] = static_cast<uint32_t>(i);
+    }
+}
@@ -0,0 +1,42 @@
+#ifndef VULKAN_BASIC_SAMPLES_INSTANCEBATCHER_H
+#define VULKAN_BASIC_SAMPLES_INSTANCEBATCHER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/* One vkCmdDrawIndexed covering instanceCount instances from firstInstance on */
+struct InstanceBatch {
+    uint32_t pipeline;
+    uint32_t mesh;
+    uint32_t firstInstance;
+    uint32_t instanceCount;
+};
+
+/*
+ * Orders objects by pipeline, then mesh, so each pipeline is bound once and
+ * each of its meshes drawn once. An object's key is key(pipeline, mesh);
+ * with a handful of pipelines and meshes a counting sort over the keys is
+ * two linear passes and no comparisons, cheap enough to redo every frame.
+ */
+class InstanceBatcher {
+public:
+    void init(uint32_t pipelineCount, uint32_t meshCount);
+
+    uint32_t key(uint32_t pipeline, uint32_t mesh) const { return pipeline * mmeshCount + mesh; }
+
+    /* Sorts keys[0, count) into order() and batches(); empty batches are left out */
+    void sort(const uint32_t* keys, size_t count);
+
+    /* Object indices in draw order: instance i of the frame is object order()[i] */
+    const std::vector<uint32_t>& order() const { return morder; }
+    const std::vector<InstanceBatch>& batches() const { return mbatches; }
+
+private:
+    uint32_t mmeshCount = 0;
+    std::vector<uint32_t> mstarts;
+    std::vector<uint32_t> morder;
+    std::vector<InstanceBatch> mbatches;
+};
+
+#endif //VULKAN_BASIC_SAMPLES_INSTANCEBATCHER_H
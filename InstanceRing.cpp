@@ -0,0 +1,61 @@
+#include "InstanceRing.h"
+
+#include <algorithm>
+#include <cstdio>
+
+#include "DeletionQueue.h"
+#include "Log.h"
+
+namespace {
+
+/* Regions hold whole multiples of this many instances, 64 KiB */
+const uint32_t INSTANCE_RING_GRANULARITY = 1024;
+
+}
+
+void InstanceRing::init(GpuAllocator& allocator, DeletionQueue& deletionQueue, uint32_t frameCount,
+                        uint32_t capacity) {
+    mallocator = &allocator;
+    mdeletionQueue = &deletionQueue;
+    mframeCount = frameCount;
+    createBuffer(capacity);
+}
+
+void InstanceRing::destroy() {
+    if (mbuffer != VK_NULL_HANDLE) {
+        mdeletionQueue->retireBuffer(mbuffer, mallocation);
+    }
+    mcapacity = 0;
+}
+
+void InstanceRing::createBuffer(uint32_t capacity) {
+    capacity = std::max(capacity, 1u);
+    mcapacity = (capacity + INSTANCE_RING_GRANULARITY - 1) / INSTANCE_RING_GRANULARITY * INSTANCE_RING_GRANULARITY;
+
+    VkBufferCreateInfo bufferInfo = {};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = offset(mframeCount);
+    bufferInfo.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    /* Device-local when the device has such host-visible memory, so the vertex fetch stays on the GPU */
+    mallocator->createBuffer(bufferInfo, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                             mbuffer, mallocation, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+}
+
+InstanceData* InstanceRing::begin(uint32_t frame, uint32_t count) {
+    if (count > mcapacity) {
+        /* Frames in flight keep drawing from the old buffer until they retire */
+        mdeletionQueue->retireBuffer(mbuffer, mallocation);
+        createBuffer(count + count / 2);
+        mgrowCount++;
+        LOG_INFO(LOG_MEMORY, "Instance ring grown to %u instances per frame (%.2f MiB)", mcapacity,
+                 offset(mframeCount) / (1024.0 * 1024.0));
+    }
+    mpeakCount = std::max(mpeakCount, count);
+    return reinterpret_cast<InstanceData*>(static_cast<char*>(mallocation.mapped) + offset(frame));
+}
+
+void InstanceRing::printStats() const {
+    printf("Instance ring: %u frames x %u instances (%.2f MiB), peak %u instances per frame, grown %u times \n",
+           mframeCount, mcapacity, offset(mframeCount) / (1024.0 * 1024.0), mpeakCount, mgrowCount);
+}
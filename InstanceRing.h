@@ -0,0 +1,68 @@
+#ifndef VULKAN_BASIC_SAMPLES_INSTANCERING_H
+#define VULKAN_BASIC_SAMPLES_INSTANCERING_H
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+
+#include "GpuAllocator.h"
+
+class DeletionQueue;
+
+/* Per-instance vertex attributes of shaders/instance_ring.vert, read at instance rate */
+struct InstanceData {
+    /* Rows of a 3x4 affine object-to-world transform */
+    float transform[3][4];
+    /* RGBA8 */
+    uint32_t color;
+    uint32_t material;
+    uint32_t padding[2];
+};
+static_assert(sizeof(InstanceData) == 64, "InstanceData is one cache line");
+
+/*
+ * Instance data for every frame in flight in one persistently mapped,
+ * host-visible buffer, one region per frame. A frame writes its own region
+ * after its fence has been waited on, so the CPU never touches what the GPU
+ * may still be reading, and the region is bound as a vertex buffer without
+ * any copy.
+ *
+ * Regions are sized by demand. When begin() asks for more instances than a
+ * region holds, the buffer is replaced by one whose regions fit half as much
+ * again. The old buffer goes to the deletion queue, which frees it once the
+ * frames still drawing from it have retired, so growing never waits on the
+ * GPU.
+ */
+class InstanceRing {
+public:
+    void init(GpuAllocator& allocator, DeletionQueue& deletionQueue, uint32_t frameCount, uint32_t capacity);
+    /* Retires the buffer */
+    void destroy();
+
+    /* The frame's region with room for at least count instances; buffer() may change */
+    InstanceData* begin(uint32_t frame, uint32_t count);
+
+    VkBuffer buffer() const { return mbuffer; }
+    VkDeviceSize offset(uint32_t frame) const {
+        return static_cast<VkDeviceSize>(frame) * mcapacity * sizeof(InstanceData);
+    }
+    /* Instances per region */
+    uint32_t capacity() const { return mcapacity; }
+
+    void printStats() const;
+
+private:
+    void createBuffer(uint32_t capacity);
+
+    GpuAllocator* mallocator = nullptr;
+    DeletionQueue* mdeletionQueue = nullptr;
+    uint32_t mframeCount = 0;
+    uint32_t mcapacity = 0;
+    VkBuffer mbuffer = VK_NULL_HANDLE;
+    GpuAllocation mallocation;
+
+    uint32_t mgrowCount = 0;
+    uint32_t mpeakCount = 0;
+};
+
+#endif //VULKAN_BASIC_SAMPLES_INSTANCERING_H
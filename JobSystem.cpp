@@ -0,0 +1,135 @@
+#include "JobSystem.h"
+
+#include <algorithm>
+
+JobSystem::JobSystem(unsigned workerCount) : mnextQueue(0), mpending(0) {
+    if (workerCount == 0) {
+        unsigned hardwareThreads = std::thread::hardware_concurrency();
+        workerCount = hardwareThreads > 1 ? hardwareThreads - 1 : 0;
+    }
+
+    for (unsigned i = 0; i < workerCount + 1; i++) {
+        mqueues.push_back(std::unique_ptr<WorkerQueue>(new WorkerQueue()));
+    }
+    for (unsigned i = 1; i <= workerCount; i++) {
+        mworkers.push_back(std::thread(&JobSystem::workerLoop, this, i));
+    }
+}
+
+JobSystem::~JobSystem() {
+    {
+        std::lock_guard<std::mutex> lock(msleepMutex);
+        mstop = true;
+    }
+    mwake.notify_all();
+    for (auto& worker : mworkers) {
+        worker.join();
+    }
+}
+
+void JobSystem::submit(const Job& job, std::atomic<size_t>& counter) {
+    counter.fetch_add(1);
+
+    /* Round-robin over all queues, stealing evens out whatever imbalance is left */
+    unsigned queueIndex = mnextQueue.fetch_add(1) % threadCount();
+    {
+        std::lock_guard<std::mutex> lock(mqueues[queueIndex]->mutex);
+        QueuedJob queued;
+        queued.job = job;
+        queued.counter = &counter;
+        mqueues[queueIndex]->jobs.push_back(queued);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(msleepMutex);
+        mpending.fetch_add(1);
+    }
+    mwake.notify_one();
+}
+
+void JobSystem::wait(std::atomic<size_t>& counter) {
+    while (counter.load() != 0) {
+        if (!runOne(0)) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+void JobSystem::parallelFor(size_t count, size_t chunkCount, const RangeJob& job) {
+    if (count == 0) {
+        return;
+    }
+    if (chunkCount == 0) {
+        chunkCount = threadCount();
+    }
+    chunkCount = std::min(chunkCount, count);
+
+    if (chunkCount == 1) {
+        job(0, count, 0, 0);
+        return;
+    }
+
+    std::atomic<size_t> counter(0);
+    size_t chunkSize = count / chunkCount;
+    size_t remainder = count % chunkCount;
+    size_t begin = 0;
+    for (size_t chunk = 0; chunk < chunkCount; chunk++) {
+        size_t end = begin + chunkSize + (chunk < remainder ? 1 : 0);
+        submit([&job, begin, end, chunk](unsigned threadIndex) {
+            job(begin, end, chunk, threadIndex);
+        }, counter);
+        begin = end;
+    }
+    wait(counter);
+}
+
+bool JobSystem::popLocal(unsigned threadIndex, QueuedJob& out) {
+    WorkerQueue& queue = *mqueues[threadIndex];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.jobs.empty()) {
+        return false;
+    }
+    out = queue.jobs.back();
+    queue.jobs.pop_back();
+    return true;
+}
+
+bool JobSystem::steal(unsigned threadIndex, QueuedJob& out) {
+    unsigned count = threadCount();
+    for (unsigned offset = 1; offset < count; offset++) {
+        WorkerQueue& victim = *mqueues[(threadIndex + offset) % count];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.jobs.empty()) {
+            out = victim.jobs.front();
+            victim.jobs.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+bool JobSystem::runOne(unsigned threadIndex) {
+    QueuedJob queued;
+    if (!popLocal(threadIndex, queued) && !steal(threadIndex, queued)) {
+        return false;
+    }
+
+    mpending.fetch_sub(1);
+    queued.job(threadIndex);
+    queued.counter->fetch_sub(1);
+    return true;
+}
+
+void JobSystem::workerLoop(unsigned threadIndex) {
+    for (;;) {
+        if (runOne(threadIndex)) {
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(msleepMutex);
+        mwake.wait(lock, [this] { return mstop || mpending.load() != 0; });
+        if (mstop) {
+            return;
+        }
+    }
+}
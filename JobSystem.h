@@ -0,0 +1,72 @@
+#ifndef VULKAN_BASIC_SAMPLES_JOBSYSTEM_H
+#define VULKAN_BASIC_SAMPLES_JOBSYSTEM_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * Fixed pool of worker threads with one job deque per thread. A thread pops
+ * from the back of its own deque and steals from the front of the others when
+ * it runs dry. The thread calling wait()/parallelFor() takes part as thread
+ * index 0, workers are 1..threadCount()-1, so per-thread resources such as
+ * command pools can be indexed directly by the thread index passed to a job.
+ */
+class JobSystem {
+public:
+    typedef std::function<void(unsigned threadIndex)> Job;
+    typedef std::function<void(size_t begin, size_t end, size_t chunk, unsigned threadIndex)> RangeJob;
+
+    /* workerCount 0 sizes the pool to the number of hardware threads */
+    explicit JobSystem(unsigned workerCount = 0);
+    ~JobSystem();
+
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    /* Workers plus the calling thread */
+    unsigned threadCount() const { return static_cast<unsigned>(mqueues.size()); }
+
+    /*
+     * Splits [0, count) into chunkCount contiguous chunks (0 picks one per
+     * thread), runs them across the pool and returns once all have finished.
+     */
+    void parallelFor(size_t count, size_t chunkCount, const RangeJob& job);
+
+    /* Queues independent jobs; wait() on the same counter blocks until all have run */
+    void submit(const Job& job, std::atomic<size_t>& counter);
+    void wait(std::atomic<size_t>& counter);
+
+private:
+    struct QueuedJob {
+        Job job;
+        std::atomic<size_t>* counter;
+    };
+
+    struct WorkerQueue {
+        std::mutex mutex;
+        std::deque<QueuedJob> jobs;
+    };
+
+    void workerLoop(unsigned threadIndex);
+    bool runOne(unsigned threadIndex);
+    bool popLocal(unsigned threadIndex, QueuedJob& out);
+    bool steal(unsigned threadIndex, QueuedJob& out);
+
+    std::vector<std::unique_ptr<WorkerQueue>> mqueues;
+    std::vector<std::thread> mworkers;
+    std::atomic<unsigned> mnextQueue;
+
+    std::mutex msleepMutex;
+    std::condition_variable mwake;
+    std::atomic<size_t> mpending;
+    bool mstop = false;
+};
+
+#endif //VULKAN_BASIC_SAMPLES_JOBSYSTEM_H
@@ -0,0 +1,399 @@
+#include "Log.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdarg>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+/* Power of two; 128-byte slots make the ring 512 KiB */
+const uint64_t SLOT_COUNT = 4096;
+const size_t SLOT_PAYLOAD = 120;
+/* Longer messages are truncated; validation messages can run to a few hundred characters */
+const size_t MAX_MESSAGE_BYTES = 2048;
+const std::chrono::milliseconds FLUSH_INTERVAL(2);
+/*
+ * A producer preempted between claiming and publishing holds up the
+ * flusher, so a full ring usually drains in a scheduling quantum. Yield that
+ * long before dropping.
+ */
+const unsigned FULL_RING_YIELDS = 64;
+/* Direct-mapped table of recent distinct messages; a new message evicts the one in its bucket */
+const size_t REPEAT_BUCKETS = 1024;
+const size_t SUMMARY_CHARACTERS = 160;
+
+const uint64_t FNV_OFFSET_BASIS = 0xcbf29ce484222325ull;
+const uint64_t FNV_PRIME = 0x100000001b3ull;
+
+const char* const LEVEL_NAMES[] = {"trace", "debug", "info", "warning", "error"};
+const char* const CATEGORY_NAMES[] = {"general", "validation", "device", "memory", "pipeline", "swapchain", "render"};
+const size_t CATEGORY_COUNT = sizeof(CATEGORY_NAMES) / sizeof(CATEGORY_NAMES[0]);
+
+/* Starts a record; the text follows it, both spread over as many consecutive slots as needed */
+struct RecordHeader {
+    int64_t timeUs;
+    const char* function;
+    uint32_t thread;
+    uint32_t length;
+    uint8_t level;
+    uint8_t category;
+};
+
+/*
+ * A slot at ring position p is free for the producer claiming p when its
+ * sequence is p, and holds a published record start for the consumer when
+ * it is p + 1. Only a record's first slot is published; the consumer frees
+ * slots in order, so a producer need only check the last slot it claims.
+ */
+struct Slot {
+    std::atomic<uint64_t> sequence;
+    char payload[SLOT_PAYLOAD];
+};
+
+struct Repeat {
+    uint64_t hash = 0;
+    uint64_t count = 0;
+    uint8_t level = 0;
+    uint8_t category = 0;
+    std::string text;
+};
+
+struct LogState {
+    LogState() {
+        for (uint64_t i = 0; i < SLOT_COUNT; i++) {
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    std::atomic<int> level{LOG_LEVEL_INFO};
+    std::atomic<uint32_t> categories{LOG_ALL_CATEGORIES};
+    std::atomic<uint32_t> threadCounter{0};
+    std::atomic<uint64_t> written{0};
+    std::atomic<uint64_t> dropped{0};
+
+    /* Producers contend on head; keep it off the line the consumer writes */
+    alignas(64) std::atomic<uint64_t> head{0};
+    alignas(64) Slot slots[SLOT_COUNT];
+
+    /* Held by whichever thread is consuming: the flusher or a caller of flush() */
+    std::mutex consumerMutex;
+    uint64_t tail = 0;
+    FILE* output = nullptr;
+    std::vector<Repeat> repeats = std::vector<Repeat>(REPEAT_BUCKETS);
+    uint64_t suppressed = 0;
+
+    std::mutex wakeMutex;
+    std::condition_variable wake;
+    bool stopping = false;
+    std::thread flusher;
+};
+
+LogState& state() {
+    static LogState logState;
+    return logState;
+}
+
+uint32_t threadIndex() {
+    static thread_local uint32_t index = state().threadCounter.fetch_add(1, std::memory_order_relaxed);
+    return index;
+}
+
+size_t categoryIndex(uint32_t category) {
+    size_t index = 0;
+    while (index + 1 < CATEGORY_COUNT && (category & (1u << index)) == 0) {
+        index++;
+    }
+    return index;
+}
+
+/* Copies size bytes to or from the byte stream starting at ring position position */
+void scatter(LogState& s, uint64_t position, size_t offset, const void* source, size_t size) {
+    const char* bytes = static_cast<const char*>(source);
+    while (size > 0) {
+        Slot& slot = s.slots[(position + offset / SLOT_PAYLOAD) & (SLOT_COUNT - 1)];
+        size_t inSlot = offset % SLOT_PAYLOAD;
+        size_t chunk = std::min(size, SLOT_PAYLOAD - inSlot);
+        memcpy(slot.payload + inSlot, bytes, chunk);
+        bytes += chunk;
+        offset += chunk;
+        size -= chunk;
+    }
+}
+
+void gather(LogState& s, uint64_t position, size_t offset, void* destination, size_t size) {
+    char* bytes = static_cast<char*>(destination);
+    while (size > 0) {
+        const Slot& slot = s.slots[(position + offset / SLOT_PAYLOAD) & (SLOT_COUNT - 1)];
+        size_t inSlot = offset % SLOT_PAYLOAD;
+        size_t chunk = std::min(size, SLOT_PAYLOAD - inSlot);
+        memcpy(bytes, slot.payload + inSlot, chunk);
+        bytes += chunk;
+        offset += chunk;
+        size -= chunk;
+    }
+}
+
+uint64_t slotsFor(size_t textLength) {
+    return (sizeof(RecordHeader) + textLength + SLOT_PAYLOAD - 1) / SLOT_PAYLOAD;
+}
+
+FILE* outputOf(const LogState& s) {
+    return s.output != nullptr ? s.output : stderr;
+}
+
+/* Call with consumerMutex held */
+void writeRepeatCount(LogState& s, Repeat& repeat) {
+    if (repeat.count > 0) {
+        fprintf(outputOf(s), "%-7s %-10s repeated %llu more times: %s\n", LEVEL_NAMES[repeat.level],
+                CATEGORY_NAMES[repeat.category], static_cast<unsigned long long>(repeat.count), repeat.text.c_str());
+        repeat.count = 0;
+    }
+}
+
+/* Call with consumerMutex held */
+void emit(LogState& s, const RecordHeader& header, const char* text) {
+    uint64_t hash = FNV_OFFSET_BASIS;
+    hash = (hash ^ header.level) * FNV_PRIME;
+    hash = (hash ^ header.category) * FNV_PRIME;
+    for (uint32_t i = 0; i < header.length; i++) {
+        hash = (hash ^ static_cast<unsigned char>(text[i])) * FNV_PRIME;
+    }
+    Repeat& repeat = s.repeats[hash & (REPEAT_BUCKETS - 1)];
+    if (repeat.hash == hash) {
+        repeat.count++;
+        s.suppressed++;
+        return;
+    }
+    writeRepeatCount(s, repeat);
+    repeat.hash = hash;
+    repeat.level = header.level;
+    repeat.category = header.category;
+    repeat.text.assign(text, std::min<size_t>(header.length, SUMMARY_CHARACTERS));
+
+    FILE* output = outputOf(s);
+    fprintf(output, "[%9.3f] %-7s %-10s %2u ", header.timeUs / 1e6, LEVEL_NAMES[header.level],
+            CATEGORY_NAMES[header.category], header.thread);
+    if (header.function != nullptr) {
+        fprintf(output, "%s: ", header.function);
+    }
+    fwrite(text, 1, header.length, output);
+    fputc('\n', output);
+}
+
+/* Call with consumerMutex held */
+void drain(LogState& s) {
+    char text[MAX_MESSAGE_BYTES];
+    bool wrote = false;
+    for (;;) {
+        Slot& first = s.slots[s.tail & (SLOT_COUNT - 1)];
+        if (first.sequence.load(std::memory_order_acquire) != s.tail + 1) {
+            break;
+        }
+        RecordHeader header;
+        gather(s, s.tail, 0, &header, sizeof(header));
+        gather(s, s.tail, sizeof(header), text, header.length);
+
+        uint64_t count = slotsFor(header.length);
+        for (uint64_t i = 0; i < count; i++) {
+            s.slots[(s.tail + i) & (SLOT_COUNT - 1)].sequence.store(s.tail + i + SLOT_COUNT,
+                                                                     std::memory_order_release);
+        }
+        s.tail += count;
+
+        emit(s, header, text);
+        wrote = true;
+    }
+    if (wrote) {
+        fflush(outputOf(s));
+    }
+}
+
+void flusherLoop() {
+    Trace::setThreadName("logFlusher");
+    LogState& s = state();
+    for (;;) {
+        {
+            std::lock_guard<std::mutex> lock(s.consumerMutex);
+            drain(s);
+        }
+        std::unique_lock<std::mutex> lock(s.wakeMutex);
+        if (s.stopping) {
+            break;
+        }
+        s.wake.wait_for(lock, FLUSH_INTERVAL);
+    }
+}
+
+}
+
+void Log::start(LogLevel level, uint32_t categories) {
+    LogState& s = state();
+    s.level = level;
+    s.categories = categories;
+    std::lock_guard<std::mutex> lock(s.wakeMutex);
+    if (!s.flusher.joinable()) {
+        s.stopping = false;
+        s.flusher = std::thread(flusherLoop);
+    }
+}
+
+void Log::stop() {
+    LogState& s = state();
+    {
+        std::lock_guard<std::mutex> lock(s.wakeMutex);
+        s.stopping = true;
+    }
+    s.wake.notify_all();
+    if (s.flusher.joinable()) {
+        s.flusher.join();
+    }
+
+    std::lock_guard<std::mutex> lock(s.consumerMutex);
+    drain(s);
+    for (Repeat& repeat : s.repeats) {
+        writeRepeatCount(s, repeat);
+    }
+    fflush(outputOf(s));
+}
+
+void Log::flush() {
+    LogState& s = state();
+    std::lock_guard<std::mutex> lock(s.consumerMutex);
+    drain(s);
+}
+
+void Log::setOutput(FILE* output) {
+    LogState& s = state();
+    std::lock_guard<std::mutex> lock(s.consumerMutex);
+    drain(s);
+    s.output = output;
+}
+
+bool Log::enabled(LogLevel level, LogCategory category) {
+    const LogState& s = state();
+    return level >= s.level.load(std::memory_order_relaxed) &&
+           (s.categories.load(std::memory_order_relaxed) & category) != 0;
+}
+
+void Log::write(LogLevel level, LogCategory category, const char* function, const char* format, ...) {
+    LogState& s = state();
+    /* Wait or drop before paying for formatting when the ring is already full */
+    unsigned yields = 0;
+    for (;;) {
+        uint64_t head = s.head.load(std::memory_order_relaxed);
+        if (s.slots[head & (SLOT_COUNT - 1)].sequence.load(std::memory_order_relaxed) >= head) {
+            break;
+        }
+        if (++yields > FULL_RING_YIELDS) {
+            s.dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        std::this_thread::yield();
+    }
+
+    char text[MAX_MESSAGE_BYTES];
+    va_list args;
+    va_start(args, format);
+    int formatted = vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+    if (formatted < 0) {
+        return;
+    }
+    /* Lines are terminated by the flusher */
+    size_t length = std::min(static_cast<size_t>(formatted), sizeof(text) - 1);
+    while (length > 0 && (text[length - 1] == '\n' || text[length - 1] == ' ')) {
+        length--;
+    }
+
+    uint64_t count = slotsFor(length);
+    uint64_t position = s.head.load(std::memory_order_relaxed);
+    for (;;) {
+        uint64_t last = position + count - 1;
+        uint64_t sequence = s.slots[last & (SLOT_COUNT - 1)].sequence.load(std::memory_order_acquire);
+        int64_t difference = static_cast<int64_t>(sequence - last);
+        if (difference == 0) {
+            if (s.head.compare_exchange_weak(position, position + count, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (difference < 0) {
+            /* The flusher is a full ring behind */
+            if (++yields > FULL_RING_YIELDS) {
+                s.dropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            std::this_thread::yield();
+            position = s.head.load(std::memory_order_relaxed);
+        } else {
+            position = s.head.load(std::memory_order_relaxed);
+        }
+    }
+
+    RecordHeader header;
+    header.timeUs = Trace::toTraceMicroseconds(Trace::Clock::now());
+    header.function = function;
+    header.thread = threadIndex();
+    header.length = static_cast<uint32_t>(length);
+    header.level = static_cast<uint8_t>(level);
+    header.category = static_cast<uint8_t>(categoryIndex(category));
+    scatter(s, position, 0, &header, sizeof(header));
+    scatter(s, position, sizeof(header), text, length);
+    s.slots[position & (SLOT_COUNT - 1)].sequence.store(position + 1, std::memory_order_release);
+    s.written.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Log::printStats() {
+    LogState& s = state();
+    uint64_t suppressed;
+    {
+        std::lock_guard<std::mutex> lock(s.consumerMutex);
+        suppressed = s.suppressed;
+    }
+    printf("Log: %llu messages queued, %llu dropped on a full ring, %llu suppressed as repeats \n",
+           static_cast<unsigned long long>(s.written.load()), static_cast<unsigned long long>(s.dropped.load()),
+           static_cast<unsigned long long>(suppressed));
+}
+
+bool Log::parseLevel(const char* name, LogLevel& level) {
+    for (int i = LOG_LEVEL_TRACE; i <= LOG_LEVEL_ERROR; i++) {
+        if (strcmp(name, LEVEL_NAMES[i]) == 0) {
+            level = static_cast<LogLevel>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Log::parseCategories(const char* names, uint32_t& categories) {
+    uint32_t parsed = 0;
+    std::string list(names);
+    size_t start = 0;
+    while (start <= list.size()) {
+        size_t end = list.find(',', start);
+        if (end == std::string::npos) {
+            end = list.size();
+        }
+        std::string name = list.substr(start, end - start);
+        if (name == "all") {
+            parsed |= LOG_ALL_CATEGORIES;
+        } else {
+            size_t index = 0;
+            while (index < CATEGORY_COUNT && name != CATEGORY_NAMES[index]) {
+                index++;
+            }
+            if (index == CATEGORY_COUNT) {
+                return false;
+            }
+            parsed |= 1u << index;
+        }
+        start = end + 1;
+    }
+    categories = parsed;
+    return true;
+}
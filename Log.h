@@ -0,0 +1,83 @@
+#ifndef VULKAN_BASIC_SAMPLES_LOG_H
+#define VULKAN_BASIC_SAMPLES_LOG_H
+
+#include <cstdint>
+#include <cstdio>
+
+enum LogLevel {
+    LOG_LEVEL_TRACE,
+    LOG_LEVEL_DEBUG,
+    LOG_LEVEL_INFO,
+    LOG_LEVEL_WARNING,
+    LOG_LEVEL_ERROR
+};
+
+/* One bit each, so a runtime filter is a mask */
+enum LogCategory : uint32_t {
+    LOG_GENERAL = 1u << 0,
+    LOG_VALIDATION = 1u << 1,
+    LOG_DEVICE = 1u << 2,
+    LOG_MEMORY = 1u << 3,
+    LOG_PIPELINE = 1u << 4,
+    LOG_SWAPCHAIN = 1u << 5,
+    LOG_RENDER = 1u << 6,
+    LOG_ALL_CATEGORIES = (1u << 7) - 1
+};
+
+/* Levels below this are compiled out: the macros expand to a constant-false branch */
+#ifndef LOG_COMPILED_LEVEL
+#ifdef NDEBUG
+#define LOG_COMPILED_LEVEL LOG_LEVEL_INFO
+#else
+#define LOG_COMPILED_LEVEL LOG_LEVEL_TRACE
+#endif
+#endif
+
+/*
+ * Asynchronous log. A message that passes the level and category filters is
+ * formatted on the calling thread into a lock-free multi-producer ring and
+ * written out by a single flusher thread, so logging threads never block on
+ * I/O or on each other. A message that does not fit in a full ring is
+ * dropped and counted rather than stalling the caller.
+ *
+ * The flusher writes the first occurrence of a message and counts exact
+ * repeats (same level, category and text). stop() prints each suppressed
+ * message with its repeat count. Before start() is called, messages are
+ * queued and written once the flusher starts.
+ */
+class Log {
+public:
+    static void start(LogLevel level, uint32_t categories);
+    /* Drains the ring, prints the repeat counts and joins the flusher; safe to call twice */
+    static void stop();
+    /* Writes everything queued so far before returning */
+    static void flush();
+    /* stderr by default; the caller keeps ownership */
+    static void setOutput(FILE* output);
+
+    static bool enabled(LogLevel level, LogCategory category);
+    static void write(LogLevel level, LogCategory category, const char* function, const char* format, ...)
+        __attribute__((format(printf, 4, 5)));
+
+    /* Messages written, dropped on a full ring and suppressed as repeats */
+    static void printStats();
+
+    /* Return false for an unknown name; categories are comma separated, or "all" */
+    static bool parseLevel(const char* name, LogLevel& level);
+    static bool parseCategories(const char* names, uint32_t& categories);
+};
+
+#define LOG_AT(level, category, ...) \
+    do { \
+        if ((level) >= LOG_COMPILED_LEVEL && Log::enabled(level, category)) { \
+            Log::write(level, category, __func__, __VA_ARGS__); \
+        } \
+    } while (0)
+
+#define LOG_TRACE(category, ...) LOG_AT(LOG_LEVEL_TRACE, category, __VA_ARGS__)
+#define LOG_DEBUG(category, ...) LOG_AT(LOG_LEVEL_DEBUG, category, __VA_ARGS__)
+#define LOG_INFO(category, ...) LOG_AT(LOG_LEVEL_INFO, category, __VA_ARGS__)
+#define LOG_WARNING(category, ...) LOG_AT(LOG_LEVEL_WARNING, category, __VA_ARGS__)
+#define LOG_ERROR(category, ...) LOG_AT(LOG_LEVEL_ERROR, category, __VA_ARGS__)
+
+#endif //VULKAN_BASIC_SAMPLES_LOG_H
@@ -0,0 +1,216 @@
+#include "MeshCooker.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+
+#include <lz4hc.h>
+
+namespace {
+
+uint64_t alignUp(uint64_t value, uint64_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+/* OBJ indices are 1-based, negative ones count back from the latest element */
+int resolveIndex(long index, size_t count) {
+    if (index > 0) {
+        return static_cast<int>(index - 1);
+    }
+    if (index < 0) {
+        return static_cast<int>(count) + static_cast<int>(index);
+    }
+    return -1;
+}
+
+}
+
+void loadObj(const std::string& path, std::vector<MeshData>& meshes) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        throw std::runtime_error("Failed to open " + path);
+    }
+
+    std::vector<float> positions;
+    std::vector<float> texCoords;
+    std::vector<float> normals;
+    std::unordered_map<std::string, uint32_t> vertexIds;
+    MeshData mesh;
+    mesh.name = "default";
+
+    auto finishMesh = [&]() {
+        if (!mesh.indices.empty()) {
+            meshes.push_back(mesh);
+        }
+        mesh.vertices.clear();
+        mesh.indices.clear();
+        vertexIds.clear();
+    };
+
+    std::string line;
+    std::vector<uint32_t> polygon;
+    while (std::getline(file, line)) {
+        std::istringstream stream(line);
+        std::string keyword;
+        stream >> keyword;
+        if (keyword == "v" || keyword == "vn") {
+            float x = 0.0f, y = 0.0f, z = 0.0f;
+            stream >> x >> y >> z;
+            std::vector<float>& target = keyword == "v" ? positions : normals;
+            target.push_back(x);
+            target.push_back(y);
+            target.push_back(z);
+        } else if (keyword == "vt") {
+            float u = 0.0f, v = 0.0f;
+            stream >> u >> v;
+            texCoords.push_back(u);
+            texCoords.push_back(v);
+        } else if (keyword == "o" || keyword == "g") {
+            finishMesh();
+            stream >> mesh.name;
+        } else if (keyword == "f") {
+            polygon.clear();
+            std::string corner;
+            while (stream >> corner) {
+                long indices[3] = {0, 0, 0};
+                const char* cursor = corner.c_str();
+                for (int i = 0; i < 3 && *cursor != '\0'; i++) {
+                    char* end;
+                    indices[i] = strtol(cursor, &end, 10);
+                    cursor = *end == '/' ? end + 1 : end;
+                }
+                int p = resolveIndex(indices[0], positions.size() / 3);
+                int t = resolveIndex(indices[1], texCoords.size() / 2);
+                int n = resolveIndex(indices[2], normals.size() / 3);
+                if (p < 0 || static_cast<size_t>(p) >= positions.size() / 3) {
+                    throw std::runtime_error("Bad vertex index in " + path + ": " + corner);
+                }
+
+                /* Keyed on resolved indices, relative ones name different vertices on different lines */
+                std::string key = std::to_string(p) + "/" + std::to_string(t) + "/" + std::to_string(n);
+                auto found = vertexIds.find(key);
+                if (found != vertexIds.end()) {
+                    polygon.push_back(found->second);
+                    continue;
+                }
+
+                PackedVertex vertex = {};
+                memcpy(vertex.position, &positions[static_cast<size_t>(p) * 3], sizeof(vertex.position));
+                if (t >= 0 && static_cast<size_t>(t) < texCoords.size() / 2) {
+                    memcpy(vertex.uv, &texCoords[static_cast<size_t>(t) * 2], sizeof(vertex.uv));
+                }
+                if (n >= 0 && static_cast<size_t>(n) < normals.size() / 3) {
+                    memcpy(vertex.normal, &normals[static_cast<size_t>(n) * 3], sizeof(vertex.normal));
+                }
+                uint32_t id = static_cast<uint32_t>(mesh.vertices.size());
+                mesh.vertices.push_back(vertex);
+                vertexIds[key] = id;
+                polygon.push_back(id);
+            }
+            for (size_t i = 2; i < polygon.size(); i++) {
+                mesh.indices.push_back(polygon[0]);
+                mesh.indices.push_back(polygon[i - 1]);
+                mesh.indices.push_back(polygon[i]);
+            }
+        }
+    }
+    finishMesh();
+}
+
+AssetCookStats writeAssetPackage(const std::string& path, const std::vector<MeshData>& meshes, bool compress) {
+    AssetCookStats stats;
+    std::vector<AssetMesh> meshTable;
+    std::vector<AssetChunk> chunkTable;
+    /* Stored chunk bytes, in file order, each padded to the blob alignment */
+    std::vector<char> blobs;
+
+    std::vector<char> payload;
+    std::vector<char> compressed(LZ4_compressBound(ASSET_CHUNK_BYTES));
+    for (const MeshData& data : meshes) {
+        AssetMesh mesh = {};
+        strncpy(mesh.name, data.name.c_str(), sizeof(mesh.name) - 1);
+        mesh.vertexCount = static_cast<uint32_t>(data.vertices.size());
+        mesh.indexCount = static_cast<uint32_t>(data.indices.size());
+        uint64_t vertexBytes = data.vertices.size() * sizeof(PackedVertex);
+        mesh.indexOffset = alignUp(vertexBytes, ASSET_BLOB_ALIGNMENT);
+        mesh.payloadBytes = mesh.indexOffset + data.indices.size() * sizeof(uint32_t);
+        mesh.firstChunk = static_cast<uint32_t>(chunkTable.size());
+        for (int axis = 0; axis < 3; axis++) {
+            mesh.boundsMin[axis] = data.vertices.empty() ? 0.0f : data.vertices[0].position[axis];
+            mesh.boundsMax[axis] = mesh.boundsMin[axis];
+        }
+        for (const PackedVertex& vertex : data.vertices) {
+            for (int axis = 0; axis < 3; axis++) {
+                mesh.boundsMin[axis] = std::min(mesh.boundsMin[axis], vertex.position[axis]);
+                mesh.boundsMax[axis] = std::max(mesh.boundsMax[axis], vertex.position[axis]);
+            }
+        }
+
+        payload.assign(mesh.payloadBytes, 0);
+        memcpy(payload.data(), data.vertices.data(), vertexBytes);
+        memcpy(payload.data() + mesh.indexOffset, data.indices.data(), data.indices.size() * sizeof(uint32_t));
+
+        for (uint64_t offset = 0; offset < payload.size(); offset += ASSET_CHUNK_BYTES) {
+            AssetChunk chunk = {};
+            chunk.bytes = static_cast<uint32_t>(std::min<uint64_t>(ASSET_CHUNK_BYTES, payload.size() - offset));
+            const char* source = payload.data() + offset;
+            chunk.storedBytes = chunk.bytes;
+            if (compress) {
+                int size = LZ4_compress_HC(source, compressed.data(), static_cast<int>(chunk.bytes),
+                                           static_cast<int>(compressed.size()), LZ4HC_CLEVEL_DEFAULT);
+                if (size > 0 && static_cast<uint32_t>(size) < chunk.bytes) {
+                    chunk.flags |= ASSET_CHUNK_LZ4;
+                    chunk.storedBytes = static_cast<uint32_t>(size);
+                    source = compressed.data();
+                    stats.compressedChunks++;
+                }
+            }
+            /* Offsets are relative to the blob area until the tables' size is known */
+            chunk.fileOffset = blobs.size();
+            blobs.insert(blobs.end(), source, source + chunk.storedBytes);
+            blobs.resize(alignUp(blobs.size(), ASSET_BLOB_ALIGNMENT), 0);
+            chunkTable.push_back(chunk);
+        }
+        mesh.chunkCount = static_cast<uint32_t>(chunkTable.size()) - mesh.firstChunk;
+        meshTable.push_back(mesh);
+        stats.payloadBytes += mesh.payloadBytes;
+    }
+
+    AssetPackageHeader header = {};
+    header.magic = ASSET_PACKAGE_MAGIC;
+    header.version = ASSET_PACKAGE_VERSION;
+    header.meshCount = static_cast<uint32_t>(meshTable.size());
+    header.chunkCount = static_cast<uint32_t>(chunkTable.size());
+    header.meshOffset = sizeof(AssetPackageHeader);
+    header.chunkOffset = header.meshOffset + meshTable.size() * sizeof(AssetMesh);
+    uint64_t blobOffset = alignUp(header.chunkOffset + chunkTable.size() * sizeof(AssetChunk), ASSET_BLOB_ALIGNMENT);
+    header.fileSize = blobOffset + blobs.size();
+    for (AssetChunk& chunk : chunkTable) {
+        chunk.fileOffset += blobOffset;
+    }
+
+    std::string temporary = path + ".tmp";
+    FILE* file = fopen(temporary.c_str(), "wb");
+    if (file == nullptr) {
+        throw std::runtime_error("Failed to create " + temporary);
+    }
+    std::vector<char> padding(blobOffset - header.chunkOffset - chunkTable.size() * sizeof(AssetChunk), 0);
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                   fwrite(meshTable.data(), sizeof(AssetMesh), meshTable.size(), file) == meshTable.size() &&
+                   fwrite(chunkTable.data(), sizeof(AssetChunk), chunkTable.size(), file) == chunkTable.size() &&
+                   fwrite(padding.data(), 1, padding.size(), file) == padding.size() &&
+                   fwrite(blobs.data(), 1, blobs.size(), file) == blobs.size();
+    if (fclose(file) != 0 || !written || rename(temporary.c_str(), path.c_str()) != 0) {
+        remove(temporary.c_str());
+        throw std::runtime_error("Failed to write " + path);
+    }
+
+    stats.fileBytes = header.fileSize;
+    stats.chunks = header.chunkCount;
+    return stats;
+}
@@ -0,0 +1,39 @@
+#ifndef VULKAN_BASIC_SAMPLES_MESHCOOKER_H
+#define VULKAN_BASIC_SAMPLES_MESHCOOKER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "AssetPackage.h"
+
+struct MeshData {
+    std::string name;
+    std::vector<PackedVertex> vertices;
+    std::vector<uint32_t> indices;
+};
+
+struct AssetCookStats {
+    uint64_t payloadBytes = 0;
+    uint64_t fileBytes = 0;
+    uint32_t chunks = 0;
+    uint32_t compressedChunks = 0;
+};
+
+/*
+ * Straightforward OBJ reader: v, vt, vn and f lines, with polygons split
+ * into fans and each o or g line starting a new mesh. Vertices are
+ * deduplicated by their v/vt/vn triple. It is both the cooker's front end
+ * and the parse-and-copy baseline that packages are measured against, so
+ * it is deliberately plain iostream code. Throws if the file cannot be read.
+ */
+void loadObj(const std::string& path, std::vector<MeshData>& meshes);
+
+/*
+ * Writes meshes as an asset package (see AssetPackage.h). With compress,
+ * each chunk is LZ4 HC compressed and kept that way only if it shrank. The
+ * file is written under a temporary name and renamed into place.
+ */
+AssetCookStats writeAssetPackage(const std::string& path, const std::vector<MeshData>& meshes, bool compress);
+
+#endif //VULKAN_BASIC_SAMPLES_MESHCOOKER_H
@@ -0,0 +1,131 @@
+#include "PipelineCache.h"
+#include "HostAllocator.h"
+#include "Log.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+namespace {
+
+/* Layout of VK_PIPELINE_CACHE_HEADER_VERSION_ONE, see vkGetPipelineCacheData */
+struct PipelineCacheHeader {
+    uint32_t headerSize;
+    uint32_t headerVersion;
+    uint32_t vendorID;
+    uint32_t deviceID;
+    uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+};
+
+bool readBlob(const std::string& path, std::vector<char>& data) {
+    std::ifstream file(path, std::ios::ate | std::ios::binary);
+    if (!file.is_open()) {
+        return false;
+    }
+
+    size_t fileSize = (size_t) file.tellg();
+    data.resize(fileSize);
+    file.seekg(0);
+    file.read(data.data(), fileSize);
+    return file.good();
+}
+
+}
+
+bool PipelineCache::validateHeader(const std::vector<char>& data, const VkPhysicalDeviceProperties& properties) {
+    if (data.size() < sizeof(PipelineCacheHeader)) {
+        return false;
+    }
+
+    PipelineCacheHeader header;
+    memcpy(&header, data.data(), sizeof(header));
+
+    return header.headerSize >= sizeof(PipelineCacheHeader) &&
+           header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+           header.vendorID == properties.vendorID &&
+           header.deviceID == properties.deviceID &&
+           memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+void PipelineCache::preload(const std::string& path) {
+    mpreloadedPath = path;
+    mpreloadedValid = readBlob(path, mpreloaded);
+}
+
+void PipelineCache::create(VkDevice device, const VkPhysicalDeviceProperties& properties,
+                           const std::string& path, bool loadFromDisk) {
+    mdevice = device;
+    mpath = path;
+    mwarm = false;
+
+    std::vector<char> data;
+    bool loaded = false;
+    if (loadFromDisk && mpreloadedPath == mpath) {
+        data.swap(mpreloaded);
+        loaded = mpreloadedValid;
+    } else if (loadFromDisk) {
+        loaded = readBlob(mpath, data);
+    }
+    if (loaded) {
+        if (validateHeader(data, properties)) {
+            mwarm = true;
+        } else {
+            LOG_INFO(LOG_PIPELINE, "Discarding pipeline cache %s, it was written by another device or driver",
+                     mpath.c_str());
+            data.clear();
+        }
+    }
+
+    VkPipelineCacheCreateInfo createInfo = {};
+    createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    createInfo.initialDataSize = data.size();
+    createInfo.pInitialData = data.empty() ? nullptr : data.data();
+
+    if (vkCreatePipelineCache(mdevice, &createInfo, HostAllocator::callbacks(), &mcache) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create pipeline cache");
+    }
+
+    LOG_DEBUG(LOG_PIPELINE, "%s pipeline cache, %zu bytes loaded", mwarm ? "Warm" : "Cold", data.size());
+}
+
+void PipelineCache::save() {
+    if (mcache == VK_NULL_HANDLE) {
+        return;
+    }
+
+    size_t dataSize = 0;
+    if (vkGetPipelineCacheData(mdevice, mcache, &dataSize, nullptr) != VK_SUCCESS || dataSize == 0) {
+        return;
+    }
+
+    std::vector<char> data(dataSize);
+    if (vkGetPipelineCacheData(mdevice, mcache, &dataSize, data.data()) != VK_SUCCESS) {
+        return;
+    }
+
+    /* Write to a temporary file and rename so a crash never leaves a torn cache behind */
+    std::string tmpPath = mpath + ".tmp";
+    std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        LOG_WARNING(LOG_PIPELINE, "Failed to open %s for writing", tmpPath.c_str());
+        return;
+    }
+    file.write(data.data(), dataSize);
+    file.close();
+
+    if (!file || rename(tmpPath.c_str(), mpath.c_str()) != 0) {
+        LOG_WARNING(LOG_PIPELINE, "Failed to write pipeline cache %s", mpath.c_str());
+        remove(tmpPath.c_str());
+        return;
+    }
+
+    LOG_DEBUG(LOG_PIPELINE, "Saved %zu bytes to %s", dataSize, mpath.c_str());
+}
+
+void PipelineCache::destroy() {
+    if (mcache != VK_NULL_HANDLE) {
+        vkDestroyPipelineCache(mdevice, mcache, HostAllocator::callbacks());
+        mcache = VK_NULL_HANDLE;
+    }
+}
@@ -0,0 +1,45 @@
+#ifndef VULKAN_BASIC_SAMPLES_PIPELINECACHE_H
+#define VULKAN_BASIC_SAMPLES_PIPELINECACHE_H
+
+#include <vulkan/vulkan.h>
+
+#include <string>
+#include <vector>
+
+/*
+ * VkPipelineCache persisted to disk between runs.
+ *
+ * The blob written by the driver starts with a VkPipelineCacheHeaderVersion
+ * ONE header. It is only fed back to the driver when vendor ID, device ID and
+ * pipelineCacheUUID all match the current device, otherwise an empty cache is
+ * created and the stale file is overwritten on save().
+ */
+class PipelineCache {
+public:
+    /* Reads the blob ahead of time so the disk read can overlap device creation */
+    void preload(const std::string& path);
+
+    void create(VkDevice device, const VkPhysicalDeviceProperties& properties,
+                const std::string& path, bool loadFromDisk);
+    void save();
+    void destroy();
+
+    VkPipelineCache handle() const { return mcache; }
+
+    /* True when the cache was seeded from a valid on-disk blob */
+    bool isWarm() const { return mwarm; }
+
+private:
+    static bool validateHeader(const std::vector<char>& data, const VkPhysicalDeviceProperties& properties);
+
+    VkDevice mdevice = VK_NULL_HANDLE;
+    VkPipelineCache mcache = VK_NULL_HANDLE;
+    std::string mpath;
+    bool mwarm = false;
+
+    std::string mpreloadedPath;
+    std::vector<char> mpreloaded;
+    bool mpreloadedValid = false;
+};
+
+#endif //VULKAN_BASIC_SAMPLES_PIPELINECACHE_H
@@ -0,0 +1,182 @@
+#ifndef VULKAN_BASIC_SAMPLES_PIPELINEDESCRIPTION_H
+#define VULKAN_BASIC_SAMPLES_PIPELINEDESCRIPTION_H
+
+#include <vulkan/vulkan.h>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * Fixed-function graphics pipeline state as constexpr data.
+ *
+ * A PipelineState names constexpr vertex binding and attribute arrays and
+ * the rasterizer and blend settings the app's pipelines differ in; the
+ * with*() members derive variants from it. Whatever every pipeline shares
+ * is filled in by PipelineRegistry: dynamic viewport and scissor, one
+ * sample, one colour attachment, no depth. hash() is FNV-1a over the whole
+ * description and is a constant expression, so a state's key is computed
+ * by the compiler and distinct states can be checked with static_assert.
+ */
+
+const uint64_t PIPELINE_HASH_SEED = 14695981039346656037ull;
+
+/* FNV-1a over value's eight bytes, low byte first */
+constexpr uint64_t hashPipelineValue(uint64_t hash, uint64_t value) {
+    for (int byte = 0; byte < 8; byte++) {
+        hash = (hash ^ ((value >> (byte * 8)) & 0xff)) * 1099511628211ull;
+    }
+    return hash;
+}
+
+/* Vertex attribute format of a member type; a type without one fails to compile */
+template <typename T> struct VertexFormat;
+template <> struct VertexFormat<float[2]> { static constexpr VkFormat value = VK_FORMAT_R32G32_SFLOAT; };
+template <> struct VertexFormat<float[3]> { static constexpr VkFormat value = VK_FORMAT_R32G32B32_SFLOAT; };
+template <> struct VertexFormat<float[4]> { static constexpr VkFormat value = VK_FORMAT_R32G32B32A32_SFLOAT; };
+template <> struct VertexFormat<uint32_t> { static constexpr VkFormat value = VK_FORMAT_R32_UINT; };
+
+struct VertexBinding {
+    uint32_t binding;
+    uint32_t stride;
+    VkVertexInputRate inputRate;
+};
+
+struct VertexAttribute {
+    uint32_t location;
+    uint32_t binding;
+    VkFormat format;
+    uint32_t offset;
+};
+
+/* An attribute reading Type::member with the format that follows from the member's type */
+#define VERTEX_ATTRIBUTE(location, binding, Type, member) \
+    VertexAttribute{location, binding, VertexFormat<decltype(Type::member)>::value, \
+                    static_cast<uint32_t>(offsetof(Type, member))}
+
+struct BlendState {
+    VkBool32 enable;
+    VkBlendFactor srcColor;
+    VkBlendFactor dstColor;
+    VkBlendOp colorOp;
+    VkBlendFactor srcAlpha;
+    VkBlendFactor dstAlpha;
+    VkBlendOp alphaOp;
+};
+
+constexpr BlendState BLEND_OPAQUE = {VK_FALSE, VK_BLEND_FACTOR_ONE, VK_BLEND_FACTOR_ZERO, VK_BLEND_OP_ADD,
+                                     VK_BLEND_FACTOR_ONE, VK_BLEND_FACTOR_ZERO, VK_BLEND_OP_ADD};
+/* Colour adds to the target; alpha replaces it */
+constexpr BlendState BLEND_ADDITIVE = {VK_TRUE, VK_BLEND_FACTOR_ONE, VK_BLEND_FACTOR_ONE, VK_BLEND_OP_ADD,
+                                       VK_BLEND_FACTOR_ONE, VK_BLEND_FACTOR_ZERO, VK_BLEND_OP_ADD};
+
+struct PipelineState {
+    const VertexBinding* bindings;
+    uint32_t bindingCount;
+    const VertexAttribute* attributes;
+    uint32_t attributeCount;
+    VkPrimitiveTopology topology;
+    VkPolygonMode polygonMode;
+    VkCullModeFlags cullMode;
+    VkFrontFace frontFace;
+    BlendState blend;
+
+    constexpr PipelineState withTopology(VkPrimitiveTopology value) const {
+        PipelineState state = *this;
+        state.topology = value;
+        return state;
+    }
+    constexpr PipelineState withPolygonMode(VkPolygonMode value) const {
+        PipelineState state = *this;
+        state.polygonMode = value;
+        return state;
+    }
+    constexpr PipelineState withCullMode(VkCullModeFlags value) const {
+        PipelineState state = *this;
+        state.cullMode = value;
+        return state;
+    }
+    constexpr PipelineState withBlend(const BlendState& value) const {
+        PipelineState state = *this;
+        state.blend = value;
+        return state;
+    }
+
+    /* Hashes what the arrays hold, not where they are */
+    constexpr uint64_t hash() const {
+        uint64_t hash = hashPipelineValue(PIPELINE_HASH_SEED, bindingCount);
+        for (uint32_t i = 0; i < bindingCount; i++) {
+            hash = hashPipelineValue(hash, bindings[i].binding);
+            hash = hashPipelineValue(hash, bindings[i].stride);
+            hash = hashPipelineValue(hash, bindings[i].inputRate);
+        }
+        hash = hashPipelineValue(hash, attributeCount);
+        for (uint32_t i = 0; i < attributeCount; i++) {
+            hash = hashPipelineValue(hash, attributes[i].location);
+            hash = hashPipelineValue(hash, attributes[i].binding);
+            hash = hashPipelineValue(hash, attributes[i].format);
+            hash = hashPipelineValue(hash, attributes[i].offset);
+        }
+        hash = hashPipelineValue(hash, topology);
+        hash = hashPipelineValue(hash, polygonMode);
+        hash = hashPipelineValue(hash, cullMode);
+        hash = hashPipelineValue(hash, frontFace);
+        hash = hashPipelineValue(hash, blend.enable);
+        hash = hashPipelineValue(hash, blend.srcColor);
+        hash = hashPipelineValue(hash, blend.dstColor);
+        hash = hashPipelineValue(hash, blend.colorOp);
+        hash = hashPipelineValue(hash, blend.srcAlpha);
+        hash = hashPipelineValue(hash, blend.dstAlpha);
+        return hashPipelineValue(hash, blend.alphaOp);
+    }
+};
+
+/*
+ * Filled, clockwise, back-face culled, opaque triangle lists reading the
+ * given vertex input; both arrays must be constexpr objects of static
+ * storage duration, since the state keeps pointers to them.
+ */
+template <size_t BindingCount, size_t AttributeCount>
+constexpr PipelineState describeVertexInput(const VertexBinding (&bindings)[BindingCount],
+                                            const VertexAttribute (&attributes)[AttributeCount]) {
+    return PipelineState{bindings, BindingCount, attributes, AttributeCount, VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
+                         VK_POLYGON_MODE_FILL, VK_CULL_MODE_BACK_BIT, VK_FRONT_FACE_CLOCKWISE, BLEND_OPAQUE};
+}
+
+/*
+ * Specialization info for constants 0 to count - 1, each 32 bits and read
+ * from values in order. entries holds count elements; it and values must
+ * outlive pipeline creation.
+ */
+inline VkSpecializationInfo describeSpecialization(const uint32_t* values, uint32_t count,
+                                                   VkSpecializationMapEntry* entries) {
+    for (uint32_t i = 0; i < count; i++) {
+        entries[i].constantID = i;
+        entries[i].offset = i * sizeof(uint32_t);
+        entries[i].size = sizeof(uint32_t);
+    }
+    VkSpecializationInfo specialization = {};
+    specialization.mapEntryCount = count;
+    specialization.pMapEntries = entries;
+    specialization.dataSize = count * sizeof(uint32_t);
+    specialization.pData = values;
+    return specialization;
+}
+
+/*
+ * Values of specialization constants 0 to Count - 1. Each is 32 bits, as
+ * GLSL bool, int, uint and float constants are; a bool is VK_TRUE or
+ * VK_FALSE. Stages ignore entries for constant ids they do not declare, so
+ * one set of values can serve every stage of a pipeline.
+ */
+template <size_t Count>
+struct SpecializationConstants {
+    std::array<uint32_t, Count> values;
+
+    /* entries, like this object, must outlive pipeline creation */
+    VkSpecializationInfo info(std::array<VkSpecializationMapEntry, Count>& entries) const {
+        return describeSpecialization(values.data(), static_cast<uint32_t>(Count), entries.data());
+    }
+};
+
+#endif //VULKAN_BASIC_SAMPLES_PIPELINEDESCRIPTION_H
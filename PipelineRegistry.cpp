@@ -0,0 +1,338 @@
+#include "PipelineRegistry.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <exception>
+#include <stdexcept>
+
+#include "HostAllocator.h"
+#include "Log.h"
+
+void PipelineRegistry::init(VkDevice device, VkPipelineCache pipelineCache, VkRenderPass renderPass,
+                            DeletionQueue& deletionQueue, ShaderCache& shaders) {
+    mdevice = device;
+    mpipelineCache = pipelineCache;
+    mrenderPass = renderPass;
+    mdeletionQueue = &deletionQueue;
+    mshaders = &shaders;
+}
+
+void PipelineRegistry::destroy() {
+    for (auto& entry : mentries) {
+        if (entry->rebuild.valid()) {
+            VkPipeline pipeline = entry->rebuild.get();
+            if (pipeline != VK_NULL_HANDLE) {
+                vkDestroyPipeline(mdevice, pipeline, HostAllocator::callbacks());
+            }
+        }
+        entry->pipeline.reset();
+    }
+    mentries.clear();
+    mids.clear();
+}
+
+PipelineRegistry::PipelineId PipelineRegistry::add(const PipelineState& state, uint64_t stateHash,
+                                                   VkPipelineLayout layout, ShaderCache::ShaderId vert,
+                                                   ShaderCache::ShaderId frag, const uint32_t* constants,
+                                                   size_t count) {
+    mrequests++;
+    uint64_t key = hashPipelineValue(stateHash, reinterpret_cast<uint64_t>(layout));
+    key = hashPipelineValue(key, vert);
+    key = hashPipelineValue(key, frag);
+    key = hashPipelineValue(key, count);
+    for (size_t i = 0; i < count; i++) {
+        key = hashPipelineValue(key, constants[i]);
+    }
+
+    auto found = mids.find(key);
+    if (found != mids.end()) {
+        const Entry& entry = *mentries[found->second];
+        if (entry.stateHash != stateHash || entry.layout != layout || entry.vert != vert || entry.frag != frag ||
+            !std::equal(constants, constants + count, entry.constants.begin(), entry.constants.end())) {
+            throw std::runtime_error("Two pipeline permutations hash to the same key");
+        }
+        return found->second;
+    }
+
+    PipelineId id = static_cast<PipelineId>(mentries.size());
+    std::unique_ptr<Entry> entry(new Entry());
+    entry->state = state;
+    entry->stateHash = stateHash;
+    entry->key = key;
+    entry->layout = layout;
+    entry->vert = vert;
+    entry->frag = frag;
+    entry->constants.assign(constants, constants + count);
+    mentries.push_back(std::move(entry));
+    mids[key] = id;
+    LOG_DEBUG(LOG_PIPELINE, "Pipeline %u: key %016llx, %zu specialization constants", id, (unsigned long long) key,
+              count);
+    return id;
+}
+
+/* Workers pull entries off a shared index, so one slow compile does not hold up a whole share */
+void PipelineRegistry::prewarm(unsigned threadCount) {
+    std::vector<PipelineId> pending;
+    for (PipelineId id = 0; id < mentries.size(); id++) {
+        if (mentries[id]->pipeline.get() == VK_NULL_HANDLE) {
+            pending.push_back(id);
+        }
+    }
+    if (pending.empty()) {
+        return;
+    }
+
+    auto startTime = std::chrono::steady_clock::now();
+    std::vector<VkPipeline> built(pending.size(), VK_NULL_HANDLE);
+    std::atomic<size_t> next(0);
+    unsigned workerCount = std::max(1u, std::min(threadCount, static_cast<unsigned>(pending.size())));
+    std::vector<std::future<void>> workers;
+    for (unsigned worker = 0; worker < workerCount; worker++) {
+        workers.push_back(std::async(std::launch::async, [this, &pending, &built, &next]() {
+            for (size_t i = next++; i < pending.size(); i = next++) {
+                const Entry& entry = *mentries[pending[i]];
+                built[i] = build(entry, *mshaders->get(entry.vert), *mshaders->get(entry.frag));
+            }
+        }));
+    }
+
+    /* Whatever did build is owned before a failure is rethrown, so nothing leaks */
+    std::exception_ptr failure;
+    for (auto& worker : workers) {
+        try {
+            worker.get();
+        } catch (...) {
+            if (!failure) {
+                failure = std::current_exception();
+            }
+        }
+    }
+    for (size_t i = 0; i < pending.size(); i++) {
+        if (built[i] != VK_NULL_HANDLE) {
+            mentries[pending[i]]->pipeline = mdeletionQueue->own(built[i]);
+            mprewarmed++;
+        }
+    }
+    if (failure) {
+        std::rethrow_exception(failure);
+    }
+
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - startTime;
+    mprewarmMs += elapsed.count();
+    mprewarmThreads = std::max(mprewarmThreads, workerCount);
+    LOG_INFO(LOG_PIPELINE, "Prewarmed %zu pipelines on %u threads in %.2f ms", pending.size(), workerCount,
+             elapsed.count());
+}
+
+VkPipeline PipelineRegistry::get(PipelineId id) {
+    Entry& entry = *mentries[id];
+    if (entry.pipeline.get() == VK_NULL_HANDLE) {
+        entry.pipeline = mdeletionQueue->own(build(entry, *mshaders->get(entry.vert), *mshaders->get(entry.frag)));
+        mlateBuilds++;
+    }
+    return entry.pipeline;
+}
+
+void PipelineRegistry::poll(const std::vector<ShaderCache::ShaderId>& reloaded) {
+    for (PipelineId id = 0; id < mentries.size(); id++) {
+        Entry& entry = *mentries[id];
+        for (ShaderCache::ShaderId shader : reloaded) {
+            if (shader == entry.vert || shader == entry.frag) {
+                entry.stale = true;
+            }
+        }
+
+        if (entry.rebuild.valid() && entry.rebuild.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+            VkPipeline pipeline = entry.rebuild.get();
+            if (pipeline != VK_NULL_HANDLE) {
+                entry.pipeline = mdeletionQueue->own(pipeline);
+                mreloads++;
+                LOG_INFO(LOG_PIPELINE, "Reloaded pipeline %u (key %016llx)", id, (unsigned long long) entry.key);
+            }
+        }
+
+        /* A change during a rebuild waits for it, so the newest SPIR-V always wins */
+        if (entry.stale && !entry.rebuild.valid()) {
+            entry.stale = false;
+            SpirvBlob vert = mshaders->get(entry.vert);
+            SpirvBlob frag = mshaders->get(entry.frag);
+            const Entry* source = &entry;
+            entry.rebuild = std::async(std::launch::async, [this, source, vert, frag]() -> VkPipeline {
+                try {
+                    return build(*source, *vert, *frag);
+                } catch (const std::exception& e) {
+                    LOG_WARNING(LOG_PIPELINE, "Pipeline rebuild failed, keeping the previous pipeline: %s", e.what());
+                    return VK_NULL_HANDLE;
+                }
+            });
+        }
+    }
+}
+
+VkShaderModule PipelineRegistry::createShaderModule(const MappedFile& code) const {
+    VkShaderModuleCreateInfo createInfo = {};
+    createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    createInfo.codeSize = code.size();
+    createInfo.pCode = static_cast<const uint32_t*>(code.data());
+
+    VkShaderModule shaderModule;
+    if (vkCreateShaderModule(mdevice, &createInfo, HostAllocator::callbacks(), &shaderModule) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create shader module");
+    }
+    return shaderModule;
+}
+
+void PipelineRegistry::setRenderPass(VkRenderPass renderPass, unsigned threadCount) {
+    for (auto& entry : mentries) {
+        /* A rebuild in flight targets the old pass and no frame has used it; the build below reads the newest SPIR-V */
+        if (entry->rebuild.valid()) {
+            VkPipeline pipeline = entry->rebuild.get();
+            if (pipeline != VK_NULL_HANDLE) {
+                vkDestroyPipeline(mdevice, pipeline, HostAllocator::callbacks());
+            }
+        }
+        entry->stale = false;
+        entry->pipeline.reset();
+    }
+    mrenderPass = renderPass;
+    prewarm(threadCount);
+}
+
+/* Reads only the entry's immutable fields, so a rebuild may run while frames use the current pipeline */
+VkPipeline PipelineRegistry::build(const Entry& entry, const MappedFile& vertCode,
+                                   const MappedFile& fragCode) const {
+    const PipelineState& state = entry.state;
+
+    std::vector<VkSpecializationMapEntry> constantEntries(entry.constants.size());
+    VkSpecializationInfo specialization = describeSpecialization(
+            entry.constants.data(), static_cast<uint32_t>(entry.constants.size()), constantEntries.data());
+
+    VkShaderModule vertShaderModule = createShaderModule(vertCode);
+    VkShaderModule fragShaderModule;
+    try {
+        fragShaderModule = createShaderModule(fragCode);
+    } catch (...) {
+        vkDestroyShaderModule(mdevice, vertShaderModule, HostAllocator::callbacks());
+        throw;
+    }
+
+    VkPipelineShaderStageCreateInfo shaderStages[2] = {};
+    shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+    shaderStages[0].module = vertShaderModule;
+    shaderStages[0].pName = "main";
+    shaderStages[0].pSpecializationInfo = entry.constants.empty() ? nullptr : &specialization;
+    shaderStages[1] = shaderStages[0];
+    shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+    shaderStages[1].module = fragShaderModule;
+
+    std::vector<VkVertexInputBindingDescription> bindings(state.bindingCount);
+    for (uint32_t i = 0; i < state.bindingCount; i++) {
+        bindings[i].binding = state.bindings[i].binding;
+        bindings[i].stride = state.bindings[i].stride;
+        bindings[i].inputRate = state.bindings[i].inputRate;
+    }
+    std::vector<VkVertexInputAttributeDescription> attributes(state.attributeCount);
+    for (uint32_t i = 0; i < state.attributeCount; i++) {
+        attributes[i].location = state.attributes[i].location;
+        attributes[i].binding = state.attributes[i].binding;
+        attributes[i].format = state.attributes[i].format;
+        attributes[i].offset = state.attributes[i].offset;
+    }
+
+    VkPipelineVertexInputStateCreateInfo vertexInputInfo = {};
+    vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+    vertexInputInfo.vertexBindingDescriptionCount = state.bindingCount;
+    vertexInputInfo.pVertexBindingDescriptions = bindings.data();
+    vertexInputInfo.vertexAttributeDescriptionCount = state.attributeCount;
+    vertexInputInfo.pVertexAttributeDescriptions = attributes.data();
+
+    VkPipelineInputAssemblyStateCreateInfo inputAssembly = {};
+    inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    inputAssembly.topology = state.topology;
+    inputAssembly.primitiveRestartEnable = VK_FALSE;
+
+    /* Viewport and scissor are dynamic so the pipeline survives swapchain resizes */
+    VkPipelineViewportStateCreateInfo viewportState = {};
+    viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewportState.viewportCount = 1;
+    viewportState.scissorCount = 1;
+
+    VkPipelineRasterizationStateCreateInfo rasterizer = {};
+    rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    rasterizer.depthClampEnable = VK_FALSE;
+    rasterizer.rasterizerDiscardEnable = VK_FALSE;
+    rasterizer.polygonMode = state.polygonMode;
+    rasterizer.lineWidth = 1.0f;
+    rasterizer.cullMode = state.cullMode;
+    rasterizer.frontFace = state.frontFace;
+    rasterizer.depthBiasEnable = VK_FALSE;
+
+    VkPipelineMultisampleStateCreateInfo multisampling = {};
+    multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    multisampling.sampleShadingEnable = VK_FALSE;
+    multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+    VkPipelineColorBlendAttachmentState colorBlendAttachment = {};
+    colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
+                                          VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+    colorBlendAttachment.blendEnable = state.blend.enable;
+    colorBlendAttachment.srcColorBlendFactor = state.blend.srcColor;
+    colorBlendAttachment.dstColorBlendFactor = state.blend.dstColor;
+    colorBlendAttachment.colorBlendOp = state.blend.colorOp;
+    colorBlendAttachment.srcAlphaBlendFactor = state.blend.srcAlpha;
+    colorBlendAttachment.dstAlphaBlendFactor = state.blend.dstAlpha;
+    colorBlendAttachment.alphaBlendOp = state.blend.alphaOp;
+
+    VkPipelineColorBlendStateCreateInfo colorBlending = {};
+    colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    colorBlending.logicOpEnable = VK_FALSE;
+    colorBlending.logicOp = VK_LOGIC_OP_COPY;
+    colorBlending.attachmentCount = 1;
+    colorBlending.pAttachments = &colorBlendAttachment;
+
+    VkDynamicState dynamicStates[] = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+
+    VkPipelineDynamicStateCreateInfo dynamicState = {};
+    dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamicState.dynamicStateCount = 2;
+    dynamicState.pDynamicStates = dynamicStates;
+
+    VkGraphicsPipelineCreateInfo pipelineInfo = {};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipelineInfo.stageCount = 2;
+    pipelineInfo.pStages = shaderStages;
+    pipelineInfo.pVertexInputState = &vertexInputInfo;
+    pipelineInfo.pInputAssemblyState = &inputAssembly;
+    pipelineInfo.pViewportState = &viewportState;
+    pipelineInfo.pRasterizationState = &rasterizer;
+    pipelineInfo.pMultisampleState = &multisampling;
+    pipelineInfo.pColorBlendState = &colorBlending;
+    pipelineInfo.pDynamicState = &dynamicState;
+    pipelineInfo.layout = entry.layout;
+    pipelineInfo.renderPass = mrenderPass;
+    pipelineInfo.subpass = 0;
+    pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+
+    VkPipeline pipeline;
+    auto startTime = std::chrono::steady_clock::now();
+    VkResult result = vkCreateGraphicsPipelines(mdevice, mpipelineCache, 1, &pipelineInfo,
+                                                HostAllocator::callbacks(), &pipeline);
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - startTime;
+    vkDestroyShaderModule(mdevice, fragShaderModule, HostAllocator::callbacks());
+    vkDestroyShaderModule(mdevice, vertShaderModule, HostAllocator::callbacks());
+    if (result != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create graphics pipeline");
+    }
+    LOG_DEBUG(LOG_PIPELINE, "vkCreateGraphicsPipelines took %.3f ms for key %016llx", elapsed.count(),
+              (unsigned long long) entry.key);
+    return pipeline;
+}
+
+void PipelineRegistry::printStats() const {
+    printf("Pipelines: %zu permutations from %u requests, %u prewarmed on %u threads in %.2f ms, "
+           "%u built on first use, %u reloaded \n",
+           mentries.size(), mrequests, mprewarmed, mprewarmThreads, mprewarmMs, mlateBuilds, mreloads);
+}
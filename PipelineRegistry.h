@@ -0,0 +1,104 @@
+#ifndef VULKAN_BASIC_SAMPLES_PIPELINEREGISTRY_H
+#define VULKAN_BASIC_SAMPLES_PIPELINEREGISTRY_H
+
+#include <vulkan/vulkan.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "DeletionQueue.h"
+#include "PipelineDescription.h"
+#include "ShaderCache.h"
+
+/*
+ * Every graphics pipeline of the app, one per permutation.
+ *
+ * A permutation is a PipelineState, a layout, a vertex and fragment shader
+ * and the values of their specialization constants. request() hashes those
+ * into a key and returns the id already holding that key, or adds an entry,
+ * so asking for the same permutation twice yields one pipeline. The state's
+ * part of the key is a compile-time constant. request() compiles nothing:
+ * prewarm() builds every entry not built yet on worker threads, which share
+ * the internally synchronised VkPipelineCache, and get() builds a straggler
+ * on first use. request() and get() are for one thread at a time.
+ *
+ * With --hot-reload, poll() marks the entries whose shaders changed and
+ * rebuilds them on a background thread while frames keep using the old
+ * pipeline. The swap happens between frames; the old pipeline goes to the
+ * deletion queue, which destroys it once the frames that used it retire.
+ * setRenderPass() rebuilds every pipeline the same way when the swapchain's
+ * colour format, and with it the render pass, changes.
+ */
+class PipelineRegistry {
+public:
+    typedef uint32_t PipelineId;
+
+    void init(VkDevice device, VkPipelineCache pipelineCache, VkRenderPass renderPass, DeletionQueue& deletionQueue,
+              ShaderCache& shaders);
+    /* Waits for rebuilds in flight, then retires every pipeline */
+    void destroy();
+
+    template <const PipelineState& State, size_t Count = 0>
+    PipelineId request(VkPipelineLayout layout, ShaderCache::ShaderId vert, ShaderCache::ShaderId frag,
+                       const SpecializationConstants<Count>& constants = SpecializationConstants<Count>()) {
+        constexpr uint64_t stateHash = State.hash();
+        return add(State, stateHash, layout, vert, frag, constants.values.data(), Count);
+    }
+
+    /* Builds every entry not built yet on up to threadCount threads, and waits for them */
+    void prewarm(unsigned threadCount);
+    /* Builds the pipeline on this thread if prewarm() has not */
+    VkPipeline get(PipelineId id);
+
+    /* Between frames, with what ShaderCache::takeReloaded() returned */
+    void poll(const std::vector<ShaderCache::ShaderId>& reloaded);
+    /*
+     * Between frames, after the colour format changed. Waits for rebuilds in
+     * flight, retires every pipeline and builds them all against renderPass
+     * on up to threadCount threads.
+     */
+    void setRenderPass(VkRenderPass renderPass, unsigned threadCount);
+
+    void printStats() const;
+
+private:
+    struct Entry {
+        PipelineState state;
+        uint64_t stateHash;
+        uint64_t key;
+        VkPipelineLayout layout;
+        ShaderCache::ShaderId vert;
+        ShaderCache::ShaderId frag;
+        std::vector<uint32_t> constants;
+        UniqueHandle<VkPipeline> pipeline;
+        std::future<VkPipeline> rebuild;
+        bool stale = false;
+    };
+
+    PipelineId add(const PipelineState& state, uint64_t stateHash, VkPipelineLayout layout,
+                   ShaderCache::ShaderId vert, ShaderCache::ShaderId frag, const uint32_t* constants, size_t count);
+    VkPipeline build(const Entry& entry, const MappedFile& vertCode, const MappedFile& fragCode) const;
+    VkShaderModule createShaderModule(const MappedFile& code) const;
+
+    VkDevice mdevice = VK_NULL_HANDLE;
+    VkPipelineCache mpipelineCache = VK_NULL_HANDLE;
+    VkRenderPass mrenderPass = VK_NULL_HANDLE;
+    DeletionQueue* mdeletionQueue = nullptr;
+    ShaderCache* mshaders = nullptr;
+
+    std::vector<std::unique_ptr<Entry>> mentries;
+    std::unordered_map<uint64_t, PipelineId> mids;
+
+    uint32_t mrequests = 0;
+    uint32_t mprewarmed = 0;
+    unsigned mprewarmThreads = 0;
+    double mprewarmMs = 0.0;
+    uint32_t mlateBuilds = 0;
+    uint32_t mreloads = 0;
+};
+
+#endif //VULKAN_BASIC_SAMPLES_PIPELINEREGISTRY_H
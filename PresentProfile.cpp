@@ -0,0 +1,74 @@
+#include "PresentProfile.h"
+
+#include <algorithm>
+
+namespace {
+
+const std::vector<PresentProfile>& presentProfiles() {
+    static const std::vector<PresentProfile> profiles = {
+        {"default", "mailbox if available, one spare image, two frames in flight",
+         {VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_IMMEDIATE_KHR}, 1, 2},
+        {"low-latency", "newest frame wins, a single frame in flight",
+         {VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_FIFO_RELAXED_KHR}, 1, 1},
+        {"vsync-power-saving", "strict vsync with the shallowest queue, the CPU sleeps on the fence",
+         {VK_PRESENT_MODE_FIFO_KHR}, 0, 1},
+        {"max-throughput", "never waits for vblank, deep queue to keep the GPU busy",
+         {VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_MAILBOX_KHR}, 2, 3},
+    };
+    return profiles;
+}
+
+}
+
+const PresentProfile* findPresentProfile(const std::string& name) {
+    for (const auto& profile : presentProfiles()) {
+        if (name == profile.name) {
+            return &profile;
+        }
+    }
+    return nullptr;
+}
+
+std::string presentProfileNames() {
+    std::string names;
+    for (const auto& profile : presentProfiles()) {
+        if (!names.empty()) {
+            names += " ";
+        }
+        names += profile.name;
+    }
+    return names;
+}
+
+VkPresentModeKHR choosePresentMode(const PresentProfile& profile, const std::vector<VkPresentModeKHR>& available) {
+    for (VkPresentModeKHR mode : profile.presentModes) {
+        if (std::find(available.begin(), available.end(), mode) != available.end()) {
+            return mode;
+        }
+    }
+    return VK_PRESENT_MODE_FIFO_KHR;
+}
+
+uint32_t chooseImageCount(const PresentProfile& profile, const VkSurfaceCapabilitiesKHR& capabilities) {
+    /* Two images are the minimum for the CPU to record while one is displayed */
+    uint32_t imageCount = std::max<uint32_t>(capabilities.minImageCount + profile.extraImages, 2);
+    if (capabilities.maxImageCount > 0 && imageCount > capabilities.maxImageCount) {
+        imageCount = capabilities.maxImageCount;
+    }
+    return imageCount;
+}
+
+const char* presentModeName(VkPresentModeKHR mode) {
+    switch (mode) {
+        case VK_PRESENT_MODE_IMMEDIATE_KHR:
+            return "immediate";
+        case VK_PRESENT_MODE_MAILBOX_KHR:
+            return "mailbox";
+        case VK_PRESENT_MODE_FIFO_KHR:
+            return "fifo";
+        case VK_PRESENT_MODE_FIFO_RELAXED_KHR:
+            return "fifo-relaxed";
+        default:
+            return "unknown";
+    }
+}
@@ -0,0 +1,40 @@
+#ifndef VULKAN_BASIC_SAMPLES_PRESENTPROFILE_H
+#define VULKAN_BASIC_SAMPLES_PRESENTPROFILE_H
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+ * Present mode, swapchain depth and CPU run-ahead are tuned together:
+ * IMMEDIATE with a deep queue never waits for vblank and maximises
+ * throughput at the cost of tearing, FIFO with the shallowest queue lets the
+ * CPU sleep on vsync, and MAILBOX with one frame in flight keeps the
+ * displayed image as fresh as possible.
+ */
+struct PresentProfile {
+    const char* name;
+    const char* description;
+    /* Preference order; FIFO is always available as the final fallback */
+    std::vector<VkPresentModeKHR> presentModes;
+    /* Images requested on top of the surface's minImageCount */
+    uint32_t extraImages;
+    uint32_t framesInFlight;
+};
+
+/* Returns nullptr for unknown names */
+const PresentProfile* findPresentProfile(const std::string& name);
+
+/* Space-separated profile names, for error messages */
+std::string presentProfileNames();
+
+VkPresentModeKHR choosePresentMode(const PresentProfile& profile, const std::vector<VkPresentModeKHR>& available);
+
+/* Clamps minImageCount + extraImages to the surface limits */
+uint32_t chooseImageCount(const PresentProfile& profile, const VkSurfaceCapabilitiesKHR& capabilities);
+
+const char* presentModeName(VkPresentModeKHR mode);
+
+#endif //VULKAN_BASIC_SAMPLES_PRESENTPROFILE_H
@@ -0,0 +1,605 @@
+#include "RenderGraph.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <stdexcept>
+
+#include "DeletionQueue.h"
+#include "HostAllocator.h"
+#include "Log.h"
+
+namespace {
+
+struct AccessInfo {
+    VkImageLayout layout;
+    VkPipelineStageFlags stages;
+    VkAccessFlags readAccess;
+    VkAccessFlags writeAccess;
+    VkImageUsageFlags usage;
+};
+
+AccessInfo accessInfo(RenderAccess access) {
+    switch (access) {
+        case RenderAccess::ColorAttachment:
+            return {VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                    VK_ACCESS_COLOR_ATTACHMENT_READ_BIT,
+                    VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+                    VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT};
+        case RenderAccess::DepthAttachment:
+            return {VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+                    VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+                    VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT,
+                    VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+                    VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT};
+        case RenderAccess::SampledFragment:
+            return {VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                    VK_ACCESS_SHADER_READ_BIT, 0, VK_IMAGE_USAGE_SAMPLED_BIT};
+        case RenderAccess::SampledCompute:
+            return {VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                    VK_ACCESS_SHADER_READ_BIT, 0, VK_IMAGE_USAGE_SAMPLED_BIT};
+        case RenderAccess::StorageCompute:
+            return {VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,
+                    VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_IMAGE_USAGE_STORAGE_BIT};
+        case RenderAccess::TransferSrc:
+            return {VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                    VK_ACCESS_TRANSFER_READ_BIT, 0, VK_IMAGE_USAGE_TRANSFER_SRC_BIT};
+        case RenderAccess::TransferDst:
+            return {VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                    VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_USAGE_TRANSFER_DST_BIT};
+    }
+    throw std::runtime_error("Render graph: unknown access");
+}
+
+VkImageAspectFlags aspectMask(VkImageUsageFlags usage) {
+    return (usage & VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT) ? VK_IMAGE_ASPECT_DEPTH_BIT
+                                                                 : VK_IMAGE_ASPECT_COLOR_BIT;
+}
+
+/* Usages that bind through an image view */
+const VkImageUsageFlags VIEW_USAGE = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT |
+                                     VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT;
+
+VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+bool lifetimesOverlap(int32_t firstA, int32_t lastA, int32_t firstB, int32_t lastB) {
+    return firstA <= lastB && firstB <= lastA;
+}
+
+}
+
+VkImageLayout RenderGraph::layout(RenderAccess access) {
+    return accessInfo(access).layout;
+}
+
+void RenderGraph::init(VkDevice device, GpuAllocator& allocator, DeletionQueue& deletionQueue) {
+    mdevice = device;
+    mallocator = &allocator;
+    mdeletionQueue = &deletionQueue;
+}
+
+void RenderGraph::destroy() {
+    clear();
+}
+
+void RenderGraph::clear() {
+    releasePhysical();
+    mpasses.clear();
+    mresources.clear();
+    mbarriers.clear();
+    mstats = Stats();
+}
+
+RenderGraph::ResourceId RenderGraph::importImage(const char* name, VkFormat format, VkExtent2D extent,
+                                                 RenderAccess finalAccess) {
+    Resource resource;
+    resource.name = name;
+    resource.format = format;
+    resource.extent = extent;
+    resource.imported = true;
+    resource.finalAccess = finalAccess;
+    mresources.push_back(resource);
+    return static_cast<ResourceId>(mresources.size() - 1);
+}
+
+void RenderGraph::setImportedImage(ResourceId resource, VkImage image, VkImageView view) {
+    if (!mresources[resource].imported) {
+        throw std::runtime_error("Render graph: " + mresources[resource].name + " is not imported");
+    }
+    mresources[resource].image = image;
+    mresources[resource].view = view;
+}
+
+RenderGraph::ResourceId RenderGraph::createImage(const char* name, VkFormat format, VkExtent2D extent) {
+    Resource resource;
+    resource.name = name;
+    resource.format = format;
+    resource.extent = extent;
+    mresources.push_back(resource);
+    return static_cast<ResourceId>(mresources.size() - 1);
+}
+
+RenderGraph::PassId RenderGraph::addPass(const char* name, Record record) {
+    Pass pass;
+    pass.name = name;
+    pass.record = record;
+    mpasses.push_back(pass);
+    return static_cast<PassId>(mpasses.size() - 1);
+}
+
+void RenderGraph::read(PassId pass, ResourceId resource, RenderAccess access) {
+    for (Access& existing : mpasses[pass].accesses) {
+        if (existing.resource == resource) {
+            if (existing.access != access) {
+                throw std::runtime_error("Render graph: pass " + mpasses[pass].name + " uses " +
+                                         mresources[resource].name + " in two layouts");
+            }
+            return;
+        }
+    }
+    mpasses[pass].accesses.push_back(Access{resource, access, false});
+}
+
+void RenderGraph::write(PassId pass, ResourceId resource, RenderAccess access) {
+    for (Access& existing : mpasses[pass].accesses) {
+        if (existing.resource == resource) {
+            if (existing.access != access) {
+                throw std::runtime_error("Render graph: pass " + mpasses[pass].name + " uses " +
+                                         mresources[resource].name + " in two layouts");
+            }
+            existing.write = true;
+            return;
+        }
+    }
+    mpasses[pass].accesses.push_back(Access{resource, access, true});
+}
+
+void RenderGraph::compile() {
+    releasePhysical();
+    mbarriers.clear();
+    mstats = Stats();
+    for (Pass& pass : mpasses) {
+        pass.culled = false;
+        pass.firstBarrier = 0;
+        pass.barrierCount = 0;
+        pass.srcStages = 0;
+        pass.dstStages = 0;
+    }
+    for (Resource& resource : mresources) {
+        resource.usage = 0;
+        resource.firstPass = -1;
+        resource.lastPass = -1;
+        resource.aliases.clear();
+    }
+
+    cull();
+    for (size_t p = 0; p < mpasses.size(); p++) {
+        if (mpasses[p].culled) {
+            continue;
+        }
+        for (const Access& access : mpasses[p].accesses) {
+            Resource& resource = mresources[access.resource];
+            resource.usage |= accessInfo(access.access).usage;
+            if (resource.firstPass < 0) {
+                resource.firstPass = static_cast<int32_t>(p);
+            }
+            resource.lastPass = static_cast<int32_t>(p);
+        }
+    }
+    createTransients();
+    computeBarriers();
+
+    mstats.passes = static_cast<uint32_t>(mpasses.size());
+    mstats.imageBarriers = static_cast<uint32_t>(mbarriers.size());
+    for (const Pass& pass : mpasses) {
+        if (pass.culled) {
+            mstats.culledPasses++;
+            LOG_DEBUG(LOG_RENDER, "Render graph: culled pass %s", pass.name.c_str());
+        } else if (pass.barrierCount > 0) {
+            mstats.barrierBatches++;
+        }
+    }
+    if (mfinalBarrierCount > 0) {
+        mstats.barrierBatches++;
+    }
+
+    size_t largestBatch = mfinalBarrierCount;
+    for (const Pass& pass : mpasses) {
+        largestBatch = std::max<size_t>(largestBatch, pass.barrierCount);
+    }
+    mscratch.resize(largestBatch);
+}
+
+/*
+ * Reference counting from the outputs back: a pass is referenced by the
+ * resources it writes, and a resource by the surviving passes that read it
+ * plus, for imported images, the outside world. Whatever drops to zero is
+ * culled, releasing the passes that fed it in turn.
+ */
+void RenderGraph::cull() {
+    std::vector<uint32_t> passRefs(mpasses.size(), 0);
+    std::vector<uint32_t> readers(mresources.size(), 0);
+    std::vector<std::vector<PassId>> writers(mresources.size());
+    for (size_t p = 0; p < mpasses.size(); p++) {
+        for (const Access& access : mpasses[p].accesses) {
+            if (access.write) {
+                passRefs[p]++;
+                writers[access.resource].push_back(static_cast<PassId>(p));
+            } else {
+                readers[access.resource]++;
+            }
+        }
+    }
+
+    std::vector<ResourceId> unreferenced;
+    for (size_t r = 0; r < mresources.size(); r++) {
+        if (mresources[r].imported) {
+            readers[r]++;
+        } else if (readers[r] == 0) {
+            unreferenced.push_back(static_cast<ResourceId>(r));
+        }
+    }
+
+    auto cullPass = [&](PassId p) {
+        mpasses[p].culled = true;
+        for (const Access& access : mpasses[p].accesses) {
+            if (!access.write && --readers[access.resource] == 0) {
+                unreferenced.push_back(access.resource);
+            }
+        }
+    };
+    for (size_t p = 0; p < mpasses.size(); p++) {
+        if (passRefs[p] == 0) {
+            cullPass(static_cast<PassId>(p));
+        }
+    }
+    while (!unreferenced.empty()) {
+        ResourceId resource = unreferenced.back();
+        unreferenced.pop_back();
+        for (PassId writer : writers[resource]) {
+            if (!mpasses[writer].culled && --passRefs[writer] == 0) {
+                cullPass(writer);
+            }
+        }
+    }
+}
+
+void RenderGraph::createTransients() {
+    std::vector<VkMemoryRequirements> requirements(mresources.size());
+    for (size_t r = 0; r < mresources.size(); r++) {
+        Resource& resource = mresources[r];
+        if (resource.imported || resource.firstPass < 0) {
+            continue;
+        }
+        VkImageCreateInfo imageInfo = {};
+        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageInfo.format = resource.format;
+        imageInfo.extent.width = resource.extent.width;
+        imageInfo.extent.height = resource.extent.height;
+        imageInfo.extent.depth = 1;
+        imageInfo.mipLevels = 1;
+        imageInfo.arrayLayers = 1;
+        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageInfo.usage = resource.usage;
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        if (vkCreateImage(mdevice, &imageInfo, HostAllocator::callbacks(), &resource.image) != VK_SUCCESS) {
+            throw std::runtime_error("Render graph: failed to create transient image " + resource.name);
+        }
+        vkGetImageMemoryRequirements(mdevice, resource.image, &requirements[r]);
+        resource.size = requirements[r].size;
+        mstats.transientImages++;
+        mstats.transientBytes += resource.size;
+    }
+
+    placeTransients(requirements);
+
+    for (Resource& resource : mresources) {
+        if (resource.imported || resource.image == VK_NULL_HANDLE) {
+            continue;
+        }
+        const GpuAllocation& heap = mheaps[resource.heap];
+        if (vkBindImageMemory(mdevice, resource.image, heap.memory, heap.offset + resource.offset) != VK_SUCCESS) {
+            throw std::runtime_error("Render graph: failed to bind " + resource.name);
+        }
+        if (!(resource.usage & VIEW_USAGE)) {
+            continue;
+        }
+        VkImageViewCreateInfo viewInfo = {};
+        viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        viewInfo.image = resource.image;
+        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        viewInfo.format = resource.format;
+        viewInfo.subresourceRange.aspectMask = aspectMask(resource.usage);
+        viewInfo.subresourceRange.levelCount = 1;
+        viewInfo.subresourceRange.layerCount = 1;
+        if (vkCreateImageView(mdevice, &viewInfo, HostAllocator::callbacks(), &resource.view) != VK_SUCCESS) {
+            throw std::runtime_error("Render graph: failed to create a view of " + resource.name);
+        }
+    }
+}
+
+/*
+ * Greedy interval placement, one heap per memory type. Images are placed
+ * largest first, each at the lowest suitably aligned offset that does not
+ * overlap an already placed image whose lifetime overlaps its own.
+ */
+void RenderGraph::placeTransients(std::vector<VkMemoryRequirements>& requirements) {
+    std::vector<ResourceId> order;
+    for (size_t r = 0; r < mresources.size(); r++) {
+        if (mresources[r].image != VK_NULL_HANDLE && !mresources[r].imported) {
+            order.push_back(static_cast<ResourceId>(r));
+        }
+    }
+    std::stable_sort(order.begin(), order.end(), [this](ResourceId a, ResourceId b) {
+        return mresources[a].size > mresources[b].size;
+    });
+
+    struct Heap {
+        uint32_t memoryType;
+        VkDeviceSize size;
+        VkDeviceSize alignment;
+        std::vector<ResourceId> placed;
+    };
+    std::vector<Heap> heaps;
+    std::vector<ResourceId> conflicts;
+    for (ResourceId r : order) {
+        Resource& resource = mresources[r];
+        uint32_t memoryType = mallocator->findMemoryType(requirements[r].memoryTypeBits,
+                                                         VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        size_t h = 0;
+        while (h < heaps.size() && heaps[h].memoryType != memoryType) {
+            h++;
+        }
+        if (h == heaps.size()) {
+            heaps.push_back(Heap{memoryType, 0, 1, std::vector<ResourceId>()});
+        }
+        Heap& heap = heaps[h];
+        VkDeviceSize alignment = requirements[r].alignment;
+
+        conflicts.clear();
+        for (ResourceId other : heap.placed) {
+            const Resource& placed = mresources[other];
+            if (lifetimesOverlap(resource.firstPass, resource.lastPass, placed.firstPass, placed.lastPass)) {
+                conflicts.push_back(other);
+            }
+        }
+        std::sort(conflicts.begin(), conflicts.end(), [this](ResourceId a, ResourceId b) {
+            return mresources[a].offset < mresources[b].offset;
+        });
+        VkDeviceSize offset = 0;
+        for (ResourceId other : conflicts) {
+            const Resource& placed = mresources[other];
+            if (offset + resource.size <= placed.offset) {
+                break;
+            }
+            offset = std::max(offset, alignUp(placed.offset + placed.size, alignment));
+        }
+
+        resource.heap = static_cast<uint32_t>(h);
+        resource.offset = offset;
+        heap.size = std::max(heap.size, offset + resource.size);
+        heap.alignment = std::max(heap.alignment, alignment);
+
+        /* Any image sharing memory with this one hands over to it, in pass order */
+        for (ResourceId other : heap.placed) {
+            Resource& placed = mresources[other];
+            bool memoryOverlaps = offset < placed.offset + placed.size && placed.offset < offset + resource.size;
+            if (!memoryOverlaps) {
+                continue;
+            }
+            if (placed.lastPass < resource.firstPass) {
+                resource.aliases.push_back(other);
+            } else if (resource.lastPass < placed.firstPass) {
+                placed.aliases.push_back(r);
+            }
+        }
+        heap.placed.push_back(r);
+    }
+
+    for (const Heap& heap : heaps) {
+        VkMemoryRequirements heapRequirements = {};
+        heapRequirements.size = heap.size;
+        heapRequirements.alignment = heap.alignment;
+        heapRequirements.memoryTypeBits = 1u << heap.memoryType;
+        mheaps.push_back(mallocator->allocate(heapRequirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                                              ResourceKind::Optimal));
+        mstats.peakTransientBytes += heap.size;
+    }
+}
+
+/*
+ * Walks the surviving passes in order, tracking for every image its layout,
+ * the stages and access of the last write (a layout transition counts as
+ * one), the stages that read it since, and which stages and accesses that
+ * write has been made visible to.
+ *
+ * Transient memory is shared by every frame in flight, so a transient's
+ * first barrier also waits on the previous frame's last use of its memory:
+ * the final state of every transient placed over the same range, itself
+ * included. Those are only known once the walk is done, so first barriers
+ * are patched afterwards.
+ */
+void RenderGraph::computeBarriers() {
+    struct State {
+        bool touched;
+        VkImageLayout layout;
+        VkPipelineStageFlags writeStages;
+        VkAccessFlags writeAccess;
+        VkPipelineStageFlags readStages;
+        VkPipelineStageFlags visibleStages;
+        VkAccessFlags visibleAccess;
+    };
+    std::vector<State> states(mresources.size(), State{false, VK_IMAGE_LAYOUT_UNDEFINED, 0, 0, 0, 0, 0});
+    struct FirstUse {
+        size_t pass;
+        size_t barrier;
+        ResourceId resource;
+    };
+    std::vector<FirstUse> firstUses;
+
+    auto transition = [](State& state, VkImageLayout layout, VkPipelineStageFlags stages, VkAccessFlags access,
+                         bool write) {
+        state.touched = true;
+        state.layout = layout;
+        state.writeStages = stages;
+        state.writeAccess = write ? access : 0;
+        state.readStages = write ? 0 : stages;
+        state.visibleStages = stages;
+        state.visibleAccess = access;
+    };
+
+    for (size_t p = 0; p < mpasses.size(); p++) {
+        Pass& pass = mpasses[p];
+        if (pass.culled) {
+            continue;
+        }
+        pass.firstBarrier = static_cast<uint32_t>(mbarriers.size());
+        for (const Access& access : pass.accesses) {
+            AccessInfo info = accessInfo(access.access);
+            VkAccessFlags accessMask = access.write ? info.writeAccess : info.readAccess;
+            const Resource& resource = mresources[access.resource];
+            State& state = states[access.resource];
+            Barrier barrier = {access.resource, state.layout, info.layout, 0, accessMask};
+
+            if (!state.touched) {
+                if (!resource.imported && !access.write) {
+                    throw std::runtime_error("Render graph: pass " + pass.name + " reads " + resource.name +
+                                             " before anything writes it");
+                }
+                VkPipelineStageFlags srcStages = resource.imported ? info.stages : 0;
+                for (ResourceId alias : resource.aliases) {
+                    if (mresources[alias].lastPass < static_cast<int32_t>(p)) {
+                        srcStages |= states[alias].writeStages | states[alias].readStages;
+                        barrier.srcAccess |= states[alias].writeAccess;
+                    }
+                }
+                if (srcStages == 0) {
+                    srcStages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+                }
+                pass.srcStages |= srcStages;
+                barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+                transition(state, info.layout, info.stages, accessMask, access.write);
+                if (!resource.imported) {
+                    firstUses.push_back(FirstUse{p, mbarriers.size(), access.resource});
+                }
+            } else if (state.layout != info.layout || access.write) {
+                pass.srcStages |= state.writeStages | state.readStages;
+                barrier.srcAccess = state.writeAccess;
+                transition(state, info.layout, info.stages, accessMask, access.write);
+            } else if ((info.stages & ~state.visibleStages) || (accessMask & ~state.visibleAccess)) {
+                pass.srcStages |= state.writeStages;
+                barrier.srcAccess = state.writeAccess;
+                state.visibleStages |= info.stages;
+                state.visibleAccess |= accessMask;
+                state.readStages |= info.stages;
+            } else {
+                state.readStages |= info.stages;
+                continue;
+            }
+            pass.dstStages |= info.stages;
+            mbarriers.push_back(barrier);
+        }
+        pass.barrierCount = static_cast<uint32_t>(mbarriers.size()) - pass.firstBarrier;
+    }
+
+    for (const FirstUse& use : firstUses) {
+        const Resource& resource = mresources[use.resource];
+        for (size_t r = 0; r < mresources.size(); r++) {
+            const Resource& other = mresources[r];
+            bool memoryOverlaps = !other.imported && states[r].touched && other.heap == resource.heap &&
+                                  resource.offset < other.offset + other.size &&
+                                  other.offset < resource.offset + resource.size;
+            if (memoryOverlaps) {
+                mpasses[use.pass].srcStages |= states[r].writeStages | states[r].readStages;
+                mbarriers[use.barrier].srcAccess |= states[r].writeAccess;
+            }
+        }
+    }
+
+    mfinalFirstBarrier = static_cast<uint32_t>(mbarriers.size());
+    mfinalSrcStages = 0;
+    mfinalDstStages = 0;
+    for (size_t r = 0; r < mresources.size(); r++) {
+        const Resource& resource = mresources[r];
+        const State& state = states[r];
+        if (!resource.imported || !state.touched) {
+            continue;
+        }
+        AccessInfo info = accessInfo(resource.finalAccess);
+        VkAccessFlags accessMask = info.writeAccess != 0 ? info.writeAccess : info.readAccess;
+        mbarriers.push_back(Barrier{static_cast<ResourceId>(r), state.layout, info.layout, state.writeAccess,
+                                    accessMask});
+        mfinalSrcStages |= state.writeStages | state.readStages;
+        mfinalDstStages |= info.stages;
+    }
+    mfinalBarrierCount = static_cast<uint32_t>(mbarriers.size()) - mfinalFirstBarrier;
+}
+
+void RenderGraph::execute(VkCommandBuffer commandBuffer) {
+    auto recordBarriers = [&](uint32_t first, uint32_t count, VkPipelineStageFlags srcStages,
+                              VkPipelineStageFlags dstStages) {
+        for (uint32_t i = 0; i < count; i++) {
+            const Barrier& barrier = mbarriers[first + i];
+            const Resource& resource = mresources[barrier.resource];
+            VkImageMemoryBarrier& imageBarrier = mscratch[i];
+            imageBarrier = {};
+            imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+            imageBarrier.srcAccessMask = barrier.srcAccess;
+            imageBarrier.dstAccessMask = barrier.dstAccess;
+            imageBarrier.oldLayout = barrier.oldLayout;
+            imageBarrier.newLayout = barrier.newLayout;
+            imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            imageBarrier.image = resource.image;
+            imageBarrier.subresourceRange.aspectMask = aspectMask(resource.usage);
+            imageBarrier.subresourceRange.levelCount = 1;
+            imageBarrier.subresourceRange.layerCount = 1;
+        }
+        vkCmdPipelineBarrier(commandBuffer, srcStages, dstStages, 0, 0, nullptr, 0, nullptr, count, mscratch.data());
+    };
+
+    for (Pass& pass : mpasses) {
+        if (pass.culled) {
+            continue;
+        }
+        if (pass.barrierCount > 0) {
+            recordBarriers(pass.firstBarrier, pass.barrierCount, pass.srcStages, pass.dstStages);
+        }
+        pass.record(commandBuffer, *this);
+    }
+    if (mfinalBarrierCount > 0) {
+        recordBarriers(mfinalFirstBarrier, mfinalBarrierCount, mfinalSrcStages, mfinalDstStages);
+    }
+}
+
+void RenderGraph::releasePhysical() {
+    for (Resource& resource : mresources) {
+        if (resource.imported) {
+            continue;
+        }
+        if (resource.view != VK_NULL_HANDLE) {
+            mdeletionQueue->retire(resource.view);
+            resource.view = VK_NULL_HANDLE;
+        }
+        if (resource.image != VK_NULL_HANDLE) {
+            GpuAllocation none;
+            mdeletionQueue->retireImage(resource.image, none);
+        }
+    }
+    for (GpuAllocation& heap : mheaps) {
+        mdeletionQueue->retireAllocation(heap);
+    }
+    mheaps.clear();
+}
+
+void RenderGraph::printReport() const {
+    printf("Render graph: %u passes, %u culled, %u image barriers in %u batches per frame \n", mstats.passes,
+           mstats.culledPasses, mstats.imageBarriers, mstats.barrierBatches);
+    printf("Render graph: %u transient images, peak transient memory %.2f MiB (%.2f MiB without aliasing) \n",
+           mstats.transientImages, mstats.peakTransientBytes / (1024.0 * 1024.0),
+           mstats.transientBytes / (1024.0 * 1024.0));
+}
@@ -0,0 +1,178 @@
+#ifndef VULKAN_BASIC_SAMPLES_RENDERGRAPH_H
+#define VULKAN_BASIC_SAMPLES_RENDERGRAPH_H
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "GpuAllocator.h"
+
+class DeletionQueue;
+
+/* How a pass touches an image; each maps to one layout, stage mask and access mask */
+enum class RenderAccess {
+    ColorAttachment,
+    DepthAttachment,
+    SampledFragment,
+    SampledCompute,
+    StorageCompute,
+    TransferSrc,
+    TransferDst,
+};
+
+/*
+ * Frame graph over images. Passes declare which images they read and write
+ * and record their commands in a callback. compile() does all of the
+ * analysis once, and execute() replays the result every frame without
+ * allocating.
+ *
+ * compile() steps:
+ * - Culling: a pass survives only if an imported image (the frame's output)
+ *   depends on what it writes.
+ * - Barriers: each surviving pass gets at most one vkCmdPipelineBarrier. It
+ *   holds every layout transition and hazard for the pass, with the stage
+ *   masks merged. A read in the layout and at the stages an earlier barrier
+ *   already made the image visible to needs no barrier.
+ * - Aliasing: each transient image lives from its first to its last
+ *   surviving use. Images whose lifetimes do not overlap share memory. Each
+ *   memory type gets one allocation, and images are placed in it greedily,
+ *   largest first, at the lowest offset free for their lifetime. An image
+ *   that takes over memory from an earlier one starts from UNDEFINED, with
+ *   its first barrier waiting on the earlier image's last use.
+ * - Frames in flight: every frame uses the same transient images and memory.
+ *   Each transient's first barrier therefore also waits on the stages and
+ *   writes of the previous frame's last use of that memory, the final state
+ *   of every transient overlapping it, which orders the previous
+ *   submission's reads and writes before this frame overwrites them.
+ *
+ * Imported images start each frame in UNDEFINED: their contents are
+ * discarded. Any semaphore the frame waits on for them must cover the stage
+ * of their first use. After the last pass, each one moves to the state its
+ * final access names, for whatever records after the graph. Recompiling,
+ * for example after a resize, hands the previous images and memory to the
+ * deletion queue, so frames still in flight keep them.
+ */
+class RenderGraph {
+public:
+    typedef uint32_t ResourceId;
+    typedef uint32_t PassId;
+    typedef std::function<void(VkCommandBuffer, const RenderGraph&)> Record;
+
+    struct Stats {
+        uint32_t passes = 0;
+        uint32_t culledPasses = 0;
+        uint32_t transientImages = 0;
+        /* Sum of the transient images' sizes, as if none were aliased */
+        VkDeviceSize transientBytes = 0;
+        /* Memory actually allocated for them */
+        VkDeviceSize peakTransientBytes = 0;
+        uint32_t imageBarriers = 0;
+        uint32_t barrierBatches = 0;
+    };
+
+    void init(VkDevice device, GpuAllocator& allocator, DeletionQueue& deletionQueue);
+    /* Retires the transient images and their memory */
+    void destroy();
+
+    /* Drops every pass and resource; the next compile() starts from scratch */
+    void clear();
+
+    ResourceId importImage(const char* name, VkFormat format, VkExtent2D extent, RenderAccess finalAccess);
+    /* Binds the imported image for the frames recorded from now on */
+    void setImportedImage(ResourceId resource, VkImage image, VkImageView view);
+    ResourceId createImage(const char* name, VkFormat format, VkExtent2D extent);
+
+    PassId addPass(const char* name, Record record);
+    void read(PassId pass, ResourceId resource, RenderAccess access);
+    void write(PassId pass, ResourceId resource, RenderAccess access);
+
+    /* Throws when a pass reads an image nothing wrote or a transient's format is unsupported */
+    void compile();
+    void execute(VkCommandBuffer commandBuffer);
+
+    VkImage image(ResourceId resource) const { return mresources[resource].image; }
+    VkImageView view(ResourceId resource) const { return mresources[resource].view; }
+    VkExtent2D extent(ResourceId resource) const { return mresources[resource].extent; }
+    VkFormat format(ResourceId resource) const { return mresources[resource].format; }
+    static VkImageLayout layout(RenderAccess access);
+
+    const Stats& stats() const { return mstats; }
+    void printReport() const;
+
+private:
+    struct Access {
+        ResourceId resource;
+        RenderAccess access;
+        bool write;
+    };
+
+    struct Pass {
+        std::string name;
+        Record record;
+        std::vector<Access> accesses;
+        bool culled = false;
+        /* Range in mbarriers executed before the pass */
+        uint32_t firstBarrier = 0;
+        uint32_t barrierCount = 0;
+        VkPipelineStageFlags srcStages = 0;
+        VkPipelineStageFlags dstStages = 0;
+    };
+
+    struct Resource {
+        std::string name;
+        VkFormat format = VK_FORMAT_UNDEFINED;
+        VkExtent2D extent = {};
+        bool imported = false;
+        RenderAccess finalAccess = RenderAccess::ColorAttachment;
+        VkImageUsageFlags usage = 0;
+        /* First and last surviving pass that uses it, in declaration order */
+        int32_t firstPass = -1;
+        int32_t lastPass = -1;
+        /* Placement for transients */
+        uint32_t heap = 0;
+        VkDeviceSize offset = 0;
+        VkDeviceSize size = 0;
+        /* Transients whose memory this one takes over */
+        std::vector<ResourceId> aliases;
+        VkImage image = VK_NULL_HANDLE;
+        VkImageView view = VK_NULL_HANDLE;
+    };
+
+    /* A compiled barrier; the image is looked up at execute() so imports can change per frame */
+    struct Barrier {
+        ResourceId resource;
+        VkImageLayout oldLayout;
+        VkImageLayout newLayout;
+        VkAccessFlags srcAccess;
+        VkAccessFlags dstAccess;
+    };
+
+    void cull();
+    void createTransients();
+    void placeTransients(std::vector<VkMemoryRequirements>& requirements);
+    void computeBarriers();
+    void releasePhysical();
+
+    VkDevice mdevice = VK_NULL_HANDLE;
+    GpuAllocator* mallocator = nullptr;
+    DeletionQueue* mdeletionQueue = nullptr;
+
+    std::vector<Pass> mpasses;
+    std::vector<Resource> mresources;
+    std::vector<GpuAllocation> mheaps;
+
+    std::vector<Barrier> mbarriers;
+    /* Trailing transitions of imported images into their final state */
+    uint32_t mfinalFirstBarrier = 0;
+    uint32_t mfinalBarrierCount = 0;
+    VkPipelineStageFlags mfinalSrcStages = 0;
+    VkPipelineStageFlags mfinalDstStages = 0;
+
+    std::vector<VkImageMemoryBarrier> mscratch;
+    Stats mstats;
+};
+
+#endif //VULKAN_BASIC_SAMPLES_RENDERGRAPH_H
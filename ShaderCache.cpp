@@ -0,0 +1,359 @@
+#include "ShaderCache.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <fstream>
+#include <set>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <spawn.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "JobSystem.h"
+#include "Log.h"
+#include "Trace.h"
+
+extern char** environ;
+
+namespace {
+    const uint64_t FNV_OFFSET_BASIS = 0xcbf29ce484222325ull;
+    const uint64_t FNV_PRIME = 0x100000001b3ull;
+    /* How often the watcher checks for destroy() while no events arrive */
+    const int WATCH_POLL_MS = 100;
+
+    uint64_t fnv1a(uint64_t hash, const void* data, size_t size) {
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < size; i++) {
+            hash = (hash ^ bytes[i]) * FNV_PRIME;
+        }
+        return hash;
+    }
+
+    bool readSource(const std::string& path, std::string& contents) {
+        std::ifstream file(path, std::ios::binary);
+        if (!file.is_open()) {
+            return false;
+        }
+        contents.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        return true;
+    }
+
+    std::string directoryOf(const std::string& path) {
+        size_t slash = path.find_last_of('/');
+        return slash == std::string::npos ? "." : path.substr(0, slash);
+    }
+
+    std::string fileNameOf(const std::string& path) {
+        size_t slash = path.find_last_of('/');
+        return slash == std::string::npos ? path : path.substr(slash + 1);
+    }
+}
+
+MappedFile::~MappedFile() {
+    if (mdata != nullptr) {
+        munmap(mdata, msize);
+    }
+}
+
+bool MappedFile::open(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0) {
+        close(fd);
+        return false;
+    }
+    void* data = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return false;
+    }
+    mdata = data;
+    msize = static_cast<size_t>(info.st_size);
+    return true;
+}
+
+ShaderCache::ShaderCache()
+    : mpendingJobs(0), mstopWatching(false), mhits(0), mcompiled(0), mprebuilt(0), mtemporaryCounter(0) {
+}
+
+ShaderCache::~ShaderCache() {
+    destroy();
+}
+
+void ShaderCache::init(const std::string& cacheDirectory, const std::string& compiler, unsigned workerCount) {
+    mcacheDirectory = cacheDirectory;
+    mcompiler = compiler;
+    if (mkdir(cacheDirectory.c_str(), 0755) != 0 && errno != EEXIST) {
+        LOG_WARNING(LOG_PIPELINE, "Cannot create shader cache directory %s, compiling to prebuilt SPIR-V only",
+                    cacheDirectory.c_str());
+    }
+
+    /* get() waits on a condition variable rather than helping, so there must be at least one worker */
+    if (workerCount == 0) {
+        unsigned hardwareThreads = std::thread::hardware_concurrency();
+        workerCount = hardwareThreads > 2 ? hardwareThreads - 1 : 1;
+    }
+    mjobs.reset(new JobSystem(workerCount));
+}
+
+void ShaderCache::destroy() {
+    if (mwatcher.joinable()) {
+        mstopWatching = true;
+        mwatcher.join();
+    }
+    if (minotify >= 0) {
+        close(minotify);
+        minotify = -1;
+    }
+    if (mjobs) {
+        mjobs->wait(mpendingJobs);
+        mjobs.reset();
+    }
+}
+
+ShaderCache::ShaderId ShaderCache::add(const std::string& sourcePath, const std::string& spirvPath) {
+    ShaderId shader;
+    {
+        std::lock_guard<std::mutex> lock(mmutex);
+        std::unique_ptr<Entry> entry(new Entry());
+        entry->sourcePath = sourcePath;
+        entry->spirvPath = spirvPath;
+        shader = static_cast<ShaderId>(mentries.size());
+        mentries.push_back(std::move(entry));
+    }
+    mjobs->submit([this, shader](unsigned) { load(shader, false); }, mpendingJobs);
+    return shader;
+}
+
+SpirvBlob ShaderCache::get(ShaderId shader) {
+    std::unique_lock<std::mutex> lock(mmutex);
+    Entry& entry = *mentries[shader];
+    mloaded.wait(lock, [&entry] { return entry.state != STATE_LOADING; });
+    if (entry.state == STATE_FAILED) {
+        throw std::runtime_error(entry.error);
+    }
+    return entry.blob;
+}
+
+std::vector<ShaderCache::ShaderId> ShaderCache::takeReloaded() {
+    std::lock_guard<std::mutex> lock(mmutex);
+    std::vector<ShaderId> reloaded;
+    reloaded.swap(mreloaded);
+    return reloaded;
+}
+
+/* Runs on the job system; never throws, failures are recorded on the entry */
+void ShaderCache::load(ShaderId shader, bool reload) {
+    TRACE_SCOPE(reload ? "reloadShader" : "loadShader", "shaders");
+
+    std::string sourcePath;
+    std::string spirvPath;
+    uint64_t previousHash;
+    {
+        std::lock_guard<std::mutex> lock(mmutex);
+        sourcePath = mentries[shader]->sourcePath;
+        spirvPath = mentries[shader]->spirvPath;
+        previousHash = mentries[shader]->hash;
+    }
+
+    SpirvBlob blob;
+    uint64_t hash = 0;
+    std::string error;
+    std::string source;
+    if (readSource(sourcePath, source)) {
+        std::string extension = sourcePath.substr(sourcePath.find_last_of('.') + 1);
+        hash = fnv1a(FNV_OFFSET_BASIS, mcompiler.c_str(), mcompiler.size() + 1);
+        hash = fnv1a(hash, extension.c_str(), extension.size() + 1);
+        hash = fnv1a(hash, source.data(), source.size());
+
+        if (reload && hash == previousHash) {
+            /* Touched without a content change */
+        } else {
+            char name[32];
+            snprintf(name, sizeof(name), "/%016llx.spv", static_cast<unsigned long long>(hash));
+            std::shared_ptr<MappedFile> cached = std::make_shared<MappedFile>();
+            if (cached->open(mcacheDirectory + name)) {
+                blob = cached;
+                mhits++;
+            } else {
+                try {
+                    blob = compile(sourcePath, hash);
+                    mcompiled++;
+                } catch (const std::exception& e) {
+                    error = e.what();
+                }
+            }
+        }
+    } else if (reload) {
+        /* Deleted or mid-rename; the next event for the file triggers another reload */
+        error = "Cannot read " + sourcePath;
+    }
+
+    if (!blob && !reload) {
+        std::shared_ptr<MappedFile> prebuilt = std::make_shared<MappedFile>();
+        if (prebuilt->open(spirvPath)) {
+            if (!error.empty()) {
+                LOG_WARNING(LOG_PIPELINE, "%s, using prebuilt %s", error.c_str(), spirvPath.c_str());
+            }
+            blob = prebuilt;
+            mprebuilt++;
+        } else {
+            error = "Failed to load shader " + spirvPath;
+        }
+    }
+
+    bool reloadAgain = false;
+    {
+        std::lock_guard<std::mutex> lock(mmutex);
+        Entry& entry = *mentries[shader];
+        if (!reload) {
+            entry.state = blob ? STATE_READY : STATE_FAILED;
+            entry.error = error;
+            entry.blob = blob;
+            entry.hash = hash;
+        } else {
+            if (blob) {
+                entry.blob = blob;
+                entry.hash = hash;
+                mreloaded.push_back(shader);
+            } else if (!error.empty()) {
+                LOG_WARNING(LOG_PIPELINE, "Hot reload of %s failed, keeping the previous SPIR-V: %s",
+                            sourcePath.c_str(), error.c_str());
+            }
+            reloadAgain = entry.reloadQueued;
+            entry.reloadQueued = false;
+            entry.reloading = reloadAgain;
+        }
+    }
+    mloaded.notify_all();
+
+    if (reloadAgain) {
+        mjobs->submit([this, shader](unsigned) { load(shader, true); }, mpendingJobs);
+    }
+}
+
+SpirvBlob ShaderCache::compile(const std::string& sourcePath, uint64_t hash) {
+    char name[64];
+    snprintf(name, sizeof(name), "/%016llx.spv", static_cast<unsigned long long>(hash));
+    std::string outputPath = mcacheDirectory + name;
+    snprintf(name, sizeof(name), ".%d.%u.tmp", static_cast<int>(getpid()), mtemporaryCounter.fetch_add(1));
+    std::string temporaryPath = outputPath + name;
+
+    std::vector<char*> argv;
+    std::string arguments[] = {mcompiler, "-V", sourcePath, "-o", temporaryPath};
+    for (std::string& argument : arguments) {
+        argv.push_back(&argument[0]);
+    }
+    argv.push_back(nullptr);
+
+    pid_t pid;
+    if (posix_spawnp(&pid, mcompiler.c_str(), nullptr, nullptr, argv.data(), environ) != 0) {
+        throw std::runtime_error("Cannot run shader compiler " + mcompiler);
+    }
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+    }
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        unlink(temporaryPath.c_str());
+        throw std::runtime_error("Failed to compile " + sourcePath);
+    }
+    if (rename(temporaryPath.c_str(), outputPath.c_str()) != 0) {
+        unlink(temporaryPath.c_str());
+        throw std::runtime_error("Failed to write " + outputPath);
+    }
+
+    std::shared_ptr<MappedFile> compiled = std::make_shared<MappedFile>();
+    if (!compiled->open(outputPath)) {
+        throw std::runtime_error("Failed to map " + outputPath);
+    }
+    return compiled;
+}
+
+void ShaderCache::watch() {
+    minotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (minotify < 0) {
+        throw std::runtime_error("Failed to initialise inotify for shader hot reload");
+    }
+
+    std::set<std::string> directories;
+    {
+        std::lock_guard<std::mutex> lock(mmutex);
+        for (const auto& entry : mentries) {
+            directories.insert(directoryOf(entry->sourcePath));
+        }
+    }
+    /* Editors either rewrite the file in place or rename a new one over it */
+    for (const std::string& directory : directories) {
+        int watch = inotify_add_watch(minotify, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+        if (watch < 0) {
+            throw std::runtime_error("Failed to watch shader directory " + directory);
+        }
+        mwatchDirectories[watch] = directory;
+    }
+
+    mstopWatching = false;
+    mwatcher = std::thread(&ShaderCache::watchLoop, this);
+    printf("Watching %zu shader directories for changes \n", directories.size());
+}
+
+void ShaderCache::watchLoop() {
+    Trace::setThreadName("shaderWatcher");
+    alignas(struct inotify_event) char buffer[4096];
+
+    while (!mstopWatching) {
+        pollfd descriptor = {};
+        descriptor.fd = minotify;
+        descriptor.events = POLLIN;
+        if (poll(&descriptor, 1, WATCH_POLL_MS) <= 0) {
+            continue;
+        }
+
+        ssize_t length = read(minotify, buffer, sizeof(buffer));
+        for (ssize_t offset = 0; offset < length;) {
+            const inotify_event* event = reinterpret_cast<const inotify_event*>(buffer + offset);
+            offset += sizeof(inotify_event) + event->len;
+            if (event->len == 0) {
+                continue;
+            }
+            auto directory = mwatchDirectories.find(event->wd);
+            if (directory == mwatchDirectories.end()) {
+                continue;
+            }
+
+            std::vector<ShaderId> changed;
+            {
+                std::lock_guard<std::mutex> lock(mmutex);
+                for (ShaderId shader = 0; shader < mentries.size(); shader++) {
+                    Entry& entry = *mentries[shader];
+                    if (directoryOf(entry.sourcePath) != directory->second ||
+                        fileNameOf(entry.sourcePath) != event->name || entry.state != STATE_READY) {
+                        continue;
+                    }
+                    if (entry.reloading) {
+                        entry.reloadQueued = true;
+                    } else {
+                        entry.reloading = true;
+                        changed.push_back(shader);
+                    }
+                }
+            }
+            for (ShaderId shader : changed) {
+                mjobs->submit([this, shader](unsigned) { load(shader, true); }, mpendingJobs);
+            }
+        }
+    }
+}
+
+void ShaderCache::printStats() const {
+    printf("Shaders: %u from cache, %u compiled, %u prebuilt \n", mhits.load(), mcompiled.load(), mprebuilt.load());
+}
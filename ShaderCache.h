@@ -0,0 +1,126 @@
+#ifndef VULKAN_BASIC_SAMPLES_SHADERCACHE_H
+#define VULKAN_BASIC_SAMPLES_SHADERCACHE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class JobSystem;
+
+/* Read-only mapping of a whole file; the data is page-aligned, as SPIR-V words need */
+class MappedFile {
+public:
+    MappedFile() {}
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    /* Returns false if the file cannot be opened or is empty */
+    bool open(const std::string& path);
+
+    const void* data() const { return mdata; }
+    size_t size() const { return msize; }
+
+private:
+    void* mdata = nullptr;
+    size_t msize = 0;
+};
+
+typedef std::shared_ptr<const MappedFile> SpirvBlob;
+
+/*
+ * SPIR-V for each registered shader, loaded in the background.
+ *
+ * add() queues the shader on the cache's own job system and returns at
+ * once; get() blocks only until that shader is ready. When the GLSL source
+ * is present, it is hashed (FNV-1a 64, with the compiler path) and the
+ * SPIR-V is mapped from <cache directory>/<hash>.spv. On a miss the
+ * compiler writes that file first, through a temporary file and rename(), so
+ * concurrent runs never map a partial blob. Without the source, or if the
+ * compiler cannot be run, the prebuilt .spv from the Makefile is mapped
+ * instead. #include directives are not followed, so only the top-level
+ * file is part of the key.
+ *
+ * watch() starts an inotify thread on the source directories. A source that
+ * is written or renamed into place is recompiled in the background. If its
+ * hash changed and it compiled, the new blob replaces the old one and the
+ * shader is reported by takeReloaded(). Compile errors are printed and the
+ * previous blob stays current.
+ */
+class ShaderCache {
+public:
+    typedef uint32_t ShaderId;
+
+    ShaderCache();
+    ~ShaderCache();
+    ShaderCache(const ShaderCache&) = delete;
+    ShaderCache& operator=(const ShaderCache&) = delete;
+
+    /* compiler is run as "<compiler> -V <source> -o <output>", looked up in PATH */
+    void init(const std::string& cacheDirectory, const std::string& compiler, unsigned workerCount);
+    /* Waits for outstanding loads and stops the watcher */
+    void destroy();
+
+    /* Ids are handed out in order, starting at 0 */
+    ShaderId add(const std::string& sourcePath, const std::string& spirvPath);
+    /* Blocks until the shader's first load finishes; throws if it failed */
+    SpirvBlob get(ShaderId shader);
+
+    void watch();
+    /* Shaders whose blob was replaced by a reload since the last call */
+    std::vector<ShaderId> takeReloaded();
+
+    void printStats() const;
+
+private:
+    enum State {
+        STATE_LOADING,
+        STATE_READY,
+        STATE_FAILED
+    };
+
+    struct Entry {
+        std::string sourcePath;
+        std::string spirvPath;
+        State state = STATE_LOADING;
+        std::string error;
+        SpirvBlob blob;
+        uint64_t hash = 0;
+        /* A reload job is queued or running; another change while it runs sets reloadQueued */
+        bool reloading = false;
+        bool reloadQueued = false;
+    };
+
+    void load(ShaderId shader, bool reload);
+    SpirvBlob compile(const std::string& sourcePath, uint64_t hash);
+    void watchLoop();
+
+    std::string mcacheDirectory;
+    std::string mcompiler;
+    std::unique_ptr<JobSystem> mjobs;
+    std::atomic<size_t> mpendingJobs;
+
+    mutable std::mutex mmutex;
+    std::condition_variable mloaded;
+    std::vector<std::unique_ptr<Entry>> mentries;
+    std::vector<ShaderId> mreloaded;
+
+    int minotify = -1;
+    std::map<int, std::string> mwatchDirectories;
+    std::thread mwatcher;
+    std::atomic<bool> mstopWatching;
+
+    std::atomic<uint32_t> mhits;
+    std::atomic<uint32_t> mcompiled;
+    std::atomic<uint32_t> mprebuilt;
+    std::atomic<uint32_t> mtemporaryCounter;
+};
+
+#endif //VULKAN_BASIC_SAMPLES_SHADERCACHE_H
@@ -0,0 +1,113 @@
+#include "TaskGraph.h"
+#include "Trace.h"
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+TaskGraph::TaskId TaskGraph::add(const char* name, Task task, const std::vector<TaskId>& dependencies,
+                                 bool mainThread) {
+    TaskId id = mnodes.size();
+    Node node;
+    node.name = name;
+    node.task = task;
+    node.pendingDependencies = dependencies.size();
+    node.mainThread = mainThread;
+    mnodes.push_back(node);
+
+    for (TaskId dependency : dependencies) {
+        if (dependency >= id) {
+            throw std::logic_error("TaskGraph dependencies must be added before their dependents");
+        }
+        mnodes[dependency].dependents.push_back(id);
+    }
+    return id;
+}
+
+void TaskGraph::run(unsigned workerCount) {
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<TaskId> ready;
+    std::deque<TaskId> readyMain;
+    size_t remaining = mnodes.size();
+    size_t running = 0;
+    std::exception_ptr failure;
+
+    for (TaskId id = 0; id < mnodes.size(); id++) {
+        if (mnodes[id].pendingDependencies == 0) {
+            (mnodes[id].mainThread ? readyMain : ready).push_back(id);
+        }
+    }
+
+    /* Returns false once there is nothing left this thread could ever run */
+    auto runOne = [&](bool isMainThread) -> bool {
+        std::unique_lock<std::mutex> lock(mutex);
+        for (;;) {
+            bool done = remaining == 0 || (failure && running == 0);
+            if (done) {
+                wake.notify_all();
+                return false;
+            }
+            if (!failure) {
+                if (isMainThread && !readyMain.empty()) {
+                    break;
+                }
+                if (!ready.empty()) {
+                    break;
+                }
+            }
+            wake.wait(lock);
+        }
+
+        std::deque<TaskId>& queue = (isMainThread && !readyMain.empty()) ? readyMain : ready;
+        TaskId id = queue.front();
+        queue.pop_front();
+        running++;
+        lock.unlock();
+
+        std::exception_ptr error;
+        {
+            TraceScope scope(mnodes[id].name, "init");
+            try {
+                mnodes[id].task();
+            } catch (...) {
+                error = std::current_exception();
+            }
+        }
+
+        lock.lock();
+        running--;
+        remaining--;
+        if (error && !failure) {
+            failure = error;
+        }
+        for (TaskId dependent : mnodes[id].dependents) {
+            if (--mnodes[dependent].pendingDependencies == 0) {
+                (mnodes[dependent].mainThread ? readyMain : ready).push_back(dependent);
+            }
+        }
+        wake.notify_all();
+        return true;
+    };
+
+    std::vector<std::thread> workers;
+    for (unsigned i = 0; i < workerCount; i++) {
+        workers.push_back(std::thread([&runOne]() {
+            Trace::setThreadName("init worker");
+            while (runOne(false)) {
+            }
+        }));
+    }
+    while (runOne(true)) {
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    if (failure) {
+        std::rethrow_exception(failure);
+    }
+}
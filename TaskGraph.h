@@ -0,0 +1,41 @@
+#ifndef VULKAN_BASIC_SAMPLES_TASKGRAPH_H
+#define VULKAN_BASIC_SAMPLES_TASKGRAPH_H
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+/*
+ * One-shot dependency graph for initialisation. A task runs once all of its
+ * dependencies have finished; independent tasks run concurrently on a few
+ * short-lived worker threads. Tasks marked mainThread (GLFW window calls)
+ * only ever run on the thread that calls run(), which also executes other
+ * ready tasks while it waits.
+ *
+ * The first exception thrown by a task stops new tasks from starting and is
+ * rethrown from run() once the running ones have finished. Every task is
+ * recorded as a trace scope under the "init" category.
+ */
+class TaskGraph {
+public:
+    typedef size_t TaskId;
+    typedef std::function<void()> Task;
+
+    TaskId add(const char* name, Task task, const std::vector<TaskId>& dependencies = std::vector<TaskId>(),
+               bool mainThread = false);
+
+    void run(unsigned workerCount);
+
+private:
+    struct Node {
+        const char* name;
+        Task task;
+        std::vector<TaskId> dependents;
+        size_t pendingDependencies;
+        bool mainThread;
+    };
+
+    std::vector<Node> mnodes;
+};
+
+#endif //VULKAN_BASIC_SAMPLES_TASKGRAPH_H
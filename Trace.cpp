@@ -0,0 +1,169 @@
+#include "Trace.h"
+#include "Log.h"
+
+#include <atomic>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct TraceEvent {
+    const char* name;
+    const char* category;
+    int64_t startUs;
+    int64_t durationUs;
+    uint32_t pid;
+    uint32_t tid;
+};
+
+const uint32_t CPU_PID = 1;
+const uint32_t GPU_PID = 2;
+
+struct TraceState {
+    /* Initialised with the other globals, before main() runs */
+    Trace::Clock::time_point processStart = Trace::Clock::now();
+    std::atomic<bool> enabled{false};
+    std::string path;
+    std::mutex mutex;
+    std::vector<TraceEvent> events;
+    std::map<std::thread::id, uint32_t> threadIds;
+    std::map<uint32_t, std::string> threadNames;
+    std::map<std::string, uint32_t> tracks;
+};
+
+TraceState& state() {
+    static TraceState traceState;
+    return traceState;
+}
+
+/* Force construction during static initialisation so processStart is early */
+TraceState& gforceInit = state();
+
+int64_t microseconds(Trace::Clock::time_point time) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(time - state().processStart).count();
+}
+
+/* Call with the mutex held */
+uint32_t threadIndex(TraceState& s) {
+    auto it = s.threadIds.find(std::this_thread::get_id());
+    if (it != s.threadIds.end()) {
+        return it->second;
+    }
+    uint32_t index = static_cast<uint32_t>(s.threadIds.size());
+    s.threadIds[std::this_thread::get_id()] = index;
+    return index;
+}
+
+void writeEscaped(FILE* file, const std::string& text) {
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            fputc('\\', file);
+        }
+        fputc(c, file);
+    }
+}
+
+}
+
+void Trace::enable(const std::string& path) {
+    TraceState& s = state();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    s.path = path;
+    s.events.reserve(4096);
+    s.enabled = true;
+}
+
+bool Trace::enabled() {
+    return state().enabled.load(std::memory_order_relaxed);
+}
+
+void Trace::setThreadName(const char* name) {
+    TraceState& s = state();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    s.threadNames[threadIndex(s)] = name;
+}
+
+void Trace::complete(const char* name, const char* category, Clock::time_point start, Clock::time_point end) {
+    TraceState& s = state();
+    TraceEvent event;
+    event.name = name;
+    event.category = category;
+    event.startUs = microseconds(start);
+    event.durationUs = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+
+    std::lock_guard<std::mutex> lock(s.mutex);
+    event.pid = CPU_PID;
+    event.tid = threadIndex(s);
+    s.events.push_back(event);
+}
+
+void Trace::completeOnTrack(const char* name, const char* category, const char* track, int64_t startUs,
+                            int64_t durationUs) {
+    TraceState& s = state();
+    TraceEvent event;
+    event.name = name;
+    event.category = category;
+    event.startUs = startUs;
+    event.durationUs = durationUs;
+    event.pid = GPU_PID;
+
+    std::lock_guard<std::mutex> lock(s.mutex);
+    auto it = s.tracks.find(track);
+    if (it == s.tracks.end()) {
+        it = s.tracks.insert(std::make_pair(std::string(track), static_cast<uint32_t>(s.tracks.size()))).first;
+    }
+    event.tid = it->second;
+    s.events.push_back(event);
+}
+
+int64_t Trace::toTraceMicroseconds(Clock::time_point time) {
+    return microseconds(time);
+}
+
+double Trace::sinceProcessStartMs() {
+    std::chrono::duration<double, std::milli> elapsed = Clock::now() - state().processStart;
+    return elapsed.count();
+}
+
+void Trace::write() {
+    TraceState& s = state();
+    if (!s.enabled) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(s.mutex);
+    FILE* file = fopen(s.path.c_str(), "w");
+    if (file == nullptr) {
+        LOG_WARNING(LOG_GENERAL, "Failed to open trace file %s", s.path.c_str());
+        return;
+    }
+
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%u,\"args\":{\"name\":\"CPU\"}},\n", CPU_PID);
+    fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%u,\"args\":{\"name\":\"GPU\"}}", GPU_PID);
+    for (const auto& thread : s.threadNames) {
+        fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%u,\"tid\":%u,\"args\":{\"name\":\"",
+                CPU_PID, thread.first);
+        writeEscaped(file, thread.second);
+        fprintf(file, "\"}}");
+    }
+    for (const auto& track : s.tracks) {
+        fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%u,\"tid\":%u,\"args\":{\"name\":\"",
+                GPU_PID, track.second);
+        writeEscaped(file, track.first);
+        fprintf(file, "\"}}");
+    }
+    for (const auto& event : s.events) {
+        fprintf(file, ",\n{\"name\":\"");
+        writeEscaped(file, event.name);
+        fprintf(file, "\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%lld,\"dur\":%lld,\"pid\":%u,\"tid\":%u}",
+                event.category, (long long) event.startUs, (long long) event.durationUs, event.pid, event.tid);
+    }
+    fprintf(file, "\n]}\n");
+    fclose(file);
+
+    printf("Wrote %zu trace events to %s \n", s.events.size(), s.path.c_str());
+}
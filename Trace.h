@@ -0,0 +1,69 @@
+#ifndef VULKAN_BASIC_SAMPLES_TRACE_H
+#define VULKAN_BASIC_SAMPLES_TRACE_H
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+/*
+ * Collects timed events and writes them as Chrome trace JSON
+ * (chrome://tracing, Perfetto). Recording is off until enable() is called,
+ * in which case a scope costs one clock read and one branch. Timestamps are
+ * microseconds since process start, so the trace also shows how long the
+ * process ran before main().
+ */
+class Trace {
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    static void enable(const std::string& path);
+    static bool enabled();
+
+    /* Writes the trace file; safe to call when disabled */
+    static void write();
+
+    /* Names the calling thread in the trace viewer */
+    static void setThreadName(const char* name);
+
+    static void complete(const char* name, const char* category, Clock::time_point start, Clock::time_point end);
+
+    /*
+     * Event with explicit timestamps on a named track of the "GPU" process,
+     * for work timed by the device rather than the calling thread.
+     */
+    static void completeOnTrack(const char* name, const char* category, const char* track, int64_t startUs,
+                                int64_t durationUs);
+
+    /* Microseconds since process start, the trace timebase */
+    static int64_t toTraceMicroseconds(Clock::time_point time);
+
+    /* Milliseconds between process start and now */
+    static double sinceProcessStartMs();
+};
+
+class TraceScope {
+public:
+    TraceScope(const char* name, const char* category)
+        : mname(name), mcategory(category), mstart(Trace::enabled() ? Trace::Clock::now() : Trace::Clock::time_point()) {
+    }
+
+    ~TraceScope() {
+        if (Trace::enabled()) {
+            Trace::complete(mname, mcategory, mstart, Trace::Clock::now());
+        }
+    }
+
+private:
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+    const char* mname;
+    const char* mcategory;
+    Trace::Clock::time_point mstart;
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+#define TRACE_SCOPE(name, category) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name, category)
+
+#endif //VULKAN_BASIC_SAMPLES_TRACE_H
@@ -0,0 +1,414 @@
+#include "TransformSystem.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include "JobSystem.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define TRANSFORM_SYSTEM_X86 1
+#else
+#define TRANSFORM_SYSTEM_X86 0
+#endif
+
+namespace {
+    /* Nodes per SIMD batch in the streams; also the padding granularity */
+    const size_t BATCH_NODES = 8;
+    /* Below this many nodes per chunk a pass is not worth handing to the job system */
+    const size_t MIN_NODES_PER_CHUNK = 4096;
+
+    size_t chunkCountFor(JobSystem* jobs, size_t count) {
+        if (jobs == nullptr || count < 2 * MIN_NODES_PER_CHUNK) {
+            return 1;
+        }
+        return std::min(static_cast<size_t>(jobs->threadCount()), count / MIN_NODES_PER_CHUNK);
+    }
+
+    void runChunks(JobSystem* jobs, size_t count, size_t chunkCount, const JobSystem::RangeJob& job) {
+        if (chunkCount <= 1) {
+            job(0, count, 0, 0);
+        } else {
+            jobs->parallelFor(count, chunkCount, job);
+        }
+    }
+
+    /*
+     * Local matrix of one node from its TRS components, written as rows 0-2
+     * of a column-major matrix: M = T * R(q) * S.
+     */
+    void composeLocalScalar(const float* const* in, float* const* out, size_t i) {
+        float x = in[3][i], y = in[4][i], z = in[5][i], w = in[6][i];
+        float sx = in[7][i], sy = in[8][i], sz = in[9][i];
+        float xx = x * x, yy = y * y, zz = z * z;
+        float xy = x * y, xz = x * z, yz = y * z;
+        float wx = w * x, wy = w * y, wz = w * z;
+
+        out[0][i] = (1.0f - 2.0f * (yy + zz)) * sx;
+        out[1][i] = 2.0f * (xy + wz) * sx;
+        out[2][i] = 2.0f * (xz - wy) * sx;
+        out[3][i] = 2.0f * (xy - wz) * sy;
+        out[4][i] = (1.0f - 2.0f * (xx + zz)) * sy;
+        out[5][i] = 2.0f * (yz + wx) * sy;
+        out[6][i] = 2.0f * (xz + wy) * sz;
+        out[7][i] = 2.0f * (yz - wx) * sz;
+        out[8][i] = (1.0f - 2.0f * (xx + yy)) * sz;
+        out[9][i] = in[0][i];
+        out[10][i] = in[1][i];
+        out[11][i] = in[2][i];
+    }
+
+#if TRANSFORM_SYSTEM_X86
+    void composeLocalsSse(const float* const* in, float* const* out, size_t i) {
+        const __m128 one = _mm_set1_ps(1.0f);
+        const __m128 two = _mm_set1_ps(2.0f);
+        __m128 x = _mm_load_ps(in[3] + i), y = _mm_load_ps(in[4] + i);
+        __m128 z = _mm_load_ps(in[5] + i), w = _mm_load_ps(in[6] + i);
+        __m128 sx = _mm_load_ps(in[7] + i), sy = _mm_load_ps(in[8] + i), sz = _mm_load_ps(in[9] + i);
+        __m128 xx = _mm_mul_ps(x, x), yy = _mm_mul_ps(y, y), zz = _mm_mul_ps(z, z);
+        __m128 xy = _mm_mul_ps(x, y), xz = _mm_mul_ps(x, z), yz = _mm_mul_ps(y, z);
+        __m128 wx = _mm_mul_ps(w, x), wy = _mm_mul_ps(w, y), wz = _mm_mul_ps(w, z);
+
+        _mm_store_ps(out[0] + i, _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))), sx));
+        _mm_store_ps(out[1] + i, _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xy, wz)), sx));
+        _mm_store_ps(out[2] + i, _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xz, wy)), sx));
+        _mm_store_ps(out[3] + i, _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xy, wz)), sy));
+        _mm_store_ps(out[4] + i, _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))), sy));
+        _mm_store_ps(out[5] + i, _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(yz, wx)), sy));
+        _mm_store_ps(out[6] + i, _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xz, wy)), sz));
+        _mm_store_ps(out[7] + i, _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(yz, wx)), sz));
+        _mm_store_ps(out[8] + i, _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))), sz));
+        _mm_store_ps(out[9] + i, _mm_load_ps(in[0] + i));
+        _mm_store_ps(out[10] + i, _mm_load_ps(in[1] + i));
+        _mm_store_ps(out[11] + i, _mm_load_ps(in[2] + i));
+    }
+
+    __attribute__((target("avx2,fma")))
+    void composeLocalsAvx2(const float* const* in, float* const* out, size_t i) {
+        const __m256 one = _mm256_set1_ps(1.0f);
+        const __m256 two = _mm256_set1_ps(2.0f);
+        __m256 x = _mm256_load_ps(in[3] + i), y = _mm256_load_ps(in[4] + i);
+        __m256 z = _mm256_load_ps(in[5] + i), w = _mm256_load_ps(in[6] + i);
+        __m256 sx = _mm256_load_ps(in[7] + i), sy = _mm256_load_ps(in[8] + i), sz = _mm256_load_ps(in[9] + i);
+        __m256 xx = _mm256_mul_ps(x, x), yy = _mm256_mul_ps(y, y), zz = _mm256_mul_ps(z, z);
+        __m256 xy = _mm256_mul_ps(x, y), xz = _mm256_mul_ps(x, z), yz = _mm256_mul_ps(y, z);
+        __m256 wx = _mm256_mul_ps(w, x), wy = _mm256_mul_ps(w, y), wz = _mm256_mul_ps(w, z);
+
+        _mm256_store_ps(out[0] + i, _mm256_mul_ps(_mm256_fnmadd_ps(two, _mm256_add_ps(yy, zz), one), sx));
+        _mm256_store_ps(out[1] + i, _mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(xy, wz)), sx));
+        _mm256_store_ps(out[2] + i, _mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(xz, wy)), sx));
+        _mm256_store_ps(out[3] + i, _mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(xy, wz)), sy));
+        _mm256_store_ps(out[4] + i, _mm256_mul_ps(_mm256_fnmadd_ps(two, _mm256_add_ps(xx, zz), one), sy));
+        _mm256_store_ps(out[5] + i, _mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(yz, wx)), sy));
+        _mm256_store_ps(out[6] + i, _mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(xz, wy)), sz));
+        _mm256_store_ps(out[7] + i, _mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(yz, wx)), sz));
+        _mm256_store_ps(out[8] + i, _mm256_mul_ps(_mm256_fnmadd_ps(two, _mm256_add_ps(xx, yy), one), sz));
+        _mm256_store_ps(out[9] + i, _mm256_load_ps(in[0] + i));
+        _mm256_store_ps(out[10] + i, _mm256_load_ps(in[1] + i));
+        _mm256_store_ps(out[11] + i, _mm256_load_ps(in[2] + i));
+    }
+
+    /* world = parent * local, one 4-float column at a time; local's row 3 is (0, 0, 0, 1) */
+    void composeWorldSse(const float* parent, const float* local, float* world) {
+        __m128 p0 = _mm_load_ps(parent), p1 = _mm_load_ps(parent + 4);
+        __m128 p2 = _mm_load_ps(parent + 8), p3 = _mm_load_ps(parent + 12);
+        for (int column = 0; column < 4; column++) {
+            const float* l = local + column * 3;
+            __m128 result = _mm_add_ps(_mm_add_ps(_mm_mul_ps(p0, _mm_set1_ps(l[0])),
+                                                  _mm_mul_ps(p1, _mm_set1_ps(l[1]))),
+                                       _mm_mul_ps(p2, _mm_set1_ps(l[2])));
+            _mm_store_ps(world + column * 4, column == 3 ? _mm_add_ps(result, p3) : result);
+        }
+    }
+
+    __attribute__((target("avx2,fma")))
+    void composeWorldFma(const float* parent, const float* local, float* world) {
+        __m128 p0 = _mm_load_ps(parent), p1 = _mm_load_ps(parent + 4);
+        __m128 p2 = _mm_load_ps(parent + 8), p3 = _mm_load_ps(parent + 12);
+        for (int column = 0; column < 4; column++) {
+            const float* l = local + column * 3;
+            __m128 result = _mm_fmadd_ps(p2, _mm_set1_ps(l[2]), column == 3 ? p3 : _mm_setzero_ps());
+            result = _mm_fmadd_ps(p1, _mm_set1_ps(l[1]), result);
+            result = _mm_fmadd_ps(p0, _mm_set1_ps(l[0]), result);
+            _mm_store_ps(world + column * 4, result);
+        }
+    }
+#endif
+
+    void composeWorldScalar(const float* parent, const float* local, float* world) {
+        for (int column = 0; column < 4; column++) {
+            const float* l = local + column * 3;
+            for (int row = 0; row < 4; row++) {
+                float sum = parent[row] * l[0] + parent[4 + row] * l[1] + parent[8 + row] * l[2];
+                world[column * 4 + row] = column == 3 ? sum + parent[12 + row] : sum;
+            }
+        }
+    }
+
+    void writeMatrix(const float* source, float* destination, bool stream) {
+#if TRANSFORM_SYSTEM_X86
+        /* Non-temporal stores: the destination is usually write-combined memory the CPU never reads back */
+        if (stream) {
+            for (int column = 0; column < 4; column++) {
+                _mm_stream_ps(destination + column * 4, _mm_load_ps(source + column * 4));
+            }
+            return;
+        }
+#endif
+        memcpy(destination, source, 16 * sizeof(float));
+    }
+}
+
+const TransformSystem::Node TransformSystem::INVALID_NODE;
+const int TransformSystem::LOCAL_STREAM_COUNT;
+
+TransformSystem::TransformSystem() : msimdPath(detectSimdPath()) {
+}
+
+TransformSystem::SimdPath TransformSystem::detectSimdPath() {
+#if TRANSFORM_SYSTEM_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        return SIMD_AVX2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return SIMD_SSE;
+    }
+#endif
+    return SIMD_SCALAR;
+}
+
+const char* TransformSystem::simdPathName(SimdPath path) {
+    switch (path) {
+        case SIMD_AVX2: return "avx2";
+        case SIMD_SSE: return "sse";
+        default: return "scalar";
+    }
+}
+
+void TransformSystem::reserve(size_t count) {
+    size_t padded = (count + BATCH_NODES - 1) / BATCH_NODES * BATCH_NODES;
+    for (auto& stream : minputs) {
+        stream.reserve(padded);
+    }
+    for (auto& stream : mlocals) {
+        stream.reserve(padded);
+    }
+    mworlds.reserve(count * 16);
+    mlocalDirty.reserve(padded);
+    mworldChanged.reserve(count);
+    mworldVersions.reserve(count);
+    mparents.reserve(count);
+    mdepths.reserve(count);
+}
+
+TransformSystem::Node TransformSystem::create(Node parent) {
+    if (parent != INVALID_NODE && parent >= mparents.size()) {
+        throw std::runtime_error("Transform parent does not exist");
+    }
+    Node node = static_cast<Node>(mparents.size());
+
+    if (node == mstreamCapacity) {
+        mstreamCapacity += BATCH_NODES;
+        for (auto& stream : minputs) {
+            stream.resize(mstreamCapacity, 0.0f);
+        }
+        for (auto& stream : mlocals) {
+            stream.resize(mstreamCapacity, 0.0f);
+        }
+        mlocalDirty.resize(mstreamCapacity, 0);
+    }
+    minputs[ROTATION_W][node] = 1.0f;
+    minputs[SCALE_X][node] = minputs[SCALE_Y][node] = minputs[SCALE_Z][node] = 1.0f;
+    mlocalDirty[node] = 1;
+
+    mworlds.resize(mworlds.size() + 16, 0.0f);
+    mworldChanged.push_back(0);
+    mworldVersions.push_back(0);
+    mparents.push_back(parent);
+    mdepths.push_back(parent == INVALID_NODE ? 0 : mdepths[parent] + 1);
+    mlevelsDirty = true;
+    return node;
+}
+
+void TransformSystem::setPosition(Node node, float x, float y, float z) {
+    minputs[POSITION_X][node] = x;
+    minputs[POSITION_Y][node] = y;
+    minputs[POSITION_Z][node] = z;
+    mlocalDirty[node] = 1;
+}
+
+void TransformSystem::setRotation(Node node, float x, float y, float z, float w) {
+    minputs[ROTATION_X][node] = x;
+    minputs[ROTATION_Y][node] = y;
+    minputs[ROTATION_Z][node] = z;
+    minputs[ROTATION_W][node] = w;
+    mlocalDirty[node] = 1;
+}
+
+void TransformSystem::setScale(Node node, float x, float y, float z) {
+    minputs[SCALE_X][node] = x;
+    minputs[SCALE_Y][node] = y;
+    minputs[SCALE_Z][node] = z;
+    mlocalDirty[node] = 1;
+}
+
+/* Counting sort by depth; within a level nodes stay in index order */
+void TransformSystem::buildLevels() {
+    uint32_t levelCount = 0;
+    for (uint32_t depth : mdepths) {
+        levelCount = std::max(levelCount, depth + 1);
+    }
+    mlevelStarts.assign(levelCount + 1, 0);
+    for (uint32_t depth : mdepths) {
+        mlevelStarts[depth + 1]++;
+    }
+    for (uint32_t level = 0; level < levelCount; level++) {
+        mlevelStarts[level + 1] += mlevelStarts[level];
+    }
+    std::vector<size_t> cursor(mlevelStarts.begin(), mlevelStarts.end() - 1);
+    mlevelNodes.resize(mparents.size());
+    for (Node node = 0; node < mparents.size(); node++) {
+        mlevelNodes[cursor[mdepths[node]]++] = node;
+    }
+    mlevelsDirty = false;
+}
+
+/* [begin, end) are multiples of BATCH_NODES */
+size_t TransformSystem::composeLocals(size_t begin, size_t end) {
+    const float* in[INPUT_STREAM_COUNT];
+    for (int s = 0; s < INPUT_STREAM_COUNT; s++) {
+        in[s] = minputs[s].data();
+    }
+    float* out[LOCAL_STREAM_COUNT];
+    for (int s = 0; s < LOCAL_STREAM_COUNT; s++) {
+        out[s] = mlocals[s].data();
+    }
+
+    size_t composed = 0;
+    for (size_t i = begin; i < end; i += BATCH_NODES) {
+        uint64_t dirty;
+        memcpy(&dirty, mlocalDirty.data() + i, sizeof(dirty));
+        if (dirty == 0) {
+            continue;
+        }
+        switch (msimdPath) {
+#if TRANSFORM_SYSTEM_X86
+            case SIMD_AVX2:
+                composeLocalsAvx2(in, out, i);
+                composed += BATCH_NODES;
+                break;
+            case SIMD_SSE:
+                for (size_t half = i; half < i + BATCH_NODES; half += 4) {
+                    uint32_t halfDirty;
+                    memcpy(&halfDirty, mlocalDirty.data() + half, sizeof(halfDirty));
+                    if (halfDirty != 0) {
+                        composeLocalsSse(in, out, half);
+                        composed += 4;
+                    }
+                }
+                break;
+#endif
+            default:
+                for (size_t node = i; node < i + BATCH_NODES; node++) {
+                    if (mlocalDirty[node]) {
+                        composeLocalScalar(in, out, node);
+                        composed++;
+                    }
+                }
+                break;
+        }
+    }
+    return composed;
+}
+
+void TransformSystem::composeWorlds(const Node* nodes, size_t count, float* destination, uint64_t destinationVersion,
+                                    UpdateStats& stats) {
+    bool x86 = TRANSFORM_SYSTEM_X86 && msimdPath != SIMD_SCALAR;
+    for (size_t n = 0; n < count; n++) {
+        Node node = nodes[n];
+        Node parent = mparents[node];
+        bool changed = mlocalDirty[node] || (parent != INVALID_NODE && mworldChanged[parent]);
+        float* world = &mworlds[static_cast<size_t>(node) * 16];
+
+        if (changed) {
+            float local[LOCAL_STREAM_COUNT];
+            for (int s = 0; s < LOCAL_STREAM_COUNT; s++) {
+                local[s] = mlocals[s][node];
+            }
+            if (parent == INVALID_NODE) {
+                for (int column = 0; column < 4; column++) {
+                    world[column * 4 + 0] = local[column * 3 + 0];
+                    world[column * 4 + 1] = local[column * 3 + 1];
+                    world[column * 4 + 2] = local[column * 3 + 2];
+                    world[column * 4 + 3] = column == 3 ? 1.0f : 0.0f;
+                }
+            } else {
+                const float* parentWorld = &mworlds[static_cast<size_t>(parent) * 16];
+#if TRANSFORM_SYSTEM_X86
+                if (msimdPath == SIMD_AVX2) {
+                    composeWorldFma(parentWorld, local, world);
+                } else if (msimdPath == SIMD_SSE) {
+                    composeWorldSse(parentWorld, local, world);
+                } else
+#endif
+                {
+                    composeWorldScalar(parentWorld, local, world);
+                }
+            }
+            mworldVersions[node] = mversion;
+            stats.worldsComposed++;
+        }
+        mworldChanged[node] = changed;
+        mlocalDirty[node] = 0;
+
+        if (destination != nullptr && mworldVersions[node] > destinationVersion) {
+            writeMatrix(world, destination + static_cast<size_t>(node) * 16, x86);
+            stats.matricesWritten++;
+        }
+    }
+#if TRANSFORM_SYSTEM_X86
+    if (x86) {
+        _mm_sfence();
+    }
+#endif
+}
+
+TransformSystem::UpdateStats TransformSystem::update(JobSystem* jobs, float* destination,
+                                                     uint64_t& destinationVersion) {
+    UpdateStats stats;
+    if (mlevelsDirty) {
+        buildLevels();
+    }
+    mversion++;
+
+    size_t batchCount = mstreamCapacity / BATCH_NODES;
+    size_t chunkCount = chunkCountFor(jobs, mstreamCapacity);
+    std::vector<size_t> composed(chunkCount, 0);
+    runChunks(jobs, batchCount, chunkCount, [&](size_t begin, size_t end, size_t chunk, unsigned) {
+        composed[chunk] = composeLocals(begin * BATCH_NODES, end * BATCH_NODES);
+    });
+    for (size_t count : composed) {
+        stats.localsComposed += count;
+    }
+
+    /* Levels run in order so every parent's world matrix is final before its children read it */
+    std::vector<UpdateStats> chunkStats;
+    for (size_t level = 0; level + 1 < mlevelStarts.size(); level++) {
+        const Node* nodes = mlevelNodes.data() + mlevelStarts[level];
+        size_t count = mlevelStarts[level + 1] - mlevelStarts[level];
+        chunkCount = chunkCountFor(jobs, count);
+        chunkStats.assign(chunkCount, UpdateStats());
+        runChunks(jobs, count, chunkCount, [&](size_t begin, size_t end, size_t chunk, unsigned) {
+            composeWorlds(nodes + begin, end - begin, destination, destinationVersion, chunkStats[chunk]);
+        });
+        for (const UpdateStats& chunk : chunkStats) {
+            stats.worldsComposed += chunk.worldsComposed;
+            stats.matricesWritten += chunk.matricesWritten;
+        }
+    }
+
+    destinationVersion = mversion;
+    return stats;
+}
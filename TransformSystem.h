@@ -0,0 +1,143 @@
+#ifndef VULKAN_BASIC_SAMPLES_TRANSFORMSYSTEM_H
+#define VULKAN_BASIC_SAMPLES_TRANSFORMSYSTEM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+class JobSystem;
+
+/* std::vector storage aligned to a cache line, so SIMD loads and streams never split one */
+template <typename T>
+struct CacheAlignedAllocator {
+    typedef T value_type;
+    static const size_t ALIGNMENT = 64;
+
+    CacheAlignedAllocator() {}
+    template <typename U>
+    CacheAlignedAllocator(const CacheAlignedAllocator<U>&) {}
+
+    T* allocate(size_t count) {
+        void* memory = nullptr;
+        if (posix_memalign(&memory, ALIGNMENT, count * sizeof(T)) != 0) {
+            throw std::bad_alloc();
+        }
+        return static_cast<T*>(memory);
+    }
+    void deallocate(T* memory, size_t) { free(memory); }
+};
+
+template <typename T, typename U>
+bool operator==(const CacheAlignedAllocator<T>&, const CacheAlignedAllocator<U>&) { return true; }
+template <typename T, typename U>
+bool operator!=(const CacheAlignedAllocator<T>&, const CacheAlignedAllocator<U>&) { return false; }
+
+template <typename T>
+using AlignedVector = std::vector<T, CacheAlignedAllocator<T>>;
+
+/*
+ * Scene node transforms in structure-of-arrays form: position, rotation
+ * (quaternion) and scale components each live in their own 64-byte-aligned
+ * stream, indexed by node.
+ *
+ * update() runs in two passes. The first recomposes the local TRS matrix of
+ * every locally dirty node, eight (AVX2) or four (SSE) nodes at a time
+ * straight from the streams, and skips whole batches whose dirty flags are
+ * all clear. The second walks the hierarchy one depth level at a time,
+ * spread over the job system in chunks, multiplying each changed local
+ * matrix by its parent's world matrix. A world matrix is recomputed only
+ * when the node or one of its ancestors was dirty.
+ *
+ * World matrices are column-major mat4s, one per 64-byte line. update()
+ * streams each one into the caller's destination (typically one frame's
+ * region of a persistently mapped buffer) if it changed since that
+ * destination was last written, which the caller tracks with a version.
+ */
+class TransformSystem {
+public:
+    typedef uint32_t Node;
+    static const Node INVALID_NODE = ~0u;
+
+    enum SimdPath {
+        SIMD_SCALAR,
+        SIMD_SSE,
+        SIMD_AVX2
+    };
+
+    struct UpdateStats {
+        /* Nodes whose local matrix was rebuilt, including clean ones sharing a SIMD batch with dirty ones */
+        size_t localsComposed = 0;
+        size_t worldsComposed = 0;
+        size_t matricesWritten = 0;
+    };
+
+    TransformSystem();
+
+    /* Best path the CPU supports; AVX2 is chosen at run time, the build needs no -mavx2 */
+    static SimdPath detectSimdPath();
+    static const char* simdPathName(SimdPath path);
+    void setSimdPath(SimdPath path) { msimdPath = path; }
+    SimdPath simdPath() const { return msimdPath; }
+
+    void reserve(size_t count);
+    /* A parent must already exist, so parents always precede their children */
+    Node create(Node parent = INVALID_NODE);
+    size_t size() const { return mparents.size(); }
+    Node parent(Node node) const { return mparents[node]; }
+
+    void setPosition(Node node, float x, float y, float z);
+    /* Unit quaternion */
+    void setRotation(Node node, float x, float y, float z, float w);
+    void setScale(Node node, float x, float y, float z);
+
+    /* 16 floats, column-major; valid after update() */
+    const float* world(Node node) const { return &mworlds[static_cast<size_t>(node) * 16]; }
+
+    /*
+     * Recomposes dirty nodes and writes every world matrix newer than
+     * destinationVersion to destination (size() * 16 floats, 16-byte
+     * aligned, may be null), then sets destinationVersion to the current
+     * version. Start a destination at version 0 to have it fully written.
+     * jobs may be null to run on the calling thread.
+     */
+    UpdateStats update(JobSystem* jobs, float* destination, uint64_t& destinationVersion);
+
+private:
+    enum Stream {
+        POSITION_X, POSITION_Y, POSITION_Z,
+        ROTATION_X, ROTATION_Y, ROTATION_Z, ROTATION_W,
+        SCALE_X, SCALE_Y, SCALE_Z,
+        INPUT_STREAM_COUNT
+    };
+    /* Rows 0-2 of the local matrix, column-major; row 3 is always (0, 0, 0, 1) */
+    static const int LOCAL_STREAM_COUNT = 12;
+
+    void buildLevels();
+    size_t composeLocals(size_t begin, size_t end);
+    void composeWorlds(const Node* nodes, size_t count, float* destination, uint64_t destinationVersion,
+                       UpdateStats& stats);
+
+    SimdPath msimdPath;
+
+    /* Streams are padded to a multiple of 8 nodes so SIMD batches never need a tail */
+    size_t mstreamCapacity = 0;
+    AlignedVector<float> minputs[INPUT_STREAM_COUNT];
+    AlignedVector<float> mlocals[LOCAL_STREAM_COUNT];
+    AlignedVector<float> mworlds;
+    AlignedVector<uint8_t> mlocalDirty;
+    std::vector<uint8_t> mworldChanged;
+    std::vector<uint64_t> mworldVersions;
+    std::vector<Node> mparents;
+
+    /* Nodes sorted by depth; level i is mlevelNodes[mlevelStarts[i], mlevelStarts[i + 1]) */
+    bool mlevelsDirty = false;
+    std::vector<Node> mlevelNodes;
+    std::vector<size_t> mlevelStarts;
+    std::vector<uint32_t> mdepths;
+
+    uint64_t mversion = 0;
+};
+
+#endif //VULKAN_BASIC_SAMPLES_TRANSFORMSYSTEM_H
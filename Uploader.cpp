@@ -0,0 +1,359 @@
+#include "Uploader.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+#include "HostAllocator.h"
+
+/* Everything that may read uploaded data on the graphics queue */
+static const VkPipelineStageFlags UPLOAD_CONSUMER_STAGES =
+        VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT |
+        VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT |
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+static const VkAccessFlags UPLOAD_CONSUMER_ACCESS =
+        VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT |
+        VK_ACCESS_UNIFORM_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+
+/* Staging offsets are kept 16 byte aligned, enough for any texel block copied here */
+static const VkDeviceSize STAGING_ALIGNMENT = 16;
+
+typedef std::chrono::steady_clock Clock;
+typedef std::chrono::duration<double> Seconds;
+
+const uint32_t Uploader::BATCH_COUNT;
+
+void Uploader::init(GpuAllocator& allocator, VkDevice device, VkQueue transferQueue, uint32_t transferFamily,
+                    uint32_t graphicsFamily, VkDeviceSize stagingSize) {
+    mallocator = &allocator;
+    mdevice = device;
+    mtransferQueue = transferQueue;
+    mtransferFamily = transferFamily;
+    mgraphicsFamily = graphicsFamily;
+    mstagingSize = stagingSize;
+
+    VkBufferCreateInfo bufferInfo = {};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = stagingSize;
+    bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    allocator.createBuffer(bufferInfo, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                           mstaging, mstagingAllocation);
+
+    mbatches.resize(BATCH_COUNT);
+    for (auto& batch : mbatches) {
+        VkCommandPoolCreateInfo poolInfo = {};
+        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+        poolInfo.queueFamilyIndex = transferFamily;
+        if (vkCreateCommandPool(device, &poolInfo, HostAllocator::callbacks(), &batch.commandPool) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create upload command pool");
+        }
+
+        VkCommandBufferAllocateInfo allocInfo = {};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.commandPool = batch.commandPool;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandBufferCount = 1;
+        if (vkAllocateCommandBuffers(device, &allocInfo, &batch.commandBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to allocate upload command buffer");
+        }
+
+        VkFenceCreateInfo fenceInfo = {};
+        fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+        if (vkCreateFence(device, &fenceInfo, HostAllocator::callbacks(), &batch.fence) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create upload fence");
+        }
+    }
+}
+
+void Uploader::destroy() {
+    flush();
+    while (retireOldest(true)) {
+    }
+
+    for (auto& batch : mbatches) {
+        vkDestroyFence(mdevice, batch.fence, HostAllocator::callbacks());
+        vkDestroyCommandPool(mdevice, batch.commandPool, HostAllocator::callbacks());
+    }
+    mbatches.clear();
+    mallocator->destroyBuffer(mstaging, mstagingAllocation);
+}
+
+Uploader::Batch& Uploader::recordingBatch() {
+    if (mhasRecording) {
+        return mbatches[mrecording];
+    }
+
+    /* All batches in flight: the one about to be reused is the oldest, wait for it */
+    Batch& batch = mbatches[mnext];
+    if (batch.state == BatchState::Submitted) {
+        retireOldest(true);
+    }
+
+    vkResetCommandPool(mdevice, batch.commandPool, 0);
+
+    VkCommandBufferBeginInfo beginInfo = {};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkBeginCommandBuffer(batch.commandBuffer, &beginInfo);
+
+    if (mprofiler != nullptr) {
+        mprofiler->beginSlot(batch.commandBuffer, static_cast<uint32_t>(mnext));
+        batch.profileScope = mprofiler->beginScope(batch.commandBuffer, "upload");
+    }
+
+    batch.state = BatchState::Recording;
+    batch.ticket = mnextTicket++;
+    batch.stagingBytes = 0;
+    batch.bytes = 0;
+
+    mrecording = mnext;
+    mnext = (mnext + 1) % mbatches.size();
+    mhasRecording = true;
+    return batch;
+}
+
+VkDeviceSize Uploader::reserveStaging(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& consumed) {
+    if (size > mstagingSize) {
+        throw std::runtime_error("Upload larger than the staging ring");
+    }
+
+    for (;;) {
+        VkDeviceSize start = (mhead + alignment - 1) / alignment * alignment;
+        if (start + size > mstagingSize) {
+            /* Skip the tail end of the ring, the padding is released with this batch */
+            start = 0;
+            consumed = mstagingSize - mhead + size;
+        } else {
+            consumed = start - mhead + size;
+        }
+
+        if (minFlight + consumed <= mstagingSize) {
+            mhead = start + size;
+            minFlight += consumed;
+            return start;
+        }
+
+        /* Ring full: submit what has been recorded and block on the oldest batch */
+        flush();
+        if (!retireOldest(true)) {
+            throw std::runtime_error("Staging ring exhausted with nothing in flight");
+        }
+    }
+}
+
+Uploader::Ticket Uploader::uploadBuffer(VkBuffer dst, VkDeviceSize dstOffset, const void* data, VkDeviceSize size) {
+    const char* src = static_cast<const char*>(data);
+    Ticket ticket = 0;
+
+    /* Anything larger than half the ring is streamed in pieces so batches can overlap */
+    VkDeviceSize maxChunk = mstagingSize / 2;
+    while (size > 0) {
+        VkDeviceSize chunk = std::min(size, maxChunk);
+        memcpy(stageBuffer(dst, dstOffset, chunk, ticket), src, chunk);
+        src += chunk;
+        dstOffset += chunk;
+        size -= chunk;
+    }
+    return ticket;
+}
+
+void* Uploader::stageBuffer(VkBuffer dst, VkDeviceSize dstOffset, VkDeviceSize size, Ticket& ticket) {
+    if (size > mstagingSize / 2) {
+        throw std::runtime_error("Staged copy larger than half the staging ring");
+    }
+    VkDeviceSize consumed;
+    VkDeviceSize stagingOffset = reserveStaging(size, STAGING_ALIGNMENT, consumed);
+
+    Batch& batch = recordingBatch();
+    batch.stagingBytes += consumed;
+    batch.bytes += size;
+    ticket = batch.ticket;
+
+    VkBufferCopy region = {};
+    region.srcOffset = stagingOffset;
+    region.dstOffset = dstOffset;
+    region.size = size;
+    vkCmdCopyBuffer(batch.commandBuffer, mstaging, dst, 1, &region);
+
+    VkBufferMemoryBarrier release = {};
+    release.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    release.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    release.buffer = dst;
+    release.offset = dstOffset;
+    release.size = size;
+    if (ownershipTransfer()) {
+        release.dstAccessMask = 0;
+        release.srcQueueFamilyIndex = mtransferFamily;
+        release.dstQueueFamilyIndex = mgraphicsFamily;
+
+        VkBufferMemoryBarrier acquire = release;
+        acquire.srcAccessMask = 0;
+        acquire.dstAccessMask = UPLOAD_CONSUMER_ACCESS;
+        batch.bufferAcquires.push_back(acquire);
+    } else {
+        release.dstAccessMask = UPLOAD_CONSUMER_ACCESS;
+        release.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        release.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    }
+    batch.bufferReleases.push_back(release);
+
+    return static_cast<char*>(mstagingAllocation.mapped) + stagingOffset;
+}
+
+Uploader::Ticket Uploader::uploadImage(VkImage dst, VkExtent3D extent, VkImageAspectFlags aspect, const void* data,
+                                       VkDeviceSize size, VkImageLayout finalLayout) {
+    VkDeviceSize consumed;
+    VkDeviceSize stagingOffset = reserveStaging(size, STAGING_ALIGNMENT, consumed);
+    memcpy(static_cast<char*>(mstagingAllocation.mapped) + stagingOffset, data, size);
+
+    Batch& batch = recordingBatch();
+    batch.stagingBytes += consumed;
+    batch.bytes += size;
+
+    VkImageMemoryBarrier toTransfer = {};
+    toTransfer.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    toTransfer.srcAccessMask = 0;
+    toTransfer.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    toTransfer.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    toTransfer.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    toTransfer.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    toTransfer.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    toTransfer.image = dst;
+    toTransfer.subresourceRange.aspectMask = aspect;
+    toTransfer.subresourceRange.levelCount = 1;
+    toTransfer.subresourceRange.layerCount = 1;
+    vkCmdPipelineBarrier(batch.commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                         0, nullptr, 0, nullptr, 1, &toTransfer);
+
+    VkBufferImageCopy region = {};
+    region.bufferOffset = stagingOffset;
+    region.imageSubresource.aspectMask = aspect;
+    region.imageSubresource.layerCount = 1;
+    region.imageExtent = extent;
+    vkCmdCopyBufferToImage(batch.commandBuffer, mstaging, dst, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+    VkImageMemoryBarrier release = toTransfer;
+    release.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    release.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    release.newLayout = finalLayout;
+    if (ownershipTransfer()) {
+        release.dstAccessMask = 0;
+        release.srcQueueFamilyIndex = mtransferFamily;
+        release.dstQueueFamilyIndex = mgraphicsFamily;
+
+        VkImageMemoryBarrier acquire = release;
+        acquire.srcAccessMask = 0;
+        acquire.dstAccessMask = UPLOAD_CONSUMER_ACCESS;
+        batch.imageAcquires.push_back(acquire);
+    } else {
+        release.dstAccessMask = UPLOAD_CONSUMER_ACCESS;
+    }
+    batch.imageReleases.push_back(release);
+
+    return batch.ticket;
+}
+
+void Uploader::flush() {
+    if (!mhasRecording) {
+        return;
+    }
+
+    Batch& batch = mbatches[mrecording];
+    if (!batch.bufferReleases.empty() || !batch.imageReleases.empty()) {
+        /* A release only needs to be ordered after the copies, the acquire side does the rest */
+        VkPipelineStageFlags dstStage = ownershipTransfer()
+                ? static_cast<VkPipelineStageFlags>(VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT)
+                : UPLOAD_CONSUMER_STAGES;
+        vkCmdPipelineBarrier(batch.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, dstStage, 0, 0, nullptr,
+                             static_cast<uint32_t>(batch.bufferReleases.size()), batch.bufferReleases.data(),
+                             static_cast<uint32_t>(batch.imageReleases.size()), batch.imageReleases.data());
+    }
+    if (mprofiler != nullptr) {
+        mprofiler->endScope(batch.commandBuffer, batch.profileScope);
+    }
+    vkEndCommandBuffer(batch.commandBuffer);
+
+    VkSubmitInfo submitInfo = {};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &batch.commandBuffer;
+    if (vkQueueSubmit(mtransferQueue, 1, &submitInfo, batch.fence) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to submit upload batch");
+    }
+    if (mprofiler != nullptr) {
+        mprofiler->markSubmitted(static_cast<uint32_t>(mrecording));
+    }
+
+    batch.state = BatchState::Submitted;
+    if (msubmittedCount++ == 0) {
+        mbusyStart = Clock::now();
+    }
+    batch.bufferReleases.clear();
+    batch.imageReleases.clear();
+    mhasRecording = false;
+    mstats.batches++;
+}
+
+bool Uploader::retireOldest(bool wait) {
+    Batch& batch = mbatches[moldest];
+    if (batch.state != BatchState::Submitted) {
+        return false;
+    }
+
+    if (wait) {
+        Clock::time_point start = Clock::now();
+        vkWaitForFences(mdevice, 1, &batch.fence, VK_TRUE, std::numeric_limits<uint64_t>::max());
+        mstats.stallSeconds += Seconds(Clock::now() - start).count();
+    } else if (vkGetFenceStatus(mdevice, batch.fence) != VK_SUCCESS) {
+        return false;
+    }
+
+    if (--msubmittedCount == 0) {
+        mstats.busySeconds += Seconds(Clock::now() - mbusyStart).count();
+    }
+    mstats.bytes += batch.bytes;
+
+    mbufferAcquires.insert(mbufferAcquires.end(), batch.bufferAcquires.begin(), batch.bufferAcquires.end());
+    mimageAcquires.insert(mimageAcquires.end(), batch.imageAcquires.begin(), batch.imageAcquires.end());
+    batch.bufferAcquires.clear();
+    batch.imageAcquires.clear();
+
+    vkResetFences(mdevice, 1, &batch.fence);
+    batch.state = BatchState::Free;
+    mcompletedTicket = batch.ticket;
+    moldest = (moldest + 1) % mbatches.size();
+
+    minFlight -= batch.stagingBytes;
+    if (minFlight == 0) {
+        mhead = 0;
+    }
+    return true;
+}
+
+void Uploader::collect() {
+    while (retireOldest(false)) {
+    }
+}
+
+void Uploader::takeAcquires(VkCommandBuffer graphicsCommands) {
+    if (mbufferAcquires.empty() && mimageAcquires.empty()) {
+        return;
+    }
+
+    vkCmdPipelineBarrier(graphicsCommands, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, UPLOAD_CONSUMER_STAGES, 0, 0, nullptr,
+                         static_cast<uint32_t>(mbufferAcquires.size()), mbufferAcquires.data(),
+                         static_cast<uint32_t>(mimageAcquires.size()), mimageAcquires.data());
+    mbufferAcquires.clear();
+    mimageAcquires.clear();
+}
+
+void Uploader::printStats() const {
+    double megabytes = mstats.bytes / (1024.0 * 1024.0);
+    printf("Uploads: %.2f MiB in %u batches, %.1f MiB/s, main thread stalled %.3f ms \n", megabytes,
+           mstats.batches, mstats.busySeconds > 0.0 ? megabytes / mstats.busySeconds : 0.0,
+           mstats.stallSeconds * 1000.0);
+}
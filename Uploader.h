@@ -0,0 +1,126 @@
+#ifndef VULKAN_BASIC_SAMPLES_UPLOADER_H
+#define VULKAN_BASIC_SAMPLES_UPLOADER_H
+
+#include <vulkan/vulkan.h>
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#include "GpuAllocator.h"
+#include "GpuProfiler.h"
+
+/*
+ * Asynchronous uploads through a persistently mapped staging ring on the
+ * transfer queue.
+ *
+ * Copies are batched into one command buffer until flush(). Every submitted
+ * batch signals a fence that collect() polls without blocking; once it has
+ * signalled, the batch's share of the staging ring is recycled and its
+ * resources are handed to the graphics queue. When the transfer queue is in
+ * another family each batch ends with queue-ownership release barriers and
+ * takeAcquires() records the matching acquire barriers in the next graphics
+ * command buffer. The render thread only ever blocks when the staging ring
+ * itself is full.
+ */
+class Uploader {
+public:
+    typedef uint64_t Ticket;
+
+    /* Command buffers cycled in ring order; also the slot count for a profiler */
+    static const uint32_t BATCH_COUNT = 8;
+
+    struct Stats {
+        uint64_t bytes = 0;
+        uint32_t batches = 0;
+        double busySeconds = 0.0;   // wall time with at least one batch in flight
+        double stallSeconds = 0.0;  // caller blocked waiting for staging space
+    };
+
+    void init(GpuAllocator& allocator, VkDevice device, VkQueue transferQueue, uint32_t transferFamily,
+              uint32_t graphicsFamily, VkDeviceSize stagingSize);
+    void destroy();
+
+    /* Times each batch on the transfer queue; slots are batch indices */
+    void setProfiler(GpuProfiler* profiler) { mprofiler = profiler; }
+
+    /* Both calls copy data into the staging ring immediately, the source can be freed on return */
+    Ticket uploadBuffer(VkBuffer dst, VkDeviceSize dstOffset, const void* data, VkDeviceSize size);
+    /*
+     * Reserves staging space for a copy into dst and returns where its bytes
+     * go, so a producer can decode straight into the ring. The bytes must be
+     * written before the next call on the uploader. At most half the ring.
+     */
+    void* stageBuffer(VkBuffer dst, VkDeviceSize dstOffset, VkDeviceSize size, Ticket& ticket);
+    Ticket uploadImage(VkImage dst, VkExtent3D extent, VkImageAspectFlags aspect, const void* data,
+                       VkDeviceSize size, VkImageLayout finalLayout);
+
+    /* Submits the batch being recorded, if any */
+    void flush();
+
+    /* Retires finished batches without blocking; call once per frame */
+    void collect();
+    bool isComplete(Ticket ticket) const { return ticket <= mcompletedTicket; }
+
+    /*
+     * Records acquire barriers for everything retired since the last call.
+     * Must run on the graphics queue before any use of those resources.
+     */
+    void takeAcquires(VkCommandBuffer graphicsCommands);
+
+    const Stats& stats() const { return mstats; }
+    void printStats() const;
+
+private:
+    enum class BatchState { Free, Recording, Submitted };
+
+    struct Batch {
+        VkCommandPool commandPool = VK_NULL_HANDLE;
+        VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+        VkFence fence = VK_NULL_HANDLE;
+        BatchState state = BatchState::Free;
+        Ticket ticket = 0;
+        VkDeviceSize stagingBytes = 0;  // ring bytes consumed, including alignment and wrap padding
+        uint64_t bytes = 0;
+        uint32_t profileScope = GpuProfiler::INVALID_SCOPE;
+        std::vector<VkBufferMemoryBarrier> bufferReleases;
+        std::vector<VkImageMemoryBarrier> imageReleases;
+        std::vector<VkBufferMemoryBarrier> bufferAcquires;
+        std::vector<VkImageMemoryBarrier> imageAcquires;
+    };
+
+    Batch& recordingBatch();
+    VkDeviceSize reserveStaging(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& consumed);
+    bool retireOldest(bool wait);
+    bool ownershipTransfer() const { return mtransferFamily != mgraphicsFamily; }
+
+    VkDevice mdevice = VK_NULL_HANDLE;
+    GpuAllocator* mallocator = nullptr;
+    GpuProfiler* mprofiler = nullptr;
+    VkQueue mtransferQueue = VK_NULL_HANDLE;
+    uint32_t mtransferFamily = 0;
+    uint32_t mgraphicsFamily = 0;
+
+    VkBuffer mstaging = VK_NULL_HANDLE;
+    GpuAllocation mstagingAllocation;
+    VkDeviceSize mstagingSize = 0;
+    VkDeviceSize mhead = 0;        // next free byte of the ring
+    VkDeviceSize minFlight = 0;    // bytes owned by recording or submitted batches
+
+    /* Used in ring order: moldest is the oldest batch not yet retired, mnext the next to record */
+    std::vector<Batch> mbatches;
+    size_t moldest = 0;
+    size_t mnext = 0;
+    size_t mrecording = 0;
+    bool mhasRecording = false;
+    size_t msubmittedCount = 0;
+    std::chrono::steady_clock::time_point mbusyStart;
+    Ticket mnextTicket = 1;
+    Ticket mcompletedTicket = 0;
+
+    std::vector<VkBufferMemoryBarrier> mbufferAcquires;
+    std::vector<VkImageMemoryBarrier> mimageAcquires;
+    Stats mstats;
+};
+
+#endif //VULKAN_BASIC_SAMPLES_UPLOADER_H
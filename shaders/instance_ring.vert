@@ -0,0 +1,29 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+layout(location = 0) in vec2 inPosition;
+layout(location = 1) in vec3 inColor;
+
+/* InstanceData from the frame's region of the InstanceRing, one element per instance */
+layout(location = 2) in vec4 inTransform0;
+layout(location = 3) in vec4 inTransform1;
+layout(location = 4) in vec4 inTransform2;
+layout(location = 5) in vec4 inInstanceColor;
+layout(location = 6) in uint inMaterial;
+
+/* Written per frame into the frame transient buffer, bound at that frame's dynamic offset */
+layout(set = 0, binding = 0) uniform Camera {
+    mat4 viewProjection;
+} camera;
+
+layout(location = 0) out vec3 fragColor;
+
+/* Stand-in materials: each index scales the instance colour differently */
+const vec3 MATERIAL_TINTS[4] = vec3[](vec3(1.0), vec3(1.0, 0.6, 0.6), vec3(0.6, 1.0, 0.6), vec3(0.6, 0.6, 1.0));
+
+void main() {
+    vec4 local = vec4(inPosition, 0.0, 1.0);
+    vec3 world = vec3(dot(inTransform0, local), dot(inTransform1, local), dot(inTransform2, local));
+    gl_Position = camera.viewProjection * vec4(world, 1.0);
+    fragColor = inColor * inInstanceColor.rgb * MATERIAL_TINTS[inMaterial & 3u];
+}
@@ -0,0 +1,30 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+layout(location = 0) in vec2 inPosition;
+layout(location = 1) in vec3 inColor;
+
+/* Streams of GpuCuller::InstanceStream, each stride floats long */
+layout(set = 0, binding = 0) readonly buffer Instances {
+    float streams[];
+};
+
+layout(push_constant) uniform DrawConstants {
+    mat4 viewProjection;
+    vec2 scale;
+    uint stride;
+} draw;
+
+layout(location = 0) out vec3 fragColor;
+
+/* Each instance is a camera-facing copy of the triangle, sized to its bounding sphere */
+void main() {
+    uint instance = gl_InstanceIndex;
+    vec3 center = vec3(streams[instance], streams[draw.stride + instance], streams[2 * draw.stride + instance]);
+    float radius = streams[3 * draw.stride + instance];
+    vec4 color = unpackUnorm4x8(floatBitsToUint(streams[4 * draw.stride + instance]));
+
+    gl_Position = draw.viewProjection * vec4(center, 1.0);
+    gl_Position.xy += inPosition * radius * draw.scale;
+    fragColor = inColor * color.rgb;
+}
@@ -0,0 +1,26 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+/*
+ * Both descriptor paths, chosen when the pipeline is created.
+ * Bindless: the whole heap is bound once, draws push an index into it.
+ * Per-set: every draw binds a set holding just its texture, TEXTURE_COUNT is 1.
+ */
+layout(constant_id = 0) const bool BINDLESS = false;
+layout(constant_id = 1) const uint TEXTURE_COUNT = 1;
+
+layout(set = 0, binding = 0) uniform sampler2D textures[TEXTURE_COUNT];
+
+layout(push_constant) uniform DrawConstants {
+    uint textureIndex;
+} draw;
+
+layout(location = 0) in vec3 fragColor;
+layout(location = 1) in vec2 fragTexCoord;
+
+layout(location = 0) out vec4 outColor;
+
+void main() {
+    uint textureIndex = BINDLESS ? draw.textureIndex : 0u;
+    outColor = vec4(fragColor * texture(textures[textureIndex], fragTexCoord).rgb, 1.0);
+}